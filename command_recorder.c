@@ -0,0 +1,196 @@
+#include "command_recorder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static VkResult
+recordSecondary(CommandRecorder* recorder, RecordingThread* thread)
+{
+    VkCommandBuffer commandBuffer = thread->commandBuffers[recorder->frameIndex];
+    /// No VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, the primary executing the secondaries
+    /// may be submitted more than once.
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+        .pInheritanceInfo = &recorder->inheritanceInfo
+    };
+    VkResult result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+    if (result != VK_SUCCESS)
+    {
+        return result;
+    }
+    recorder->record(recorder->userData, thread->index, recorder->threadCount, commandBuffer);
+    return vkEndCommandBuffer(commandBuffer);
+}
+
+
+/// Workers sleep until the generation changes, record their share, and the last one to
+/// finish wakes up the thread waiting in `commandRecorderRecord`.
+static void*
+recordingThread(void* argument)
+{
+    RecordingThread* thread = (RecordingThread*) argument;
+    CommandRecorder* recorder = thread->recorder;
+    uint64_t generation = 0;
+    pthread_mutex_lock(&recorder->mutex);
+    while (1)
+    {
+        while (recorder->running && recorder->generation == generation)
+        {
+            pthread_cond_wait(&recorder->started, &recorder->mutex);
+        }
+        if (!recorder->running)
+        {
+            break;
+        }
+        generation = recorder->generation;
+        pthread_mutex_unlock(&recorder->mutex);
+
+        thread->result = recordSecondary(recorder, thread);
+
+        pthread_mutex_lock(&recorder->mutex);
+        if (--recorder->remaining == 0)
+        {
+            pthread_cond_signal(&recorder->finished);
+        }
+    }
+    pthread_mutex_unlock(&recorder->mutex);
+    return NULL;
+}
+
+
+int
+commandRecorderInit(CommandRecorder* recorder,
+                    VkDevice device,
+                    uint32_t queueFamilyIndex,
+                    uint32_t threadCount,
+                    uint32_t frameCount)
+{
+    memset(recorder, 0, sizeof(*recorder));
+    if (threadCount == 0 || threadCount > MAX_RECORDING_THREADS ||
+        frameCount == 0 || frameCount > MAX_FRAMES_IN_FLIGHT)
+    {
+        printf("Unsupported number of recording threads %u (maximum %d)\n",
+               threadCount, MAX_RECORDING_THREADS);
+        return EXIT_FAILURE;
+    }
+    recorder->device = device;
+    pthread_mutex_init(&recorder->mutex, NULL);
+    pthread_cond_init(&recorder->started, NULL);
+    pthread_cond_init(&recorder->finished, NULL);
+    recorder->running = 1;
+
+    /// The pools and command buffers are created up front on this thread. After that, each
+    /// pool is only ever touched by the worker that owns it.
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        RecordingThread* thread = &recorder->threads[i];
+        thread->recorder = recorder;
+        thread->index = i;
+        VkCommandPoolCreateInfo commandPoolCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            .queueFamilyIndex = queueFamilyIndex
+        };
+        if (vkCreateCommandPool(device, &commandPoolCreateInfo, NULL, &thread->commandPool)
+            != VK_SUCCESS)
+        {
+            printf("Failed to create command pool for recording thread %u\n", i);
+            return EXIT_FAILURE;
+        }
+        VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = thread->commandPool,
+            .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+            .commandBufferCount = frameCount
+        };
+        if (vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, thread->commandBuffers)
+            != VK_SUCCESS)
+        {
+            printf("Failed to allocate secondary command buffers for recording thread %u\n", i);
+            vkDestroyCommandPool(device, thread->commandPool, NULL);
+            thread->commandPool = VK_NULL_HANDLE;
+            return EXIT_FAILURE;
+        }
+        if (pthread_create(&thread->thread, NULL, recordingThread, thread) != 0)
+        {
+            printf("Failed to start recording thread %u\n", i);
+            vkDestroyCommandPool(device, thread->commandPool, NULL);
+            thread->commandPool = VK_NULL_HANDLE;
+            return EXIT_FAILURE;
+        }
+        recorder->threadCount++;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+int
+commandRecorderRecord(CommandRecorder* recorder,
+                      uint32_t frameIndex,
+                      VkRenderPass renderPass,
+                      VkFramebuffer framebuffer,
+                      RecordFunction record,
+                      void* userData,
+                      VkCommandBuffer* commandBuffers)
+{
+    /// Secondary command buffers recorded inside a render pass inherit the render pass and
+    /// subpass. The framebuffer is optional, but specifying it lets the driver optimize.
+    pthread_mutex_lock(&recorder->mutex);
+    recorder->frameIndex = frameIndex;
+    recorder->inheritanceInfo = (VkCommandBufferInheritanceInfo) {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .renderPass = renderPass,
+        .subpass = 0,
+        .framebuffer = framebuffer,
+        .pipelineStatistics = recorder->pipelineStatistics
+    };
+    recorder->record = record;
+    recorder->userData = userData;
+    recorder->remaining = recorder->threadCount;
+    recorder->generation++;
+    pthread_cond_broadcast(&recorder->started);
+    while (recorder->remaining > 0)
+    {
+        pthread_cond_wait(&recorder->finished, &recorder->mutex);
+    }
+    pthread_mutex_unlock(&recorder->mutex);
+
+    for (uint32_t i = 0; i < recorder->threadCount; ++i)
+    {
+        RecordingThread* thread = &recorder->threads[i];
+        if (thread->result != VK_SUCCESS)
+        {
+            printf("Recording thread %u failed, code: %d\n", i, thread->result);
+            return EXIT_FAILURE;
+        }
+        commandBuffers[i] = thread->commandBuffers[frameIndex];
+    }
+    return EXIT_SUCCESS;
+}
+
+
+void
+commandRecorderShutdown(CommandRecorder* recorder)
+{
+    if (!recorder->running)
+    {
+        return;
+    }
+    pthread_mutex_lock(&recorder->mutex);
+    recorder->running = 0;
+    pthread_cond_broadcast(&recorder->started);
+    pthread_mutex_unlock(&recorder->mutex);
+    for (uint32_t i = 0; i < recorder->threadCount; ++i)
+    {
+        pthread_join(recorder->threads[i].thread, NULL);
+        /// Destroying the pool frees its command buffers.
+        vkDestroyCommandPool(recorder->device, recorder->threads[i].commandPool, NULL);
+    }
+    pthread_cond_destroy(&recorder->finished);
+    pthread_cond_destroy(&recorder->started);
+    pthread_mutex_destroy(&recorder->mutex);
+    recorder->threadCount = 0;
+}
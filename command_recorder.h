@@ -0,0 +1,102 @@
+#ifndef COMMAND_RECORDER_H
+#define COMMAND_RECORDER_H
+
+/// Parallel recording of the draws inside a render pass.
+///
+/// Recording a command buffer is pure CPU work, and for a scene with many draws it can take
+/// longer than rendering it. A command buffer can only be recorded by one thread at a time,
+/// and so can every command buffer allocated from the same command pool, since the pool is
+/// externally synchronized. To record in parallel each thread therefore gets a command pool
+/// of its own, with one secondary command buffer per frame in flight.
+///
+/// The recorder keeps a fixed set of worker threads. For every render, each worker records
+/// its share of the draws into its secondary command buffer, begun with
+/// VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT against the render pass and framebuffer
+/// of the render. The primary command buffer then begins the render pass with
+/// VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS and executes the secondaries in order.
+
+#include <vulkan/vulkan.h>
+
+#include <pthread.h>
+#include <stdint.h>
+
+#ifndef MAX_RECORDING_THREADS
+#define MAX_RECORDING_THREADS 16
+#endif
+
+#ifndef MAX_FRAMES_IN_FLIGHT
+#define MAX_FRAMES_IN_FLIGHT 4
+#endif
+
+
+/// Record the share of thread `threadIndex` out of `threadCount` into `commandBuffer`, which
+/// has already been begun and is ended by the recorder.
+typedef void (*RecordFunction)(void* userData,
+                               uint32_t threadIndex,
+                               uint32_t threadCount,
+                               VkCommandBuffer commandBuffer);
+
+
+typedef struct RecordingThread {
+    struct CommandRecorder* recorder;
+    uint32_t index;
+    pthread_t thread;
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
+    VkResult result;
+} RecordingThread;
+
+
+typedef struct CommandRecorder {
+    VkDevice device;
+    RecordingThread threads[MAX_RECORDING_THREADS];
+    uint32_t threadCount;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t started;
+    pthread_cond_t finished;
+    int running;
+    /// Incremented for every recording, so workers can tell a new one from a spurious wakeup.
+    uint64_t generation;
+    uint32_t remaining;
+
+    /// The recording in progress.
+    uint32_t frameIndex;
+    VkCommandBufferInheritanceInfo inheritanceInfo;
+    RecordFunction record;
+    void* userData;
+
+    /// Statistics of the pipeline statistics query that is active while the secondary
+    /// command buffers execute, 0 if there is none. Set after `commandRecorderInit`.
+    VkQueryPipelineStatisticFlags pipelineStatistics;
+} CommandRecorder;
+
+
+/// Create `threadCount` worker threads, each with a command pool for `queueFamilyIndex` and
+/// `frameCount` secondary command buffers.
+/// On failure the recorder is left in a state that `commandRecorderShutdown` can clean up.
+int
+commandRecorderInit(CommandRecorder* recorder,
+                    VkDevice device,
+                    uint32_t queueFamilyIndex,
+                    uint32_t threadCount,
+                    uint32_t frameCount);
+
+/// Record the secondary command buffers of frame `frameIndex` on all threads and wait for
+/// them to finish. The command buffers, in the order they are to be executed, are written
+/// to `commandBuffers`, which must hold threadCount elements. The previous recording of the
+/// frame must have finished executing.
+int
+commandRecorderRecord(CommandRecorder* recorder,
+                      uint32_t frameIndex,
+                      VkRenderPass renderPass,
+                      VkFramebuffer framebuffer,
+                      RecordFunction record,
+                      void* userData,
+                      VkCommandBuffer* commandBuffers);
+
+/// Stop the threads and destroy their command pools. The device must be idle.
+void
+commandRecorderShutdown(CommandRecorder* recorder);
+
+#endif // COMMAND_RECORDER_H
@@ -0,0 +1,171 @@
+#include "completion.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/// Retire the oldest `count` pending submissions. Called by the waiter thread with the mutex
+/// unlocked, since the callbacks may take a while.
+static void
+retire(CompletionQueue* queue, uint32_t count, VkResult result)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        pthread_mutex_lock(&queue->mutex);
+        Completion completion = queue->pending[queue->pendingHead];
+        uint64_t ticket = queue->retiredTicket + 1;
+        pthread_mutex_unlock(&queue->mutex);
+
+        if (completion.callback != NULL)
+        {
+            completion.callback(completion.userData, ticket, result);
+        }
+
+        pthread_mutex_lock(&queue->mutex);
+        queue->pendingHead = (queue->pendingHead + 1) % MAX_PENDING_COMPLETIONS;
+        queue->pendingCount--;
+        queue->retiredTicket = ticket;
+        if (result != VK_SUCCESS)
+        {
+            queue->result = result;
+        }
+        pthread_cond_broadcast(&queue->retired);
+        pthread_mutex_unlock(&queue->mutex);
+    }
+}
+
+
+static void*
+waiterThread(void* argument)
+{
+    CompletionQueue* queue = (CompletionQueue*) argument;
+    pthread_mutex_lock(&queue->mutex);
+    for (;;)
+    {
+        while (queue->pendingCount == 0 && queue->running)
+        {
+            pthread_cond_wait(&queue->submitted, &queue->mutex);
+        }
+        if (queue->pendingCount == 0)
+        {
+            break;
+        }
+        uint32_t pendingHead = queue->pendingHead;
+        uint32_t pendingCount = queue->pendingCount;
+        VkFence oldest = queue->pending[pendingHead].fence;
+        pthread_mutex_unlock(&queue->mutex);
+
+        /// Sleep until the oldest submission has completed. Fences that belong to pending
+        /// submissions are only reset after they have been retired, so it is safe to use
+        /// them without holding the mutex.
+        VkResult result = vkWaitForFences(queue->device, 1, &oldest, VK_TRUE, UINT64_MAX);
+
+        /// Whatever completed while we were asleep is retired in the same batch. We stop at
+        /// the first submission that is still running, to keep retirement in ticket order.
+        uint32_t completedCount = 1;
+        while (result == VK_SUCCESS && completedCount < pendingCount)
+        {
+            uint32_t index = (pendingHead + completedCount) % MAX_PENDING_COMPLETIONS;
+            if (vkGetFenceStatus(queue->device, queue->pending[index].fence) != VK_SUCCESS)
+            {
+                break;
+            }
+            completedCount++;
+        }
+        if (result != VK_SUCCESS)
+        {
+            printf("Failed to wait for fence, code: %d\n", result);
+        }
+        retire(queue, completedCount, result);
+
+        pthread_mutex_lock(&queue->mutex);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return NULL;
+}
+
+
+int
+completionQueueInit(CompletionQueue* queue, VkDevice device)
+{
+    queue->device = device;
+    queue->pendingHead = 0;
+    queue->pendingCount = 0;
+    queue->submittedTicket = 0;
+    queue->retiredTicket = 0;
+    queue->result = VK_SUCCESS;
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->submitted, NULL);
+    pthread_cond_init(&queue->retired, NULL);
+    queue->running = 1;
+    if (pthread_create(&queue->thread, NULL, waiterThread, queue) != 0)
+    {
+        printf("Failed to start completion waiter thread\n");
+        queue->running = 0;
+        pthread_cond_destroy(&queue->retired);
+        pthread_cond_destroy(&queue->submitted);
+        pthread_mutex_destroy(&queue->mutex);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+int
+completionQueueAdd(CompletionQueue* queue,
+                   VkFence fence,
+                   CompletionCallback callback,
+                   void* userData,
+                   uint64_t* ticket)
+{
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->pendingCount == MAX_PENDING_COMPLETIONS)
+    {
+        pthread_mutex_unlock(&queue->mutex);
+        printf("Too many pending completions (maximum %d)\n", MAX_PENDING_COMPLETIONS);
+        return EXIT_FAILURE;
+    }
+    uint32_t index = (queue->pendingHead + queue->pendingCount) % MAX_PENDING_COMPLETIONS;
+    queue->pending[index] = (Completion) {
+        .fence = fence,
+        .callback = callback,
+        .userData = userData
+    };
+    queue->pendingCount++;
+    *ticket = ++queue->submittedTicket;
+    pthread_cond_signal(&queue->submitted);
+    pthread_mutex_unlock(&queue->mutex);
+    return EXIT_SUCCESS;
+}
+
+
+int
+completionQueueWait(CompletionQueue* queue, uint64_t ticket)
+{
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->retiredTicket < ticket)
+    {
+        pthread_cond_wait(&queue->retired, &queue->mutex);
+    }
+    VkResult result = queue->result;
+    pthread_mutex_unlock(&queue->mutex);
+    return result == VK_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+void
+completionQueueShutdown(CompletionQueue* queue)
+{
+    if (!queue->running)
+    {
+        return;
+    }
+    pthread_mutex_lock(&queue->mutex);
+    queue->running = 0;
+    pthread_cond_signal(&queue->submitted);
+    pthread_mutex_unlock(&queue->mutex);
+    pthread_join(queue->thread, NULL);
+    pthread_cond_destroy(&queue->retired);
+    pthread_cond_destroy(&queue->submitted);
+    pthread_mutex_destroy(&queue->mutex);
+}
@@ -0,0 +1,82 @@
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+/// Event driven completion of queue submissions.
+///
+/// Each submission is registered together with the fence it signals. A dedicated waiter
+/// thread blocks in `vkWaitForFences` on the oldest outstanding fence, without a timeout, so
+/// nothing wakes up until the device has actually finished some work. When it returns, every
+/// submission that has completed by then is retired in one go and its callback is invoked,
+/// so a single thread keeps up with hundreds of submissions in flight.
+///
+/// Every registered submission gets a ticket, numbered from 1 in registration order, and
+/// submissions retire in ticket order. This is the same model as a timeline semaphore
+/// (core in Vulkan 1.2): `completionQueueWait` blocks until the counter of retired tickets
+/// reaches a value, only here it works on any Vulkan 1.0 implementation.
+
+#include <vulkan/vulkan.h>
+
+#include <pthread.h>
+#include <stdint.h>
+
+/// Maximum number of submissions that can be outstanding at the same time.
+#ifndef MAX_PENDING_COMPLETIONS
+#define MAX_PENDING_COMPLETIONS 256
+#endif
+
+/// Called on the waiter thread when a submission has completed. `result` is VK_SUCCESS, or
+/// the error returned while waiting for the fence (for example VK_ERROR_DEVICE_LOST).
+/// Callbacks are invoked in ticket order and must not register new submissions.
+typedef void (*CompletionCallback)(void* userData, uint64_t ticket, VkResult result);
+
+
+typedef struct Completion {
+    VkFence fence;
+    CompletionCallback callback;
+    void* userData;
+} Completion;
+
+
+typedef struct CompletionQueue {
+    VkDevice device;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t submitted;
+    pthread_cond_t retired;
+    int running;
+
+    /// Ring buffer of outstanding submissions, oldest first.
+    Completion pending[MAX_PENDING_COMPLETIONS];
+    uint32_t pendingHead;
+    uint32_t pendingCount;
+
+    uint64_t submittedTicket;
+    uint64_t retiredTicket;
+    VkResult result;
+} CompletionQueue;
+
+
+/// Start the waiter thread for fences created from `device`.
+int
+completionQueueInit(CompletionQueue* queue, VkDevice device);
+
+/// Register a submission that signals `fence`. Call this after `vkQueueSubmit`. The
+/// callback may be NULL. `*ticket` receives the ticket of the submission.
+int
+completionQueueAdd(CompletionQueue* queue,
+                   VkFence fence,
+                   CompletionCallback callback,
+                   void* userData,
+                   uint64_t* ticket);
+
+/// Block until the submission with the given ticket, and all before it, have retired and
+/// their callbacks have returned. Fails if waiting for any fence failed.
+int
+completionQueueWait(CompletionQueue* queue, uint64_t ticket);
+
+/// Retire all outstanding submissions and stop the waiter thread. Safe to call on a queue
+/// that was never initialized, as long as it was zeroed.
+void
+completionQueueShutdown(CompletionQueue* queue);
+
+#endif // COMPLETION_H
@@ -0,0 +1,91 @@
+/// Benchmark of converting the depth on the device against decoding it on the host.
+///
+///     ./out/Release/conversion_benchmark [renders] [WIDTHxHEIGHT]
+///
+/// The triangle is rendered `renders` times (default 100) at WIDTHxHEIGHT (default
+/// 1920x1080), with two frames in flight, and read back three ways (see
+/// RenderConfig.depthConversion): the depth image copied as it is and decoded on the host,
+/// converted to 32 bit floats by a compute shader and copied by the host, and converted to
+/// 16 bit floats, which halves the bytes the host reads. Rendering and readback are timed
+/// together, and the time spent in `renderContextCollect` is reported on its own.
+
+#include "render_benchmark.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/// The size of the readback buffer goes to `readbackBytes`.
+static int
+benchmarkConversion(const RenderRequest* request,
+                    DepthConversion depthConversion,
+                    uint32_t renderCount,
+                    RenderBenchmarkTimings* timings,
+                    uint64_t* readbackBytes)
+{
+    RenderConfig config = {
+        .framesInFlight = 2,
+        .reuseCommandBuffers = 1,
+        .depthConversion = depthConversion
+    };
+    RenderBenchmark benchmark;
+    int status = renderBenchmarkInit(&benchmark, &config, request);
+    if (status == EXIT_SUCCESS)
+    {
+        *readbackBytes = benchmark.context.renderTargets[0].pixelReadbackBufferSize;
+        status = renderBenchmarkRun(&benchmark, request, renderCount, NULL, timings);
+    }
+    renderBenchmarkShutdown(&benchmark);
+    return status;
+}
+
+
+int main(int argc, char** argv)
+{
+    RenderRequest request = {
+        .width = 1920,
+        .height = 1080
+    };
+    uint32_t renderCount = argc > 1 ? (uint32_t) strtoul(argv[1], NULL, 10) : 100;
+    if (renderCount == 0 ||
+        (argc > 2 && sscanf(argv[2], "%ux%u", &request.width, &request.height) != 2))
+    {
+        printf("Usage: %s [renders] [WIDTHxHEIGHT]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const DepthConversion depthConversions[] = {
+        DEPTH_CONVERSION_NONE,
+        DEPTH_CONVERSION_FLOAT32,
+        DEPTH_CONVERSION_FLOAT16
+    };
+    const char* names[] = { "host decode", "device float32", "device float16" };
+    const uint32_t conversionCount = sizeof(depthConversions) / sizeof(depthConversions[0]);
+    RenderBenchmarkTimings timings[sizeof(depthConversions) / sizeof(depthConversions[0])];
+    uint64_t readbackBytes[sizeof(depthConversions) / sizeof(depthConversions[0])];
+    for (uint32_t i = 0; i < conversionCount; ++i)
+    {
+        if (benchmarkConversion(&request,
+                                depthConversions[i],
+                                renderCount,
+                                &timings[i],
+                                &readbackBytes[i]) != EXIT_SUCCESS)
+        {
+            printf("Failed to benchmark %s\n", names[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("Renders at %ux%u, %u renders\n", request.width, request.height, renderCount);
+    for (uint32_t i = 0; i < conversionCount; ++i)
+    {
+        printf("%-15s %9.2f MB read back, %8.3f ms per render, %8.3f ms per collect, %.2fx\n",
+               names[i],
+               1e-6 * readbackBytes[i],
+               timings[i].milliseconds,
+               timings[i].collectMilliseconds,
+               timings[0].milliseconds / timings[i].milliseconds);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+/// Benchmark of frustum culling on the device.
+///
+///     ./out/Release/cull_benchmark [renders] [WIDTHxHEIGHT]
+///
+/// Scenes of 10k, 100k and 1M instances of the triangle are scattered at random through a
+/// volume about 50 times that of the view frustum, so only a few percent of them are visible.
+/// Every scene is rendered as a single instanced draw of all instances, and with culling
+/// (see RenderConfig.culling), as a compute pass that culls the instances followed by an
+/// indirect draw of the visible ones. Rendering and readback are timed together, over
+/// `renders` renders (default 100) at WIDTHxHEIGHT (default 512x512).
+
+#include "render_benchmark.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/// Column-major model matrices of `instanceCount` instances scaled down to 2% and placed
+/// uniformly at random in [-4, 4] x [-4, 4] x [-1, 2], with a fixed seed.
+static float*
+scatterInstances(uint32_t instanceCount)
+{
+    float* instances = (float*) calloc((size_t) instanceCount * 16, sizeof(float));
+    if (instances == NULL)
+    {
+        return NULL;
+    }
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for (uint32_t i = 0; i < instanceCount; ++i)
+    {
+        float* instance = &instances[16 * i];
+        float position[3];
+        for (uint32_t j = 0; j < 3; ++j)
+        {
+            /// xorshift64*, plenty for placing triangles.
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            position[j] = (float) ((state * 0x2545F4914F6CDD1Dull) >> 40) / (1 << 24);
+        }
+        instance[0] = 0.02f;
+        instance[5] = 0.02f;
+        instance[10] = 0.02f;
+        instance[12] = 8.0f * position[0] - 4.0f;
+        instance[13] = 8.0f * position[1] - 4.0f;
+        instance[14] = 3.0f * position[2] - 1.0f;
+        instance[15] = 1.0f;
+    }
+    return instances;
+}
+
+
+/// The average time per render goes to `milliseconds`. With culling, the average number of
+/// visible instances goes to `visibleCount`.
+static int
+benchmarkScene(const RenderRequest* request,
+               uint32_t culling,
+               uint32_t renderCount,
+               double* milliseconds,
+               double* visibleCount)
+{
+    RenderConfig config = {
+        .framesInFlight = 2,
+        .reuseCommandBuffers = 1,
+        .culling = culling
+    };
+    RenderBenchmark benchmark;
+    RenderBenchmarkTimings timings;
+    /// The first render also grows the instance buffer.
+    int status = renderBenchmarkInit(&benchmark, &config, request);
+    if (status == EXIT_SUCCESS)
+    {
+        uint64_t firstVisibleCount = benchmark.context.visibleInstanceCount;
+        status = renderBenchmarkRun(&benchmark, request, renderCount, NULL, &timings);
+        *milliseconds = timings.milliseconds;
+        *visibleCount = (double) (benchmark.context.visibleInstanceCount - firstVisibleCount) /
+                        renderCount;
+    }
+    renderBenchmarkShutdown(&benchmark);
+    return status;
+}
+
+
+int main(int argc, char** argv)
+{
+    RenderRequest request = {
+        .width = 512,
+        .height = 512
+    };
+    uint32_t renderCount = argc > 1 ? (uint32_t) strtoul(argv[1], NULL, 10) : 100;
+    if (renderCount == 0 ||
+        (argc > 2 && sscanf(argv[2], "%ux%u", &request.width, &request.height) != 2))
+    {
+        printf("Usage: %s [renders] [WIDTHxHEIGHT]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const uint32_t instanceCounts[] = { 10000, 100000, 1000000 };
+    const uint32_t sceneCount = sizeof(instanceCounts) / sizeof(instanceCounts[0]);
+    double milliseconds[sizeof(instanceCounts) / sizeof(instanceCounts[0])][2];
+    double visibleCounts[sizeof(instanceCounts) / sizeof(instanceCounts[0])];
+    for (uint32_t i = 0; i < sceneCount; ++i)
+    {
+        float* instances = scatterInstances(instanceCounts[i]);
+        if (instances == NULL)
+        {
+            printf("Failed to allocate %u instances\n", instanceCounts[i]);
+            return EXIT_FAILURE;
+        }
+        request.instanceCount = instanceCounts[i];
+        request.instances = instances;
+        for (uint32_t culling = 0; culling < 2; ++culling)
+        {
+            if (benchmarkScene(&request,
+                               culling,
+                               renderCount,
+                               &milliseconds[i][culling],
+                               &visibleCounts[i]) != EXIT_SUCCESS)
+            {
+                printf("Failed to benchmark %u instances %s\n",
+                       instanceCounts[i], culling ? "with culling" : "without culling");
+                free(instances);
+                return EXIT_FAILURE;
+            }
+        }
+        free(instances);
+    }
+
+    printf("Scenes at %ux%u, %u renders\n", request.width, request.height, renderCount);
+    for (uint32_t i = 0; i < sceneCount; ++i)
+    {
+        printf("%8u instances: %9.1f visible, %9.1f culled, all drawn %8.3f ms, "
+               "culled %8.3f ms, %.2fx\n",
+               instanceCounts[i],
+               visibleCounts[i],
+               instanceCounts[i] - visibleCounts[i],
+               milliseconds[i][0],
+               milliseconds[i][1],
+               milliseconds[i][0] / milliseconds[i][1]);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+/// Micro-benchmark and correctness check of the depth decode kernels in depth_decode.c.
+///
+///     ./out/Release/decode_benchmark [pixel count] [iterations]
+///
+/// For every depth texel layout, every instruction set supported by the CPU decodes the
+/// same texels and must produce exactly the same bits as the scalar reference. The unorm
+/// layouts are checked exhaustively, every 16-bit value and every 24-bit value (with
+/// garbage in the unused high byte), and so are the half floats of converted depth, NaNs and
+/// infinities included. The decode time is then measured on `pixel count`
+/// texels (default 3840x2160) over `iterations` runs.
+/// The program exits with EXIT_FAILURE if any result differs, so it doubles as a test.
+
+#include "depth_decode.h"
+#include "timing.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/// One format per texel layout, the stencil variants decode the same way.
+static const VkFormat formats[] = {
+    VK_FORMAT_D16_UNORM,
+    VK_FORMAT_D24_UNORM_S8_UINT,
+    VK_FORMAT_D32_SFLOAT,
+    VK_FORMAT_R32_SFLOAT,
+    VK_FORMAT_R16_SFLOAT
+};
+
+static const char* formatNames[] = {
+    "D16_UNORM",
+    "D24_UNORM_S8_UINT",
+    "D32_SFLOAT",
+    "R32_SFLOAT converted",
+    "R16_SFLOAT converted"
+};
+
+
+/// xorshift32, reproducible and good enough for test data.
+static uint32_t
+nextRandom(uint32_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+/// Fill `count` texels of the layout of `format`. Exhaustive mode enumerates the unorm
+/// values, otherwise values are random with a quarter of the texels at the far plane, like
+/// the background of a rendered image.
+static void
+fillTexels(VkFormat format, void* texels, size_t count, int exhaustive)
+{
+    uint32_t state = 0x1337;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t random = nextRandom(&state);
+        int far = (random & 3) == 0;
+        switch (format)
+        {
+        case VK_FORMAT_D16_UNORM:
+            ((uint16_t*) texels)[i] = (uint16_t) (exhaustive ? i : far ? 0xFFFF : random);
+            break;
+        case VK_FORMAT_R16_SFLOAT:
+            /// Random halves in [0, 2), converted depth has the far plane at 0.
+            ((uint16_t*) texels)[i] = (uint16_t) (exhaustive ? i : far ? 0 : random & 0x3FFF);
+            break;
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+            ((uint32_t*) texels)[i] = (random & 0xFF000000)
+                                    | ((exhaustive ? (uint32_t) i : far ? 0xFFFFFF : random)
+                                       & 0xFFFFFF);
+            break;
+        default:
+            ((float*) texels)[i] = far ? 1.0f : (float) (random >> 8) / 0xFFFFFF;
+            break;
+        }
+    }
+}
+
+
+static int
+verify(VkFormat format, const char* formatName)
+{
+    size_t count = depthTexelSize(format) == 2 ? 1 << 16 : 1 << 24;
+    int exhaustive = format != VK_FORMAT_D32_SFLOAT && format != VK_FORMAT_R32_SFLOAT;
+    /// Odd sizes exercise the scalar tail of every SIMD version.
+    size_t sizes[] = { count, 1, 7, 15, 17, 33 };
+    void* texels = malloc(count * depthTexelSize(format));
+    float* expected = (float*) malloc(count * sizeof(float));
+    float* actual = (float*) malloc(count * sizeof(float));
+    fillTexels(format, texels, count, exhaustive);
+
+    int status = EXIT_SUCCESS;
+    for (int isa = DEPTH_DECODE_SCALAR + 1; isa < DEPTH_DECODE_ISA_COUNT; ++isa)
+    {
+        if (!depthDecodeIsaSupported((DepthDecodeIsa) isa))
+        {
+            continue;
+        }
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+        {
+            memset(actual, 0xAB, count * sizeof(float));
+            depthDecodeWithIsa(DEPTH_DECODE_SCALAR, format, texels, expected, sizes[s]);
+            depthDecodeWithIsa((DepthDecodeIsa) isa, format, texels, actual, sizes[s]);
+            if (memcmp(expected, actual, sizes[s] * sizeof(float)) != 0)
+            {
+                printf("%s %s differs from scalar for %zu texels\n",
+                       formatName, depthDecodeIsaName((DepthDecodeIsa) isa), sizes[s]);
+                status = EXIT_FAILURE;
+            }
+        }
+    }
+    if (status == EXIT_SUCCESS)
+    {
+        printf("%s: all instruction sets match scalar on %zu texels\n", formatName, count);
+    }
+    free(actual);
+    free(expected);
+    free(texels);
+    return status;
+}
+
+
+static void
+benchmark(VkFormat format, const char* formatName, size_t count, uint32_t iterations)
+{
+    void* texels = malloc(count * depthTexelSize(format));
+    float* depthData = (float*) malloc(count * sizeof(float));
+    fillTexels(format, texels, count, 0);
+    for (int isa = DEPTH_DECODE_SCALAR; isa < DEPTH_DECODE_ISA_COUNT; ++isa)
+    {
+        if (!depthDecodeIsaSupported((DepthDecodeIsa) isa))
+        {
+            continue;
+        }
+        /// One untimed run to fault in the pages of the output buffer.
+        depthDecodeWithIsa((DepthDecodeIsa) isa, format, texels, depthData, count);
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (uint32_t i = 0; i < iterations; ++i)
+        {
+            depthDecodeWithIsa((DepthDecodeIsa) isa, format, texels, depthData, count);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double milliseconds = elapsedMilliseconds(&start, &end) / iterations;
+        printf("%-20s %-8s %8.3f ms %8.1f Mpixel/s\n",
+               formatName, depthDecodeIsaName((DepthDecodeIsa) isa),
+               milliseconds, 1e-3 * count / milliseconds);
+    }
+    free(depthData);
+    free(texels);
+}
+
+
+int main(int argc, char** argv)
+{
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 3840 * 2160;
+    uint32_t iterations = argc > 2 ? (uint32_t) strtoul(argv[2], NULL, 10) : 20;
+    if (count == 0 || iterations == 0)
+    {
+        printf("Usage: %s [pixel count] [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    printf("Best supported instruction set: %s\n", depthDecodeIsaName(depthDecodeBestIsa()));
+
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i)
+    {
+        if (verify(formats[i], formatNames[i]) != EXIT_SUCCESS)
+        {
+            status = EXIT_FAILURE;
+        }
+    }
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i)
+    {
+        benchmark(formats[i], formatNames[i], count, iterations);
+    }
+    return status;
+}
@@ -0,0 +1,474 @@
+#include "depth_decode.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DEPTH_DECODE_X86 1
+#include <immintrin.h>
+#else
+#define DEPTH_DECODE_X86 0
+#endif
+
+
+#define UNORM16_MAX 0xFFFF
+#define UNORM24_MAX 0xFFFFFF
+
+
+typedef enum DepthLayout {
+    DEPTH_LAYOUT_UNORM16,
+    DEPTH_LAYOUT_UNORM24,
+    DEPTH_LAYOUT_FLOAT32,
+    DEPTH_LAYOUT_CONVERTED32,
+    DEPTH_LAYOUT_CONVERTED16,
+    DEPTH_LAYOUT_COUNT
+} DepthLayout;
+
+
+typedef void (*DecodeFunction)(const void* texels, float* depthData, size_t count);
+
+
+static const char* isaNames[DEPTH_DECODE_ISA_COUNT] = {
+    "scalar", "SSE2", "AVX2", "AVX-512"
+};
+
+
+/// The scalar versions are the reference, the SIMD versions below are expected to match
+/// them bit by bit. They also decode the tail that does not fill a whole SIMD register.
+static void
+decodeUnorm16Scalar(const void* texels, float* depthData, size_t count)
+{
+    const uint16_t* unorm = (const uint16_t*) texels;
+    for (size_t i = 0; i < count; ++i)
+    {
+        depthData[i] = unorm[i] == UNORM16_MAX ? 0.0f : (float) unorm[i] / UNORM16_MAX;
+    }
+}
+
+
+static void
+decodeUnorm24Scalar(const void* texels, float* depthData, size_t count)
+{
+    const uint32_t* packed = (const uint32_t*) texels;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t unorm = UNORM24_MAX & packed[i];
+        depthData[i] = unorm == UNORM24_MAX ? 0.0f : (float) unorm / UNORM24_MAX;
+    }
+}
+
+
+static void
+decodeFloat32Scalar(const void* texels, float* depthData, size_t count)
+{
+    const float* depth = (const float*) texels;
+    for (size_t i = 0; i < count; ++i)
+    {
+        depthData[i] = depth[i] == 1.0f ? 0.0f : depth[i];
+    }
+}
+
+
+/// Depth converted on the device is final, the far plane is already 0. Floats are copied,
+/// which no SIMD loop does better than memcpy.
+static void
+copyConverted32(const void* texels, float* depthData, size_t count)
+{
+    memcpy(depthData, texels, count * sizeof(float));
+}
+
+
+/// Half floats are widened bit by bit, which is exact. Subnormal halves are normal floats,
+/// so their mantissa is shifted up until the implicit bit shows. Signaling NaNs come out
+/// quiet, like they do from the F16C instructions.
+static void
+decodeConverted16Scalar(const void* texels, float* depthData, size_t count)
+{
+    const uint16_t* half = (const uint16_t*) texels;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t sign = (uint32_t) (half[i] & 0x8000) << 16;
+        uint32_t exponent = (half[i] >> 10) & 0x1F;
+        uint32_t mantissa = half[i] & 0x3FF;
+        uint32_t bits;
+        if (exponent == 0x1F)
+        {
+            bits = sign | 0x7F800000 | (mantissa != 0 ? 0x400000 : 0) | (mantissa << 13);
+        }
+        else if (exponent != 0)
+        {
+            bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+        }
+        else if (mantissa != 0)
+        {
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400))
+            {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+        }
+        else
+        {
+            bits = sign;
+        }
+        memcpy(&depthData[i], &bits, sizeof(bits));
+    }
+}
+
+
+#if DEPTH_DECODE_X86
+
+/// The far plane test is a compare that produces an all ones lane mask, and-not'ing the
+/// decoded depth with it zeroes those lanes without a branch.
+
+__attribute__((target("sse2")))
+static void
+decodeUnorm16Sse2(const void* texels, float* depthData, size_t count)
+{
+    const uint16_t* unorm = (const uint16_t*) texels;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi32(UNORM16_MAX);
+    const __m128 scale = _mm_set1_ps((float) UNORM16_MAX);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i texel = _mm_loadu_si128((const __m128i*) (unorm + i));
+        __m128i low = _mm_unpacklo_epi16(texel, zero);
+        __m128i high = _mm_unpackhi_epi16(texel, zero);
+        __m128 lowDepth = _mm_div_ps(_mm_cvtepi32_ps(low), scale);
+        __m128 highDepth = _mm_div_ps(_mm_cvtepi32_ps(high), scale);
+        lowDepth = _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(low, max)), lowDepth);
+        highDepth = _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(high, max)), highDepth);
+        _mm_storeu_ps(depthData + i, lowDepth);
+        _mm_storeu_ps(depthData + i + 4, highDepth);
+    }
+    decodeUnorm16Scalar(unorm + i, depthData + i, count - i);
+}
+
+
+__attribute__((target("sse2")))
+static void
+decodeUnorm24Sse2(const void* texels, float* depthData, size_t count)
+{
+    const uint32_t* packed = (const uint32_t*) texels;
+    const __m128i max = _mm_set1_epi32(UNORM24_MAX);
+    const __m128 scale = _mm_set1_ps((float) UNORM24_MAX);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i unorm = _mm_and_si128(_mm_loadu_si128((const __m128i*) (packed + i)), max);
+        __m128 depth = _mm_div_ps(_mm_cvtepi32_ps(unorm), scale);
+        depth = _mm_andnot_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(unorm, max)), depth);
+        _mm_storeu_ps(depthData + i, depth);
+    }
+    decodeUnorm24Scalar(packed + i, depthData + i, count - i);
+}
+
+
+__attribute__((target("sse2")))
+static void
+decodeFloat32Sse2(const void* texels, float* depthData, size_t count)
+{
+    const float* texelDepth = (const float*) texels;
+    const __m128 one = _mm_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 depth = _mm_loadu_ps(texelDepth + i);
+        depth = _mm_andnot_ps(_mm_cmpeq_ps(depth, one), depth);
+        _mm_storeu_ps(depthData + i, depth);
+    }
+    decodeFloat32Scalar(texelDepth + i, depthData + i, count - i);
+}
+
+
+__attribute__((target("avx2")))
+static void
+decodeUnorm16Avx2(const void* texels, float* depthData, size_t count)
+{
+    const uint16_t* unorm = (const uint16_t*) texels;
+    const __m256i max = _mm256_set1_epi32(UNORM16_MAX);
+    const __m256 scale = _mm256_set1_ps((float) UNORM16_MAX);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i texel = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) (unorm + i)));
+        __m256 depth = _mm256_div_ps(_mm256_cvtepi32_ps(texel), scale);
+        depth = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(texel, max)), depth);
+        _mm256_storeu_ps(depthData + i, depth);
+    }
+    decodeUnorm16Scalar(unorm + i, depthData + i, count - i);
+}
+
+
+__attribute__((target("avx2")))
+static void
+decodeUnorm24Avx2(const void* texels, float* depthData, size_t count)
+{
+    const uint32_t* packed = (const uint32_t*) texels;
+    const __m256i max = _mm256_set1_epi32(UNORM24_MAX);
+    const __m256 scale = _mm256_set1_ps((float) UNORM24_MAX);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i texel = _mm256_loadu_si256((const __m256i*) (packed + i));
+        __m256i unorm = _mm256_and_si256(texel, max);
+        __m256 depth = _mm256_div_ps(_mm256_cvtepi32_ps(unorm), scale);
+        depth = _mm256_andnot_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(unorm, max)), depth);
+        _mm256_storeu_ps(depthData + i, depth);
+    }
+    decodeUnorm24Scalar(packed + i, depthData + i, count - i);
+}
+
+
+__attribute__((target("avx2")))
+static void
+decodeFloat32Avx2(const void* texels, float* depthData, size_t count)
+{
+    const float* texelDepth = (const float*) texels;
+    const __m256 one = _mm256_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 depth = _mm256_loadu_ps(texelDepth + i);
+        depth = _mm256_andnot_ps(_mm256_cmp_ps(depth, one, _CMP_EQ_OQ), depth);
+        _mm256_storeu_ps(depthData + i, depth);
+    }
+    decodeFloat32Scalar(texelDepth + i, depthData + i, count - i);
+}
+
+
+/// Every CPU with AVX2 also has F16C, which `depthDecodeIsaSupported` checks as well.
+__attribute__((target("avx2,f16c")))
+static void
+decodeConverted16Avx2(const void* texels, float* depthData, size_t count)
+{
+    const uint16_t* half = (const uint16_t*) texels;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i texel = _mm_loadu_si128((const __m128i*) (half + i));
+        _mm256_storeu_ps(depthData + i, _mm256_cvtph_ps(texel));
+    }
+    decodeConverted16Scalar(half + i, depthData + i, count - i);
+}
+
+
+/// AVX-512 compares produce bit masks instead of lane masks, so the far plane lanes are
+/// zeroed with a zero-masked move instead.
+
+__attribute__((target("avx512f")))
+static void
+decodeUnorm16Avx512(const void* texels, float* depthData, size_t count)
+{
+    const uint16_t* unorm = (const uint16_t*) texels;
+    const __m512i max = _mm512_set1_epi32(UNORM16_MAX);
+    const __m512 scale = _mm512_set1_ps((float) UNORM16_MAX);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m512i texel = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*) (unorm + i)));
+        __m512 depth = _mm512_div_ps(_mm512_cvtepi32_ps(texel), scale);
+        __mmask16 written = _mm512_cmpneq_epi32_mask(texel, max);
+        _mm512_storeu_ps(depthData + i, _mm512_maskz_mov_ps(written, depth));
+    }
+    decodeUnorm16Scalar(unorm + i, depthData + i, count - i);
+}
+
+
+__attribute__((target("avx512f")))
+static void
+decodeUnorm24Avx512(const void* texels, float* depthData, size_t count)
+{
+    const uint32_t* packed = (const uint32_t*) texels;
+    const __m512i max = _mm512_set1_epi32(UNORM24_MAX);
+    const __m512 scale = _mm512_set1_ps((float) UNORM24_MAX);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m512i unorm = _mm512_and_si512(_mm512_loadu_si512(packed + i), max);
+        __m512 depth = _mm512_div_ps(_mm512_cvtepi32_ps(unorm), scale);
+        __mmask16 written = _mm512_cmpneq_epi32_mask(unorm, max);
+        _mm512_storeu_ps(depthData + i, _mm512_maskz_mov_ps(written, depth));
+    }
+    decodeUnorm24Scalar(packed + i, depthData + i, count - i);
+}
+
+
+__attribute__((target("avx512f")))
+static void
+decodeFloat32Avx512(const void* texels, float* depthData, size_t count)
+{
+    const float* texelDepth = (const float*) texels;
+    const __m512 one = _mm512_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m512 depth = _mm512_loadu_ps(texelDepth + i);
+        __mmask16 written = _mm512_cmp_ps_mask(depth, one, _CMP_NEQ_UQ);
+        _mm512_storeu_ps(depthData + i, _mm512_maskz_mov_ps(written, depth));
+    }
+    decodeFloat32Scalar(texelDepth + i, depthData + i, count - i);
+}
+
+
+__attribute__((target("avx512f")))
+static void
+decodeConverted16Avx512(const void* texels, float* depthData, size_t count)
+{
+    const uint16_t* half = (const uint16_t*) texels;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m256i texel = _mm256_loadu_si256((const __m256i*) (half + i));
+        _mm512_storeu_ps(depthData + i, _mm512_cvtph_ps(texel));
+    }
+    decodeConverted16Scalar(half + i, depthData + i, count - i);
+}
+
+#endif // DEPTH_DECODE_X86
+
+
+/// SSE2 has no half float conversion, that version uses the scalar one.
+static const DecodeFunction decodeFunctions[DEPTH_DECODE_ISA_COUNT][DEPTH_LAYOUT_COUNT] = {
+    [DEPTH_DECODE_SCALAR] = { decodeUnorm16Scalar, decodeUnorm24Scalar, decodeFloat32Scalar,
+                              copyConverted32, decodeConverted16Scalar },
+#if DEPTH_DECODE_X86
+    [DEPTH_DECODE_SSE2]   = { decodeUnorm16Sse2, decodeUnorm24Sse2, decodeFloat32Sse2,
+                              copyConverted32, decodeConverted16Scalar },
+    [DEPTH_DECODE_AVX2]   = { decodeUnorm16Avx2, decodeUnorm24Avx2, decodeFloat32Avx2,
+                              copyConverted32, decodeConverted16Avx2 },
+    [DEPTH_DECODE_AVX512] = { decodeUnorm16Avx512, decodeUnorm24Avx512, decodeFloat32Avx512,
+                              copyConverted32, decodeConverted16Avx512 },
+#endif
+};
+
+
+const char*
+depthDecodeIsaName(DepthDecodeIsa isa)
+{
+    return isa < DEPTH_DECODE_ISA_COUNT ? isaNames[isa] : "unknown";
+}
+
+
+int
+depthDecodeIsaSupported(DepthDecodeIsa isa)
+{
+#if DEPTH_DECODE_X86
+    __builtin_cpu_init();
+    switch (isa)
+    {
+    case DEPTH_DECODE_SCALAR: return 1;
+    case DEPTH_DECODE_SSE2:   return __builtin_cpu_supports("sse2");
+    case DEPTH_DECODE_AVX2:   return __builtin_cpu_supports("avx2") &&
+                                     __builtin_cpu_supports("f16c");
+    case DEPTH_DECODE_AVX512: return __builtin_cpu_supports("avx512f");
+    default: return 0;
+    }
+#else
+    return isa == DEPTH_DECODE_SCALAR;
+#endif
+}
+
+
+/// The CPU does not change while we run, so the answer is computed once. The workers of
+/// render_scheduler.h decode on several threads, so the first call is guarded by a once.
+static pthread_once_t bestIsaOnce = PTHREAD_ONCE_INIT;
+static DepthDecodeIsa bestIsa;
+
+
+static void
+findBestIsa(void)
+{
+    int isa = DEPTH_DECODE_ISA_COUNT - 1;
+    while (!depthDecodeIsaSupported((DepthDecodeIsa) isa))
+    {
+        isa--;
+    }
+    bestIsa = (DepthDecodeIsa) isa;
+}
+
+
+DepthDecodeIsa
+depthDecodeBestIsa(void)
+{
+    pthread_once(&bestIsaOnce, findBestIsa);
+    return bestIsa;
+}
+
+
+uint32_t
+depthTexelSize(VkFormat format)
+{
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:          return 2;
+        case VK_FORMAT_D16_UNORM_S8_UINT:  return 2;
+        case VK_FORMAT_D24_UNORM_S8_UINT:  return 4;
+        case VK_FORMAT_D32_SFLOAT:         return 4;
+        case VK_FORMAT_D32_SFLOAT_S8_UINT: return 4;
+        case VK_FORMAT_R16_SFLOAT:         return 2;
+        case VK_FORMAT_R32_SFLOAT:         return 4;
+        default: return 0;
+    }
+}
+
+
+static int
+depthLayout(VkFormat format, DepthLayout* layout)
+{
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+            *layout = DEPTH_LAYOUT_UNORM16;
+            return EXIT_SUCCESS;
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+            *layout = DEPTH_LAYOUT_UNORM24;
+            return EXIT_SUCCESS;
+        case VK_FORMAT_D32_SFLOAT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            *layout = DEPTH_LAYOUT_FLOAT32;
+            return EXIT_SUCCESS;
+        case VK_FORMAT_R32_SFLOAT:
+            *layout = DEPTH_LAYOUT_CONVERTED32;
+            return EXIT_SUCCESS;
+        case VK_FORMAT_R16_SFLOAT:
+            *layout = DEPTH_LAYOUT_CONVERTED16;
+            return EXIT_SUCCESS;
+        default:
+            return EXIT_FAILURE;
+    }
+}
+
+
+int
+depthDecodeWithIsa(DepthDecodeIsa isa,
+                   VkFormat format,
+                   const void* texels,
+                   float* depthData,
+                   size_t count)
+{
+    DepthLayout layout;
+    if (depthLayout(format, &layout) != EXIT_SUCCESS)
+    {
+        printf("Unsupported depth format %d\n", format);
+        return EXIT_FAILURE;
+    }
+    if (!depthDecodeIsaSupported(isa))
+    {
+        printf("Instruction set %s is not supported\n", depthDecodeIsaName(isa));
+        return EXIT_FAILURE;
+    }
+    decodeFunctions[isa][layout](texels, depthData, count);
+    return EXIT_SUCCESS;
+}
+
+
+int
+depthDecode(VkFormat format, const void* texels, float* depthData, size_t count)
+{
+    return depthDecodeWithIsa(depthDecodeBestIsa(), format, texels, depthData, count);
+}
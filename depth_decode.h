@@ -0,0 +1,73 @@
+#ifndef DEPTH_DECODE_H
+#define DEPTH_DECODE_H
+
+/// Decoding of depth texels, as copied from the depth aspect of an image to a buffer, into
+/// floats in [0, 1]. Texels at the far plane (depth 1) decode to 0, which makes the image
+/// easier to look at.
+///
+/// The layout of the copied texels depends on the format (see the comment on pixel readback
+/// in render.c):
+///
+///     VK_FORMAT_D16_UNORM, VK_FORMAT_D16_UNORM_S8_UINT      16-bit unsigned normalized
+///     VK_FORMAT_D24_UNORM_S8_UINT                           24-bit unsigned normalized in
+///                                                           the low bits of 32 (X8_D24)
+///     VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT    32-bit float
+///
+/// Depth converted on the device (see RenderConfig.depthConversion) is already final, with
+/// the far plane at 0 and possibly linearized, so it is not limited to [0, 1]. It comes as
+///
+///     VK_FORMAT_R32_SFLOAT                                  32-bit float, copied as it is
+///     VK_FORMAT_R16_SFLOAT                                  16-bit float, widened to 32
+///
+/// There is a plain C loop for each layout, and SSE2, AVX2 and AVX-512 versions of it on x86.
+/// The best version supported by the CPU is picked at runtime. All versions produce exactly
+/// the same bits: the integer to float conversion is exact for up to 24 bits and the
+/// division by the maximum value is correctly rounded in both scalar and SIMD arithmetic.
+/// Widening half floats is exact as well, with F16C (which the AVX2 version requires) or
+/// AVX-512.
+
+#include <vulkan/vulkan.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+typedef enum DepthDecodeIsa {
+    DEPTH_DECODE_SCALAR,
+    DEPTH_DECODE_SSE2,
+    DEPTH_DECODE_AVX2,
+    DEPTH_DECODE_AVX512,
+    DEPTH_DECODE_ISA_COUNT
+} DepthDecodeIsa;
+
+
+const char*
+depthDecodeIsaName(DepthDecodeIsa isa);
+
+/// Whether the CPU we run on supports the instruction set. The scalar version is always
+/// supported.
+int
+depthDecodeIsaSupported(DepthDecodeIsa isa);
+
+/// The widest supported instruction set, which is what `depthDecode` uses.
+DepthDecodeIsa
+depthDecodeBestIsa(void);
+
+/// Byte size of a texel copied from the depth aspect of the format, or 0 for formats that
+/// are not depth formats.
+uint32_t
+depthTexelSize(VkFormat format);
+
+/// Decode `count` texels copied from the depth aspect of an image of the given format.
+/// Returns EXIT_FAILURE for unsupported formats or instruction sets.
+int
+depthDecodeWithIsa(DepthDecodeIsa isa,
+                   VkFormat format,
+                   const void* texels,
+                   float* depthData,
+                   size_t count);
+
+int
+depthDecode(VkFormat format, const void* texels, float* depthData, size_t count);
+
+#endif // DEPTH_DECODE_H
@@ -0,0 +1,265 @@
+#include "depth_output.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+
+#define DEPTH_OUTPUT_RAW_MAGIC 0x48545044 // "DPTH"
+#define DEPTH_OUTPUT_RAW_VERSION 1
+#define DEPTH_OUTPUT_NPY_HEADER_SIZE 128
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define HOST_IS_LITTLE_ENDIAN 0
+#else
+#define HOST_IS_LITTLE_ENDIAN 1
+#endif
+
+
+static const char* formatNames[DEPTH_OUTPUT_FORMAT_COUNT] = {
+    "text", "raw", "npy", "pgm"
+};
+
+static const char* fileNames[DEPTH_OUTPUT_FORMAT_COUNT] = {
+    "out.dat", "out.raw", "out.npy", "out.pgm"
+};
+
+
+int
+depthOutputFormatParse(const char* name, DepthOutputFormat* format)
+{
+    for (uint32_t i = 0; i < DEPTH_OUTPUT_FORMAT_COUNT; ++i)
+    {
+        if (strcmp(name, formatNames[i]) == 0)
+        {
+            *format = (DepthOutputFormat) i;
+            return EXIT_SUCCESS;
+        }
+    }
+    printf("Unknown output format %s, expected text, raw, npy or pgm\n", name);
+    return EXIT_FAILURE;
+}
+
+
+const char*
+depthOutputFormatName(DepthOutputFormat format)
+{
+    return formatNames[format];
+}
+
+
+const char*
+depthOutputFileName(DepthOutputFormat format)
+{
+    return fileNames[format];
+}
+
+
+/// Write a header and a payload with one system call. writev may still write less than
+/// asked for (for example when interrupted by a signal), in which case we continue where it
+/// left off.
+static int
+writeFile(const char* path, const void* header, size_t headerSize, const void* data, size_t size)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        printf("Failed to open %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    struct iovec vectors[2] = {
+        { .iov_base = (void*) header, .iov_len = headerSize },
+        { .iov_base = (void*) data, .iov_len = size }
+    };
+    struct iovec* vector = vectors;
+    int vectorCount = 2;
+    while (vectorCount > 0)
+    {
+        ssize_t written = writev(fd, vector, vectorCount);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            printf("Failed to write %s: %s\n", path, strerror(errno));
+            close(fd);
+            return EXIT_FAILURE;
+        }
+        while (vectorCount > 0 && (size_t) written >= vector->iov_len)
+        {
+            written -= vector->iov_len;
+            vector++;
+            vectorCount--;
+        }
+        if (vectorCount > 0)
+        {
+            vector->iov_base = (uint8_t*) vector->iov_base + written;
+            vector->iov_len -= written;
+        }
+    }
+    if (close(fd) != 0)
+    {
+        printf("Failed to close %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+static uint32_t
+byteSwap32(uint32_t value)
+{
+    return (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+}
+
+
+/// Write float32 data in little endian byte order. On little endian hosts, which is all of
+/// them in practice, the depth data is written straight from the caller's buffer.
+static int
+writeLittleEndianFloats(const char* path,
+                        const void* header,
+                        size_t headerSize,
+                        const float* depthData,
+                        size_t count)
+{
+    if (HOST_IS_LITTLE_ENDIAN)
+    {
+        return writeFile(path, header, headerSize, depthData, count * sizeof(float));
+    }
+    uint32_t* swapped = (uint32_t*) malloc(count * sizeof(uint32_t));
+    if (swapped == NULL)
+    {
+        printf("Failed to allocate output buffer\n");
+        return EXIT_FAILURE;
+    }
+    memcpy(swapped, depthData, count * sizeof(uint32_t));
+    for (size_t i = 0; i < count; ++i)
+    {
+        swapped[i] = byteSwap32(swapped[i]);
+    }
+    int status = writeFile(path, header, headerSize, swapped, count * sizeof(uint32_t));
+    free(swapped);
+    return status;
+}
+
+
+/// The original text output, four decimals per pixel and one line per row.
+static int
+writeText(const char* path, const float* depthData, uint32_t width, uint32_t height)
+{
+    FILE* outputFile = fopen(path, "w");
+    if (outputFile == NULL)
+    {
+        printf("Failed to open %s\n", path);
+        return EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < height; ++i) {
+        for (uint32_t j = 0; j < width; ++j) {
+            fprintf(outputFile, "%.4f ", depthData[width * i + j]);
+        }
+        fprintf(outputFile, "\n");
+    }
+    if (fclose(outputFile) != 0)
+    {
+        printf("Failed to write %s\n", path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+static int
+writeRaw(const char* path, const float* depthData, uint32_t width, uint32_t height)
+{
+    uint32_t header[4] = { DEPTH_OUTPUT_RAW_MAGIC, DEPTH_OUTPUT_RAW_VERSION, width, height };
+    if (!HOST_IS_LITTLE_ENDIAN)
+    {
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            header[i] = byteSwap32(header[i]);
+        }
+    }
+    return writeLittleEndianFloats(path, header, sizeof(header), depthData,
+                                   (size_t) width * height);
+}
+
+
+/// The NPY format (version 1.0) is a magic string, a little endian uint16 header length and
+/// a Python dict literal describing the array, padded with spaces and terminated by a
+/// newline so that the data starts at a multiple of 64 bytes.
+static int
+writeNpy(const char* path, const float* depthData, uint32_t width, uint32_t height)
+{
+    char header[DEPTH_OUTPUT_NPY_HEADER_SIZE];
+    uint16_t dictSize = DEPTH_OUTPUT_NPY_HEADER_SIZE - 10;
+    memcpy(header, "\x93NUMPY\x01\x00", 8);
+    header[8] = (char) (dictSize & 0xFF);
+    header[9] = (char) (dictSize >> 8);
+    int length = snprintf(header + 10, dictSize,
+                          "{'descr': '<f4', 'fortran_order': False, 'shape': (%u, %u), }",
+                          height, width);
+    if (length < 0 || length >= dictSize)
+    {
+        printf("NPY header too long\n");
+        return EXIT_FAILURE;
+    }
+    memset(header + 10 + length, ' ', dictSize - length - 1);
+    header[DEPTH_OUTPUT_NPY_HEADER_SIZE - 1] = '\n';
+    return writeLittleEndianFloats(path, header, sizeof(header), depthData,
+                                   (size_t) width * height);
+}
+
+
+/// 16-bit PGM stores samples most significant byte first.
+static int
+writePgm(const char* path, const float* depthData, uint32_t width, uint32_t height)
+{
+    char header[64];
+    int headerSize = snprintf(header, sizeof(header), "P5\n%u %u\n65535\n", width, height);
+    size_t count = (size_t) width * height;
+    uint8_t* samples = (uint8_t*) malloc(2 * count);
+    if (samples == NULL)
+    {
+        printf("Failed to allocate output buffer\n");
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        float depth = depthData[i] < 0.0f ? 0.0f : depthData[i] > 1.0f ? 1.0f : depthData[i];
+        uint16_t sample = (uint16_t) (depth * 65535.0f + 0.5f);
+        samples[2 * i] = (uint8_t) (sample >> 8);
+        samples[2 * i + 1] = (uint8_t) (sample & 0xFF);
+    }
+    int status = writeFile(path, header, (size_t) headerSize, samples, 2 * count);
+    free(samples);
+    return status;
+}
+
+
+int
+depthOutputWrite(const char* path,
+                 DepthOutputFormat format,
+                 const float* depthData,
+                 uint32_t width,
+                 uint32_t height)
+{
+    switch (format)
+    {
+    case DEPTH_OUTPUT_TEXT:
+        return writeText(path, depthData, width, height);
+    case DEPTH_OUTPUT_RAW:
+        return writeRaw(path, depthData, width, height);
+    case DEPTH_OUTPUT_NPY:
+        return writeNpy(path, depthData, width, height);
+    case DEPTH_OUTPUT_PGM:
+        return writePgm(path, depthData, width, height);
+    default:
+        printf("Unknown output format %d\n", format);
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef DEPTH_OUTPUT_H
+#define DEPTH_OUTPUT_H
+
+/// Writing depth images to disk.
+///
+/// Formatting every pixel with fprintf is slower than rendering it in the first place, and
+/// the text is about three times the size of the data. Apart from the original text format,
+/// depth can be written in binary:
+///
+///  - raw: a 16 byte header (magic "DPTH", version, width and height as little endian
+///    uint32) followed by width * height little endian float32 values, row by row.
+///  - npy: NumPy array file of shape (height, width) and dtype '<f4', load with numpy.load.
+///  - pgm: 16-bit binary PGM (P5, maxval 65535), depth scaled to [0, 65535]. Any image
+///    viewer can show it, at the cost of precision.
+///
+/// The binary formats are written with a single write call each.
+
+#include <stdint.h>
+
+
+typedef enum DepthOutputFormat {
+    DEPTH_OUTPUT_TEXT,
+    DEPTH_OUTPUT_RAW,
+    DEPTH_OUTPUT_NPY,
+    DEPTH_OUTPUT_PGM,
+    DEPTH_OUTPUT_FORMAT_COUNT
+} DepthOutputFormat;
+
+
+/// Parse a format name ("text", "raw", "npy" or "pgm").
+int
+depthOutputFormatParse(const char* name, DepthOutputFormat* format);
+
+/// Name of the format, as accepted by `depthOutputFormatParse`.
+const char*
+depthOutputFormatName(DepthOutputFormat format);
+
+/// Default file name for the format, out.dat for text and out.<name> otherwise.
+const char*
+depthOutputFileName(DepthOutputFormat format);
+
+/// Write `width` * `height` depth values to `path`.
+/// Returns EXIT_SUCCESS if the whole file was written, EXIT_FAILURE otherwise.
+int
+depthOutputWrite(const char* path,
+                 DepthOutputFormat format,
+                 const float* depthData,
+                 uint32_t width,
+                 uint32_t height);
+
+#endif // DEPTH_OUTPUT_H
@@ -0,0 +1,275 @@
+#include "device_select.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+
+/// The device type outweighs everything else, memory only decides between devices of the
+/// same type.
+static uint64_t
+deviceTypeScore(VkPhysicalDeviceType deviceType)
+{
+    switch (deviceType) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   return 4;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 3;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    return 2;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:            return 1;
+        default: return 0;
+    }
+}
+
+
+static const char*
+deviceTypeString(VkPhysicalDeviceType deviceType)
+{
+    switch (deviceType) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   return "discrete GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    return "virtual GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:            return "CPU";
+        default: return "other";
+    }
+}
+
+
+static uint64_t
+scorePhysicalDevice(VkPhysicalDevice physicalDevice, const VkPhysicalDeviceProperties* properties)
+{
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    VkDeviceSize deviceLocalBytes = 0;
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i)
+    {
+        if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+        {
+            deviceLocalBytes += memoryProperties.memoryHeaps[i].size;
+        }
+    }
+    /// Memory in MB fits comfortably in the low 40 bits.
+    return (deviceTypeScore(properties->deviceType) << 40) | (deviceLocalBytes >> 20);
+}
+
+
+/// The device UUID needs `vkGetPhysicalDeviceProperties2`, which is core in Vulkan 1.1.
+static void
+getDeviceUUID(VkPhysicalDevice physicalDevice, uint8_t* deviceUUID)
+{
+    VkPhysicalDeviceIDProperties idProperties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES
+    };
+    VkPhysicalDeviceProperties2 properties2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &idProperties
+    };
+    vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+    memcpy(deviceUUID, idProperties.deviceUUID, VK_UUID_SIZE);
+}
+
+
+int
+enumeratePhysicalDeviceCandidates(VkInstance instance,
+                                  PhysicalDeviceCandidate* candidates,
+                                  uint32_t* candidateCount)
+{
+    printf("Enumerating physical devices (maximum %d)\n", MAX_PHYSICAL_DEVICE_COUNT);
+    uint32_t physicalDeviceCount = MAX_PHYSICAL_DEVICE_COUNT;
+    VkPhysicalDevice physicalDevices[MAX_PHYSICAL_DEVICE_COUNT];
+    VkResult code = vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices);
+    if (code != VK_SUCCESS)
+    {
+        if (code == VK_INCOMPLETE) {
+            printf("There are more than MAX_PHYSICAL_DEVICE_COUNT physical devices available,"
+                   " consider recompiling with a different value\n");
+        }
+        else {
+            printf("Failed to enumerate physical devices, code: %d\n", code);
+            return EXIT_FAILURE;
+        }
+    }
+    printf("%d physical devices available\n", physicalDeviceCount);
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < physicalDeviceCount && count < *candidateCount; ++i)
+    {
+        PhysicalDeviceCandidate candidate = {
+            .physicalDevice = physicalDevices[i],
+            .index = i
+        };
+        vkGetPhysicalDeviceProperties(candidate.physicalDevice, &candidate.properties);
+        /// Calling a Vulkan 1.1 function on a device that only supports 1.0 is invalid, even
+        /// when the instance supports 1.1, so such devices are not candidates at all.
+        if (candidate.properties.apiVersion < VK_API_VERSION_1_1)
+        {
+            printf("Physical device %u: %s, supports Vulkan %u.%u, 1.1 is required\n",
+                   i, candidate.properties.deviceName,
+                   VK_API_VERSION_MAJOR(candidate.properties.apiVersion),
+                   VK_API_VERSION_MINOR(candidate.properties.apiVersion));
+            continue;
+        }
+        getDeviceUUID(candidate.physicalDevice, candidate.deviceUUID);
+
+        VkQueueFamilyProperties queueFamilyProperties[MAX_PHYSICAL_DEVICE_QUEUE_FAMILIES];
+        uint32_t queueFamilyCount = MAX_PHYSICAL_DEVICE_QUEUE_FAMILIES;
+        vkGetPhysicalDeviceQueueFamilyProperties(
+            candidate.physicalDevice, &queueFamilyCount, queueFamilyProperties
+        );
+        for (candidate.queueFamilyIndex = 0;
+             candidate.queueFamilyIndex < queueFamilyCount;
+             ++candidate.queueFamilyIndex)
+        {
+            VkQueueFlags flags = queueFamilyProperties[candidate.queueFamilyIndex].queueFlags;
+            if ((flags & VK_QUEUE_GRAPHICS_BIT) && (flags & VK_QUEUE_COMPUTE_BIT) &&
+                (flags & VK_QUEUE_TRANSFER_BIT)) {
+                break;
+            }
+        }
+        if (candidate.queueFamilyIndex == queueFamilyCount)
+        {
+            printf("Physical device %u: %s, no queue family with graphics, compute and transfer\n",
+                   i, candidate.properties.deviceName);
+            continue;
+        }
+        candidate.transferQueueFamilyIndex = candidate.queueFamilyIndex;
+        uint32_t transferQueueFamilyScore = 0;
+        for (uint32_t j = 0; j < queueFamilyCount; ++j)
+        {
+            VkQueueFlags flags = queueFamilyProperties[j].queueFlags;
+            if (!(flags & VK_QUEUE_TRANSFER_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT))
+            {
+                continue;
+            }
+            uint32_t score = (flags & VK_QUEUE_COMPUTE_BIT) ? 1 : 2;
+            if (score > transferQueueFamilyScore)
+            {
+                candidate.transferQueueFamilyIndex = j;
+                transferQueueFamilyScore = score;
+            }
+        }
+        candidate.timestampValidBits =
+            queueFamilyProperties[candidate.queueFamilyIndex].timestampValidBits;
+        candidate.transferTimestampValidBits =
+            queueFamilyProperties[candidate.transferQueueFamilyIndex].timestampValidBits;
+        candidate.score = scorePhysicalDevice(candidate.physicalDevice, &candidate.properties);
+
+        char uuid[2 * VK_UUID_SIZE + 1];
+        for (uint32_t j = 0; j < VK_UUID_SIZE; ++j)
+        {
+            snprintf(uuid + 2 * j, 3, "%02x", candidate.deviceUUID[j]);
+        }
+        printf("Physical device %u: %s (%s, uuid %s)\n",
+               i, candidate.properties.deviceName,
+               deviceTypeString(candidate.properties.deviceType), uuid);
+
+        /// Insertion sort by decreasing score, stable so that ties keep enumeration order.
+        uint32_t position = count++;
+        while (position > 0 && candidates[position - 1].score < candidate.score)
+        {
+            candidates[position] = candidates[position - 1];
+            position--;
+        }
+        candidates[position] = candidate;
+    }
+    *candidateCount = count;
+    return EXIT_SUCCESS;
+}
+
+
+/// Parse 32 hex digits, ignoring dashes. Returns 0 if `string` is not a UUID.
+static int
+parseUUID(const char* string, uint8_t* uuid)
+{
+    uint32_t digitCount = 0;
+    for (const char* c = string; *c != '\0'; ++c)
+    {
+        if (*c == '-')
+        {
+            continue;
+        }
+        if (!isxdigit((unsigned char) *c) || digitCount == 2 * VK_UUID_SIZE)
+        {
+            return 0;
+        }
+        int value = isdigit((unsigned char) *c)
+                  ? *c - '0'
+                  : tolower((unsigned char) *c) - 'a' + 10;
+        if (digitCount % 2 == 0)
+        {
+            uuid[digitCount / 2] = (uint8_t) (value << 4);
+        }
+        else
+        {
+            uuid[digitCount / 2] |= (uint8_t) value;
+        }
+        digitCount++;
+    }
+    return digitCount == 2 * VK_UUID_SIZE;
+}
+
+
+static int
+containsIgnoringCase(const char* string, const char* substring)
+{
+    size_t length = strlen(substring);
+    for (const char* start = string; *start != '\0'; ++start)
+    {
+        if (strncasecmp(start, substring, length) == 0)
+        {
+            return 1;
+        }
+    }
+    return length == 0;
+}
+
+
+int
+physicalDeviceMatches(const PhysicalDeviceCandidate* candidate, const char* specification)
+{
+    char* end;
+    unsigned long index = strtoul(specification, &end, 10);
+    if (*specification != '\0' && *end == '\0')
+    {
+        return candidate->index == index;
+    }
+    uint8_t uuid[VK_UUID_SIZE];
+    if (parseUUID(specification, uuid))
+    {
+        return memcmp(candidate->deviceUUID, uuid, VK_UUID_SIZE) == 0;
+    }
+    return containsIgnoringCase(candidate->properties.deviceName, specification);
+}
+
+
+int
+selectPhysicalDeviceCandidate(const PhysicalDeviceCandidate* candidates,
+                              uint32_t candidateCount,
+                              const char* specification,
+                              uint32_t* selected)
+{
+    if (candidateCount == 0)
+    {
+        printf("Failed to find a suitable physical device\n");
+        return EXIT_FAILURE;
+    }
+    if (specification == NULL)
+    {
+        specification = getenv(RENDER_DEVICE_ENVIRONMENT_VARIABLE);
+    }
+    if (specification == NULL || *specification == '\0')
+    {
+        *selected = 0;
+        return EXIT_SUCCESS;
+    }
+    for (uint32_t i = 0; i < candidateCount; ++i)
+    {
+        if (physicalDeviceMatches(&candidates[i], specification))
+        {
+            *selected = i;
+            return EXIT_SUCCESS;
+        }
+    }
+    printf("No suitable physical device matches \"%s\"\n", specification);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,83 @@
+#ifndef DEVICE_SELECT_H
+#define DEVICE_SELECT_H
+
+/// Physical device selection.
+///
+/// Every physical device that supports Vulkan 1.1 and has a queue family with graphics,
+/// compute and transfer support is a candidate, whatever its type. The render context needs
+/// 1.1 for multiview, which its vertex shader uses, and to query features and properties
+/// through `vkGetPhysicalDeviceFeatures2` and `vkGetPhysicalDeviceProperties2`. Candidates
+/// are scored, foremost by device type (discrete before integrated before virtual GPUs
+/// before CPU implementations such as Lavapipe), then by the amount of device local memory.
+/// The best candidate is selected by default, so a machine with a GPU uses it, and a
+/// headless machine with only a software implementation still renders.
+///
+/// The selection can be overridden by a device specification, which is one of
+///
+///  - an index into the list of physical devices, as printed when they are enumerated
+///  - the device UUID, 32 hex digits (dashes are ignored). One of only decimal digits reads
+///    as an index unless it has dashes, as in the usual 8-4-4-4-12 form.
+///  - a case-insensitive substring of the device name, for example "llvmpipe"
+///
+/// The specification is taken from the RENDER_DEVICE environment variable, unless one is
+/// given explicitly (from the command line for example).
+
+#include <vulkan/vulkan.h>
+
+#include <stdint.h>
+
+/// Compile time limits, which allow us to use less dynamic allocation.
+#ifndef MAX_PHYSICAL_DEVICE_COUNT
+#define MAX_PHYSICAL_DEVICE_COUNT 4
+#endif
+
+#ifndef MAX_PHYSICAL_DEVICE_QUEUE_FAMILIES
+#define MAX_PHYSICAL_DEVICE_QUEUE_FAMILIES 8
+#endif
+
+/// Environment variable holding the default device specification.
+#define RENDER_DEVICE_ENVIRONMENT_VARIABLE "RENDER_DEVICE"
+
+
+typedef struct PhysicalDeviceCandidate {
+    VkPhysicalDevice physicalDevice;
+    VkPhysicalDeviceProperties properties;
+    uint8_t deviceUUID[VK_UUID_SIZE];
+    /// Index of the device in the order of vkEnumeratePhysicalDevices.
+    uint32_t index;
+    /// First queue family supporting graphics, compute and transfer commands.
+    uint32_t queueFamilyIndex;
+    /// Queue family supporting transfer but not graphics commands, preferably not compute
+    /// either, which is typically backed by a dedicated copy engine. Equal to
+    /// queueFamilyIndex if the device has none.
+    uint32_t transferQueueFamilyIndex;
+    /// Valid bits of the timestamps written on those queue families, 0 when they can not
+    /// write timestamps.
+    uint32_t timestampValidBits;
+    uint32_t transferTimestampValidBits;
+    uint64_t score;
+} PhysicalDeviceCandidate;
+
+
+/// Enumerate the physical devices of `instance` and collect those that can render, sorted
+/// by decreasing score. At most `*candidateCount` are returned, the actual number is
+/// written back to `*candidateCount`.
+int
+enumeratePhysicalDeviceCandidates(VkInstance instance,
+                                  PhysicalDeviceCandidate* candidates,
+                                  uint32_t* candidateCount);
+
+/// Pick the candidate matching `specification`. If `specification` is NULL the environment
+/// variable is used instead, and if that is not set either the best scoring candidate.
+/// A specification that matches no candidate is an error.
+int
+selectPhysicalDeviceCandidate(const PhysicalDeviceCandidate* candidates,
+                              uint32_t candidateCount,
+                              const char* specification,
+                              uint32_t* selected);
+
+/// Whether `candidate` matches the device specification.
+int
+physicalDeviceMatches(const PhysicalDeviceCandidate* candidate, const char* specification);
+
+#endif // DEVICE_SELECT_H
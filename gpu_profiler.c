@@ -0,0 +1,300 @@
+#include "gpu_profiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static const char* sectionNames[GPU_SECTION_COUNT] = {
+    "cull",
+    "render pass",
+    "barrier",
+    "statistics",
+    "conversion",
+    "copy"
+};
+
+
+/// Index of the timestamp at the start of `section` in frame `frameIndex`, the one at its
+/// end follows it.
+static uint32_t
+timestampQuery(uint32_t frameIndex, GpuSection section)
+{
+    return 2 * (frameIndex * GPU_SECTION_COUNT + section);
+}
+
+
+int
+gpuProfilerInit(GpuProfiler* profiler,
+                VkDevice device,
+                uint32_t frameCount,
+                float timestampPeriod,
+                uint32_t timestampValidBits,
+                uint32_t pipelineStatistics)
+{
+    memset(profiler, 0, sizeof(*profiler));
+    profiler->device = device;
+    profiler->frameCount = frameCount;
+    profiler->timestampPeriod = timestampPeriod;
+    if (timestampValidBits == 0)
+    {
+        printf("The queue family does not support timestamps\n");
+        return EXIT_FAILURE;
+    }
+    profiler->timestampMask = timestampValidBits >= 64
+                            ? UINT64_MAX
+                            : (UINT64_C(1) << timestampValidBits) - 1;
+
+    VkQueryPoolCreateInfo timestampPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = 2 * GPU_SECTION_COUNT * frameCount
+    };
+    if (vkCreateQueryPool(device, &timestampPoolCreateInfo, NULL, &profiler->timestampPool)
+        != VK_SUCCESS)
+    {
+        printf("Failed to create timestamp query pool\n");
+        return EXIT_FAILURE;
+    }
+    if (pipelineStatistics)
+    {
+        VkQueryPoolCreateInfo statisticsPoolCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+            .queryCount = frameCount,
+            .pipelineStatistics = GPU_PIPELINE_STATISTICS
+        };
+        if (vkCreateQueryPool(device, &statisticsPoolCreateInfo, NULL, &profiler->statisticsPool)
+            != VK_SUCCESS)
+        {
+            printf("Failed to create pipeline statistics query pool\n");
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+
+void
+gpuProfilerReset(GpuProfiler* profiler, VkCommandBuffer commandBuffer, uint32_t frameIndex)
+{
+    vkCmdResetQueryPool(commandBuffer,
+                        profiler->timestampPool,
+                        timestampQuery(frameIndex, 0),
+                        2 * GPU_SECTION_COUNT);
+    if (profiler->statisticsPool != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(commandBuffer, profiler->statisticsPool, frameIndex, 1);
+    }
+}
+
+
+void
+gpuProfilerBegin(GpuProfiler* profiler,
+                 VkCommandBuffer commandBuffer,
+                 uint32_t frameIndex,
+                 GpuSection section)
+{
+    vkCmdWriteTimestamp(commandBuffer,
+                        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                        profiler->timestampPool,
+                        timestampQuery(frameIndex, section));
+}
+
+
+void
+gpuProfilerEnd(GpuProfiler* profiler,
+               VkCommandBuffer commandBuffer,
+               uint32_t frameIndex,
+               GpuSection section)
+{
+    vkCmdWriteTimestamp(commandBuffer,
+                        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                        profiler->timestampPool,
+                        timestampQuery(frameIndex, section) + 1);
+}
+
+
+void
+gpuProfilerBeginStatistics(GpuProfiler* profiler,
+                           VkCommandBuffer commandBuffer,
+                           uint32_t frameIndex)
+{
+    if (profiler->statisticsPool != VK_NULL_HANDLE)
+    {
+        vkCmdBeginQuery(commandBuffer, profiler->statisticsPool, frameIndex, 0);
+    }
+}
+
+
+void
+gpuProfilerEndStatistics(GpuProfiler* profiler,
+                         VkCommandBuffer commandBuffer,
+                         uint32_t frameIndex)
+{
+    if (profiler->statisticsPool != VK_NULL_HANDLE)
+    {
+        vkCmdEndQuery(commandBuffer, profiler->statisticsPool, frameIndex);
+    }
+}
+
+
+int
+gpuProfilerRead(GpuProfiler* profiler,
+                uint32_t frameIndex,
+                uint32_t sectionMask,
+                uint32_t transferSectionMask,
+                uint32_t hasStatistics,
+                GpuFrameTimings* timings)
+{
+    memset(timings, 0, sizeof(*timings));
+    timings->sectionMask = sectionMask;
+    timings->transferSectionMask = transferSectionMask & sectionMask;
+    timings->hasStatistics = hasStatistics && profiler->statisticsPool != VK_NULL_HANDLE;
+
+    /// Timestamps wrap around at timestampValidBits, so the difference is taken modulo that.
+    /// The sections are read one at a time, since the queries of sections that were not
+    /// recorded are never written, and reading them would never become available. The total
+    /// only spans the sections on the graphics queue, the clock of the transfer queue can not
+    /// be compared with it.
+    uint64_t first = 0;
+    uint64_t last = 0;
+    uint32_t sectionCount = 0;
+    for (uint32_t section = 0; section < GPU_SECTION_COUNT; ++section)
+    {
+        if (!(sectionMask & (1u << section)))
+        {
+            continue;
+        }
+        uint64_t timestamps[2];
+        if (vkGetQueryPoolResults(profiler->device,
+                                  profiler->timestampPool,
+                                  timestampQuery(frameIndex, section),
+                                  2,
+                                  sizeof(timestamps),
+                                  timestamps,
+                                  sizeof(timestamps[0]),
+                                  VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT)
+            != VK_SUCCESS)
+        {
+            printf("Failed to read timestamps of frame %u\n", frameIndex);
+            return EXIT_FAILURE;
+        }
+        uint64_t begin = timestamps[0] & profiler->timestampMask;
+        uint64_t end = timestamps[1] & profiler->timestampMask;
+        uint64_t ticks = (end - begin) & profiler->timestampMask;
+        timings->milliseconds[section] = 1e-6 * profiler->timestampPeriod * ticks;
+        if (timings->transferSectionMask & (1u << section))
+        {
+            continue;
+        }
+        if (sectionCount == 0)
+        {
+            first = begin;
+        }
+        last = end;
+        sectionCount++;
+    }
+    timings->totalMilliseconds =
+        1e-6 * profiler->timestampPeriod * ((last - first) & profiler->timestampMask);
+
+    if (timings->hasStatistics &&
+        vkGetQueryPoolResults(profiler->device,
+                              profiler->statisticsPool,
+                              frameIndex,
+                              1,
+                              sizeof(timings->statistics),
+                              timings->statistics,
+                              sizeof(timings->statistics),
+                              VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT)
+        != VK_SUCCESS)
+    {
+        printf("Failed to read pipeline statistics of frame %u\n", frameIndex);
+        return EXIT_FAILURE;
+    }
+
+    profiler->readCount++;
+    profiler->transferSectionMask |= timings->transferSectionMask;
+    profiler->totalMilliseconds += timings->totalMilliseconds;
+    for (uint32_t section = 0; section < GPU_SECTION_COUNT; ++section)
+    {
+        if (sectionMask & (1u << section))
+        {
+            profiler->sectionCounts[section]++;
+            profiler->sectionMilliseconds[section] += timings->milliseconds[section];
+        }
+    }
+    for (uint32_t i = 0; i < GPU_STATISTIC_COUNT; ++i)
+    {
+        profiler->statistics[i] += timings->statistics[i];
+    }
+    return EXIT_SUCCESS;
+}
+
+
+void
+gpuProfilerPrintFrame(uint32_t renderIndex, const GpuFrameTimings* timings)
+{
+    printf("Render %u on the device:", renderIndex);
+    for (uint32_t section = 0; section < GPU_SECTION_COUNT; ++section)
+    {
+        if (timings->sectionMask & (1u << section))
+        {
+            printf(" %s %.3f ms%s,",
+                   sectionNames[section],
+                   timings->milliseconds[section],
+                   timings->transferSectionMask & (1u << section) ? " on the transfer queue" : "");
+        }
+    }
+    printf(" total %.3f ms on the graphics queue\n", timings->totalMilliseconds);
+    if (timings->hasStatistics)
+    {
+        const uint64_t* statistics = timings->statistics;
+        printf("    %lu vertices, %lu primitives assembled, %lu clipped of %lu, "
+               "%lu vertex, %lu fragment and %lu compute shader invocations\n",
+               (unsigned long) statistics[GPU_STATISTIC_INPUT_ASSEMBLY_VERTICES],
+               (unsigned long) statistics[GPU_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES],
+               (unsigned long) statistics[GPU_STATISTIC_CLIPPING_PRIMITIVES],
+               (unsigned long) statistics[GPU_STATISTIC_CLIPPING_INVOCATIONS],
+               (unsigned long) statistics[GPU_STATISTIC_VERTEX_SHADER_INVOCATIONS],
+               (unsigned long) statistics[GPU_STATISTIC_FRAGMENT_SHADER_INVOCATIONS],
+               (unsigned long) statistics[GPU_STATISTIC_COMPUTE_SHADER_INVOCATIONS]);
+    }
+}
+
+
+void
+gpuProfilerPrintTotals(const GpuProfiler* profiler)
+{
+    if (profiler->readCount == 0)
+    {
+        return;
+    }
+    printf("Average of %lu frames on the device:", (unsigned long) profiler->readCount);
+    for (uint32_t section = 0; section < GPU_SECTION_COUNT; ++section)
+    {
+        if (profiler->sectionCounts[section] > 0)
+        {
+            printf(" %s %.3f ms%s,",
+                   sectionNames[section],
+                   profiler->sectionMilliseconds[section] / profiler->sectionCounts[section],
+                   profiler->transferSectionMask & (1u << section) ? " on the transfer queue" : "");
+        }
+    }
+    printf(" total %.3f ms on the graphics queue\n",
+           profiler->totalMilliseconds / profiler->readCount);
+}
+
+
+void
+gpuProfilerShutdown(GpuProfiler* profiler)
+{
+    if (profiler->device == VK_NULL_HANDLE)
+    {
+        return;
+    }
+    vkDestroyQueryPool(profiler->device, profiler->timestampPool, NULL);
+    vkDestroyQueryPool(profiler->device, profiler->statisticsPool, NULL);
+    profiler->timestampPool = VK_NULL_HANDLE;
+    profiler->statisticsPool = VK_NULL_HANDLE;
+}
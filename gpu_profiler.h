@@ -0,0 +1,171 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+/// Device side timing of the passes of a frame, with queries.
+///
+/// The host can only time a frame from submission to fence, which says nothing about where
+/// the device spent that time. Vulkan lets the device write timestamps into a query pool as
+/// it executes a command buffer: `vkCmdWriteTimestamp` writes the time at which all earlier
+/// commands have reached a pipeline stage. Every section of a frame is bracketed by a
+/// timestamp at VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT and one at
+/// VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, so the difference is the time from the section
+/// starting to everything recorded up to its end having finished. A barrier section is
+/// mostly the wait for the work before it to drain. Timestamps count ticks of
+/// `timestampPeriod` nanoseconds, and only their lowest `timestampValidBits` bits are valid.
+/// Only timestamps written on the same queue can be compared, so a section written on the
+/// transfer queue is timed on its own, and left out of the total of the frame.
+///
+/// A pipeline statistics query counts what the pipeline did in between its begin and end:
+/// vertices and primitives assembled, shader invocations and primitives clipped. It needs
+/// the pipelineStatisticsQuery feature, and without it only the timestamps are written. If
+/// secondary command buffers execute while it is active, it needs the inheritedQueries
+/// feature too.
+///
+/// Every frame in flight has queries of its own. They are reset at the start of its command
+/// buffer, and read back once its fence has signaled, so reading never waits.
+
+#include <vulkan/vulkan.h>
+
+#include <stdint.h>
+
+
+/// The sections of a frame, in the order they are recorded. A frame only records those that
+/// apply to it, see GpuFrameTimings.sectionMask.
+typedef enum GpuSection {
+    GPU_SECTION_CULL,
+    GPU_SECTION_RENDER_PASS,
+    GPU_SECTION_BARRIER,
+    GPU_SECTION_STATISTICS,
+    GPU_SECTION_CONVERSION,
+    GPU_SECTION_COPY,
+    GPU_SECTION_COUNT
+} GpuSection;
+
+
+/// The pipeline statistics that are counted, in the order of their bits in
+/// VkQueryPipelineStatisticFlagBits, which is the order of the query results.
+typedef enum GpuStatistic {
+    GPU_STATISTIC_INPUT_ASSEMBLY_VERTICES,
+    GPU_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES,
+    GPU_STATISTIC_VERTEX_SHADER_INVOCATIONS,
+    GPU_STATISTIC_CLIPPING_INVOCATIONS,
+    GPU_STATISTIC_CLIPPING_PRIMITIVES,
+    GPU_STATISTIC_FRAGMENT_SHADER_INVOCATIONS,
+    GPU_STATISTIC_COMPUTE_SHADER_INVOCATIONS,
+    GPU_STATISTIC_COUNT
+} GpuStatistic;
+
+#define GPU_PIPELINE_STATISTICS \
+    (VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT | \
+     VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT | \
+     VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | \
+     VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT | \
+     VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | \
+     VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT | \
+     VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT)
+
+
+/// Device side timings of one frame.
+typedef struct GpuFrameTimings {
+    /// Bit `1 << section` is set for every section the frame recorded, and in
+    /// `transferSectionMask` for those of them written on the transfer queue.
+    uint32_t sectionMask;
+    uint32_t transferSectionMask;
+    double milliseconds[GPU_SECTION_COUNT];
+    /// From the start of the first section to the end of the last one, of the sections
+    /// written on the graphics queue.
+    double totalMilliseconds;
+    /// Whether `statistics` were counted.
+    uint32_t hasStatistics;
+    uint64_t statistics[GPU_STATISTIC_COUNT];
+} GpuFrameTimings;
+
+
+typedef struct GpuProfiler {
+    VkDevice device;
+    /// Two timestamps per section per frame.
+    VkQueryPool timestampPool;
+    /// One query per frame, VK_NULL_HANDLE without the pipelineStatisticsQuery feature.
+    VkQueryPool statisticsPool;
+    uint32_t frameCount;
+    float timestampPeriod;
+    uint64_t timestampMask;
+
+    /// Totals over the frames read so far, and the sections any of them wrote on the
+    /// transfer queue.
+    uint64_t readCount;
+    uint32_t transferSectionMask;
+    uint64_t sectionCounts[GPU_SECTION_COUNT];
+    double sectionMilliseconds[GPU_SECTION_COUNT];
+    double totalMilliseconds;
+    uint64_t statistics[GPU_STATISTIC_COUNT];
+} GpuProfiler;
+
+
+/// Create the query pools for `frameCount` frames. `timestampPeriod` comes from the limits
+/// of the physical device, `timestampValidBits` from the queue family the frames are
+/// submitted to, and must not be 0. With `pipelineStatistics`, the device was created with
+/// the pipelineStatisticsQuery feature enabled, and inheritedQueries if it is needed.
+/// On failure the profiler is left in a state that `gpuProfilerShutdown` can clean up.
+int
+gpuProfilerInit(GpuProfiler* profiler,
+                VkDevice device,
+                uint32_t frameCount,
+                float timestampPeriod,
+                uint32_t timestampValidBits,
+                uint32_t pipelineStatistics);
+
+/// Record the reset of the queries of frame `frameIndex` into `commandBuffer`, outside of a
+/// render pass and before any of them is written.
+void
+gpuProfilerReset(GpuProfiler* profiler, VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+/// Record the timestamps at the start and end of `section` into `commandBuffer`.
+void
+gpuProfilerBegin(GpuProfiler* profiler,
+                 VkCommandBuffer commandBuffer,
+                 uint32_t frameIndex,
+                 GpuSection section);
+void
+gpuProfilerEnd(GpuProfiler* profiler,
+               VkCommandBuffer commandBuffer,
+               uint32_t frameIndex,
+               GpuSection section);
+
+/// Record the begin and end of the pipeline statistics query of the frame, outside of a
+/// render pass. Nothing is recorded without the pipelineStatisticsQuery feature.
+void
+gpuProfilerBeginStatistics(GpuProfiler* profiler,
+                           VkCommandBuffer commandBuffer,
+                           uint32_t frameIndex);
+void
+gpuProfilerEndStatistics(GpuProfiler* profiler,
+                         VkCommandBuffer commandBuffer,
+                         uint32_t frameIndex);
+
+/// Read the queries of frame `frameIndex`, whose command buffers have finished executing,
+/// into `timings`, and add them to the totals. Only the sections in `sectionMask` and, with
+/// `hasStatistics`, the pipeline statistics are read, the other queries were not written.
+/// The sections in `transferSectionMask` were written on the transfer queue.
+int
+gpuProfilerRead(GpuProfiler* profiler,
+                uint32_t frameIndex,
+                uint32_t sectionMask,
+                uint32_t transferSectionMask,
+                uint32_t hasStatistics,
+                GpuFrameTimings* timings);
+
+/// Print the timings of render `renderIndex` on a line, and its pipeline statistics on
+/// another.
+void
+gpuProfilerPrintFrame(uint32_t renderIndex, const GpuFrameTimings* timings);
+
+/// Print the average timings over all frames read.
+void
+gpuProfilerPrintTotals(const GpuProfiler* profiler);
+
+/// Destroy the query pools.
+void
+gpuProfilerShutdown(GpuProfiler* profiler);
+
+#endif // GPU_PROFILER_H
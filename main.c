@@ -1,1113 +1,561 @@
-/// This file will walk through how to setup a minimal graphics pipeline and render the depth
-/// of a triangle to image on disk. The goal is to as quickly as possible see some results.
-/// Despite the warnings provided at the start of the classic tutorials about being patient,
-/// it can feel overwhelming for a beginner how much code is needed for a simple setup.
+/// This program renders the depth of a triangle to an image on disk.
 ///
-/// We will not setup presentation to screen, which is one of the most demanding things to
-/// understand for a beginner. We will not need any extensions either, only the core API.
+/// The interesting part, how to setup a minimal graphics pipeline with Vulkan, lives in
+/// render.c, which should be read first. This file is a small driver on top of it.
 ///
-/// As we code, various core Vulkan concepts will be introduced and their rationale explained.
+/// Setting up Vulkan is expensive and rendering a small depth image is cheap, so the render
+/// context is initialized once and then used for as many renders as requested on the
+/// command line (default 1):
 ///
-/// We will use pure C as our language of choice because Vulkan is a C API.
-/// In my opinion, mixing in a different language (usually C++) makes it harder to learn.
-/// It is easier to learn it with a C mindset.
+///     ./out/Debug/main [-n render count] [-f frames in flight] [-o text|raw|npy|pgm]
+///                      [-d device] [-a] [-t] [-j recording threads] [-c draws] [-r]
+///                      [-k instances] [-l] [-s poses] [-m] [-g] [-i mesh.obj|mesh.ply]
+///                      [-v float32|float16] [-z near:far] [-b bins] [-q] [-p]
+///                      [WIDTHxHEIGHT ...]
 ///
-/// We will define the whole program in the main function.
-/// Many tutorials out there are smart and factor out code into small utility functions.
-/// While this is good practice in production code, it hampers learning for beginners.
+/// When several resolutions are given, the renders cycle through them. The default
+/// resolution is IMAGE_WIDTH x IMAGE_HEIGHT. The depth of the last render is written to
+/// out.dat as text, or to out.raw, out.npy or out.pgm in one of the binary formats described
+/// in depth_output.h.
+///
+/// With more than one frame in flight (default 1, at most MAX_FRAMES_IN_FLIGHT), frames are
+/// submitted ahead of time, and the host decodes one frame while the device renders the next.
+///
+/// The physical device is picked by -d, or the RENDER_DEVICE environment variable, as an
+/// index, UUID or name substring (see device_select.h). By default the best scoring device is
+/// used. With -a, the renders are spread over every physical device instead, and the
+/// throughput of each device is reported (see render_scheduler.h).
+///
+/// With -t, the depth is copied to the readback buffer on a dedicated transfer queue when the
+/// device has one, so that the copy of one frame overlaps the rendering of the next. This
+/// needs more than one frame in flight to pay off.
+///
+/// Each render draws the triangle -c times (default 1), standing in for a scene with many
+/// objects. With -j, the draws are recorded in parallel by that many threads into secondary
+/// command buffers (see command_recorder.h).
+///
+/// With -k, each draw renders that many instances of the triangle, shrunk and laid out in a
+/// square grid, with their model matrices in a storage buffer. A scene of many copies of the
+/// same mesh is then a single draw, compared to one draw per copy with -c.
+///
+/// With -l, the instances are culled against the view frustum by a compute shader on the
+/// device, and only the visible ones are drawn, through an indirect draw.
+///
+/// With -r, each frame keeps its recorded command buffers and submits them again for as long
+/// as it renders to the same render target, so repeated renders skip recording altogether.
+///
+/// With -s, each render is a camera sweep of that many poses (at most MAX_RENDER_LAYERS),
+/// turning around the triangle from -60 to +60 degrees. The poses are rendered into the
+/// layers of one array image and read back with a single copy. The output then holds the
+/// depth of the poses stacked vertically, WIDTHx(HEIGHT * poses).
+///
+/// With -m, the poses of the sweep are rendered as the views of a single multiview render
+/// pass instead of one render pass per pose. The number of poses is then limited by the
+/// maxMultiviewViewCount of the device, at least 6.
+///
+/// With -g, the poses are rendered as the tiles of one depth atlas, a single 2D image with a
+/// grid of WIDTHxHEIGHT tiles, which suits many small renders. The output is the same as for
+/// a sweep into layers.
+///
+/// With -i, the triangle is replaced by a mesh loaded from an OBJ or binary PLY file (see
+/// mesh_loader.h). The first load parses the file and writes a cache file next to it, which
+/// later runs map instead of parsing the file again.
+///
+/// With -v, the depth is converted to 32 or 16 bit floats by a compute shader on the device,
+/// so the host only copies (or widens) what it reads back, instead of decoding the depth
+/// format. With -z as well, the depth is linearized for a perspective projection with those
+/// near and far planes. This replaces -t.
+///
+/// With -b, a compute shader reduces the depth of every render to its minimum, maximum and
+/// mean, a histogram of that many bins, and the number of covered pixels, and those of the
+/// last render are printed. With -z they are of the linearized depth. With -q only the
+/// statistics are computed, the depth is not read back at all and no output is written.
+///
+/// With -p, the passes of every frame are timed on the device with timestamp queries, and
+/// what the pipeline did is counted with a pipeline statistics query (see gpu_profiler.h).
+/// A report is printed for every collected frame, and the averages at the end.
 
-#include <vulkan/vulkan.h>
+#include "depth_output.h"
+#include "mesh_loader.h"
+#include "render.h"
+#include "render_scheduler.h"
+#include "timing.h"
 
+#include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 
-/// We want to enable/disable certain features depending on the typical CMake
-/// build types (Debug/Release).
-/// For example, validation layers should only be enabled in Debug.
-#ifndef BUILD_TYPE
-#define BUILD_TYPE "Debug"
-#endif
-
-
-/// Define some user configurable compile time constants.
-/// MAX_PHYSICAL_DEVICE_COUNT and MAX_PHYSICAL_DEVICE_QUEUE_FAMILIES allows us
-/// to use less dynamic allocation later on.
-
-#ifndef MAX_PHYSICAL_DEVICE_COUNT
-#define MAX_PHYSICAL_DEVICE_COUNT 4
-#endif
-
-#define MAX_PHYSICAL_DEVICE_QUEUE_FAMILIES 8
-#define VERTEX_SHADER_SOURCE_PATH "out/" BUILD_TYPE "/shader.vert.spv"
-#define IMAGE_WIDTH 20
-#define IMAGE_HEIGHT 20
-
-
-/// Define some helper macros.
-#define STR(name) #name
-#define CASE_STR(name) case name : return STR(name)
+#define MAX_RESOLUTION_COUNT 16
 
 
-/// Many functions in Vulkan return status codes.
-/// We start with writing a function that converts codes into strings.
-/// See: https://registry.khronos.org/vulkan/specs/1.3/html/chap3.html#VkResult
-/// Certain result codes are introduced at specific versions of Vulkan, which we can make
-/// portable by checking against VK_VERSION_X_X definitions.
-const char*
-resultString(VkResult code)
+static void
+usage(const char* program)
 {
-    switch (code)
-    {
-        CASE_STR(VK_SUCCESS);
-        CASE_STR(VK_NOT_READY);
-        CASE_STR(VK_TIMEOUT);
-        CASE_STR(VK_EVENT_SET);
-        CASE_STR(VK_EVENT_RESET);
-        CASE_STR(VK_INCOMPLETE);
-        CASE_STR(VK_ERROR_OUT_OF_HOST_MEMORY);
-        CASE_STR(VK_ERROR_OUT_OF_DEVICE_MEMORY);
-        CASE_STR(VK_ERROR_INITIALIZATION_FAILED);
-        CASE_STR(VK_ERROR_DEVICE_LOST);
-        CASE_STR(VK_ERROR_MEMORY_MAP_FAILED);
-        CASE_STR(VK_ERROR_LAYER_NOT_PRESENT);
-        CASE_STR(VK_ERROR_EXTENSION_NOT_PRESENT);
-        CASE_STR(VK_ERROR_FEATURE_NOT_PRESENT);
-        CASE_STR(VK_ERROR_INCOMPATIBLE_DRIVER);
-        CASE_STR(VK_ERROR_TOO_MANY_OBJECTS);
-        CASE_STR(VK_ERROR_FORMAT_NOT_SUPPORTED);
-        CASE_STR(VK_ERROR_FRAGMENTED_POOL);
-        CASE_STR(VK_ERROR_UNKNOWN);
-#ifdef VK_VERSION_1_1
-        CASE_STR(VK_ERROR_OUT_OF_POOL_MEMORY);
-        CASE_STR(VK_ERROR_INVALID_EXTERNAL_HANDLE);
-#endif
-#ifdef VK_VERSION_1_2
-        CASE_STR(VK_ERROR_FRAGMENTATION);
-        CASE_STR(VK_ERROR_INVALID_OPAQUE_CAPTURE_ADDRESS);
-#endif
-#ifndef VK_VERSION_1_3
-        CASE_STR(VK_PIPELINE_COMPILE_REQUIRED);
-#endif
-        default: return "UNKNOWN";
-    }
+    printf("Usage: %s [-n render count] [-f frames in flight] [-o text|raw|npy|pgm] "
+           "[-d device] [-a] [-t] "
+           "[-j recording threads] [-c draws] [-r] [-k instances] [-l] [-s poses] [-m] [-g] "
+           "[-i mesh.obj|mesh.ply] [-v float32|float16] [-z near:far] [-b bins] [-q] [-p] "
+           "[WIDTHxHEIGHT ...]\n",
+           program);
 }
 
 
-const char*
-formatString(VkFormat format) {
-    switch (format) {
-        CASE_STR(VK_FORMAT_D16_UNORM);
-        CASE_STR(VK_FORMAT_D16_UNORM_S8_UINT);
-        CASE_STR(VK_FORMAT_D24_UNORM_S8_UINT);
-        CASE_STR(VK_FORMAT_D32_SFLOAT);
-        CASE_STR(VK_FORMAT_D32_SFLOAT_S8_UINT);
-        default: return "UNKNOWN";
+/// Column-major matrices of `poseCount` cameras evenly spread from -60 to +60 degrees around
+/// the y axis. The rotated triangle is pushed back by 0.5 to keep its depth within [0, 1].
+static float*
+sweepPoses(uint32_t poseCount)
+{
+    float* poses = (float*) calloc((size_t) poseCount * 16, sizeof(float));
+    if (poses == NULL)
+    {
+        return NULL;
     }
-}
-
-
-uint32_t
-formatSize(VkFormat format) {
-    switch (format) {
-        case VK_FORMAT_D16_UNORM:          return 2;
-        case VK_FORMAT_D16_UNORM_S8_UINT:  return 3;
-        case VK_FORMAT_D24_UNORM_S8_UINT:  return 4;
-        case VK_FORMAT_D32_SFLOAT:         return 4;
-        case VK_FORMAT_D32_SFLOAT_S8_UINT: return 5;
-        default: return 0;
+    const float maxAngle = 60.0f * 3.14159265f / 180.0f;
+    for (uint32_t i = 0; i < poseCount; ++i)
+    {
+        float angle = poseCount > 1 ? maxAngle * (2.0f * i / (poseCount - 1) - 1.0f) : 0.0f;
+        float* pose = &poses[16 * i];
+        pose[0] = cosf(angle);
+        pose[2] = -sinf(angle);
+        pose[5] = 1.0f;
+        pose[8] = sinf(angle);
+        pose[10] = cosf(angle);
+        pose[14] = 0.5f;
+        pose[15] = 1.0f;
     }
+    return poses;
 }
 
 
-int main()
+/// Column-major model matrices of `instanceCount` instances, scaled down to the cells of the
+/// smallest square grid that holds them all, filled row by row.
+static float*
+gridInstances(uint32_t instanceCount)
 {
-    const uint32_t pixelCount = IMAGE_WIDTH * IMAGE_HEIGHT;
-
-    /// Sometimes we need a variable in order to do several checks on it.
-    /// For convenience we create one that we use throughout the whole function.
-    VkResult code;
-
-
-    ////////////////////////////////////
-    ////////// PART 1 | Setup //////////
-    ////////////////////////////////////
-
-
-    /// First step is to create an instance object.
-    /// Here we can specify global stuff such as info about our application,
-    /// which validation layers and extensions that we want to load, etc.
-    /// The instance object is an opaque handle, which will be used to get physical devices.
-    ///
-    /// We create the `VkInstance` by passing a `VkInstanceCreateInfo` to `vkCreateInstance`.
-    /// Note that there is a corresponding `vkDestroyInstance` at the end of the program.
-    /// This pattern is fundamental in Vulkan, the lifetime of all opaque
-    /// objects follows this
-    ///
-    ///     1. Construct a `Vk...CreateInfo` object, where `...` is a
-    ///        placeholder for the type we are going to create
-    ///     2. Call `vkCreate...` to create the object.
-    ///     3. Call `vkDestroy...` when the object is not needed anymore.
-    ///
-    /// where the destruction usually happen in reverse order of creation.
-    ///
-    /// For this program we only specify the application info, which is minimal.
-    /// The application info is used for things like telling Vulkan what API version we expect
-    /// and telling GPU vendors about our application.
-    /// The latter usage can be used for application specific optimizations by a vendor,
-    /// say for a game engine or a game title.
-    ///
-    /// Note that we have to explicitly set the type of the application info structure.
-    /// That seems like a common point of error, and setting this wrong indeed leads to
-    /// undefined behaviour. The reason why the type exist is so that the drivers can
-    /// dynamically figure out types from objects passed in (reserved for advanced usage).
-    /// However, don't be afraid: validation layers in debug mode will detect this, so in
-    /// practice this is not really an issue (as long as you excercise all code paths ofc).
-    /// We use a compile time flag to select wheter we should enable validation layers or not.
-    /// There exist many validation layers, we only use the code Krhonos validation layer,
-    /// which does conformance checking against the API.
-#ifndef NDEBUG
-    const uint32_t validationLayerCount = 1;
-    const char * validationLayers[] = {
-        "VK_LAYER_KHRONOS_validation"
-    };
-#else
-    const uint32_t validationLayerCount = 0;
-    const char** validationLayers = NULL;
-#endif
-    printf("Creating instance with %d validation layers\n", validationLayerCount);
-    VkApplicationInfo appInfo = {
-        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
-        .apiVersion = VK_API_VERSION_1_0
-    };
-    VkInstanceCreateInfo instanceCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-        .pApplicationInfo = &appInfo,
-        .enabledLayerCount = validationLayerCount,
-        .ppEnabledLayerNames = validationLayers
-    };
-    VkInstance instance;
-    if (vkCreateInstance(&instanceCreateInfo, NULL, &instance) != VK_SUCCESS)
+    float* instances = (float*) calloc((size_t) instanceCount * 16, sizeof(float));
+    if (instances == NULL)
     {
-        printf("Failed to create instance\n");
-        return EXIT_FAILURE;
+        return NULL;
     }
-
-
-    /// After setting up the instance we are ready to define the device we will operate on.
-    /// In Vulkan you can handle several physical devices, and we want to pick one of them.
-    /// I am writing this on a laptop with 2 physical devices:
-    ///
-    ///   - The CPU with a software implementation of Vulkan called Lavapipe
-    ///   - The integrated graphics card
-    ///
-    /// which I can see by running `vulkaninfo | grep -A 7 VkPhysicalDeviceProperties`
-    ///
-    ///     VkPhysicalDeviceProperties:
-    ///     ---------------------------
-    ///     	apiVersion     = 4202678 (1.2.182)
-    ///     	driverVersion  = 88088582 (0x5402006)
-    ///     	vendorID       = 0x8086
-    ///     	deviceID       = 0x3ea0
-    ///     	deviceType     = PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU
-    ///     	deviceName     = Intel(R) UHD Graphics 620 (WHL GT2)
-    ///     --
-    ///     VkPhysicalDeviceProperties:
-    ///     ---------------------------
-    ///     	apiVersion     = 4198582 (1.1.182)
-    ///     	driverVersion  = 1 (0x0001)
-    ///     	vendorID       = 0x10005
-    ///     	deviceID       = 0x0000
-    ///     	deviceType     = PHYSICAL_DEVICE_TYPE_CPU
-    ///     	deviceName     = llvmpipe (LLVM 12.0.0, 256 bits)
-    ///
-    /// We want to select the graphics card as the physical device, and not the CPU.
-    /// Communication with the physical device is done through commands sent over queues.
-    /// A physical device can support a whole family of queues, each family with certain
-    /// properties, such as support for graphical, compute and transfer commands.
-    /// For each supported queue family, there can also be several queues.
-    /// We will select the first family that supports both graphics and transfer commands,
-    /// and we will only require one queue in that family.
-    ///
-    /// To select the appropriate physical device we will do the following
-    ///
-    ///     1. Enumerate all physical devices
-    ///     2. Query each physical device for properties
-    ///     3. Check the device type and select the first suitable match
-    ///
-    printf("Enumerating physical devices (maximum %d)\n", MAX_PHYSICAL_DEVICE_COUNT);
-    uint32_t physicalDeviceCount = MAX_PHYSICAL_DEVICE_COUNT;
-    VkPhysicalDevice physicalDevices[MAX_PHYSICAL_DEVICE_COUNT];
-    code = vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices);
-    if (code != VK_SUCCESS)
+    uint32_t columns = 1;
+    while ((uint64_t) columns * columns < instanceCount)
     {
-        if (code == VK_INCOMPLETE) {
-            printf("There are more than MAX_PHYSICAL_DEVICE_COUNT physical devices available,"
-                   " consider recompiling with a different value\n");
-        }
-        else {
-            printf("Failed to enumerate physical devices, code: %d\n", code);
-            return EXIT_FAILURE;
-        }
+        columns++;
     }
-    printf("%d physical devices available\n", physicalDeviceCount);
-    if (physicalDeviceCount == 0)
+    float scale = 1.0f / columns;
+    for (uint32_t i = 0; i < instanceCount; ++i)
     {
-        printf("Found no physical device\n");
-        return EXIT_FAILURE;
+        float* instance = &instances[16 * i];
+        instance[0] = scale;
+        instance[5] = scale;
+        instance[10] = 1.0f;
+        instance[12] = scale * (2.0f * (i % columns) + 1.0f) - 1.0f;
+        instance[13] = scale * (2.0f * (i / columns) + 1.0f) - 1.0f;
+        instance[15] = 1.0f;
     }
+    return instances;
+}
 
 
-    /// We have enumerated all physical devices, now it is time to pick the most suitable one.
-    /// We want to know the index of the best physical device among all physical devices.
-    /// We also want to know the queue family index for that physical device.
-    printf("Selecting a suitable physical device\n");
-    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-    VkPhysicalDeviceProperties physicalDeviceProperties;
-    uint32_t deviceIndex = 0;
-    uint32_t queueFamilyIndex = 0;
-    for (deviceIndex = 0; deviceIndex < physicalDeviceCount; ++deviceIndex)
-    {
-        physicalDevice = physicalDevices[deviceIndex];
-        vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
-        if (!(physicalDeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU ||
-              physicalDeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU))
-        {
-            printf("Physical device %d is not a GPU\n", deviceIndex);
-            continue;
-        }
-
-        VkQueueFamilyProperties queueFamilyProperties[MAX_PHYSICAL_DEVICE_QUEUE_FAMILIES];
-        uint32_t queueFamilyCount = MAX_PHYSICAL_DEVICE_QUEUE_FAMILIES;
-        vkGetPhysicalDeviceQueueFamilyProperties(
-            physicalDevice, &queueFamilyCount, queueFamilyProperties
-        );
-        for (queueFamilyIndex = 0; queueFamilyIndex < queueFamilyCount ; ++queueFamilyIndex)
-        {
-            VkQueueFlags flags = queueFamilyProperties[queueFamilyIndex].queueFlags;
-            if ((flags & VK_QUEUE_GRAPHICS_BIT) && (flags & VK_QUEUE_TRANSFER_BIT)) {
-                break;
-            }
-        }
-        if (queueFamilyIndex == queueFamilyCount)
+/// Print the depth statistics of a render, with the histogram bins that are not empty.
+static void
+printStatistics(const RenderStatistics* statistics)
+{
+    printf("Covered %lu of %lu pixels, depth min %.6f, max %.6f, mean %.6f\n",
+           (unsigned long) statistics->coveredCount,
+           (unsigned long) statistics->pixelCount,
+           statistics->minDepth,
+           statistics->maxDepth,
+           statistics->meanDepth);
+    float binWidth = (statistics->histogramMax - statistics->histogramMin) /
+                     statistics->binCount;
+    for (uint32_t i = 0; i < statistics->binCount; ++i)
+    {
+        if (statistics->histogram[i] > 0)
         {
-            printf("Found no suitable queue family for physical device %d\n", deviceIndex);
-            continue;
+            printf("    [%.6f, %.6f) %u\n",
+                   statistics->histogramMin + i * binWidth,
+                   statistics->histogramMin + (i + 1) * binWidth,
+                   statistics->histogram[i]);
         }
-
-        break;
-    }
-    if (deviceIndex == physicalDeviceCount)
-    {
-        printf("Failed to find a suitable physical device\n");
-        return EXIT_FAILURE;
     }
-    printf("Selected physical device: %s\n", physicalDeviceProperties.deviceName);
-
-
-    /// When we have found a suitable physical device we are ready to create a (logical)
-    /// device from it. The logical device is an abstraction of a physical device with
-    /// specified queues. It owns all the queues it creates, and we can get a queue from it
-    /// after creating the device.
-    /// In advanced setups, logical devices can encompass several physical devices
-    /// (assuming they belong to the same device group that can share memory and queues etc).
-    /// We need to specify a queue priority, which is arbitrarily set to 1 since we are only
-    /// going to use one queue.
-    printf("Creating device\n");
-    float queuePriority = 1;
-    VkDeviceQueueCreateInfo queueCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-        .queueFamilyIndex = queueFamilyIndex,
-        .queueCount = 1,
-        .pQueuePriorities = &queuePriority
-    };
-    VkDeviceCreateInfo deviceCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .queueCreateInfoCount = 1,
-        .pQueueCreateInfos = &queueCreateInfo,
-    };
-    VkDevice device;
-    if (vkCreateDevice(physicalDevice, &deviceCreateInfo, NULL, &device) != VK_SUCCESS)
-    {
-        printf("Failed to create logical device\n");
-        return EXIT_FAILURE;
-    }
-    VkQueue queue;
-    vkGetDeviceQueue(device, queueFamilyIndex, 0, &queue);
-
-
-    ////////////////////////////////////
-    ////////// PART 2 | Resources //////
-    ////////////////////////////////////
-
+}
 
-    /// Next step is to allocate resources for the image we will render to, as well as a pixel
-    /// readback buffer. Vulkan distinguish images, buffers, memory and views.
-    /// In Vulkan, memory can be allocated on different physical devices, on different heaps
-    /// of different memory types. The memory type becomes important when you want to transfer
-    /// data between device and host, for example. You will never (to my knowledge) operate
-    /// directly on memory, but through buffers and images or other memory like objects.
-    /// Buffers are simple memory objects. They add the functionality of belonging to a queue,
-    /// having a usage flag etc. Several buffers can share memory, they can even overlap,
-    /// which also should highlight why it is good to differ between raw memory and the buffer
-    /// that lies on top of it.
-    /// Images are more advanced than buffers. While buffers represent linear memory, images
-    /// support several features optimized for graphics such as formats, mipmaps, layers, and
-    /// multisampling. Images can also be (and usually are) tiled, which makes them more
-    /// efficient than buffers for image like access patterns.
-    /// Images also have something called a layout which specifies what kind of operation they
-    /// are optimized for. You want to specify a certain layout when rendering, and then
-    /// transition it to another layout before transferring.
-    /// Finally there are views, which specify a subset of the underlying resource to access.
-    /// This is what eventually will go into the framebuffer.
-    ///
-    /// Ok, what resources do we need?
-    /// We need an image + image memory + image view for the render target.
-    /// We will also need a buffer that we can transfer the image to after rendering to it.
-    /// Having the rendered content in a buffer allows us to memory map it back on the host.
 
-    /// Let us create the image for storing the rendered depth.
-    /// We select 24 bit depth and a 8 bit stencil component format, and specify that the
-    /// image will be used as a depth/stencil attachment and as a source for a transfer
-    /// operation.
-    /// We specify that the image will not be shared between different queue families by
-    /// setting share mode to VK_SHARING_MODE_EXCLUSIVE.
-    /// We specify the initial layout as undefined. We can also specify it as pre-initialized,
-    /// but then we need to initialize it manually. Other settings are boilerplate for now.
-    /// The image needs separately allocated memory.
-    printf("Creating image\n");
-    VkExtent3D imageExtent = {
-        .width = IMAGE_WIDTH,
-        .height = IMAGE_HEIGHT,
-        .depth = 1
-    };
-    VkImageCreateInfo imageCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-        .imageType = VK_IMAGE_TYPE_2D,
-        .format = VK_FORMAT_D24_UNORM_S8_UINT,
-        .extent = imageExtent,
-        .mipLevels = 1,
-        .arrayLayers = 1,
-        .samples = VK_SAMPLE_COUNT_1_BIT,
-        .tiling = VK_IMAGE_TILING_OPTIMAL,
-        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        .queueFamilyIndexCount = 1,
-        .pQueueFamilyIndices = &queueFamilyIndex,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
-    };
-    VkImage image;
-    if ((code = vkCreateImage(device, &imageCreateInfo, NULL, &image)) != VK_SUCCESS)
+/// Render on a single device, `renderCount` renders cycling through `requests`. The depth of
+/// the last render ends up in `depthData`, `*request` points at its request. With depth
+/// statistics, those of the last render are printed.
+static int
+renderOnDevice(const RenderConfig* config,
+               const RenderRequest* requests,
+               uint32_t requestCount,
+               uint32_t renderCount,
+               float* depthData,
+               const RenderRequest** request)
+{
+    struct timespec initStart, initEnd, renderEnd;
+    clock_gettime(CLOCK_MONOTONIC, &initStart);
+    RenderContext context;
+    if (renderContextInit(&context, config) != EXIT_SUCCESS)
     {
-        printf("Failed to create image: %s\n", resultString(code));
+        renderContextShutdown(&context);
         return EXIT_FAILURE;
     }
+    clock_gettime(CLOCK_MONOTONIC, &initEnd);
 
-    /// With an image object we can query for which memory type we want to use for it.
-    /// Every image can be queried for its memory requirements, which we then can compare with
-    /// the memory properties provided by the physical device.
-    /// We created the image using the device, so it knows what memory types are available.
-    /// The memory types that the image can use is provided by a bitmask.
-    /// If the bit at position `i` is set, then memory type `i` is compatible with the image
-    /// memory requirements. This leads to some bit-shifting logic beneath.
-    /// We require that the image memory have the DEVICE_LOCAL bit set, which means that
-    /// accesses to the image will be made on the device (which is optimal for rendering).
-    VkMemoryRequirements imageMemoryRequirements;
-    vkGetImageMemoryRequirements(device, image, &imageMemoryRequirements);
-    VkPhysicalDeviceMemoryProperties deviceMemoryProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &deviceMemoryProperties);
-    VkMemoryPropertyFlags imageMemoryProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-    uint32_t memoryTypeCount = deviceMemoryProperties.memoryTypeCount;
-    uint32_t memoryTypeIndex;
-    for (memoryTypeIndex = 0; memoryTypeIndex < memoryTypeCount; ++memoryTypeIndex)
+    /// Render `i` goes to frame `i % framesInFlight`, which is also the order in which the
+    /// context hands out frames. Before a frame is reused, its previous render is collected,
+    /// so there are at most framesInFlight renders on the device at any time.
+    uint32_t frameIndices[MAX_FRAMES_IN_FLIGHT];
+    RenderStatistics statistics;
+    int status = EXIT_SUCCESS;
+    for (uint32_t i = 0; i < renderCount + config->framesInFlight && status == EXIT_SUCCESS; ++i)
     {
-        if (imageMemoryRequirements.memoryTypeBits & (1 << memoryTypeIndex))
+        if (i >= config->framesInFlight)
         {
-            VkMemoryType memoryType = deviceMemoryProperties.memoryTypes[memoryTypeIndex];
-            if ((memoryType.propertyFlags & imageMemoryProperties) == imageMemoryProperties) {
-                break;
+            uint32_t collected = i - config->framesInFlight;
+            uint32_t frameIndex = frameIndices[collected % config->framesInFlight];
+            *request = &requests[collected % requestCount];
+            status = renderContextCollectStatistics(
+                &context,
+                frameIndex,
+                depthData,
+                context.depthStatistics ? &statistics : NULL);
+            if (status == EXIT_SUCCESS && context.profiling)
+            {
+                gpuProfilerPrintFrame(collected, &context.frameTimings);
             }
         }
+        if (i < renderCount && status == EXIT_SUCCESS)
+        {
+            status = renderContextSubmit(&context,
+                                         &requests[i % requestCount],
+                                         &frameIndices[i % config->framesInFlight]);
+        }
     }
-    if (memoryTypeIndex == deviceMemoryProperties.memoryTypeCount)
-    {
-        printf("Failed to find suitable device memory matching image memory requirements\n");
-        return EXIT_FAILURE;
-    }
-
-    printf("Allocating image memory\n");
-    VkMemoryAllocateInfo imageAllocateInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = imageMemoryRequirements.size,
-        .memoryTypeIndex = memoryTypeIndex
-    };
-    VkDeviceMemory imageMemory;
-    if (vkAllocateMemory(device, &imageAllocateInfo, NULL, &imageMemory) != VK_SUCCESS)
-    {
-        printf("Failed to allocate image memory\n");
-        return EXIT_FAILURE;
-    }
-
-    printf("Binding image memory\n");
-    if (vkBindImageMemory(device, image, imageMemory, 0) != VK_SUCCESS)
+    if (status != EXIT_SUCCESS)
     {
-        printf("Failed to bind image to image memory\n");
+        renderContextShutdown(&context);
         return EXIT_FAILURE;
     }
+    clock_gettime(CLOCK_MONOTONIC, &renderEnd);
 
-    /// We create an image view by specifying which mip level and array layer of the image
-    /// that we want to access. We also specify which "aspects" of an image we want to access.
-    /// In our case, we want to view both the depth and the stencil part of the image, so we
-    /// "or" those to apsects together.
-    /// Note that we need to specify that we want a 2D image view again.
-    /// The component mapping can be used to "swizzle" around the components of each pixel.
-    /// Usually this is assigned a 4-tuple of "swizzle identity".
-    /// Setting the format to something different than the format of the image can be used to
-    /// reinterpret the image components.
-    printf("Creating image view\n");
-    VkImageSubresourceRange imageSubresourceRange = {
-        .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
-        .baseMipLevel = 0,
-        .levelCount = 1,
-        .baseArrayLayer = 0,
-        .layerCount = 1
-    };
-    VkImageViewCreateInfo imageViewCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-        .image = image,
-        .viewType = VK_IMAGE_VIEW_TYPE_2D,
-        .format = imageCreateInfo.format,
-        .components = { VK_COMPONENT_SWIZZLE_IDENTITY,
-                        VK_COMPONENT_SWIZZLE_IDENTITY,
-                        VK_COMPONENT_SWIZZLE_IDENTITY,
-                        VK_COMPONENT_SWIZZLE_IDENTITY },
-        .subresourceRange = imageSubresourceRange
-    };
-    VkImageView imageView;
-    if (vkCreateImageView(device, &imageViewCreateInfo, NULL, &imageView) != VK_SUCCESS)
+    double renderMilliseconds = elapsedMilliseconds(&initEnd, &renderEnd);
+    printf("Setup took %.3f ms, %u renders took %.3f ms (%.3f ms per render)\n",
+           elapsedMilliseconds(&initStart, &initEnd),
+           renderCount,
+           renderMilliseconds,
+           renderMilliseconds / renderCount);
+    printf("%u frames in flight: %.1f frames/s\n",
+           config->framesInFlight,
+           1e3 * renderCount / renderMilliseconds);
+    printf("Recorded command buffers for %lu of %u renders, %.3f ms per render\n",
+           (unsigned long) context.recordedCount,
+           renderCount,
+           context.recordMilliseconds / renderCount);
+    if (context.depthStatistics)
     {
-        printf("Failed to create image view\n");
-        return EXIT_FAILURE;
+        printStatistics(&statistics);
     }
 
+    renderContextShutdown(&context);
+    return EXIT_SUCCESS;
+}
 
-    /// Now we have defined the image, memory and view for the render target.
-    /// We also need a buffer which we can read back the rendered data to the host with.
-    /// The procedure for allocating a suitable memory for the buffer is similar to images.
-    /// We require that the buffer memory have the HOST_VISIBLE and HOST_COHERENT bits set.
-    /// HOST_VISIBLE means that the memory can be mapped to host memory.
-    /// HOST_COHERENT means that device writes to the memory will be visible to the host
-    /// without extra flushing commands.
-    /// Note the slight inconsistency in the naming conventions here. Memory visibility is a
-    /// concept in Vulkan related to synchronization of commands, which is what the
-    /// HOST_COHERENT bit addresses.
-    /// Since we know that the memory layout will be linear for a buffer we can also calculate
-    /// how much memory we need to allocate from the image format and size.
-    /// We will also specify that the buffer will be used as a destination of a transfer
-    /// operation.
-    printf("Creating image pixel read back buffer\n");
-    VkBuffer pixelReadbackBuffer;
-    VkDeviceSize pixelReadbackBufferSize = formatSize(imageCreateInfo.format) * pixelCount;
-    if (pixelReadbackBufferSize == 0)
-    {
-        printf("Failed to estimate byte size of image format: %s\n",
-               formatString(imageCreateInfo.format));
-        return EXIT_FAILURE;
-    }
-    VkBufferCreateInfo pixelReadbackBufferCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-        .size = pixelReadbackBufferSize,
-        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-        .queueFamilyIndexCount = 1,
-        .pQueueFamilyIndices = &queueFamilyIndex
-    };
-    code = vkCreateBuffer(device, &pixelReadbackBufferCreateInfo, NULL, &pixelReadbackBuffer);
-    if (code != VK_SUCCESS)
-    {
-        printf("Failed to create pixel readback buffer\n");
-        return EXIT_FAILURE;
-    }
-
-    VkMemoryRequirements pixelReadbackBufferMemoryRequirements;
-    vkGetBufferMemoryRequirements(device, pixelReadbackBuffer,
-                                  &pixelReadbackBufferMemoryRequirements);
-    VkMemoryPropertyFlags pixelReadbackBufferMemoryProperties
-        = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-        | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    for (memoryTypeIndex = 0; memoryTypeIndex < memoryTypeCount; ++memoryTypeIndex)
-    {
-        if (pixelReadbackBufferMemoryRequirements.memoryTypeBits & (1 << memoryTypeIndex))
-        {
-            VkMemoryType memoryType = deviceMemoryProperties.memoryTypes[memoryTypeIndex];
-            VkMemoryPropertyFlags matchingProperties = (
-                memoryType.propertyFlags & pixelReadbackBufferMemoryProperties
-            );
-            if (matchingProperties == pixelReadbackBufferMemoryProperties) {
-                break;
-            }
-        }
-    }
-    if (memoryTypeIndex == deviceMemoryProperties.memoryTypeCount)
-    {
-        printf("Failed to find device memory matching pixel readback memory requirements\n");
-        return EXIT_FAILURE;
-    }
 
-    printf("Allocating pixel readback buffer memory\n");
-    VkMemoryAllocateInfo pixelReadbackBufferAllocateInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = pixelReadbackBufferSize,
-        .memoryTypeIndex = memoryTypeIndex
-    };
-    VkDeviceMemory pixelReadbackBufferMemory;
-    code = vkAllocateMemory(device,
-                            &pixelReadbackBufferAllocateInfo,
-                            NULL,
-                            &pixelReadbackBufferMemory);
-    if (code != VK_SUCCESS)
-    {
-        printf("Failed to allocated pixel readback buffer memory\n");
+/// Spread the renders over every physical device, see render_scheduler.h. Only the last
+/// render is read back into `depthData`, the others are decoded into scratch memory.
+static int
+renderOnAllDevices(const RenderConfig* config,
+                   const RenderRequest* requests,
+                   uint32_t requestCount,
+                   uint32_t renderCount,
+                   float* depthData,
+                   const RenderRequest** request)
+{
+    struct timespec initStart, initEnd, renderEnd;
+    clock_gettime(CLOCK_MONOTONIC, &initStart);
+    RenderScheduler* scheduler = (RenderScheduler*) malloc(sizeof(RenderScheduler));
+    RenderJob* jobs = (RenderJob*) calloc(renderCount, sizeof(RenderJob));
+    if (scheduler == NULL || jobs == NULL)
+    {
+        printf("Failed to allocate render jobs\n");
+        free(scheduler);
+        free(jobs);
         return EXIT_FAILURE;
     }
-
-    printf("Binding image buffer to image buffer memory\n");
-    code = vkBindBufferMemory(device, pixelReadbackBuffer, pixelReadbackBufferMemory, 0);
-    if (code != VK_SUCCESS)
+    if (renderSchedulerInit(scheduler, config) != EXIT_SUCCESS)
     {
-        printf("Failed to bind image buffer to image buffer memory\n");
+        renderSchedulerShutdown(scheduler);
+        free(scheduler);
+        free(jobs);
         return EXIT_FAILURE;
     }
+    clock_gettime(CLOCK_MONOTONIC, &initEnd);
 
-
-    ////////////////////////////////////////////
-    ////////// PART 3 | Graphics Pipeline //////
-    ////////////////////////////////////////////
-
-
-    /// In order to render something, we need to define a graphics pipeline.
-    /// A graphics pipeline needs a render pass, a framebuffer, loading of shader code for the
-    /// programmable stages, and configuration of the fixed (assembly, rasterization) stages.
-    ///
-    /// Let us start with the render pass.
-    /// The render pass needs to know about the attachment it will render to, i.e. the render
-    /// targets. When describing the attachment we configure Vulkan how the render pass load
-    /// and store operations will behave. We also specify the initial and final layouts of the
-    /// render target. A render pass automatically perform image layout transitions (nice!).
-    ///
-    /// Note some code duplication here regarding format and samples. Can't that be deduced
-    /// from the image it will render into? The render pass is loosely coupled with the actual
-    /// image it will render into, the framebuffer will connect the dots later on.
-    /// The specs states that these needs to match, so specifying anything different from
-    /// those in the image is an error. Again, Vulkan puts the burden on us to make sure that
-    /// this is the case. Luckily, validation layers also detects this type of errors for us.
-    printf("Creating render pass\n");
-    VkAttachmentDescription attachmentDescription = {
-        .flags = 0,
-        .format = imageCreateInfo.format,
-        .samples = imageCreateInfo.samples,
-        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-        .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
-    };
-
-    /// A render pass is divided into subpasses. We only need one subpass for now.
-    /// We need to tell the subpass what input and output attachment it has, which are
-    /// referenced to the attachments described by the parent render pass.
-    /// We only have one output attachment (index 0).
-    /// The pipeline bind point must be set to graphics.
-    VkAttachmentReference attachmentReference = {
-        .attachment = 0,
-        .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
-    };
-    VkSubpassDescription subpassDescription = {
-        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-        .pDepthStencilAttachment = &attachmentReference
-    };
-    VkRenderPass renderPass;
-    VkRenderPassCreateInfo renderPassCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-        .attachmentCount = 1,
-        .pAttachments = &attachmentDescription,
-        .subpassCount = 1,
-        .pSubpasses = &subpassDescription
-    };
-    if (vkCreateRenderPass(device, &renderPassCreateInfo, NULL, &renderPass) != VK_SUCCESS)
+    for (uint32_t i = 0; i < renderCount; ++i)
     {
-        printf("Failed to create render pass\n");
-        return EXIT_FAILURE;
+        jobs[i].request = requests[i % requestCount];
     }
+    jobs[renderCount - 1].depthData = depthData;
+    *request = &requests[(renderCount - 1) % requestCount];
+    int status = renderSchedulerRun(scheduler, jobs, renderCount);
+    clock_gettime(CLOCK_MONOTONIC, &renderEnd);
 
-
-    /// Let us create the framebuffer.
-    /// The framebuffer connects image views as attachments for the render pass.
-    /// The framebuffer shape (width, height) need to match up with those of the image view.
-    /// The layer parameter should be 1 except in advanced use cases.
-    printf("Creating framebuffer\n");
-    VkFramebufferCreateInfo framebufferCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-        .renderPass = renderPass,
-        .attachmentCount = 1,
-        .pAttachments = &imageView,
-        .width = imageExtent.width,
-        .height = imageExtent.height,
-        .layers = 1
-    };
-    VkFramebuffer framebuffer;
-    if (vkCreateFramebuffer(device, &framebufferCreateInfo, NULL, &framebuffer) != VK_SUCCESS)
+    if (status == EXIT_SUCCESS)
     {
-        printf("Failed to create framebuffer\n");
-        return EXIT_FAILURE;
+        printf("Setup of %u devices took %.3f ms, %u renders took %.3f ms\n",
+               scheduler->workerCount,
+               elapsedMilliseconds(&initStart, &initEnd),
+               renderCount,
+               elapsedMilliseconds(&initEnd, &renderEnd));
+        renderSchedulerPrintStats(scheduler);
     }
+    renderSchedulerShutdown(scheduler);
+    free(scheduler);
+    free(jobs);
+    return status;
+}
 
 
-    /// The graphics pipeline must have at least a vertex shader in order to draw something.
-    /// In Vulkan we load pre-compiled SPIR-V files. This allows different shading languages
-    /// to be used together with Vulkan.
-    /// One thing I noted when reading the specs is that the shader code needs to be a
-    /// multiple of 4 bytes (it is defined as an array of 32 bit integers).
-    /// Most tutorials do not take this up, but unless you make sure to allocate a multiple of
-    /// 4 bytes I think that a Vulkan implementation might segfault.
-    printf("Creating vertex shader module from %s\n", VERTEX_SHADER_SOURCE_PATH);
-    if (access(VERTEX_SHADER_SOURCE_PATH, F_OK))
-    {
-        printf("Missing vertex shader code at: %s\n", VERTEX_SHADER_SOURCE_PATH);
-        return EXIT_FAILURE;
+int main(int argc, char** argv)
+{
+    uint32_t renderCount = 1;
+    RenderConfig config = { .framesInFlight = 1 };
+    DepthOutputFormat outputFormat = DEPTH_OUTPUT_TEXT;
+    int allDevices = 0;
+    uint32_t drawCount = 1;
+    uint32_t instanceCount = 1;
+    uint32_t poseCount = 1;
+    int multiview = 0;
+    uint32_t atlas = 0;
+    const char* meshPath = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "n:f:o:d:atj:c:rk:ls:mgi:v:z:b:qp")) != -1)
+    {
+        switch (option)
+        {
+        case 'n':
+            renderCount = (uint32_t) strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            config.framesInFlight = (uint32_t) strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            if (depthOutputFormatParse(optarg, &outputFormat) != EXIT_SUCCESS)
+            {
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'd':
+            config.physicalDevice = optarg;
+            break;
+        case 'a':
+            allDevices = 1;
+            break;
+        case 't':
+            config.transferQueue = 1;
+            break;
+        case 'j':
+            config.recordingThreads = (uint32_t) strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            drawCount = (uint32_t) strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            config.reuseCommandBuffers = 1;
+            break;
+        case 'k':
+            instanceCount = (uint32_t) strtoul(optarg, NULL, 10);
+            break;
+        case 'l':
+            config.culling = 1;
+            break;
+        case 's':
+            poseCount = (uint32_t) strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            multiview = 1;
+            break;
+        case 'g':
+            atlas = 1;
+            break;
+        case 'i':
+            meshPath = optarg;
+            break;
+        case 'v':
+            if (strcmp(optarg, "float32") == 0)
+            {
+                config.depthConversion = DEPTH_CONVERSION_FLOAT32;
+            }
+            else if (strcmp(optarg, "float16") == 0)
+            {
+                config.depthConversion = DEPTH_CONVERSION_FLOAT16;
+            }
+            else
+            {
+                printf("Unknown depth conversion: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'z':
+            if (sscanf(optarg, "%f:%f", &config.nearPlane, &config.farPlane) != 2)
+            {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'b':
+            config.depthStatistics = 1;
+            config.histogramBinCount = (uint32_t) strtoul(optarg, NULL, 10);
+            break;
+        case 'q':
+            config.statisticsOnly = 1;
+            break;
+        case 'p':
+            config.profile = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
     }
-    FILE* vertexShaderFile = fopen(VERTEX_SHADER_SOURCE_PATH, "r");
-    fseek(vertexShaderFile, 0, SEEK_END);
-    size_t vertexShaderCodeSize = ftell(vertexShaderFile);
-    rewind(vertexShaderFile);
-    uint32_t* vertexShaderCode = (uint32_t*) malloc(1 + 4 * (vertexShaderCodeSize / 4));
-    size_t bytesRead = fread(vertexShaderCode, 1, vertexShaderCodeSize, vertexShaderFile);
-    if (bytesRead != vertexShaderCodeSize)
+    if (renderCount == 0 || instanceCount == 0 || poseCount == 0 ||
+        (config.farPlane > 0.0f && config.depthConversion == DEPTH_CONVERSION_NONE &&
+         !config.depthStatistics && !config.statisticsOnly))
     {
-        printf("Failed to read shader code\n");
+        usage(argv[0]);
         return EXIT_FAILURE;
     }
-    VkShaderModuleCreateInfo vertexShaderCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        .codeSize = vertexShaderCodeSize,
-        .pCode = vertexShaderCode
-    };
-    fclose(vertexShaderFile);
-    VkShaderModule vertexShaderModule;
-    code = vkCreateShaderModule(device, &vertexShaderCreateInfo, NULL, &vertexShaderModule);
-    if (code != VK_SUCCESS)
+    config.multiviewCount = multiview ? poseCount : 0;
+    LoadedMesh loadedMesh = {0};
+    if (meshPath != NULL)
     {
-        printf("Failed to create vertex shader module\n");
-        return EXIT_FAILURE;
-    }
-    free(vertexShaderCode);
-
-
-    /// Now we are ready to setup the graphics pipeline.
-    /// We do this by describing the pipeline programmable (shader) stages, the pipeline fixed
-    /// (assembly, rasterization, etc.) stages, the viewport, and the render pass to use.
-    printf("Creating graphics pipeline\n");
-    VkPipelineShaderStageCreateInfo pipelineShaderStageCreateInfos[] = {
+        struct timespec loadStart, loadEnd;
+        clock_gettime(CLOCK_MONOTONIC, &loadStart);
+        if (meshLoaderLoad(meshPath, 0, &loadedMesh) != EXIT_SUCCESS)
         {
-            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            .stage = VK_SHADER_STAGE_VERTEX_BIT,
-            .module = vertexShaderModule,
-            .pName = "main"
+            return EXIT_FAILURE;
         }
-    };
-    VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-    };
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
-    };
-    VkViewport viewport = {
-        .width = IMAGE_WIDTH,
-        .height = IMAGE_HEIGHT,
-        .minDepth = 0.0f,
-        .maxDepth = 1.0f
-    };
-    VkRect2D scissor = {
-        .extent = { IMAGE_WIDTH, IMAGE_HEIGHT }
-    };
-    VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-        .viewportCount = 1,
-        .pViewports = &viewport,
-        .scissorCount = 1,
-        .pScissors = &scissor
-    };
-    VkPipelineRasterizationStateCreateInfo pipelineRasterizationStateCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-        .polygonMode = VK_POLYGON_MODE_FILL,
-        .lineWidth = 1.0f
-    };
-    VkPipelineDepthStencilStateCreateInfo pipelineDepthStencilStateCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
-        .depthTestEnable = VK_TRUE,
-        .depthWriteEnable = VK_TRUE,
-        .depthCompareOp = VK_COMPARE_OP_LESS
-    };
-    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO
-    };
-    VkPipelineLayout pipelineLayout;
-    code = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, NULL, &pipelineLayout);
-    if (code != VK_SUCCESS)
-    {
-        printf("Failed to create pipeline layout\n");
-        return EXIT_FAILURE;
+        clock_gettime(CLOCK_MONOTONIC, &loadEnd);
+        loadedMesh.mesh.id = 1;
+        printf("Loaded %s with %u vertices and %u triangles in %.3f ms\n",
+               meshPath, loadedMesh.mesh.vertexCount, loadedMesh.mesh.indexCount / 3,
+               elapsedMilliseconds(&loadStart, &loadEnd));
     }
-
-    VkPipelineMultisampleStateCreateInfo pipelineMultisampleCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT
-    };
-
-    VkGraphicsPipelineCreateInfo graphicsPipelineCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-        .stageCount = 1,
-        .pStages = pipelineShaderStageCreateInfos,
-        .pVertexInputState = &vertexInputStateCreateInfo,
-        .pInputAssemblyState = &inputAssemblyStateCreateInfo,
-        .pViewportState = &viewportStateCreateInfo,
-        .pRasterizationState = &pipelineRasterizationStateCreateInfo,
-        .pMultisampleState = &pipelineMultisampleCreateInfo,
-        .pDepthStencilState = &pipelineDepthStencilStateCreateInfo,
-        .layout = pipelineLayout,
-        .renderPass = renderPass
-    };
-    VkPipeline graphicsPipeline;
-    code = vkCreateGraphicsPipelines(
-        device, VK_NULL_HANDLE, 1, &graphicsPipelineCreateInfo, NULL, &graphicsPipeline
-    );
-    if (code != VK_SUCCESS)
+    float* poses = NULL;
+    float* instances = NULL;
+    if (poseCount > 1)
     {
-        printf("Failed to create graphics pipeline\n");
-        return EXIT_FAILURE;
+        poses = sweepPoses(poseCount);
     }
-
-
-    ////////////////////////////////////////////
-    ////////// STEP 4 | Command buffers ////////
-    ////////////////////////////////////////////
-
-    /// Vulkan communicate with the device using commands send over the queue.
-    /// It is inefficient to send one command at a time, so we will record the commands we
-    /// want to perform in a command buffer and send it over once.
-    /// Before we can create a command buffer, we need to create a command pool. The commands
-    /// recorded in a command buffer must be compatible with the family of the queue they are
-    /// sent over. The command pool is like a factory for command buffers, they are connected
-    /// to a specific queue family on our device. Command pools let us record command buffers
-    /// in parallel in separate threads, with one pool per thread. Using a command pool also
-    /// makes allocating new command buffers more efficient that it would be allocating them
-    /// in isolation.
-    /// We create the command pool with the VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-    /// which will make sure that command buffers alloacted from the pool are put into a good
-    /// initial state if they are re-used.
-    printf("Creating command pool\n");
-    VkCommandPoolCreateInfo commandPoolCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-        .queueFamilyIndex = queueFamilyIndex
-    };
-    VkCommandPool commandPool;
-    if (vkCreateCommandPool(device, &commandPoolCreateInfo, NULL, &commandPool) != VK_SUCCESS)
+    if (instanceCount > 1)
     {
-        printf("Failed to create command pool\n");
-        return EXIT_FAILURE;
+        instances = gridInstances(instanceCount);
     }
-
-    /// With a command pool we can create a command buffer from it.
-    /// To create the command buffer we specify a command pool at a certain level.
-    /// There are two command buffer levels in Vulkan: primary and secondary.
-    /// Primary level command buffers can be submitted to queues, while secondary are called
-    /// from primary commands (advanced usage).
-    /// When the command buffer is allocated, it is put into "initial state". Operations on
-    /// command buffers act like a state machine and transitions the command buffer state.
-    printf("Allocating command buffer\n");
-    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = commandPool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1
-    };
-    VkCommandBuffer commandBuffer;
-    if (vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &commandBuffer) != VK_SUCCESS)
+    if ((poseCount > 1 && poses == NULL) || (instanceCount > 1 && instances == NULL))
     {
-        printf("Failed to allocate command buffer\n");
+        printf("Failed to allocate camera poses and instances\n");
+        free(poses);
+        free(instances);
+        meshLoaderFree(&loadedMesh);
         return EXIT_FAILURE;
     }
 
-    /// Let us record some commands for execution into the allocated command buffer.
-    /// This is the first time we are actually going "to do something", everything else up to
-    /// this point is setup code. This will put the command buffer into "recording state".
-    /// There exist several families of commands that can be recorded in a command buffer:
-    /// action, state, synchronization and launch commands. For action commands we will begin
-    /// a render pass, bind the graphics pipeline and draw our triangle. For synchronization
-    /// we will make an image layout transition so that we can transfer it to our pixel
-    /// readback buffer.
-    /// The VK_SUBPASS_CONTENTS_INLINE specify how we provide contents to the subpass, which
-    /// can either be done through recording to a primary command buffer "inline" (as belong)
-    /// or inderectly through secondary command buffers (advanced).
-    printf("Recording command buffer\n");
-    VkCommandBufferBeginInfo commandBufferBeginInfo = {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO
-    };
-    vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
-    VkClearValue clearValue = { .depthStencil = {1.0f, 0} };
-    VkRenderPassBeginInfo renderPassBeginInfo = {
-        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-        .renderPass = renderPass,
-        .framebuffer = framebuffer,
-        .renderArea = { { 0, 0 }, { scissor.extent.width, scissor.extent.height } },
-        .clearValueCount = 1,
-        .pClearValues = &clearValue
-    };
-    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-    vkCmdDraw(commandBuffer, 3, 1, 0, 0);
-    vkCmdEndRenderPass(commandBuffer);
-
-    /// Efter the render pass we want to change the image layout from the optimal layout for
-    /// depth/stencil attachment to something better as a source for a transfer operation.
-    /// We do that using an image memory barrier to synchronize access before and after the
-    /// layout transition. The memory barrier will modify the layout of the image in-place.
-    /// Note that this can also be expressed using render subpass dependencies, which is
-    /// probably more efficient if we are using more than one subpass.
-    /// We specify the "access scope" before the layout transition as those operations that
-    /// writes to the depth/stencil attachment. We specify the access scope after the
-    /// transition as those operations that do a transfer read. An access scope means what
-    /// kind of memory operations will be made before and after a synchronization command.
-    /// To really understand access scopes I recommend reading the chapter regarding
-    /// synchronization in the spec.
-    VkImageMemoryBarrier imageMemoryBarrier = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-        .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
-        .oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-        .srcQueueFamilyIndex = queueFamilyIndex,
-        .dstQueueFamilyIndex = queueFamilyIndex,
-        .image = image,
-        .subresourceRange = imageSubresourceRange
-    };
-    /// We also need to specify a "synchronization scope", which means which type of
-    /// operations need to happen before and happen after the barrier.
-    /// We specify the VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT as the prior scope (i.e. the
-    /// stage that access the depth/stencil buffer) and the VK_PIPELINE_STAGE_TRANSFER_BIT as
-    /// the posterior scope (i.e. the transfer command we want to do after the barrier).
-    /// Can can also use VkDependencyInfo + vkCmdPipelineBarrier2, which separates
-    /// configuration and function call a bit, as well as allowing more fine grained control.
-    /// We specify that the execution and memory dependencies are "framebuffer local" by
-    /// setting the VK_DEPENDENCY_BY_REGION_BIT, allowing some optimizations to be made.
-    vkCmdPipelineBarrier(commandBuffer,
-                         VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-                         VK_PIPELINE_STAGE_TRANSFER_BIT,
-                         VK_DEPENDENCY_BY_REGION_BIT,
-                         0, NULL,
-                         0, NULL,
-                         1, &imageMemoryBarrier);
-
-    /// Now the image layout is optimized for transfer and we copy it to the pixel readback
-    /// buffer. We can only copy one aspect of an image at time. Reading the specs on
-    /// VkBufferImageCopy (https://devdocs.io/vulkan/index#VkBufferImageCopy) tells us that
-    /// the depth/stencil format we have choosen can be treated as packed into 32-bit texels.
-    /// Hence, what we actually copy is both the depth and stencil aspects. Note that if we
-    /// defined the format as VK_FORMAT_D32_SFLOAT_S8_UINT, then the stencil part would be
-    /// dropped. The expected behaviour needs to be understood on a format by format basis.
-    /// Keep in mind that these rules apply for an image to buffer copy. Memory mapping an
-    /// image directly is not possible with our texel format, which is opaque by the spec.
-    /// Implementors are free to store the depth and stencil components in separate planes,
-    /// for example, and there are no guarantees on the byte packing.
-    /// Hence, copying the image to a buffer is a safe choice.
-    VkBufferImageCopy imageRegion = {
-        .imageSubresource = {
-            .aspectMask     = VK_IMAGE_ASPECT_DEPTH_BIT,
-            .mipLevel       = imageSubresourceRange.baseMipLevel,
-            .baseArrayLayer = imageSubresourceRange.baseArrayLayer,
-            .layerCount     = imageSubresourceRange.levelCount
-        },
-        .imageExtent = imageExtent
+    RenderRequest requests[MAX_RESOLUTION_COUNT] = {
+        {
+            .width = IMAGE_WIDTH,
+            .height = IMAGE_HEIGHT,
+            .mesh = meshPath != NULL ? &loadedMesh.mesh : NULL,
+            .drawCount = drawCount,
+            .instanceCount = instanceCount,
+            .instances = instances,
+            .layerCount = poseCount,
+            .poses = poses,
+            .atlas = atlas
+        }
     };
-    vkCmdCopyImageToBuffer(commandBuffer,
-                           image,
-                           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                           pixelReadbackBuffer,
-                           1, &imageRegion);
-
-    /// Finish the recording of the command buffer. This will put the command buffer into
-    /// "executable state", that is, we can submit it for execution.
-    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+    uint32_t requestCount = 1;
+    if (optind < argc)
     {
-        printf("Failed to end recording of command buffer\n");
-        return EXIT_FAILURE;
+        requestCount = 0;
+        for (int i = optind; i < argc && requestCount < MAX_RESOLUTION_COUNT; ++i)
+        {
+            RenderRequest* request = &requests[requestCount++];
+            request->mesh = requests[0].mesh;
+            request->drawCount = drawCount;
+            request->instanceCount = instanceCount;
+            request->instances = instances;
+            request->layerCount = poseCount;
+            request->poses = poses;
+            request->atlas = atlas;
+            if (sscanf(argv[i], "%ux%u", &request->width, &request->height) != 2)
+            {
+                printf("Invalid resolution %s, expected WIDTHxHEIGHT\n", argv[i]);
+                free(poses);
+                free(instances);
+                meshLoaderFree(&loadedMesh);
+                return EXIT_FAILURE;
+            }
+        }
     }
-
-    /// Now it is time to submit the recorded command buffer to the queue and execute the
-    /// graphics pipeline. Submitting the command buffer will put it into "pending state".
-    /// Depending on how the command buffer was created, it will be put back into either
-    /// "executable" or "invalid" state upon completion. Note that you can't check the state
-    /// of the command buffer, in particular there is no "executing" state.
-    /// We will also create a fence object so that we know when the command has finished
-    /// executing. The way we use the fence here is equivalent to using vkQueueWaitIdle, but
-    /// we use fences here for demonstration purposes. When creating the device we made sure
-    /// to get a queue from a family supporting both graphics and transfer operations.
-    /// A more efficient and portable solutions is to get two separate queues and synchronize
-    /// them using semaphores.
-    VkFenceCreateInfo fenceCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO
-    };
-    VkFence fence;
-    if (vkCreateFence(device, &fenceCreateInfo, NULL, &fence) != VK_SUCCESS)
+    /// A sweep of large renders easily has more pixels than fit in 32 bits.
+    uint64_t maxPixelCount = 0;
+    for (uint32_t i = 0; i < requestCount; ++i)
     {
-        printf("Failed to create fence\n");
-        return EXIT_FAILURE;
+        uint64_t pixelCount = (uint64_t) requests[i].width * requests[i].height * poseCount;
+        maxPixelCount = pixelCount > maxPixelCount ? pixelCount : maxPixelCount;
     }
-    printf("Submitting commands to queue\n");
-    VkSubmitInfo submitInfo = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &commandBuffer
-    };
-    if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS)
+
+    float* depthData = maxPixelCount <= SIZE_MAX / sizeof(float)
+        ? (float*) malloc((size_t) maxPixelCount * sizeof(float))
+        : NULL;
+    if (depthData == NULL)
     {
-        printf("Failed to submit command buffer to queue\n");
+        printf("Failed to allocate depth data for %lu pixels\n", (unsigned long) maxPixelCount);
+        free(poses);
+        free(instances);
+        meshLoaderFree(&loadedMesh);
         return EXIT_FAILURE;
     }
-
-    while ((code = vkWaitForFences(device, 1, &fence, VK_TRUE, 1000000)) != VK_SUCCESS) {
-        printf("Waiting until fence is signaled, current status: %s\n", resultString(code));
-    }
-
-    printf("Command execution completed!");
-
-    ///////////////////////////////////////////
-    ////////// STEP 5 | Pixel readback ////////
-    ///////////////////////////////////////////
-
-    /// The command has finished executing and we are ready to read back the pixels.
-    /// We do this by mapping the device memory to host, which is possible since the buffer
-    /// memory was created with the VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT. We also know that the
-    /// data is available since the VK_MEMORY_PROPERTY_HOST_COHERENT_BIT was set, so no
-    /// explicit flushing of memory caches is needed.
-    printf("Reading back pixels to host\n");
-    void* mappedImageBufferMemory;
-    uint32_t* imageData = (uint32_t*) malloc(pixelReadbackBufferCreateInfo.size);
-    vkMapMemory(device,
-                pixelReadbackBufferMemory,
-                0, // offset
-                pixelReadbackBufferCreateInfo.size,
-                0, // flags
-                &mappedImageBufferMemory);
-    memcpy(imageData, mappedImageBufferMemory, pixelReadbackBufferCreateInfo.size);
-    vkUnmapMemory(device, pixelReadbackBufferMemory);
-
-    /// The pixels are now read back from the pixel read back buffer to host memory.
-    /// Reading the spec we can read that copying the depth aspect of an image with
-    /// VK_FORMAT_D24_UNORM_S8_UINT will give us texels on the format
-    /// VK_FORMAT_X8_D24_UNFORM_PACK32. Further reading up on that format in the spec
-    /// (https://registry.khronos.org/vulkan/specs/1.3/html/chap34.html#formats-definition)
-    /// tells us that
-    ///
-    ///     1. Formats are layed out in memory in component order
-    ///     2. Multi-byte components are layed out in memory according to host endianess
-    ///
-    /// This means that the most significant byte is unspecified and the 3 least significant
-    /// bytes of the 32-bit integer contains the depth component. Let us extract the depth
-    /// component from that. D24_UNORM means 24-bit depth in unsigned normalized fixed-point
-    /// format. We extract the 3 least significant bits by bit-wise anding with 0xFFFFFF.
-    /// To convert from unorm to float we refer to the spec:
-    /// https://registry.khronos.org/vulkan/specs/1.3/html/chap3.html#fundamentals-fixedconv
-    float* depthData = (float*) malloc(pixelCount * sizeof(float));
-    for (uint32_t i = 0; i < IMAGE_WIDTH * IMAGE_HEIGHT; ++i)
+    const RenderRequest* request = NULL;
+    int status = allDevices
+        ? renderOnAllDevices(&config, requests, requestCount, renderCount, depthData, &request)
+        : renderOnDevice(&config, requests, requestCount, renderCount, depthData, &request);
+    free(poses);
+    free(instances);
+    meshLoaderFree(&loadedMesh);
+    if (status != EXIT_SUCCESS || config.statisticsOnly)
+    {
+        free(depthData);
+        return status;
+    }
+
+    /// Write the depth image to output file. In the text format, opening out.dat you should
+    /// see a triangle filled with 0.1337 values.
+    struct timespec writeStart, writeEnd;
+    const char* outputFileName = depthOutputFileName(outputFormat);
+    clock_gettime(CLOCK_MONOTONIC, &writeStart);
+    status = depthOutputWrite(outputFileName,
+                              outputFormat,
+                              depthData,
+                              request->width,
+                              request->height * poseCount);
+    clock_gettime(CLOCK_MONOTONIC, &writeEnd);
+    free(depthData);
+    if (status == EXIT_SUCCESS)
     {
-        uint32_t unormDepth = 0xFFFFFF & imageData[i];
-        depthData[i] = ((float) unormDepth) / 0xFFFFFF;
-        /// For visualization purposes we set the depth data to 0 if has not been written to
-        /// (as indicated by maximum depth value).
-        if (unormDepth  == 0xFFFFFF) {
-            depthData[i] = 0;
-        }
+        printf("Wrote %ux%u %s output to %s in %.3f ms\n",
+               request->width, request->height * poseCount,
+               depthOutputFormatName(outputFormat),
+               outputFileName,
+               elapsedMilliseconds(&writeStart, &writeEnd));
     }
-    free(imageData);
-
-    /// Write the depth image to output file, formatted to 4 decimals.
-    /// Opening out.dat you should see a triangle filled with 0.1337 values.
-    FILE* outputFile = fopen("out.dat", "w");
-    for (uint32_t i = 0; i < IMAGE_HEIGHT; ++i) {
-        for (uint32_t j = 0; j < IMAGE_WIDTH; ++j) {
-            fprintf(outputFile, "%.4f ", depthData[IMAGE_WIDTH * i + j]);
-        }
-        fprintf(outputFile, "\n");
-    }
-    fclose(outputFile);
-    free(depthData);
-
-
-    ////////////////////////////////////
-    ////////// STEP 6 | Cleanup ////////
-    ////////////////////////////////////
-
-    /// Finally, tear down the system.
-    /// Before destruction of each object we need to make sure it is not in use anymore, which
-    /// is easiest by waiting for the device to become idle. All resources that are children of
-    /// another resource needs to be released before their parent. The easiest way to do this
-    /// is by destroying objects in reverse order of creation. Resources allocated from pools
-    /// do not have to be manually freed, but we will do it anyways to show how it can be done
-    /// manually.
-    printf("Waiting until device is idle\n");
-    vkDeviceWaitIdle(device);
-
-    printf("Destroying fence\n");
-    vkDestroyFence(device, fence, NULL);
-
-    printf("Destroying image buffer\n");
-    vkDestroyBuffer(device, pixelReadbackBuffer, NULL);
-
-    printf("Destroying image buffer memory\n");
-    vkFreeMemory(device, pixelReadbackBufferMemory, NULL);
-
-    printf("Destroying image view\n");
-    vkDestroyImageView(device, imageView, NULL);
 
-    printf("Destroying image\n");
-    vkDestroyImage(device, image, NULL);
-
-    printf("Releasing image memory\n");
-    vkFreeMemory(device, imageMemory, NULL);
-
-    printf("Destroying vertex shader module\n");
-    vkDestroyShaderModule(device, vertexShaderModule, NULL);
-
-    printf("Releasing command buffers\n");
-    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
-
-    printf("Destroying command pool\n");
-    vkDestroyCommandPool(device, commandPool, NULL);
-
-    printf("Destroying pipeline\n");
-    vkDestroyPipeline(device, graphicsPipeline, NULL);
-
-    printf("Destroying pipeline layout\n");
-    vkDestroyPipelineLayout(device, pipelineLayout, NULL);
-
-    printf("Destroying framebuffer\n");
-    vkDestroyFramebuffer(device, framebuffer, NULL);
-
-    printf("Destroying render pass\n");
-    vkDestroyRenderPass(device, renderPass, NULL);
-
-    printf("Destroying device\n");
-    vkDestroyDevice(device, NULL);
-
-    printf("Destroying instance\n");
-    vkDestroyInstance(instance, NULL);
-
-    return EXIT_SUCCESS;
+    return status;
 }
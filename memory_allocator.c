@@ -0,0 +1,384 @@
+#include "memory_allocator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static VkDeviceSize
+alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+
+void
+memoryAllocatorInit(MemoryAllocator* allocator,
+                    VkDevice device,
+                    const VkPhysicalDeviceProperties* properties,
+                    const VkPhysicalDeviceMemoryProperties* memoryProperties)
+{
+    memset(allocator, 0, sizeof(*allocator));
+    allocator->device = device;
+    allocator->memoryProperties = *memoryProperties;
+    allocator->nonCoherentAtomSize = properties->limits.nonCoherentAtomSize;
+    allocator->maxMemoryAllocationCount = properties->limits.maxMemoryAllocationCount;
+}
+
+
+/// Carve `size` bytes aligned to `alignment` out of the free ranges of `block`, first fit.
+/// Returns EXIT_FAILURE if no free range is large enough.
+static int
+allocateFromBlock(MemoryBlock* block,
+                  VkDeviceSize size,
+                  VkDeviceSize alignment,
+                  VkDeviceSize* offset)
+{
+    for (uint32_t i = 0; i < block->freeRangeCount; ++i)
+    {
+        MemoryRange* range = &block->freeRanges[i];
+        VkDeviceSize alignedOffset = alignUp(range->offset, alignment);
+        VkDeviceSize padding = alignedOffset - range->offset;
+        if (padding + size > range->size)
+        {
+            continue;
+        }
+        VkDeviceSize remainder = range->size - padding - size;
+        if (padding > 0 && remainder > 0)
+        {
+            /// The range is split in two, which needs another free list entry.
+            if (block->freeRangeCount == MAX_MEMORY_BLOCK_FREE_RANGES)
+            {
+                continue;
+            }
+            memmove(range + 2, range + 1,
+                    (block->freeRangeCount - i - 1) * sizeof(MemoryRange));
+            block->freeRangeCount++;
+            range[1].offset = alignedOffset + size;
+            range[1].size = remainder;
+            range->size = padding;
+        }
+        else if (padding > 0)
+        {
+            range->size = padding;
+        }
+        else if (remainder > 0)
+        {
+            range->offset = alignedOffset + size;
+            range->size = remainder;
+        }
+        else
+        {
+            memmove(range, range + 1, (block->freeRangeCount - i - 1) * sizeof(MemoryRange));
+            block->freeRangeCount--;
+        }
+        *offset = alignedOffset;
+        return EXIT_SUCCESS;
+    }
+    return EXIT_FAILURE;
+}
+
+
+static int
+createBlock(MemoryAllocator* allocator,
+            VkDeviceSize size,
+            uint32_t memoryTypeIndex,
+            MemoryResourceKind kind,
+            uint32_t* blockIndex)
+{
+    /// Reuse the slot of a block that has been released, if any.
+    uint32_t index = 0;
+    while (index < allocator->blockCount && allocator->blocks[index].memory != VK_NULL_HANDLE)
+    {
+        index++;
+    }
+    if (index == MAX_MEMORY_BLOCKS)
+    {
+        printf("Too many memory blocks (maximum %d)\n", MAX_MEMORY_BLOCKS);
+        return EXIT_FAILURE;
+    }
+    uint32_t liveBlockCount = 0;
+    for (uint32_t i = 0; i < allocator->blockCount; ++i)
+    {
+        liveBlockCount += allocator->blocks[i].memory != VK_NULL_HANDLE;
+    }
+    if (liveBlockCount >= allocator->maxMemoryAllocationCount)
+    {
+        printf("Reached maxMemoryAllocationCount (%u)\n", allocator->maxMemoryAllocationCount);
+        return EXIT_FAILURE;
+    }
+
+    MemoryBlock* block = &allocator->blocks[index];
+    VkMemoryAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = size,
+        .memoryTypeIndex = memoryTypeIndex
+    };
+    VkResult code = vkAllocateMemory(allocator->device, &allocateInfo, NULL, &block->memory);
+    if (code != VK_SUCCESS)
+    {
+        printf("Failed to allocate %lu bytes of memory type %u, code: %d\n",
+               (unsigned long) size, memoryTypeIndex, code);
+        block->memory = VK_NULL_HANDLE;
+        return EXIT_FAILURE;
+    }
+    allocator->deviceAllocationCount++;
+
+    block->mapping = NULL;
+    VkMemoryPropertyFlags flags =
+        allocator->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+    if (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        code = vkMapMemory(allocator->device,
+                           block->memory,
+                           0, // offset
+                           VK_WHOLE_SIZE,
+                           0, // flags
+                           &block->mapping);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to map memory block, code: %d\n", code);
+            vkFreeMemory(allocator->device, block->memory, NULL);
+            block->memory = VK_NULL_HANDLE;
+            return EXIT_FAILURE;
+        }
+    }
+    block->size = size;
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->kind = kind;
+    block->allocationCount = 0;
+    block->freeRanges[0] = (MemoryRange) { .offset = 0, .size = size };
+    block->freeRangeCount = 1;
+    if (index == allocator->blockCount)
+    {
+        allocator->blockCount++;
+    }
+    *blockIndex = index;
+    return EXIT_SUCCESS;
+}
+
+
+int
+memoryAllocatorAllocate(MemoryAllocator* allocator,
+                        const VkMemoryRequirements* requirements,
+                        uint32_t memoryTypeIndex,
+                        MemoryResourceKind kind,
+                        MemoryAllocation* allocation)
+{
+    VkDeviceSize size = requirements->size;
+    VkDeviceSize alignment = requirements->alignment > 0 ? requirements->alignment : 1;
+
+    uint32_t blockIndex;
+    VkDeviceSize offset = 0;
+    int found = 0;
+    for (blockIndex = 0; blockIndex < allocator->blockCount && !found; ++blockIndex)
+    {
+        MemoryBlock* block = &allocator->blocks[blockIndex];
+        found = block->memory != VK_NULL_HANDLE
+             && block->memoryTypeIndex == memoryTypeIndex
+             && block->kind == kind
+             && allocateFromBlock(block, size, alignment, &offset) == EXIT_SUCCESS;
+    }
+    if (found)
+    {
+        blockIndex--;
+    }
+    else
+    {
+        VkDeviceSize blockSize = size > MEMORY_BLOCK_SIZE ? size : MEMORY_BLOCK_SIZE;
+        if (createBlock(allocator, blockSize, memoryTypeIndex, kind, &blockIndex)
+            != EXIT_SUCCESS ||
+            allocateFromBlock(&allocator->blocks[blockIndex], size, alignment, &offset)
+            != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    MemoryBlock* block = &allocator->blocks[blockIndex];
+    block->allocationCount++;
+    allocator->totalAllocationCount++;
+    *allocation = (MemoryAllocation) {
+        .memory = block->memory,
+        .offset = offset,
+        .size = size,
+        .mapping = block->mapping != NULL ? (uint8_t*) block->mapping + offset : NULL,
+        .blockIndex = blockIndex
+    };
+    return EXIT_SUCCESS;
+}
+
+
+void
+memoryAllocatorFree(MemoryAllocator* allocator, MemoryAllocation* allocation)
+{
+    if (allocation->memory == VK_NULL_HANDLE)
+    {
+        return;
+    }
+    MemoryBlock* block = &allocator->blocks[allocation->blockIndex];
+    VkDeviceSize offset = allocation->offset;
+    VkDeviceSize end = offset + allocation->size;
+
+    /// Find the first free range after the allocation, and merge with the ranges on either
+    /// side if they touch.
+    uint32_t i = 0;
+    while (i < block->freeRangeCount && block->freeRanges[i].offset < offset)
+    {
+        i++;
+    }
+    MemoryRange* previous = i > 0 ? &block->freeRanges[i - 1] : NULL;
+    MemoryRange* next = i < block->freeRangeCount ? &block->freeRanges[i] : NULL;
+    int mergePrevious = previous != NULL && previous->offset + previous->size == offset;
+    int mergeNext = next != NULL && next->offset == end;
+    if (mergePrevious && mergeNext)
+    {
+        previous->size += allocation->size + next->size;
+        memmove(next, next + 1, (block->freeRangeCount - i - 1) * sizeof(MemoryRange));
+        block->freeRangeCount--;
+    }
+    else if (mergePrevious)
+    {
+        previous->size += allocation->size;
+    }
+    else if (mergeNext)
+    {
+        next->offset = offset;
+        next->size += allocation->size;
+    }
+    else if (block->freeRangeCount < MAX_MEMORY_BLOCK_FREE_RANGES)
+    {
+        memmove(block->freeRanges + i + 1, block->freeRanges + i,
+                (block->freeRangeCount - i) * sizeof(MemoryRange));
+        block->freeRanges[i] = (MemoryRange) { .offset = offset, .size = allocation->size };
+        block->freeRangeCount++;
+    }
+    else
+    {
+        /// The range is lost until the block is released, which only happens when all of
+        /// its other allocations are freed.
+        printf("Free list of memory block %u is full, leaking %lu bytes\n",
+               allocation->blockIndex, (unsigned long) allocation->size);
+    }
+    block->allocationCount--;
+
+    /// Blocks are kept around when they become empty, so that the memory can be reused
+    /// without going back to the driver, unless it is a dedicated block for a large
+    /// resource.
+    if (block->allocationCount == 0 && block->size > MEMORY_BLOCK_SIZE)
+    {
+        vkFreeMemory(allocator->device, block->memory, NULL);
+        memset(block, 0, sizeof(*block));
+    }
+    else if (block->allocationCount == 0)
+    {
+        block->freeRanges[0] = (MemoryRange) { .offset = 0, .size = block->size };
+        block->freeRangeCount = 1;
+    }
+    memset(allocation, 0, sizeof(*allocation));
+}
+
+
+int
+memoryAllocatorInvalidate(MemoryAllocator* allocator, const MemoryAllocation* allocation)
+{
+    const MemoryBlock* block = &allocator->blocks[allocation->blockIndex];
+    VkMemoryPropertyFlags flags =
+        allocator->memoryProperties.memoryTypes[block->memoryTypeIndex].propertyFlags;
+    if (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+    {
+        return EXIT_SUCCESS;
+    }
+    VkDeviceSize atomSize = allocator->nonCoherentAtomSize > 0
+                          ? allocator->nonCoherentAtomSize : 1;
+    VkDeviceSize offset = allocation->offset / atomSize * atomSize;
+    VkDeviceSize end = alignUp(allocation->offset + allocation->size, atomSize);
+    VkMappedMemoryRange mappedMemoryRange = {
+        .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+        .memory = block->memory,
+        .offset = offset,
+        .size = end < block->size ? end - offset : VK_WHOLE_SIZE
+    };
+    if (vkInvalidateMappedMemoryRanges(allocator->device, 1, &mappedMemoryRange) != VK_SUCCESS)
+    {
+        printf("Failed to invalidate mapped memory range\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+void
+memoryAllocatorGetStats(const MemoryAllocator* allocator, MemoryAllocatorStats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->deviceAllocationCount = allocator->deviceAllocationCount;
+    stats->totalAllocationCount = allocator->totalAllocationCount;
+    VkDeviceSize freeBytes = 0;
+    VkDeviceSize largestFreeBytes = 0;
+    for (uint32_t i = 0; i < allocator->blockCount; ++i)
+    {
+        const MemoryBlock* block = &allocator->blocks[i];
+        if (block->memory == VK_NULL_HANDLE)
+        {
+            continue;
+        }
+        stats->blockCount++;
+        stats->allocationCount += block->allocationCount;
+        stats->blockBytes += block->size;
+        stats->freeRangeCount += block->freeRangeCount;
+        VkDeviceSize blockLargestFreeRange = 0;
+        for (uint32_t j = 0; j < block->freeRangeCount; ++j)
+        {
+            VkDeviceSize size = block->freeRanges[j].size;
+            freeBytes += size;
+            blockLargestFreeRange = size > blockLargestFreeRange ? size : blockLargestFreeRange;
+        }
+        largestFreeBytes += blockLargestFreeRange;
+        stats->largestFreeRange = blockLargestFreeRange > stats->largestFreeRange
+                                ? blockLargestFreeRange : stats->largestFreeRange;
+    }
+    stats->allocatedBytes = stats->blockBytes - freeBytes;
+    stats->fragmentation = freeBytes > 0 ? 1.0 - (double) largestFreeBytes / freeBytes : 0.0;
+}
+
+
+void
+memoryAllocatorPrintStats(const MemoryAllocator* allocator)
+{
+    MemoryAllocatorStats stats;
+    memoryAllocatorGetStats(allocator, &stats);
+    printf("Device memory: %u blocks (%lu vkAllocateMemory calls), %lu of %lu KB in use by "
+           "%u allocations (%lu in total), %u free ranges, largest %lu KB, "
+           "fragmentation %.2f\n",
+           stats.blockCount,
+           (unsigned long) stats.deviceAllocationCount,
+           (unsigned long) (stats.allocatedBytes >> 10),
+           (unsigned long) (stats.blockBytes >> 10),
+           stats.allocationCount,
+           (unsigned long) stats.totalAllocationCount,
+           stats.freeRangeCount,
+           (unsigned long) (stats.largestFreeRange >> 10),
+           stats.fragmentation);
+}
+
+
+void
+memoryAllocatorShutdown(MemoryAllocator* allocator)
+{
+    for (uint32_t i = 0; i < allocator->blockCount; ++i)
+    {
+        MemoryBlock* block = &allocator->blocks[i];
+        if (block->memory == VK_NULL_HANDLE)
+        {
+            continue;
+        }
+        if (block->allocationCount > 0)
+        {
+            printf("Memory block %u still has %u allocations\n", i, block->allocationCount);
+        }
+        /// Freeing memory implicitly unmaps it.
+        vkFreeMemory(allocator->device, block->memory, NULL);
+    }
+    memset(allocator, 0, sizeof(*allocator));
+}
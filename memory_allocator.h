@@ -0,0 +1,142 @@
+#ifndef MEMORY_ALLOCATOR_H
+#define MEMORY_ALLOCATOR_H
+
+/// Sub-allocation of device memory.
+///
+/// Every `vkAllocateMemory` is expensive, and the number of live allocations is limited by
+/// `maxMemoryAllocationCount` (which can be as low as 4096). Rather than allocating memory
+/// per image and buffer, the allocator allocates large blocks of memory per memory type and
+/// hands out ranges of them, which are bound with the offset argument of
+/// `vkBindImageMemory` and `vkBindBufferMemory`.
+///
+/// Each block keeps a free list of ranges, sorted by offset. Allocation takes the first free
+/// range that fits the size and alignment, freeing merges the range with its neighbours.
+///
+/// Linear resources (buffers) and non-linear resources (optimally tiled images) next to
+/// each other in memory must be `bufferImageGranularity` apart, or they may alias on some
+/// implementations. We keep it simple and never mix them: every block holds either linear
+/// or non-linear resources only.
+///
+/// Blocks of host visible memory are mapped once when they are allocated, and every
+/// allocation from them gets a pointer into that mapping. A memory object can only be
+/// mapped once, so resources sharing a block could not be mapped one by one.
+
+#include <vulkan/vulkan.h>
+
+#include <stdint.h>
+
+/// Size of the blocks allocated from the device. Larger resources get a block of their own.
+#ifndef MEMORY_BLOCK_SIZE
+#define MEMORY_BLOCK_SIZE (64 * 1024 * 1024)
+#endif
+
+#ifndef MAX_MEMORY_BLOCKS
+#define MAX_MEMORY_BLOCKS 64
+#endif
+
+/// Maximum number of free ranges per block. This is only reached by heavy fragmentation.
+#ifndef MAX_MEMORY_BLOCK_FREE_RANGES
+#define MAX_MEMORY_BLOCK_FREE_RANGES 128
+#endif
+
+
+typedef enum MemoryResourceKind {
+    MEMORY_RESOURCE_LINEAR,
+    MEMORY_RESOURCE_NON_LINEAR
+} MemoryResourceKind;
+
+
+typedef struct MemoryRange {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+} MemoryRange;
+
+
+typedef struct MemoryBlock {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    uint32_t memoryTypeIndex;
+    MemoryResourceKind kind;
+    void* mapping;
+    uint32_t allocationCount;
+    MemoryRange freeRanges[MAX_MEMORY_BLOCK_FREE_RANGES];
+    uint32_t freeRangeCount;
+} MemoryBlock;
+
+
+typedef struct MemoryAllocation {
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    /// Pointer to the start of the allocation for host visible memory, NULL otherwise.
+    void* mapping;
+    uint32_t blockIndex;
+} MemoryAllocation;
+
+
+typedef struct MemoryAllocatorStats {
+    /// Blocks currently allocated from the device.
+    uint32_t blockCount;
+    /// Calls to vkAllocateMemory over the lifetime of the allocator.
+    uint64_t deviceAllocationCount;
+    /// Live sub-allocations, and sub-allocations over the lifetime of the allocator.
+    uint32_t allocationCount;
+    uint64_t totalAllocationCount;
+    VkDeviceSize blockBytes;
+    VkDeviceSize allocatedBytes;
+    uint32_t freeRangeCount;
+    VkDeviceSize largestFreeRange;
+    /// 0 when all free memory is in one range per block, approaching 1 as the free memory
+    /// is split into many small ranges: 1 - sum of the largest free range of each block /
+    /// free bytes.
+    double fragmentation;
+} MemoryAllocatorStats;
+
+
+typedef struct MemoryAllocator {
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDeviceSize nonCoherentAtomSize;
+    uint32_t maxMemoryAllocationCount;
+    MemoryBlock blocks[MAX_MEMORY_BLOCKS];
+    uint32_t blockCount;
+    uint64_t deviceAllocationCount;
+    uint64_t totalAllocationCount;
+} MemoryAllocator;
+
+
+void
+memoryAllocatorInit(MemoryAllocator* allocator,
+                    VkDevice device,
+                    const VkPhysicalDeviceProperties* properties,
+                    const VkPhysicalDeviceMemoryProperties* memoryProperties);
+
+/// Allocate memory matching `requirements` from the given memory type.
+int
+memoryAllocatorAllocate(MemoryAllocator* allocator,
+                        const VkMemoryRequirements* requirements,
+                        uint32_t memoryTypeIndex,
+                        MemoryResourceKind kind,
+                        MemoryAllocation* allocation);
+
+/// Return the memory to its block. The resource bound to it must have been destroyed.
+/// Freeing a zeroed allocation is a no-op.
+void
+memoryAllocatorFree(MemoryAllocator* allocator, MemoryAllocation* allocation);
+
+/// Make device writes to a host visible, non-coherent allocation visible to the host. The
+/// range is widened to `nonCoherentAtomSize` as required by the spec.
+int
+memoryAllocatorInvalidate(MemoryAllocator* allocator, const MemoryAllocation* allocation);
+
+void
+memoryAllocatorGetStats(const MemoryAllocator* allocator, MemoryAllocatorStats* stats);
+
+void
+memoryAllocatorPrintStats(const MemoryAllocator* allocator);
+
+/// Free all blocks. All allocations must have been freed.
+void
+memoryAllocatorShutdown(MemoryAllocator* allocator);
+
+#endif // MEMORY_ALLOCATOR_H
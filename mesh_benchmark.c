@@ -0,0 +1,503 @@
+/// Benchmark of mesh loading.
+///
+///     ./out/Release/mesh_benchmark [mesh.obj|mesh.ply] [repeats]
+///
+/// Without a file, a grid of 1024x1024 quads is written to a temporary OBJ file. The file is
+/// parsed `repeats` times (default 5) with fgets and sscanf on a single thread, then with the
+/// memory mapped parser on 1, 2, 4, ... threads up to one per core, and finally loaded from
+/// its cache file. Throughput is reported in MB of source file per second, after one
+/// untimed parse that brings the file into the page cache.
+///
+/// Before anything is timed, the memory mapped parser is checked on every thread count, and
+/// so is the cache file it writes, against the stdio parser: positions must be within 1 ulp
+/// (the parsers round differently), indices must be equal. Without a file, this also covers
+/// an OBJ file with texture coordinates, normals, v/vt/vn corners and negative indices, and
+/// PLY files of triangles only and of quads mixed with triangles, each compared with an OBJ
+/// file of the same mesh. A PLY file given on the command line is compared with its parse on
+/// a single thread. Any mismatch fails the benchmark.
+
+#include "mesh_loader.h"
+#include "timing.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GRID_SIZE 1024
+/// Grids of the files that only check the parsers, still large enough to be split between
+/// threads.
+#define TEST_GRID_SIZE 256
+
+
+static int
+writeGrid(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+    {
+        printf("Failed to create %s\n", path);
+        return EXIT_FAILURE;
+    }
+    fprintf(file, "# %ux%u grid\n", GRID_SIZE, GRID_SIZE);
+    for (uint32_t y = 0; y <= GRID_SIZE; ++y)
+    {
+        for (uint32_t x = 0; x <= GRID_SIZE; ++x)
+        {
+            fprintf(file, "v %.6f %.6f %.6f\n",
+                    2.0f * x / GRID_SIZE - 1.0f, 2.0f * y / GRID_SIZE - 1.0f, 0.5f);
+        }
+    }
+    for (uint32_t y = 0; y < GRID_SIZE; ++y)
+    {
+        for (uint32_t x = 0; x < GRID_SIZE; ++x)
+        {
+            uint32_t corner = y * (GRID_SIZE + 1) + x + 1;
+            fprintf(file, "f %u %u %u %u\n",
+                    corner, corner + 1, corner + GRID_SIZE + 2, corner + GRID_SIZE + 1);
+        }
+    }
+    return fclose(file) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/// Vertex (x, y) of a test grid, with values that need every digit to round trip.
+static void
+testGridPosition(uint32_t x, uint32_t y, float position[3])
+{
+    position[0] = 2.0f * x / TEST_GRID_SIZE - 1.0f;
+    position[1] = 2.0f * y / TEST_GRID_SIZE - 1.0f;
+    position[2] = 0.5f + 0.25f * position[0] * position[1] / 3.0f;
+}
+
+
+/// OBJ file of a test grid written row by row, every row of vertices followed by the quads
+/// that reach back to the row before it. Faces use negative indices and all corner forms,
+/// and there are texture coordinate and normal statements in between.
+static int
+writeRelativeGrid(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL)
+    {
+        printf("Failed to create %s\n", path);
+        return EXIT_FAILURE;
+    }
+    const char* formats[] = {
+        "v %.9g %.9g %.9g\n",
+        "v %.8e %.8e %.8e\n",
+        "v  %+.9g\t%.9g %.9g \n"
+    };
+    fprintf(file, "vt 0 0\nvt 1 0\nvt 1 1\nvn 0 0 1\n");
+    for (uint32_t y = 0; y <= TEST_GRID_SIZE; ++y)
+    {
+        for (uint32_t x = 0; x <= TEST_GRID_SIZE; ++x)
+        {
+            float position[3];
+            testGridPosition(x, y, position);
+            fprintf(file, formats[x % 3], position[0], position[1], position[2]);
+        }
+        if (y == 0)
+        {
+            continue;
+        }
+        /// The last vertex written is -1, the first of this row -(TEST_GRID_SIZE + 1).
+        for (int32_t x = 0; x < TEST_GRID_SIZE; ++x)
+        {
+            int32_t above = x - 2 * (TEST_GRID_SIZE + 1);
+            int32_t below = x - (TEST_GRID_SIZE + 1);
+            switch (x % 4)
+            {
+                case 0:
+                    fprintf(file, "f %d %d %d %d\n", above, above + 1, below + 1, below);
+                    break;
+                case 1:
+                    fprintf(file, "f %d/1 %d/2 %d/3 %d/2\n", above, above + 1, below + 1, below);
+                    break;
+                case 2:
+                    fprintf(file, "f %d//1 %d//1 %d//1\nf %d//1 %d//1 %d//1\n",
+                            above, above + 1, below + 1, above, below + 1, below);
+                    break;
+                default:
+                    fprintf(file, "f %d/1/1 %d/2/1 %d/3/1 %d/2/1\r\n",
+                            above, above + 1, below + 1, below);
+                    break;
+            }
+        }
+        fprintf(file, "vn 0 0 1\n");
+    }
+    return fclose(file) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/// Binary PLY file of a test grid, and an OBJ file of the same mesh to check it against.
+/// Without `quads` every quad is split into two triangles, which the parser reads in
+/// parallel. With `quads`, every other quad stays a quad, which makes the parser fall back
+/// to reading the faces as polygons. The vertices have a byte in front of the position, so
+/// that the position is not aligned.
+static int
+writePlyGrid(const char* plyPath, const char* objPath, uint32_t quads)
+{
+    FILE* ply = fopen(plyPath, "wb");
+    FILE* obj = fopen(objPath, "w");
+    if (ply == NULL || obj == NULL)
+    {
+        printf("Failed to create %s and %s\n", plyPath, objPath);
+        if (ply != NULL)
+        {
+            fclose(ply);
+        }
+        if (obj != NULL)
+        {
+            fclose(obj);
+        }
+        return EXIT_FAILURE;
+    }
+    uint32_t rowSize = TEST_GRID_SIZE + 1;
+    uint32_t quadCount = TEST_GRID_SIZE * TEST_GRID_SIZE;
+    uint32_t faceCount = quads ? quadCount / 2 + 2 * (quadCount - quadCount / 2) : 2 * quadCount;
+    fprintf(ply,
+            "ply\n"
+            "format binary_little_endian 1.0\n"
+            "element vertex %u\n"
+            "property uchar flags\n"
+            "property float x\n"
+            "property float y\n"
+            "property float z\n"
+            "element face %u\n"
+            "property list uchar int vertex_indices\n"
+            "end_header\n",
+            rowSize * rowSize, faceCount);
+    for (uint32_t y = 0; y <= TEST_GRID_SIZE; ++y)
+    {
+        for (uint32_t x = 0; x <= TEST_GRID_SIZE; ++x)
+        {
+            uint8_t flags = 0;
+            float position[3];
+            testGridPosition(x, y, position);
+            fwrite(&flags, sizeof(flags), 1, ply);
+            fwrite(position, sizeof(float), 3, ply);
+            fprintf(obj, "v %.9g %.9g %.9g\n", position[0], position[1], position[2]);
+        }
+    }
+    for (uint32_t quad = 0; quad < quadCount; ++quad)
+    {
+        int32_t a = (int32_t) ((quad / TEST_GRID_SIZE) * rowSize + quad % TEST_GRID_SIZE);
+        int32_t corners[4] = { a, a + 1, a + (int32_t) rowSize + 1, a + (int32_t) rowSize };
+        if (quads && quad % 2 == 0)
+        {
+            uint8_t count = 4;
+            fwrite(&count, sizeof(count), 1, ply);
+            fwrite(corners, sizeof(int32_t), 4, ply);
+            fprintf(obj, "f %d %d %d %d\n",
+                    corners[0] + 1, corners[1] + 1, corners[2] + 1, corners[3] + 1);
+            continue;
+        }
+        int32_t triangles[2][3] = {
+            { corners[0], corners[1], corners[2] },
+            { corners[0], corners[2], corners[3] }
+        };
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            uint8_t count = 3;
+            fwrite(&count, sizeof(count), 1, ply);
+            fwrite(triangles[i], sizeof(int32_t), 3, ply);
+            fprintf(obj, "f %d %d %d\n",
+                    triangles[i][0] + 1, triangles[i][1] + 1, triangles[i][2] + 1);
+        }
+    }
+    int plyClosed = fclose(ply) == 0;
+    int objClosed = fclose(obj) == 0;
+    return plyClosed && objClosed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/// Distance between two finite floats in units in the last place.
+static uint32_t
+ulpDistance(float a, float b)
+{
+    uint32_t bits[2];
+    memcpy(&bits[0], &a, sizeof(a));
+    memcpy(&bits[1], &b, sizeof(b));
+    /// Sign and magnitude to a line on which neighbouring floats are neighbouring integers.
+    int64_t ordered[2];
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        int64_t magnitude = bits[i] & 0x7FFFFFFFu;
+        ordered[i] = bits[i] & 0x80000000u ? -magnitude : magnitude;
+    }
+    int64_t distance = ordered[0] - ordered[1];
+    return (uint32_t) (distance < 0 ? -distance : distance);
+}
+
+
+static int
+compareMeshes(const Mesh* expected, const Mesh* actual, const char* path, const char* name)
+{
+    if (actual->vertexCount != expected->vertexCount ||
+        actual->indexCount != expected->indexCount)
+    {
+        printf("%s: %s has %u vertices and %u indices, expected %u and %u\n",
+               path, name, actual->vertexCount, actual->indexCount,
+               expected->vertexCount, expected->indexCount);
+        return EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < 3 * expected->vertexCount; ++i)
+    {
+        if (ulpDistance(actual->positions[i], expected->positions[i]) > 1)
+        {
+            printf("%s: %s has %.9g for coordinate %u of vertex %u, expected %.9g\n",
+                   path, name, actual->positions[i], i % 3, i / 3, expected->positions[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    for (uint32_t i = 0; i < expected->indexCount; ++i)
+    {
+        if (actual->indices[i] != expected->indices[i])
+        {
+            printf("%s: %s has %u for index %u, expected %u\n",
+                   path, name, actual->indices[i], i, expected->indices[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/// Check the memory mapped parser of `path` on 1 to `maxThreadCount` threads, and the cache
+/// file it writes, against the stdio parser of `referencePath`, an OBJ file of the same
+/// mesh. Without one, the mapped parser on a single thread is the reference.
+static int
+verifyParsers(const char* path, const char* referencePath, uint32_t maxThreadCount)
+{
+    LoadedMesh reference;
+    int status = referencePath != NULL ? meshLoaderParseStdio(referencePath, &reference)
+                                       : meshLoaderParse(path, 1, &reference);
+    if (status != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    for (uint32_t threadCount = 1; threadCount <= maxThreadCount && status == EXIT_SUCCESS;
+         ++threadCount)
+    {
+        LoadedMesh loadedMesh;
+        char name[32];
+        snprintf(name, sizeof(name), "mmap on %u thread%s",
+                 threadCount, threadCount > 1 ? "s" : "");
+        status = meshLoaderParse(path, threadCount, &loadedMesh);
+        if (status == EXIT_SUCCESS)
+        {
+            status = compareMeshes(&reference.mesh, &loadedMesh.mesh, path, name);
+            if (status == EXIT_SUCCESS && threadCount == maxThreadCount)
+            {
+                status = meshLoaderWriteCacheFile(path, &loadedMesh);
+            }
+            meshLoaderFree(&loadedMesh);
+        }
+    }
+    if (status == EXIT_SUCCESS)
+    {
+        LoadedMesh cached;
+        status = meshLoaderMapCacheFile(path, &cached);
+        if (status == EXIT_SUCCESS)
+        {
+            status = compareMeshes(&reference.mesh, &cached.mesh, path, "cache file");
+            meshLoaderFree(&cached);
+        }
+        else
+        {
+            printf("%s: failed to map the cache file\n", path);
+        }
+    }
+    if (status == EXIT_SUCCESS)
+    {
+        printf("%s: %u vertices and %u triangles, mmap on 1 to %u threads and cache file "
+               "match %s\n",
+               path, reference.mesh.vertexCount, reference.mesh.indexCount / 3, maxThreadCount,
+               referencePath != NULL ? "stdio" : "mmap on 1 thread");
+    }
+    meshLoaderFree(&reference);
+    return status;
+}
+
+
+/// Write the files that only check the parsers, see the top of the file, and check them.
+static int
+verifyTestFiles(uint32_t maxThreadCount)
+{
+    char relativePath[] = "/tmp/mesh_benchmark_relative_XXXXXX.obj";
+    char trianglePlyPath[] = "/tmp/mesh_benchmark_triangles_XXXXXX.ply";
+    char triangleObjPath[] = "/tmp/mesh_benchmark_triangles_XXXXXX.obj";
+    char quadPlyPath[] = "/tmp/mesh_benchmark_quads_XXXXXX.ply";
+    char quadObjPath[] = "/tmp/mesh_benchmark_quads_XXXXXX.obj";
+    char* paths[] = { relativePath, trianglePlyPath, triangleObjPath, quadPlyPath, quadObjPath };
+    const uint32_t pathCount = sizeof(paths) / sizeof(paths[0]);
+    uint32_t createdCount = 0;
+    int status = EXIT_SUCCESS;
+    for (; createdCount < pathCount; ++createdCount)
+    {
+        int descriptor = mkstemps(paths[createdCount], 4);
+        if (descriptor < 0)
+        {
+            printf("Failed to create a temporary file\n");
+            status = EXIT_FAILURE;
+            break;
+        }
+        close(descriptor);
+    }
+    if (status == EXIT_SUCCESS &&
+        (writeRelativeGrid(relativePath) != EXIT_SUCCESS ||
+         writePlyGrid(trianglePlyPath, triangleObjPath, 0) != EXIT_SUCCESS ||
+         writePlyGrid(quadPlyPath, quadObjPath, 1) != EXIT_SUCCESS))
+    {
+        status = EXIT_FAILURE;
+    }
+    if (status == EXIT_SUCCESS &&
+        (verifyParsers(relativePath, relativePath, maxThreadCount) != EXIT_SUCCESS ||
+         verifyParsers(trianglePlyPath, triangleObjPath, maxThreadCount) != EXIT_SUCCESS ||
+         verifyParsers(quadPlyPath, quadObjPath, maxThreadCount) != EXIT_SUCCESS))
+    {
+        status = EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < createdCount; ++i)
+    {
+        char cachePath[64];
+        snprintf(cachePath, sizeof(cachePath), "%s%s", paths[i], MESH_CACHE_FILE_SUFFIX);
+        unlink(cachePath);
+        unlink(paths[i]);
+    }
+    return status;
+}
+
+
+/// Returns the average time per load in milliseconds, or a negative number on failure.
+/// threadCount 0 selects the stdio parser, UINT32_MAX the cache file.
+static double
+benchmarkLoad(const char* path, uint32_t threadCount, uint32_t repeatCount)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < repeatCount; ++i)
+    {
+        LoadedMesh loadedMesh;
+        int status = threadCount == 0 ? meshLoaderParseStdio(path, &loadedMesh)
+                   : threadCount == UINT32_MAX ? meshLoaderMapCacheFile(path, &loadedMesh)
+                   : meshLoaderParse(path, threadCount, &loadedMesh);
+        if (status != EXIT_SUCCESS)
+        {
+            return -1.0;
+        }
+        /// Touch every page, a mapped cache file is otherwise only read on upload.
+        volatile float sum = 0.0f;
+        for (uint32_t j = 0; j < 3 * loadedMesh.mesh.vertexCount; j += 1024)
+        {
+            sum += loadedMesh.mesh.positions[j];
+        }
+        for (uint32_t j = 0; j < loadedMesh.mesh.indexCount; j += 1024)
+        {
+            sum += (float) loadedMesh.mesh.indices[j];
+        }
+        meshLoaderFree(&loadedMesh);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return elapsedMilliseconds(&start, &end) / repeatCount;
+}
+
+
+int main(int argc, char** argv)
+{
+    char gridPath[] = "/tmp/mesh_benchmark_XXXXXX.obj";
+    const char* path = argc > 1 ? argv[1] : gridPath;
+    uint32_t repeatCount = argc > 2 ? (uint32_t) strtoul(argv[2], NULL, 10) : 5;
+    if (repeatCount == 0)
+    {
+        printf("Usage: %s [mesh.obj|mesh.ply] [repeats]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (argc <= 1)
+    {
+        int descriptor = mkstemps(gridPath, 4);
+        if (descriptor < 0)
+        {
+            printf("Failed to create a temporary file\n");
+            return EXIT_FAILURE;
+        }
+        close(descriptor);
+        if (writeGrid(gridPath) != EXIT_SUCCESS)
+        {
+            unlink(gridPath);
+            return EXIT_FAILURE;
+        }
+    }
+
+    long coreCount = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t maxThreadCount = coreCount > 0 ? (uint32_t) coreCount : 1;
+    maxThreadCount = maxThreadCount < MAX_MESH_LOADER_THREADS
+                   ? maxThreadCount
+                   : MAX_MESH_LOADER_THREADS;
+    /// The stdio baseline only reads OBJ.
+    uint32_t stdio = strstr(path, ".obj") != NULL;
+
+    /// Checking the parsers also writes the cache file, and brings the file into the page
+    /// cache.
+    struct stat status;
+    int failed = (argc <= 1 && verifyTestFiles(maxThreadCount) != EXIT_SUCCESS) ||
+                 stat(path, &status) != 0 ||
+                 verifyParsers(path, stdio ? path : NULL, maxThreadCount) != EXIT_SUCCESS;
+    if (!failed)
+    {
+        printf("%s: %.1f MB, %u repeats\n", path, 1e-6 * status.st_size, repeatCount);
+    }
+
+    double stdioMilliseconds = 0.0;
+    for (uint32_t threadCount = stdio ? 0 : 1;
+         !failed && threadCount <= maxThreadCount;
+         threadCount = threadCount == 0 ? 1
+                     : threadCount < maxThreadCount && 2 * threadCount > maxThreadCount
+                     ? maxThreadCount
+                     : 2 * threadCount)
+    {
+        double milliseconds = benchmarkLoad(path, threadCount, repeatCount);
+        failed = milliseconds < 0.0;
+        if (!failed)
+        {
+            stdioMilliseconds = threadCount == 0 ? milliseconds : stdioMilliseconds;
+            printf("%-10s %2u thread%s %9.3f ms %9.1f MB/s",
+                   threadCount == 0 ? "stdio" : "mmap", threadCount == 0 ? 1 : threadCount,
+                   threadCount <= 1 ? " " : "s",
+                   milliseconds, 1e-3 * status.st_size / milliseconds);
+            if (stdio && threadCount > 0)
+            {
+                printf(" %6.2fx", stdioMilliseconds / milliseconds);
+            }
+            printf("\n");
+        }
+    }
+    if (!failed)
+    {
+        double milliseconds = benchmarkLoad(path, UINT32_MAX, repeatCount);
+        failed = milliseconds < 0.0;
+        if (!failed)
+        {
+            printf("%-10s %2u thread  %9.3f ms %9.1f MB/s\n",
+                   "cache file", 1, milliseconds, 1e-3 * status.st_size / milliseconds);
+        }
+    }
+
+    if (argc <= 1)
+    {
+        char cachePath[sizeof(gridPath) + sizeof(MESH_CACHE_FILE_SUFFIX)];
+        snprintf(cachePath, sizeof(cachePath), "%s%s", gridPath, MESH_CACHE_FILE_SUFFIX);
+        unlink(cachePath);
+        unlink(gridPath);
+    }
+    if (failed)
+    {
+        printf("Failed to benchmark %s\n", path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,470 @@
+#include "mesh_cache.h"
+
+#include "render.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static int
+createBuffer(MeshCache* cache,
+             VkDeviceSize size,
+             VkBufferUsageFlags usage,
+             VkMemoryPropertyFlags required,
+             VkMemoryPropertyFlags preferred,
+             VkBuffer* buffer,
+             MemoryAllocation* memory)
+{
+    VkBufferCreateInfo bufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+    };
+    if (vkCreateBuffer(cache->device, &bufferCreateInfo, NULL, buffer) != VK_SUCCESS)
+    {
+        printf("Failed to create mesh buffer\n");
+        return EXIT_FAILURE;
+    }
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(cache->device, *buffer, &memoryRequirements);
+    uint32_t memoryTypeIndex = findMemoryType(&cache->allocator->memoryProperties,
+                                              memoryRequirements.memoryTypeBits,
+                                              required,
+                                              &preferred,
+                                              1);
+    if (memoryTypeIndex == cache->allocator->memoryProperties.memoryTypeCount ||
+        memoryAllocatorAllocate(cache->allocator,
+                                &memoryRequirements,
+                                memoryTypeIndex,
+                                MEMORY_RESOURCE_LINEAR,
+                                memory) != EXIT_SUCCESS ||
+        vkBindBufferMemory(cache->device, *buffer, memory->memory, memory->offset)
+        != VK_SUCCESS)
+    {
+        printf("Failed to allocate mesh buffer memory\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+int
+meshCacheInit(MeshCache* cache,
+              VkDevice device,
+              VkQueue queue,
+              uint32_t queueFamilyIndex,
+              MemoryAllocator* allocator)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->device = device;
+    cache->queue = queue;
+    cache->allocator = allocator;
+
+    /// Upload command buffers are short lived and re-recorded for every batch.
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
+                 VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = queueFamilyIndex
+    };
+    if (vkCreateCommandPool(device, &commandPoolCreateInfo, NULL, &cache->commandPool)
+        != VK_SUCCESS)
+    {
+        printf("Failed to create mesh upload command pool\n");
+        return EXIT_FAILURE;
+    }
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = cache->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    if (vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &cache->commandBuffer)
+        != VK_SUCCESS)
+    {
+        printf("Failed to allocate mesh upload command buffer\n");
+        return EXIT_FAILURE;
+    }
+    VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO
+    };
+    if (vkCreateFence(device, &fenceCreateInfo, NULL, &cache->fence) != VK_SUCCESS)
+    {
+        printf("Failed to create mesh upload fence\n");
+        return EXIT_FAILURE;
+    }
+    /// The host writes the staging buffer sequentially and never reads it, so uncached
+    /// (write-combined) memory is fine. Coherent memory spares us flushing the writes.
+    return createBuffer(cache,
+                        MESH_STAGING_BUFFER_SIZE,
+                        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                        0,
+                        &cache->stagingBuffer,
+                        &cache->stagingMemory);
+}
+
+
+static void
+destroyResidentMesh(MeshCache* cache, ResidentMesh* mesh)
+{
+    vkDestroyBuffer(cache->device, mesh->vertexBuffer, NULL);
+    memoryAllocatorFree(cache->allocator, &mesh->vertexMemory);
+    vkDestroyBuffer(cache->device, mesh->indexBuffer, NULL);
+    memoryAllocatorFree(cache->allocator, &mesh->indexMemory);
+    memset(mesh, 0, sizeof(*mesh));
+}
+
+
+/// Find a slot for a new mesh, evicting the least recently used mesh when the cache is full.
+/// Meshes in use by a frame in flight, or by the batch being uploaded, are kept.
+static ResidentMesh*
+allocateResidentMesh(MeshCache* cache)
+{
+    for (uint32_t i = 0; i < cache->meshCount; ++i)
+    {
+        if (cache->meshes[i].id == 0)
+        {
+            return &cache->meshes[i];
+        }
+    }
+    if (cache->meshCount < MAX_RESIDENT_MESHES)
+    {
+        return &cache->meshes[cache->meshCount++];
+    }
+    ResidentMesh* leastRecentlyUsed = NULL;
+    for (uint32_t i = 0; i < cache->meshCount; ++i)
+    {
+        ResidentMesh* mesh = &cache->meshes[i];
+        if (mesh->inUse || mesh->lastUsed == cache->useCount)
+        {
+            continue;
+        }
+        if (leastRecentlyUsed == NULL || mesh->lastUsed < leastRecentlyUsed->lastUsed)
+        {
+            leastRecentlyUsed = mesh;
+        }
+    }
+    if (leastRecentlyUsed != NULL)
+    {
+        destroyResidentMesh(cache, leastRecentlyUsed);
+    }
+    return leastRecentlyUsed;
+}
+
+
+/// Submit the copies recorded so far and wait for them. The barrier makes the copied data
+/// visible to vertex input of everything submitted to the queue later on.
+static int
+submitUploads(MeshCache* cache)
+{
+    VkMemoryBarrier memoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT
+    };
+    vkCmdPipelineBarrier(cache->commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                         0,
+                         1, &memoryBarrier,
+                         0, NULL,
+                         0, NULL);
+    if (vkEndCommandBuffer(cache->commandBuffer) != VK_SUCCESS)
+    {
+        printf("Failed to end recording of mesh upload command buffer\n");
+        return EXIT_FAILURE;
+    }
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cache->commandBuffer
+    };
+    if (vkQueueSubmit(cache->queue, 1, &submitInfo, cache->fence) != VK_SUCCESS ||
+        vkWaitForFences(cache->device, 1, &cache->fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS ||
+        vkResetFences(cache->device, 1, &cache->fence) != VK_SUCCESS)
+    {
+        printf("Failed to submit mesh uploads\n");
+        return EXIT_FAILURE;
+    }
+    cache->submissionCount++;
+    return EXIT_SUCCESS;
+}
+
+
+static int
+beginUploads(MeshCache* cache)
+{
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    if (vkBeginCommandBuffer(cache->commandBuffer, &beginInfo) != VK_SUCCESS)
+    {
+        printf("Failed to begin mesh upload command buffer\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/// Copy `size` bytes from the host to `buffer` through the staging buffer, starting at
+/// `*stagingOffset`. When the staging buffer is full, the copies so far are submitted and
+/// the staging buffer starts over.
+static int
+stageCopy(MeshCache* cache,
+          const void* data,
+          VkDeviceSize size,
+          VkBuffer buffer,
+          VkDeviceSize* stagingOffset)
+{
+    VkDeviceSize copied = 0;
+    while (copied < size)
+    {
+        if (*stagingOffset == MESH_STAGING_BUFFER_SIZE)
+        {
+            if (submitUploads(cache) != EXIT_SUCCESS || beginUploads(cache) != EXIT_SUCCESS)
+            {
+                return EXIT_FAILURE;
+            }
+            *stagingOffset = 0;
+        }
+        VkDeviceSize chunk = size - copied;
+        if (chunk > MESH_STAGING_BUFFER_SIZE - *stagingOffset)
+        {
+            chunk = MESH_STAGING_BUFFER_SIZE - *stagingOffset;
+        }
+        memcpy((uint8_t*) cache->stagingMemory.mapping + *stagingOffset,
+               (const uint8_t*) data + copied,
+               chunk);
+        VkBufferCopy region = {
+            .srcOffset = *stagingOffset,
+            .dstOffset = copied,
+            .size = chunk
+        };
+        vkCmdCopyBuffer(cache->commandBuffer, cache->stagingBuffer, buffer, 1, &region);
+        *stagingOffset += chunk;
+        copied += chunk;
+    }
+    cache->uploadedBytes += size;
+    return EXIT_SUCCESS;
+}
+
+
+/// Bounding sphere around the center of the axis aligned bounding box of the vertices. Not the
+/// smallest sphere, but never far off, and found in two passes over the vertices. Returns the
+/// largest index, which the same function looks for so that every mesh is scanned in one
+/// place before it is uploaded.
+static uint32_t
+meshBounds(const Mesh* mesh, float bounds[4])
+{
+    uint32_t maximumIndex = 0;
+    for (uint32_t i = 0; i < mesh->indexCount; ++i)
+    {
+        maximumIndex = mesh->indices[i] > maximumIndex ? mesh->indices[i] : maximumIndex;
+    }
+    float minimum[3], maximum[3];
+    for (uint32_t j = 0; j < 3; ++j)
+    {
+        minimum[j] = maximum[j] = mesh->positions[j];
+    }
+    for (uint32_t i = 1; i < mesh->vertexCount; ++i)
+    {
+        for (uint32_t j = 0; j < 3; ++j)
+        {
+            float value = mesh->positions[3 * i + j];
+            minimum[j] = value < minimum[j] ? value : minimum[j];
+            maximum[j] = value > maximum[j] ? value : maximum[j];
+        }
+    }
+    float radiusSquared = 0.0f;
+    for (uint32_t j = 0; j < 3; ++j)
+    {
+        bounds[j] = 0.5f * (minimum[j] + maximum[j]);
+    }
+    for (uint32_t i = 0; i < mesh->vertexCount; ++i)
+    {
+        float dx = mesh->positions[3 * i + 0] - bounds[0];
+        float dy = mesh->positions[3 * i + 1] - bounds[1];
+        float dz = mesh->positions[3 * i + 2] - bounds[2];
+        float distanceSquared = dx * dx + dy * dy + dz * dz;
+        radiusSquared = distanceSquared > radiusSquared ? distanceSquared : radiusSquared;
+    }
+    bounds[3] = sqrtf(radiusSquared);
+    return maximumIndex;
+}
+
+
+int
+meshCacheUpload(MeshCache* cache,
+                const Mesh* meshes,
+                uint32_t meshCount,
+                ResidentMesh** residentMeshes)
+{
+    cache->useCount++;
+    uint64_t firstSerial = cache->serialCount + 1;
+    uint32_t uploadCount = 0;
+    int status = EXIT_SUCCESS;
+    for (uint32_t i = 0; i < meshCount && status == EXIT_SUCCESS; ++i)
+    {
+        const Mesh* mesh = &meshes[i];
+        residentMeshes[i] = NULL;
+        /// Validated before the lookup, since free slots have id 0 and would match id 0.
+        if (mesh->id == 0 || mesh->positions == NULL || mesh->vertexCount == 0 ||
+            mesh->indices == NULL || mesh->indexCount == 0 || mesh->indexCount % 3 != 0)
+        {
+            printf("Invalid mesh %lu with %u vertices and %u indices\n",
+                   (unsigned long) mesh->id, mesh->vertexCount, mesh->indexCount);
+            status = EXIT_FAILURE;
+            break;
+        }
+        for (uint32_t j = 0; j < cache->meshCount; ++j)
+        {
+            if (cache->meshes[j].id == mesh->id)
+            {
+                residentMeshes[i] = &cache->meshes[j];
+                break;
+            }
+        }
+        if (residentMeshes[i] != NULL)
+        {
+            residentMeshes[i]->lastUsed = cache->useCount;
+            continue;
+        }
+        /// An index past the last vertex would have the device read outside the vertex
+        /// buffer, which without robustBufferAccess is undefined and can lose the device.
+        float bounds[4];
+        uint32_t maximumIndex = meshBounds(mesh, bounds);
+        if (maximumIndex >= mesh->vertexCount)
+        {
+            printf("Invalid mesh %lu with index %u of %u vertices\n",
+                   (unsigned long) mesh->id, maximumIndex, mesh->vertexCount);
+            status = EXIT_FAILURE;
+            break;
+        }
+        ResidentMesh* residentMesh = allocateResidentMesh(cache);
+        if (residentMesh == NULL)
+        {
+            printf("No room for mesh %lu, all %d resident meshes are in use\n",
+                   (unsigned long) mesh->id, MAX_RESIDENT_MESHES);
+            status = EXIT_FAILURE;
+            break;
+        }
+        /// Vertex and index buffers only need device local memory, the device is the only
+        /// one to access them. On devices without a separate host visible heap all memory
+        /// is device local anyway.
+        if (createBuffer(cache,
+                         (VkDeviceSize) mesh->vertexCount * 3 * sizeof(float),
+                         VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         0,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                         &residentMesh->vertexBuffer,
+                         &residentMesh->vertexMemory) != EXIT_SUCCESS ||
+            createBuffer(cache,
+                         (VkDeviceSize) mesh->indexCount * sizeof(uint32_t),
+                         VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         0,
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                         &residentMesh->indexBuffer,
+                         &residentMesh->indexMemory) != EXIT_SUCCESS)
+        {
+            destroyResidentMesh(cache, residentMesh);
+            status = EXIT_FAILURE;
+            break;
+        }
+        residentMesh->id = mesh->id;
+        residentMesh->serial = ++cache->serialCount;
+        residentMesh->lastUsed = cache->useCount;
+        residentMesh->indexCount = mesh->indexCount;
+        memcpy(residentMesh->bounds, bounds, sizeof(bounds));
+        residentMeshes[i] = residentMesh;
+        uploadCount++;
+    }
+    if (status == EXIT_SUCCESS && uploadCount == 0)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    /// All copies go into one command buffer, as many as fit into the staging buffer.
+    if (status == EXIT_SUCCESS)
+    {
+        status = beginUploads(cache);
+    }
+    VkDeviceSize stagingOffset = 0;
+    for (uint32_t i = 0; i < meshCount && status == EXIT_SUCCESS; ++i)
+    {
+        const Mesh* mesh = &meshes[i];
+        ResidentMesh* residentMesh = residentMeshes[i];
+        /// Only meshes allocated above have a serial from this call, and a mesh that appears
+        /// twice in the batch is uploaded once.
+        if (residentMesh->serial < firstSerial)
+        {
+            continue;
+        }
+        uint32_t duplicate = 0;
+        for (uint32_t j = 0; j < i; ++j)
+        {
+            duplicate |= residentMeshes[j] == residentMesh;
+        }
+        if (duplicate)
+        {
+            continue;
+        }
+        status = stageCopy(cache,
+                           mesh->positions,
+                           (VkDeviceSize) mesh->vertexCount * 3 * sizeof(float),
+                           residentMesh->vertexBuffer,
+                           &stagingOffset);
+        if (status == EXIT_SUCCESS)
+        {
+            status = stageCopy(cache,
+                               mesh->indices,
+                               (VkDeviceSize) mesh->indexCount * sizeof(uint32_t),
+                               residentMesh->indexBuffer,
+                               &stagingOffset);
+        }
+        cache->uploadedMeshCount += status == EXIT_SUCCESS;
+    }
+    if (status == EXIT_SUCCESS)
+    {
+        status = submitUploads(cache);
+    }
+    /// Meshes whose upload failed must not be mistaken for resident ones later on. The
+    /// device may still be reading the staging buffer, or writing the mesh buffers.
+    if (status != EXIT_SUCCESS)
+    {
+        vkDeviceWaitIdle(cache->device);
+        for (uint32_t i = 0; i < cache->meshCount; ++i)
+        {
+            if (cache->meshes[i].serial >= firstSerial)
+            {
+                destroyResidentMesh(cache, &cache->meshes[i]);
+            }
+        }
+    }
+    return status;
+}
+
+
+void
+meshCacheShutdown(MeshCache* cache)
+{
+    for (uint32_t i = 0; i < cache->meshCount; ++i)
+    {
+        destroyResidentMesh(cache, &cache->meshes[i]);
+    }
+    cache->meshCount = 0;
+    if (cache->device == VK_NULL_HANDLE)
+    {
+        return;
+    }
+    vkDestroyBuffer(cache->device, cache->stagingBuffer, NULL);
+    memoryAllocatorFree(cache->allocator, &cache->stagingMemory);
+    vkDestroyFence(cache->device, cache->fence, NULL);
+    /// Destroying the pool frees its command buffer.
+    vkDestroyCommandPool(cache->device, cache->commandPool, NULL);
+    memset(cache, 0, sizeof(*cache));
+}
@@ -0,0 +1,110 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+/// Device local vertex and index buffers.
+///
+/// The fastest memory for the device to read vertices from is device local, which on a
+/// discrete GPU is not visible to the host. Meshes are therefore uploaded through a staging
+/// buffer in host visible memory: the host copies the data into the staging buffer, and a
+/// command buffer copies it on to the device local buffers. The staging buffer has a fixed
+/// size and is reused for every upload. The copies of all meshes uploaded together are
+/// batched into one command buffer, and only a batch that does not fit the staging buffer
+/// is split into several submissions.
+///
+/// Uploaded meshes stay resident, identified by the id the caller gave them, so rendering
+/// the same mesh again costs nothing. When the cache is full, the least recently used mesh
+/// that no frame in flight refers to is evicted.
+
+#include "memory_allocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <stdint.h>
+
+#ifndef MAX_RESIDENT_MESHES
+#define MAX_RESIDENT_MESHES 64
+#endif
+
+/// Size of the staging buffer that uploads go through.
+#ifndef MESH_STAGING_BUFFER_SIZE
+#define MESH_STAGING_BUFFER_SIZE (16 * 1024 * 1024)
+#endif
+
+
+/// Triangle list with 32 bit indices into vertices of 3 floats (x, y, z). The data is only
+/// read while the mesh is uploaded.
+typedef struct Mesh {
+    /// Chosen by the caller, meshes with the same id are the same mesh. Id 0 is reserved.
+    uint64_t id;
+    const float* positions;
+    uint32_t vertexCount;
+    const uint32_t* indices;
+    uint32_t indexCount;
+} Mesh;
+
+
+typedef struct ResidentMesh {
+    uint64_t id;
+    /// Distinguishes the meshes that have lived in the same slot, for command buffers that
+    /// were recorded against an earlier one.
+    uint64_t serial;
+    uint64_t lastUsed;
+    /// Number of frames in flight that draw the mesh.
+    uint32_t inUse;
+    uint32_t indexCount;
+    /// Bounding sphere of the vertices, center (x, y, z) and radius, for culling.
+    float bounds[4];
+    VkBuffer vertexBuffer;
+    MemoryAllocation vertexMemory;
+    VkBuffer indexBuffer;
+    MemoryAllocation indexMemory;
+} ResidentMesh;
+
+
+typedef struct MeshCache {
+    VkDevice device;
+    VkQueue queue;
+    MemoryAllocator* allocator;
+    VkCommandPool commandPool;
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    VkBuffer stagingBuffer;
+    MemoryAllocation stagingMemory;
+
+    ResidentMesh meshes[MAX_RESIDENT_MESHES];
+    uint32_t meshCount;
+    uint64_t useCount;
+    uint64_t serialCount;
+
+    /// Totals over the lifetime of the cache.
+    uint64_t uploadedMeshCount;
+    uint64_t uploadedBytes;
+    uint64_t submissionCount;
+} MeshCache;
+
+
+/// Create the staging buffer, command pool and fence for uploads on `queue`.
+/// On failure the cache is left in a state that `meshCacheShutdown` can clean up.
+int
+meshCacheInit(MeshCache* cache,
+              VkDevice device,
+              VkQueue queue,
+              uint32_t queueFamilyIndex,
+              MemoryAllocator* allocator);
+
+/// Make the meshes resident, uploading those that are not yet, and write their resident
+/// versions to `residentMeshes`. Returns when the uploads have finished. The returned
+/// pointers stay valid until the meshes are evicted, which only happens to meshes that are
+/// not in use (see ResidentMesh.inUse). Meshes with an index that is not below their
+/// vertexCount are rejected.
+int
+meshCacheUpload(MeshCache* cache,
+                const Mesh* meshes,
+                uint32_t meshCount,
+                ResidentMesh** residentMeshes);
+
+/// Destroy all resident meshes and the staging resources. The device must be idle.
+void
+meshCacheShutdown(MeshCache* cache);
+
+#endif // MESH_CACHE_H
@@ -0,0 +1,1126 @@
+#include "mesh_loader.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Smallest share of a file worth handing to a thread of its own.
+#define MIN_CHUNK_SIZE (64 * 1024)
+
+#define MAX_PATH_LENGTH 4096
+
+
+typedef struct MappedFile {
+    const char* data;
+    size_t size;
+    struct stat status;
+} MappedFile;
+
+
+/// Header of the cache file, followed by vertexCount * 3 floats and indexCount indices.
+/// The size and modification time of the source file tell whether the cache is stale.
+typedef struct MeshCacheFileHeader {
+    char magic[8];
+    uint64_t sourceSize;
+    int64_t sourceModifiedSeconds;
+    int64_t sourceModifiedNanoseconds;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+} MeshCacheFileHeader;
+
+static const char meshCacheFileMagic[8] = { 'M', 'E', 'S', 'H', 'C', 'C', 'H', '1' };
+
+
+static int
+mapFile(const char* path, MappedFile* file)
+{
+    memset(file, 0, sizeof(*file));
+    int descriptor = open(path, O_RDONLY);
+    if (descriptor < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    if (fstat(descriptor, &file->status) != 0 || file->status.st_size == 0)
+    {
+        close(descriptor);
+        return EXIT_FAILURE;
+    }
+    file->size = (size_t) file->status.st_size;
+    void* data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    /// The mapping keeps the file alive, the descriptor is no longer needed.
+    close(descriptor);
+    if (data == MAP_FAILED)
+    {
+        return EXIT_FAILURE;
+    }
+    /// Every page is read once, front to back within each chunk. Ask the kernel to read
+    /// ahead aggressively. The advice values are not flags, so they take a call each.
+    madvise(data, file->size, MADV_SEQUENTIAL);
+    madvise(data, file->size, MADV_WILLNEED);
+    file->data = (const char*) data;
+    return EXIT_SUCCESS;
+}
+
+
+static void
+unmapFile(MappedFile* file)
+{
+    if (file->data != NULL)
+    {
+        munmap((void*) file->data, file->size);
+    }
+    memset(file, 0, sizeof(*file));
+}
+
+
+static uint32_t
+loaderThreadCount(uint32_t requested, size_t size)
+{
+    if (requested == 0)
+    {
+        long coreCount = sysconf(_SC_NPROCESSORS_ONLN);
+        requested = coreCount > 0 ? (uint32_t) coreCount : 1;
+    }
+    size_t useful = size / MIN_CHUNK_SIZE + 1;
+    requested = requested < useful ? requested : (uint32_t) useful;
+    return requested < MAX_MESH_LOADER_THREADS ? requested : MAX_MESH_LOADER_THREADS;
+}
+
+
+/// Run `function` on each of `count` tasks of `taskSize` bytes, one thread per task, the
+/// first task on the calling thread. Tasks whose thread fails to start run on the calling
+/// thread as well.
+static void
+runTasks(void* (*function)(void*), void* tasks, size_t taskSize, uint32_t count)
+{
+    pthread_t threads[MAX_MESH_LOADER_THREADS];
+    int started[MAX_MESH_LOADER_THREADS] = {0};
+    for (uint32_t i = 1; i < count; ++i)
+    {
+        started[i] = pthread_create(&threads[i], NULL, function,
+                                    (char*) tasks + i * taskSize) == 0;
+    }
+    function(tasks);
+    for (uint32_t i = 1; i < count; ++i)
+    {
+        if (started[i])
+        {
+            pthread_join(threads[i], NULL);
+        }
+        else
+        {
+            function((char*) tasks + i * taskSize);
+        }
+    }
+}
+
+
+static int
+allocateMesh(LoadedMesh* loadedMesh, uint64_t vertexCount, uint64_t indexCount)
+{
+    if (vertexCount == 0 || indexCount == 0 ||
+        vertexCount > UINT32_MAX / 3 || indexCount > UINT32_MAX)
+    {
+        printf("Unsupported mesh with %lu vertices and %lu indices\n",
+               (unsigned long) vertexCount, (unsigned long) indexCount);
+        return EXIT_FAILURE;
+    }
+    loadedMesh->positions = (float*) malloc(vertexCount * 3 * sizeof(float));
+    loadedMesh->indices = (uint32_t*) malloc(indexCount * sizeof(uint32_t));
+    if (loadedMesh->positions == NULL || loadedMesh->indices == NULL)
+    {
+        printf("Failed to allocate mesh with %lu vertices and %lu indices\n",
+               (unsigned long) vertexCount, (unsigned long) indexCount);
+        return EXIT_FAILURE;
+    }
+    loadedMesh->mesh.positions = loadedMesh->positions;
+    loadedMesh->mesh.vertexCount = (uint32_t) vertexCount;
+    loadedMesh->mesh.indices = loadedMesh->indices;
+    loadedMesh->mesh.indexCount = (uint32_t) indexCount;
+    return EXIT_SUCCESS;
+}
+
+
+////////////////////////////////////
+////////// OBJ /////////////////////
+////////////////////////////////////
+
+
+static inline int
+isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+
+static inline const char*
+skipBlanks(const char* p, const char* end)
+{
+    while (p < end && isBlank(*p))
+    {
+        ++p;
+    }
+    return p;
+}
+
+
+static inline const char*
+skipToken(const char* p, const char* end)
+{
+    while (p < end && !isBlank(*p) && *p != '\n')
+    {
+        ++p;
+    }
+    return p;
+}
+
+
+static inline const char*
+nextLine(const char* p, const char* end)
+{
+    const char* newline = (const char*) memchr(p, '\n', (size_t) (end - p));
+    return newline != NULL ? newline + 1 : end;
+}
+
+
+/// Parse a decimal floating point number, like strtof but without locale lookups and
+/// without the need for a terminating character. Returns NULL if there is no number.
+static const char*
+parseFloat(const char* p, const char* end, float* value)
+{
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        ++p;
+    }
+    double mantissa = 0.0;
+    int digitCount = 0;
+    int exponent = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        mantissa = 10.0 * mantissa + (*p++ - '0');
+        ++digitCount;
+    }
+    if (p < end && *p == '.')
+    {
+        ++p;
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            mantissa = 10.0 * mantissa + (*p++ - '0');
+            ++digitCount;
+            --exponent;
+        }
+    }
+    if (digitCount == 0)
+    {
+        return NULL;
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        int exponentSign = 1;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            exponentSign = *p == '-' ? -1 : 1;
+            ++p;
+        }
+        if (p == end || *p < '0' || *p > '9')
+        {
+            return NULL;
+        }
+        int explicitExponent = 0;
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            explicitExponent = explicitExponent < 1000
+                             ? 10 * explicitExponent + (*p - '0')
+                             : explicitExponent;
+            ++p;
+        }
+        exponent += exponentSign * explicitExponent;
+    }
+    double scale = 1.0;
+    double power = 10.0;
+    for (int n = exponent < 0 ? -exponent : exponent; n > 0; n >>= 1)
+    {
+        if (n & 1)
+        {
+            scale *= power;
+        }
+        power *= power;
+    }
+    double result = exponent < 0 ? mantissa / scale : mantissa * scale;
+    *value = (float) (negative ? -result : result);
+    return p;
+}
+
+
+static const char*
+parseInteger(const char* p, const char* end, int64_t* value)
+{
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        ++p;
+    }
+    if (p == end || *p < '0' || *p > '9')
+    {
+        return NULL;
+    }
+    int64_t result = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        result = result < INT64_MAX / 16 ? 10 * result + (*p - '0') : result;
+        ++p;
+    }
+    *value = negative ? -result : result;
+    return p;
+}
+
+
+static inline int
+isObjStatement(const char* p, const char* end, char statement)
+{
+    return end - p >= 2 && p[0] == statement && isBlank(p[1]);
+}
+
+
+typedef struct ObjChunk {
+    const char* begin;
+    const char* end;
+    /// Counted by the first pass.
+    uint64_t vertexCount;
+    uint64_t triangleCount;
+    /// Where the chunk writes its results, from the counts of the chunks before it.
+    uint64_t vertexOffset;
+    uint64_t triangleOffset;
+    uint64_t totalVertexCount;
+    float* positions;
+    uint32_t* indices;
+    int status;
+} ObjChunk;
+
+
+static void*
+countObjChunk(void* argument)
+{
+    ObjChunk* chunk = (ObjChunk*) argument;
+    const char* end = chunk->end;
+    for (const char* line = chunk->begin; line < end; line = nextLine(line, end))
+    {
+        const char* p = skipBlanks(line, end);
+        if (isObjStatement(p, end, 'v'))
+        {
+            chunk->vertexCount++;
+        }
+        else if (isObjStatement(p, end, 'f'))
+        {
+            uint32_t cornerCount = 0;
+            for (p = skipBlanks(p + 1, end); p < end && *p != '\n'; p = skipBlanks(p, end))
+            {
+                p = skipToken(p, end);
+                cornerCount++;
+            }
+            chunk->triangleCount += cornerCount >= 3 ? cornerCount - 2 : 0;
+        }
+    }
+    return NULL;
+}
+
+
+static void*
+parseObjChunk(void* argument)
+{
+    ObjChunk* chunk = (ObjChunk*) argument;
+    const char* end = chunk->end;
+    uint64_t vertex = chunk->vertexOffset;
+    uint32_t* indices = chunk->indices + 3 * chunk->triangleOffset;
+    chunk->status = EXIT_SUCCESS;
+    for (const char* line = chunk->begin; line < end; line = nextLine(line, end))
+    {
+        const char* p = skipBlanks(line, end);
+        if (isObjStatement(p, end, 'v'))
+        {
+            float* position = chunk->positions + 3 * vertex++;
+            p = skipBlanks(p + 1, end);
+            for (uint32_t i = 0; i < 3 && p != NULL; ++i)
+            {
+                p = parseFloat(skipBlanks(p, end), end, &position[i]);
+            }
+            if (p == NULL)
+            {
+                printf("Invalid OBJ vertex: %.*s\n",
+                       (int) (nextLine(line, end) - line - 1), line);
+                chunk->status = EXIT_FAILURE;
+                return NULL;
+            }
+        }
+        else if (isObjStatement(p, end, 'f'))
+        {
+            /// Each corner is v, v/vt, v//vn or v/vt/vn, only v matters to us. Polygons
+            /// become fans of triangles around their first corner.
+            uint32_t corners[2];
+            uint32_t cornerCount = 0;
+            for (p = skipBlanks(p + 1, end); p < end && *p != '\n'; p = skipBlanks(p, end))
+            {
+                int64_t index = 0;
+                const char* next = parseInteger(p, end, &index);
+                /// Indices count from 1, negative ones count back from the last vertex.
+                int64_t resolved = next == NULL ? -1
+                                 : index > 0 ? index - 1
+                                 : (int64_t) vertex + index;
+                if (index == 0 || resolved < 0 || (uint64_t) resolved >= chunk->totalVertexCount)
+                {
+                    printf("Invalid OBJ face: %.*s\n",
+                           (int) (nextLine(line, end) - line - 1), line);
+                    chunk->status = EXIT_FAILURE;
+                    return NULL;
+                }
+                p = skipToken(next, end);
+                if (cornerCount >= 2)
+                {
+                    *indices++ = corners[0];
+                    *indices++ = corners[1];
+                    *indices++ = (uint32_t) resolved;
+                    corners[1] = (uint32_t) resolved;
+                }
+                else
+                {
+                    corners[cornerCount] = (uint32_t) resolved;
+                }
+                cornerCount++;
+            }
+        }
+    }
+    return NULL;
+}
+
+
+static int
+parseObj(const MappedFile* file, uint32_t threadCount, LoadedMesh* loadedMesh)
+{
+    ObjChunk chunks[MAX_MESH_LOADER_THREADS];
+    memset(chunks, 0, sizeof(chunks));
+    const char* end = file->data + file->size;
+    /// Chunks start at the beginning of a line, so that no line is split between threads.
+    const char* begin = file->data;
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        const char* chunkEnd = i + 1 < threadCount
+                             ? file->data + file->size * (i + 1) / threadCount
+                             : end;
+        if (chunkEnd > begin && chunkEnd < end && chunkEnd[-1] != '\n')
+        {
+            chunkEnd = nextLine(chunkEnd, end);
+        }
+        chunkEnd = chunkEnd > begin ? chunkEnd : begin;
+        chunks[i].begin = begin;
+        chunks[i].end = chunkEnd;
+        begin = chunkEnd;
+    }
+    runTasks(countObjChunk, chunks, sizeof(ObjChunk), threadCount);
+
+    uint64_t vertexCount = 0;
+    uint64_t triangleCount = 0;
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        chunks[i].vertexOffset = vertexCount;
+        chunks[i].triangleOffset = triangleCount;
+        vertexCount += chunks[i].vertexCount;
+        triangleCount += chunks[i].triangleCount;
+    }
+    if (allocateMesh(loadedMesh, vertexCount, 3 * triangleCount) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        chunks[i].totalVertexCount = vertexCount;
+        chunks[i].positions = loadedMesh->positions;
+        chunks[i].indices = loadedMesh->indices;
+    }
+    runTasks(parseObjChunk, chunks, sizeof(ObjChunk), threadCount);
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        if (chunks[i].status != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+
+////////////////////////////////////
+////////// PLY /////////////////////
+////////////////////////////////////
+
+
+typedef enum PlyType {
+    PLY_NONE,
+    PLY_INT8,
+    PLY_UINT8,
+    PLY_INT16,
+    PLY_UINT16,
+    PLY_INT32,
+    PLY_UINT32,
+    PLY_FLOAT32,
+    PLY_FLOAT64
+} PlyType;
+
+
+static PlyType
+plyType(const char* name)
+{
+    static const struct { const char* name; PlyType type; } types[] = {
+        { "char", PLY_INT8 }, { "int8", PLY_INT8 },
+        { "uchar", PLY_UINT8 }, { "uint8", PLY_UINT8 },
+        { "short", PLY_INT16 }, { "int16", PLY_INT16 },
+        { "ushort", PLY_UINT16 }, { "uint16", PLY_UINT16 },
+        { "int", PLY_INT32 }, { "int32", PLY_INT32 },
+        { "uint", PLY_UINT32 }, { "uint32", PLY_UINT32 },
+        { "float", PLY_FLOAT32 }, { "float32", PLY_FLOAT32 },
+        { "double", PLY_FLOAT64 }, { "float64", PLY_FLOAT64 }
+    };
+    for (uint32_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i)
+    {
+        if (strcmp(name, types[i].name) == 0)
+        {
+            return types[i].type;
+        }
+    }
+    return PLY_NONE;
+}
+
+
+static uint32_t
+plyTypeSize(PlyType type)
+{
+    switch (type)
+    {
+        case PLY_INT8:
+        case PLY_UINT8: return 1;
+        case PLY_INT16:
+        case PLY_UINT16: return 2;
+        case PLY_INT32:
+        case PLY_UINT32:
+        case PLY_FLOAT32: return 4;
+        case PLY_FLOAT64: return 8;
+        default: return 0;
+    }
+}
+
+
+/// Read a little endian scalar, on a little endian host. Records are packed, so the value
+/// may be unaligned, which memcpy takes care of.
+static double
+plyRead(PlyType type, const uint8_t* p)
+{
+    switch (type)
+    {
+        case PLY_INT8: return (int8_t) *p;
+        case PLY_UINT8: return *p;
+        case PLY_INT16: { int16_t v; memcpy(&v, p, sizeof(v)); return v; }
+        case PLY_UINT16: { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+        case PLY_INT32: { int32_t v; memcpy(&v, p, sizeof(v)); return v; }
+        case PLY_UINT32: { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+        case PLY_FLOAT32: { float v; memcpy(&v, p, sizeof(v)); return v; }
+        case PLY_FLOAT64: { double v; memcpy(&v, p, sizeof(v)); return v; }
+        default: return 0.0;
+    }
+}
+
+
+typedef struct PlyLayout {
+    const uint8_t* vertices;
+    uint32_t vertexCount;
+    uint32_t vertexSize;
+    uint32_t positionOffsets[3];
+    PlyType positionTypes[3];
+    const uint8_t* faces;
+    uint32_t faceCount;
+    PlyType countType;
+    PlyType indexType;
+    const uint8_t* end;
+} PlyLayout;
+
+
+typedef struct PlyTask {
+    const PlyLayout* layout;
+    uint32_t first;
+    uint32_t last;
+    float* positions;
+    uint32_t* indices;
+    /// Set by the face pass when all faces of the task are in-range triangles.
+    int status;
+} PlyTask;
+
+
+static void*
+parsePlyVertices(void* argument)
+{
+    PlyTask* task = (PlyTask*) argument;
+    const PlyLayout* layout = task->layout;
+    for (uint32_t i = task->first; i < task->last; ++i)
+    {
+        const uint8_t* record = layout->vertices + (size_t) i * layout->vertexSize;
+        for (uint32_t j = 0; j < 3; ++j)
+        {
+            task->positions[3 * i + j] =
+                (float) plyRead(layout->positionTypes[j], record + layout->positionOffsets[j]);
+        }
+    }
+    return NULL;
+}
+
+
+static void*
+parsePlyTriangles(void* argument)
+{
+    PlyTask* task = (PlyTask*) argument;
+    const PlyLayout* layout = task->layout;
+    uint32_t countSize = plyTypeSize(layout->countType);
+    uint32_t indexSize = plyTypeSize(layout->indexType);
+    size_t recordSize = countSize + 3 * indexSize;
+    task->status = EXIT_SUCCESS;
+    for (uint32_t i = task->first; i < task->last; ++i)
+    {
+        const uint8_t* record = layout->faces + i * recordSize;
+        if (plyRead(layout->countType, record) != 3.0)
+        {
+            task->status = EXIT_FAILURE;
+            return NULL;
+        }
+        for (uint32_t j = 0; j < 3; ++j)
+        {
+            double index = plyRead(layout->indexType, record + countSize + j * indexSize);
+            if (index < 0.0 || index >= layout->vertexCount)
+            {
+                task->status = EXIT_FAILURE;
+                return NULL;
+            }
+            task->indices[3 * i + j] = (uint32_t) index;
+        }
+    }
+    return NULL;
+}
+
+
+/// Faces that are not all triangles are read one after the other, counting first and then
+/// splitting polygons into fans.
+static int
+parsePlyPolygons(const PlyLayout* layout, LoadedMesh* loadedMesh)
+{
+    uint32_t countSize = plyTypeSize(layout->countType);
+    uint32_t indexSize = plyTypeSize(layout->indexType);
+    uint64_t triangleCount = 0;
+    const uint8_t* p = layout->faces;
+    for (uint32_t i = 0; i < layout->faceCount; ++i)
+    {
+        if (p + countSize > layout->end)
+        {
+            printf("Truncated PLY faces\n");
+            return EXIT_FAILURE;
+        }
+        uint32_t cornerCount = (uint32_t) plyRead(layout->countType, p);
+        triangleCount += cornerCount >= 3 ? cornerCount - 2 : 0;
+        p += countSize + (size_t) cornerCount * indexSize;
+    }
+    if (p > layout->end)
+    {
+        printf("Truncated PLY faces\n");
+        return EXIT_FAILURE;
+    }
+    free(loadedMesh->indices);
+    loadedMesh->indices = (uint32_t*) malloc(3 * triangleCount * sizeof(uint32_t));
+    if (triangleCount == 0 || 3 * triangleCount > UINT32_MAX || loadedMesh->indices == NULL)
+    {
+        printf("Unsupported PLY mesh with %lu triangles\n", (unsigned long) triangleCount);
+        return EXIT_FAILURE;
+    }
+    loadedMesh->mesh.indices = loadedMesh->indices;
+    loadedMesh->mesh.indexCount = (uint32_t) (3 * triangleCount);
+    uint32_t* indices = loadedMesh->indices;
+    p = layout->faces;
+    for (uint32_t i = 0; i < layout->faceCount; ++i)
+    {
+        uint32_t cornerCount = (uint32_t) plyRead(layout->countType, p);
+        p += countSize;
+        uint32_t corners[2];
+        for (uint32_t j = 0; j < cornerCount; ++j, p += indexSize)
+        {
+            double index = plyRead(layout->indexType, p);
+            if (index < 0.0 || index >= layout->vertexCount)
+            {
+                printf("Invalid PLY vertex index %.0f\n", index);
+                return EXIT_FAILURE;
+            }
+            if (j >= 2)
+            {
+                *indices++ = corners[0];
+                *indices++ = corners[1];
+                *indices++ = (uint32_t) index;
+                corners[1] = (uint32_t) index;
+            }
+            else
+            {
+                corners[j] = (uint32_t) index;
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/// Read the header, which is text up to "end_header". We support a vertex element with
+/// scalar properties, including x, y and z, followed by a face element with a single list
+/// property. Elements after the faces are ignored.
+static int
+parsePlyHeader(const MappedFile* file, PlyLayout* layout)
+{
+    memset(layout, 0, sizeof(*layout));
+    const char* end = file->data + file->size;
+    const char* line = file->data;
+    enum { NO_ELEMENT, VERTEX_ELEMENT, FACE_ELEMENT, OTHER_ELEMENT } element = NO_ELEMENT;
+    uint32_t positionsFound = 0;
+    int binary = 0;
+    while (line < end)
+    {
+        const char* next = nextLine(line, end);
+        char text[256];
+        size_t length = (size_t) (next - line) < sizeof(text) ? (size_t) (next - line)
+                                                               : sizeof(text) - 1;
+        memcpy(text, line, length);
+        text[length] = '\0';
+        line = next;
+
+        char words[5][64] = {{0}};
+        int wordCount = sscanf(text, "%63s %63s %63s %63s %63s",
+                               words[0], words[1], words[2], words[3], words[4]);
+        if (wordCount <= 0)
+        {
+            continue;
+        }
+        if (strcmp(words[0], "end_header") == 0)
+        {
+            layout->vertices = (const uint8_t*) line;
+            break;
+        }
+        if (strcmp(words[0], "format") == 0)
+        {
+            binary = wordCount >= 2 && strcmp(words[1], "binary_little_endian") == 0;
+        }
+        else if (strcmp(words[0], "element") == 0 && wordCount >= 3)
+        {
+            uint32_t count = (uint32_t) strtoul(words[2], NULL, 10);
+            if (strcmp(words[1], "vertex") == 0 && element == NO_ELEMENT)
+            {
+                element = VERTEX_ELEMENT;
+                layout->vertexCount = count;
+            }
+            else if (strcmp(words[1], "face") == 0 && element == VERTEX_ELEMENT)
+            {
+                element = FACE_ELEMENT;
+                layout->faceCount = count;
+            }
+            else if (element == FACE_ELEMENT || element == OTHER_ELEMENT)
+            {
+                element = OTHER_ELEMENT;
+            }
+            else
+            {
+                printf("Unsupported PLY element %s, expected vertices and then faces\n",
+                       words[1]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(words[0], "property") == 0 && element == VERTEX_ELEMENT)
+        {
+            PlyType type = plyType(words[1]);
+            if (type == PLY_NONE || wordCount < 3)
+            {
+                printf("Unsupported PLY vertex property: %s", text);
+                return EXIT_FAILURE;
+            }
+            if (words[2][0] >= 'x' && words[2][0] <= 'z' && words[2][1] == '\0')
+            {
+                layout->positionOffsets[words[2][0] - 'x'] = layout->vertexSize;
+                layout->positionTypes[words[2][0] - 'x'] = type;
+                positionsFound |= 1u << (words[2][0] - 'x');
+            }
+            layout->vertexSize += plyTypeSize(type);
+        }
+        else if (strcmp(words[0], "property") == 0 && element == FACE_ELEMENT)
+        {
+            if (wordCount < 5 || strcmp(words[1], "list") != 0 ||
+                (layout->countType = plyType(words[2])) == PLY_NONE ||
+                (layout->indexType = plyType(words[3])) == PLY_NONE ||
+                layout->indexType == PLY_FLOAT32 || layout->indexType == PLY_FLOAT64)
+            {
+                printf("Unsupported PLY face property: %s", text);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    if (!binary)
+    {
+        printf("Only binary little endian PLY files are supported\n");
+        return EXIT_FAILURE;
+    }
+    if (layout->vertices == NULL || positionsFound != 7 || layout->countType == PLY_NONE)
+    {
+        printf("PLY file without vertex positions or faces\n");
+        return EXIT_FAILURE;
+    }
+    layout->faces = layout->vertices + (size_t) layout->vertexCount * layout->vertexSize;
+    layout->end = (const uint8_t*) end;
+    if (layout->faces > layout->end)
+    {
+        printf("Truncated PLY vertices\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+static int
+parsePly(const MappedFile* file, uint32_t threadCount, LoadedMesh* loadedMesh)
+{
+    uint16_t probe = 1;
+    if (*(const uint8_t*) &probe != 1)
+    {
+        printf("Binary PLY files are only supported on little endian hosts\n");
+        return EXIT_FAILURE;
+    }
+    PlyLayout layout;
+    if (parsePlyHeader(file, &layout) != EXIT_SUCCESS ||
+        allocateMesh(loadedMesh, layout.vertexCount, 3 * (uint64_t) layout.faceCount)
+        != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    PlyTask tasks[MAX_MESH_LOADER_THREADS];
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        tasks[i] = (PlyTask) {
+            .layout = &layout,
+            .first = (uint32_t) ((uint64_t) layout.vertexCount * i / threadCount),
+            .last = (uint32_t) ((uint64_t) layout.vertexCount * (i + 1) / threadCount),
+            .positions = loadedMesh->positions,
+            .indices = loadedMesh->indices
+        };
+    }
+    runTasks(parsePlyVertices, tasks, sizeof(PlyTask), threadCount);
+
+    /// Assume triangles, which gives every face the same record size, as long as the file
+    /// is large enough for that.
+    size_t triangleRecordSize = plyTypeSize(layout.countType) + 3 * plyTypeSize(layout.indexType);
+    int triangles = (size_t) (layout.end - layout.faces) / triangleRecordSize >= layout.faceCount;
+    if (triangles)
+    {
+        for (uint32_t i = 0; i < threadCount; ++i)
+        {
+            tasks[i].first = (uint32_t) ((uint64_t) layout.faceCount * i / threadCount);
+            tasks[i].last = (uint32_t) ((uint64_t) layout.faceCount * (i + 1) / threadCount);
+        }
+        runTasks(parsePlyTriangles, tasks, sizeof(PlyTask), threadCount);
+        for (uint32_t i = 0; i < threadCount; ++i)
+        {
+            triangles &= tasks[i].status == EXIT_SUCCESS;
+        }
+    }
+    return triangles ? EXIT_SUCCESS : parsePlyPolygons(&layout, loadedMesh);
+}
+
+
+////////////////////////////////////
+////////// Loading /////////////////
+////////////////////////////////////
+
+
+static int
+hasExtension(const char* path, const char* extension)
+{
+    size_t length = strlen(path);
+    size_t extensionLength = strlen(extension);
+    return length >= extensionLength &&
+           strcasecmp(path + length - extensionLength, extension) == 0;
+}
+
+
+int
+meshLoaderParse(const char* path, uint32_t threadCount, LoadedMesh* loadedMesh)
+{
+    memset(loadedMesh, 0, sizeof(*loadedMesh));
+    int obj = hasExtension(path, ".obj");
+    if (!obj && !hasExtension(path, ".ply"))
+    {
+        printf("Unsupported mesh file %s, expected .obj or .ply\n", path);
+        return EXIT_FAILURE;
+    }
+    MappedFile file;
+    if (mapFile(path, &file) != EXIT_SUCCESS)
+    {
+        printf("Failed to map %s\n", path);
+        return EXIT_FAILURE;
+    }
+    threadCount = loaderThreadCount(threadCount, file.size);
+    int status = obj ? parseObj(&file, threadCount, loadedMesh)
+                     : parsePly(&file, threadCount, loadedMesh);
+    unmapFile(&file);
+    if (status != EXIT_SUCCESS)
+    {
+        printf("Failed to parse %s\n", path);
+        meshLoaderFree(loadedMesh);
+    }
+    return status;
+}
+
+
+/// Append to a growing array, doubling its capacity when full.
+static int
+reserve(void** array, size_t* capacity, size_t count, size_t elementSize)
+{
+    if (count <= *capacity)
+    {
+        return EXIT_SUCCESS;
+    }
+    size_t newCapacity = *capacity > 0 ? 2 * *capacity : 1024;
+    newCapacity = newCapacity >= count ? newCapacity : count;
+    void* newArray = realloc(*array, newCapacity * elementSize);
+    if (newArray == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    *array = newArray;
+    *capacity = newCapacity;
+    return EXIT_SUCCESS;
+}
+
+
+int
+meshLoaderParseStdio(const char* path, LoadedMesh* loadedMesh)
+{
+    memset(loadedMesh, 0, sizeof(*loadedMesh));
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        printf("Failed to open %s\n", path);
+        return EXIT_FAILURE;
+    }
+    size_t vertexCount = 0, vertexCapacity = 0;
+    size_t indexCount = 0, indexCapacity = 0;
+    int status = EXIT_SUCCESS;
+    char line[4096];
+    while (status == EXIT_SUCCESS && fgets(line, sizeof(line), file) != NULL)
+    {
+        float x, y, z;
+        if (line[0] == 'v' && isBlank(line[1]))
+        {
+            status = sscanf(line + 2, "%f %f %f", &x, &y, &z) == 3 &&
+                     reserve((void**) &loadedMesh->positions, &vertexCapacity,
+                             vertexCount + 1, 3 * sizeof(float)) == EXIT_SUCCESS
+                   ? EXIT_SUCCESS
+                   : EXIT_FAILURE;
+            if (status == EXIT_SUCCESS)
+            {
+                loadedMesh->positions[3 * vertexCount + 0] = x;
+                loadedMesh->positions[3 * vertexCount + 1] = y;
+                loadedMesh->positions[3 * vertexCount + 2] = z;
+                vertexCount++;
+            }
+        }
+        else if (line[0] == 'f' && isBlank(line[1]))
+        {
+            uint32_t corners[2];
+            uint32_t cornerCount = 0;
+            char* save = NULL;
+            for (char* token = strtok_r(line + 2, " \t\r\n", &save);
+                 token != NULL && status == EXIT_SUCCESS;
+                 token = strtok_r(NULL, " \t\r\n", &save))
+            {
+                long index = strtol(token, NULL, 10);
+                long resolved = index > 0 ? index - 1 : (long) vertexCount + index;
+                if (index == 0 || resolved < 0 || (size_t) resolved >= vertexCount)
+                {
+                    status = EXIT_FAILURE;
+                    break;
+                }
+                if (cornerCount >= 2)
+                {
+                    status = reserve((void**) &loadedMesh->indices, &indexCapacity,
+                                     indexCount + 3, sizeof(uint32_t));
+                    if (status == EXIT_SUCCESS)
+                    {
+                        loadedMesh->indices[indexCount++] = corners[0];
+                        loadedMesh->indices[indexCount++] = corners[1];
+                        loadedMesh->indices[indexCount++] = (uint32_t) resolved;
+                        corners[1] = (uint32_t) resolved;
+                    }
+                }
+                else
+                {
+                    corners[cornerCount] = (uint32_t) resolved;
+                }
+                cornerCount++;
+            }
+        }
+    }
+    fclose(file);
+    if (status != EXIT_SUCCESS || vertexCount == 0 || indexCount == 0)
+    {
+        printf("Failed to parse %s\n", path);
+        meshLoaderFree(loadedMesh);
+        return EXIT_FAILURE;
+    }
+    loadedMesh->mesh.positions = loadedMesh->positions;
+    loadedMesh->mesh.vertexCount = (uint32_t) vertexCount;
+    loadedMesh->mesh.indices = loadedMesh->indices;
+    loadedMesh->mesh.indexCount = (uint32_t) indexCount;
+    return EXIT_SUCCESS;
+}
+
+
+static int
+cacheFilePath(const char* path, char* cachePath)
+{
+    int length = snprintf(cachePath, MAX_PATH_LENGTH, "%s%s", path, MESH_CACHE_FILE_SUFFIX);
+    return length > 0 && length < MAX_PATH_LENGTH ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+int
+meshLoaderWriteCacheFile(const char* path, const LoadedMesh* loadedMesh)
+{
+    struct stat status;
+    char cachePath[MAX_PATH_LENGTH];
+    char temporaryPath[MAX_PATH_LENGTH + 4];
+    if (stat(path, &status) != 0 || cacheFilePath(path, cachePath) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    MeshCacheFileHeader header = {
+        .sourceSize = (uint64_t) status.st_size,
+        .sourceModifiedSeconds = (int64_t) status.st_mtim.tv_sec,
+        .sourceModifiedNanoseconds = (int64_t) status.st_mtim.tv_nsec,
+        .vertexCount = loadedMesh->mesh.vertexCount,
+        .indexCount = loadedMesh->mesh.indexCount
+    };
+    memcpy(header.magic, meshCacheFileMagic, sizeof(header.magic));
+
+    /// Write to a temporary file and rename it, so that a concurrent load never maps a half
+    /// written cache file.
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", cachePath);
+    FILE* file = fopen(temporaryPath, "wb");
+    if (file == NULL)
+    {
+        printf("Failed to write mesh cache file %s\n", temporaryPath);
+        return EXIT_FAILURE;
+    }
+    size_t positionCount = 3 * (size_t) header.vertexCount;
+    int written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(loadedMesh->mesh.positions, sizeof(float), positionCount, file)
+                  == positionCount &&
+                  fwrite(loadedMesh->mesh.indices, sizeof(uint32_t), header.indexCount, file)
+                  == header.indexCount;
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temporaryPath, cachePath) != 0)
+    {
+        printf("Failed to write mesh cache file %s\n", cachePath);
+        unlink(temporaryPath);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+int
+meshLoaderMapCacheFile(const char* path, LoadedMesh* loadedMesh)
+{
+    memset(loadedMesh, 0, sizeof(*loadedMesh));
+    struct stat status;
+    char cachePath[MAX_PATH_LENGTH];
+    MappedFile file;
+    if (stat(path, &status) != 0 ||
+        cacheFilePath(path, cachePath) != EXIT_SUCCESS ||
+        mapFile(cachePath, &file) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    const MeshCacheFileHeader* header = (const MeshCacheFileHeader*) file.data;
+    if (file.size < sizeof(*header) ||
+        memcmp(header->magic, meshCacheFileMagic, sizeof(header->magic)) != 0 ||
+        header->sourceSize != (uint64_t) status.st_size ||
+        header->sourceModifiedSeconds != (int64_t) status.st_mtim.tv_sec ||
+        header->sourceModifiedNanoseconds != (int64_t) status.st_mtim.tv_nsec ||
+        file.size != sizeof(*header) +
+                     3 * sizeof(float) * (size_t) header->vertexCount +
+                     sizeof(uint32_t) * (size_t) header->indexCount)
+    {
+        unmapFile(&file);
+        return EXIT_FAILURE;
+    }
+    /// A corrupt cache file, or one written by another build, must not send indices past
+    /// the last vertex to the device. The parsers check every index as they read it, and
+    /// this is the same check for the cache file. It reads the indices once, and fails so
+    /// that meshLoaderLoad parses the source file instead.
+    const uint32_t* indices =
+        (const uint32_t*) ((const float*) (header + 1) + 3 * (size_t) header->vertexCount);
+    uint32_t maximumIndex = 0;
+    for (uint32_t i = 0; i < header->indexCount; ++i)
+    {
+        maximumIndex = indices[i] > maximumIndex ? indices[i] : maximumIndex;
+    }
+    if (header->indexCount > 0 && maximumIndex >= header->vertexCount)
+    {
+        printf("Mesh cache file %s has index %u of %u vertices\n",
+               cachePath, maximumIndex, header->vertexCount);
+        unmapFile(&file);
+        return EXIT_FAILURE;
+    }
+    /// The mesh points into the mapping, there is nothing to copy until the upload.
+    loadedMesh->mapping = (void*) file.data;
+    loadedMesh->mappingSize = file.size;
+    loadedMesh->mesh.positions = (const float*) (header + 1);
+    loadedMesh->mesh.vertexCount = header->vertexCount;
+    loadedMesh->mesh.indices = indices;
+    loadedMesh->mesh.indexCount = header->indexCount;
+    return EXIT_SUCCESS;
+}
+
+
+int
+meshLoaderLoad(const char* path, uint32_t threadCount, LoadedMesh* loadedMesh)
+{
+    if (meshLoaderMapCacheFile(path, loadedMesh) == EXIT_SUCCESS)
+    {
+        return EXIT_SUCCESS;
+    }
+    if (meshLoaderParse(path, threadCount, loadedMesh) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    meshLoaderWriteCacheFile(path, loadedMesh);
+    return EXIT_SUCCESS;
+}
+
+
+void
+meshLoaderFree(LoadedMesh* loadedMesh)
+{
+    if (loadedMesh->mapping != NULL)
+    {
+        munmap(loadedMesh->mapping, loadedMesh->mappingSize);
+    }
+    free(loadedMesh->positions);
+    free(loadedMesh->indices);
+    memset(loadedMesh, 0, sizeof(*loadedMesh));
+}
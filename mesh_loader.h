@@ -0,0 +1,77 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+/// Loading of meshes from Wavefront OBJ and binary PLY files.
+///
+/// Files are memory mapped rather than read through stdio, so the parser works directly on
+/// the page cache without copying the file into a buffer first. Parsing is split over
+/// several threads:
+///
+///   - OBJ is line based. The file is cut into one chunk per thread at line boundaries. A
+///     first parallel pass counts the vertices and triangles of every chunk, which gives
+///     each chunk the offsets at which it writes its results. A second parallel pass parses
+///     the chunks straight into the final arrays. Polygons are split into triangle fans, and
+///     negative (relative) indices are resolved against the vertices before them.
+///   - Binary PLY has fixed size vertex records, which are split evenly over the threads.
+///     Faces are variable length lists, but almost always triangles. The faces are split
+///     evenly assuming triangles, and only if that turns out wrong are they read again by a
+///     single thread.
+///
+/// Parsing text is far slower than copying memory. After parsing, the mesh is written to a
+/// compact binary cache file next to the source, <path>.meshcache: a small header followed
+/// by the positions and indices exactly as they go into the vertex and index buffers. The
+/// next load of an unchanged source file maps the cache file, and the mesh points straight
+/// into the mapping, from where `meshCacheUpload` copies it into the staging buffer.
+
+#include "mesh_cache.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef MAX_MESH_LOADER_THREADS
+#define MAX_MESH_LOADER_THREADS 64
+#endif
+
+#define MESH_CACHE_FILE_SUFFIX ".meshcache"
+
+
+typedef struct LoadedMesh {
+    /// Points into the arrays below, or into the mapped cache file. The id is left to the
+    /// caller.
+    Mesh mesh;
+    float* positions;
+    uint32_t* indices;
+    void* mapping;
+    size_t mappingSize;
+} LoadedMesh;
+
+
+/// Parse an OBJ or binary little endian PLY file, chosen by the file extension, with up to
+/// `threadCount` threads (0 for one per core).
+int
+meshLoaderParse(const char* path, uint32_t threadCount, LoadedMesh* loadedMesh);
+
+/// Parse an OBJ file with fgets and sscanf on a single thread. Only meant as a baseline for
+/// mesh_benchmark.c.
+int
+meshLoaderParseStdio(const char* path, LoadedMesh* loadedMesh);
+
+/// Write the cache file of the source file `path`.
+int
+meshLoaderWriteCacheFile(const char* path, const LoadedMesh* loadedMesh);
+
+/// Map the cache file of the source file `path`. Fails if there is none, if the source
+/// file has changed since the cache file was written, or if an index in it is not below the
+/// vertex count.
+int
+meshLoaderMapCacheFile(const char* path, LoadedMesh* loadedMesh);
+
+/// Map the cache file if it is up to date, otherwise parse the source file and write the
+/// cache file for next time. Failing to write the cache file is not an error.
+int
+meshLoaderLoad(const char* path, uint32_t threadCount, LoadedMesh* loadedMesh);
+
+void
+meshLoaderFree(LoadedMesh* loadedMesh);
+
+#endif // MESH_LOADER_H
@@ -0,0 +1,92 @@
+/// Benchmark of multiview rendering against one render pass per view.
+///
+///     ./out/Release/multiview_benchmark [draws] [renders] [WIDTHxHEIGHT]
+///
+/// Every render is a camera sweep of 2, 4 or 6 views (a stereo pair, a quad view and the faces
+/// of a cube map), each drawing the triangle `draws` times (default 1000) at WIDTHxHEIGHT
+/// (default 512x512). The sweep is rendered once as N sequential render passes, one per
+/// array layer, and once as a single multiview render pass with N views, where the vertices
+/// are fetched and shaded once for all views. Rendering and readback are timed together,
+/// over `renders` renders (default 100).
+
+#include "render_benchmark.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/// The average time per render goes to `milliseconds`.
+static int
+benchmarkSweep(const RenderRequest* request,
+               uint32_t multiview,
+               uint32_t renderCount,
+               double* milliseconds)
+{
+    RenderConfig config = {
+        .framesInFlight = 2,
+        .reuseCommandBuffers = 1,
+        .multiviewCount = multiview ? request->layerCount : 0
+    };
+    RenderBenchmark benchmark;
+    RenderBenchmarkTimings timings;
+    int status = renderBenchmarkInit(&benchmark, &config, request);
+    if (status == EXIT_SUCCESS)
+    {
+        status = renderBenchmarkRun(&benchmark, request, renderCount, NULL, &timings);
+        *milliseconds = timings.milliseconds;
+    }
+    renderBenchmarkShutdown(&benchmark);
+    return status;
+}
+
+
+int main(int argc, char** argv)
+{
+    RenderRequest request = {
+        .width = 512,
+        .height = 512,
+        .drawCount = argc > 1 ? (uint32_t) strtoul(argv[1], NULL, 10) : 1000
+    };
+    uint32_t renderCount = argc > 2 ? (uint32_t) strtoul(argv[2], NULL, 10) : 100;
+    if (request.drawCount == 0 || renderCount == 0 ||
+        (argc > 3 && sscanf(argv[3], "%ux%u", &request.width, &request.height) != 2))
+    {
+        printf("Usage: %s [draws] [renders] [WIDTHxHEIGHT]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const uint32_t viewCounts[] = { 2, 4, 6 };
+    const uint32_t viewCountCount = sizeof(viewCounts) / sizeof(viewCounts[0]);
+    double milliseconds[sizeof(viewCounts) / sizeof(viewCounts[0])][2];
+    for (uint32_t i = 0; i < viewCountCount; ++i)
+    {
+        request.layerCount = viewCounts[i];
+        for (uint32_t multiview = 0; multiview < 2; ++multiview)
+        {
+            if (benchmarkSweep(&request, multiview, renderCount, &milliseconds[i][multiview])
+                != EXIT_SUCCESS)
+            {
+                printf("Failed to benchmark %u views %s\n",
+                       viewCounts[i], multiview ? "with multiview" : "in sequential passes");
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    printf("Sweeps of %u draws at %ux%u, %u renders\n",
+           request.drawCount, request.width, request.height, renderCount);
+    for (uint32_t i = 0; i < viewCountCount; ++i)
+    {
+        printf("%u views: %u passes %8.3f ms (%7.1f views/s), multiview %8.3f ms "
+               "(%7.1f views/s), %.2fx\n",
+               viewCounts[i],
+               viewCounts[i],
+               milliseconds[i][0],
+               1e3 * viewCounts[i] / milliseconds[i][0],
+               milliseconds[i][1],
+               1e3 * viewCounts[i] / milliseconds[i][1],
+               milliseconds[i][0] / milliseconds[i][1]);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,267 @@
+#include "pipeline_cache.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+#define PIPELINE_CACHE_MAGIC 0x43505456 // "VTPC"
+#define PIPELINE_CACHE_FILE_VERSION 1
+#define PIPELINE_CACHE_PATH_MAX 512
+
+
+/// Every cache file starts with this header, followed by `dataSize` bytes of data as
+/// returned by `vkGetPipelineCacheData`. The device identification is duplicated from the
+/// file name so that a file copied or renamed by hand is still rejected. The checksum
+/// catches truncated files, for example from a machine that crashed before the data hit
+/// the disk. The reserved field keeps the struct free of padding, so that it can be
+/// compared with memcmp.
+typedef struct PipelineCacheFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint32_t reserved;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+    uint64_t checksum;
+} PipelineCacheFileHeader;
+
+
+/// 64-bit FNV-1a, which is plenty for detecting corruption (it is not meant to be secure).
+static uint64_t
+checksum(const uint8_t* data, size_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+
+/// The file name is the key of the cache: one file per pipelineCacheUUID, vendor and
+/// driver version. Updating the driver therefore starts out with a fresh file instead of
+/// overwriting data that another installation might still use.
+static int
+cachePath(const VkPhysicalDeviceProperties* properties,
+          const char* directory,
+          char* path,
+          size_t pathSize)
+{
+    char uuid[2 * VK_UUID_SIZE + 1];
+    for (uint32_t i = 0; i < VK_UUID_SIZE; ++i)
+    {
+        snprintf(uuid + 2 * i, 3, "%02x", properties->pipelineCacheUUID[i]);
+    }
+    int length = snprintf(path, pathSize, "%s/%s-%04x-%08x.bin",
+                          directory, uuid, properties->vendorID, properties->driverVersion);
+    if (length < 0 || (size_t) length >= pathSize)
+    {
+        printf("Pipeline cache path too long for directory %s\n", directory);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+static int
+headerMatches(const PipelineCacheFileHeader* header,
+              const VkPhysicalDeviceProperties* properties)
+{
+    return header->magic == PIPELINE_CACHE_MAGIC
+        && header->version == PIPELINE_CACHE_FILE_VERSION
+        && header->vendorID == properties->vendorID
+        && header->deviceID == properties->deviceID
+        && header->driverVersion == properties->driverVersion
+        && memcmp(header->pipelineCacheUUID, properties->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+
+/// The data returned by the driver starts with a `VkPipelineCacheHeaderVersionOne`, which
+/// we check as well. It is redundant with our own header as long as nobody tampers with
+/// the files, but it is cheap.
+static int
+driverHeaderMatches(const uint8_t* data,
+                    size_t size,
+                    const VkPhysicalDeviceProperties* properties)
+{
+    VkPipelineCacheHeaderVersionOne header;
+    if (size < sizeof(header))
+    {
+        return 0;
+    }
+    memcpy(&header, data, sizeof(header));
+    return header.headerSize >= sizeof(header)
+        && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && header.vendorID == properties->vendorID
+        && header.deviceID == properties->deviceID
+        && memcmp(header.pipelineCacheUUID, properties->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+
+/// Read and validate the file at `path`. On success `*data` points to a malloc'ed buffer of
+/// `header->dataSize` bytes which the caller must free.
+static int
+readCacheFile(const char* path,
+              const VkPhysicalDeviceProperties* properties,
+              PipelineCacheFileHeader* header,
+              uint8_t** data)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    if (fread(header, sizeof(*header), 1, file) != 1 || !headerMatches(header, properties))
+    {
+        printf("Ignoring pipeline cache with mismatching header: %s\n", path);
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+    *data = (uint8_t*) malloc(header->dataSize);
+    if (*data == NULL || fread(*data, 1, header->dataSize, file) != header->dataSize)
+    {
+        printf("Ignoring truncated pipeline cache: %s\n", path);
+        free(*data);
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+    fclose(file);
+    if (checksum(*data, header->dataSize) != header->checksum ||
+        !driverHeaderMatches(*data, header->dataSize, properties))
+    {
+        printf("Ignoring corrupt pipeline cache: %s\n", path);
+        free(*data);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+int
+pipelineCacheLoad(VkDevice device,
+                  const VkPhysicalDeviceProperties* properties,
+                  const char* directory,
+                  VkPipelineCache* pipelineCache)
+{
+    char path[PIPELINE_CACHE_PATH_MAX] = "";
+    PipelineCacheFileHeader header = { 0 };
+    uint8_t* data = NULL;
+    if (cachePath(properties, directory, path, sizeof(path)) != EXIT_SUCCESS ||
+        readCacheFile(path, properties, &header, &data) != EXIT_SUCCESS)
+    {
+        header.dataSize = 0;
+        data = NULL;
+    }
+    printf("Loaded %lu bytes of pipeline cache data from %s\n",
+           (unsigned long) header.dataSize, path);
+
+    VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = header.dataSize,
+        .pInitialData = data
+    };
+    VkResult code = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, NULL, pipelineCache);
+    free(data);
+    if (code != VK_SUCCESS)
+    {
+        printf("Failed to create pipeline cache, code: %d\n", code);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+int
+pipelineCacheSave(VkDevice device,
+                  const VkPhysicalDeviceProperties* properties,
+                  const char* directory,
+                  VkPipelineCache pipelineCache)
+{
+    char path[PIPELINE_CACHE_PATH_MAX];
+    if (cachePath(properties, directory, path, sizeof(path)) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST)
+    {
+        printf("Failed to create pipeline cache directory: %s\n", directory);
+        return EXIT_FAILURE;
+    }
+
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, NULL) != VK_SUCCESS)
+    {
+        printf("Failed to query pipeline cache data size\n");
+        return EXIT_FAILURE;
+    }
+    uint8_t* data = (uint8_t*) malloc(dataSize);
+    if (data == NULL ||
+        vkGetPipelineCacheData(device, pipelineCache, &dataSize, data) != VK_SUCCESS)
+    {
+        printf("Failed to get pipeline cache data\n");
+        free(data);
+        return EXIT_FAILURE;
+    }
+
+    PipelineCacheFileHeader header = {
+        .magic = PIPELINE_CACHE_MAGIC,
+        .version = PIPELINE_CACHE_FILE_VERSION,
+        .vendorID = properties->vendorID,
+        .deviceID = properties->deviceID,
+        .driverVersion = properties->driverVersion,
+        .dataSize = dataSize,
+        .checksum = checksum(data, dataSize)
+    };
+    memcpy(header.pipelineCacheUUID, properties->pipelineCacheUUID, VK_UUID_SIZE);
+
+    /// Skip the write altogether if the file on disk already holds the same data, which is
+    /// the common case once the cache is warm.
+    PipelineCacheFileHeader existingHeader;
+    FILE* existingFile = fopen(path, "rb");
+    if (existingFile != NULL)
+    {
+        int unchanged = fread(&existingHeader, sizeof(existingHeader), 1, existingFile) == 1
+                     && memcmp(&existingHeader, &header, sizeof(header)) == 0;
+        fclose(existingFile);
+        if (unchanged)
+        {
+            free(data);
+            return EXIT_SUCCESS;
+        }
+    }
+
+    /// The temporary file name is unique per process, so concurrent writers never write to
+    /// the same file. fsync makes sure the data is on disk before the rename publishes it.
+    char temporaryPath[PIPELINE_CACHE_PATH_MAX + 32];
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.%ld.tmp", path, (long) getpid());
+    FILE* file = fopen(temporaryPath, "wb");
+    if (file == NULL)
+    {
+        printf("Failed to open temporary pipeline cache file: %s\n", temporaryPath);
+        free(data);
+        return EXIT_FAILURE;
+    }
+    int written = fwrite(&header, sizeof(header), 1, file) == 1
+               && fwrite(data, 1, dataSize, file) == dataSize
+               && fflush(file) == 0
+               && fsync(fileno(file)) == 0;
+    written = (fclose(file) == 0) && written;
+    free(data);
+    if (!written || rename(temporaryPath, path) != 0)
+    {
+        printf("Failed to write pipeline cache file: %s\n", path);
+        unlink(temporaryPath);
+        return EXIT_FAILURE;
+    }
+    printf("Saved %lu bytes of pipeline cache data to %s\n", (unsigned long) dataSize, path);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,39 @@
+#ifndef PIPELINE_CACHE_H
+#define PIPELINE_CACHE_H
+
+/// Persistent on-disk storage of a `VkPipelineCache`.
+///
+/// Compiling shaders into a pipeline is expensive, and on software implementations such as
+/// Lavapipe it dominates the time it takes to get the first image out. Vulkan lets us
+/// serialize what the driver learned while compiling with `vkGetPipelineCacheData` and hand
+/// it back on the next run through `VkPipelineCacheCreateInfo::pInitialData`.
+///
+/// The data is only meaningful to the exact driver that produced it. The driver is supposed
+/// to reject foreign data by itself, but we do not want to rely on that, so every file is
+/// stored under a name derived from the `pipelineCacheUUID`, vendor ID and driver version of
+/// the physical device and prefixed with a header that is validated on load.
+
+#include <vulkan/vulkan.h>
+
+/// Create a pipeline cache for `device`, seeded with the data stored in `directory` for the
+/// physical device described by `properties`. A missing, stale or corrupt file is not an
+/// error, we simply start out with an empty cache.
+/// Returns EXIT_SUCCESS if a pipeline cache was created, EXIT_FAILURE otherwise.
+int
+pipelineCacheLoad(VkDevice device,
+                  const VkPhysicalDeviceProperties* properties,
+                  const char* directory,
+                  VkPipelineCache* pipelineCache);
+
+/// Write the contents of `pipelineCache` back to `directory`.
+/// The file is first written to a temporary file which is then renamed over the final
+/// path. Rename is atomic, so concurrent processes sharing the directory will only ever
+/// observe complete files, the last writer wins.
+/// Returns EXIT_SUCCESS if the data was written, EXIT_FAILURE otherwise.
+int
+pipelineCacheSave(VkDevice device,
+                  const VkPhysicalDeviceProperties* properties,
+                  const char* directory,
+                  VkPipelineCache pipelineCache);
+
+#endif // PIPELINE_CACHE_H
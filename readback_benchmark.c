@@ -0,0 +1,254 @@
+/// Benchmark of host reads from every host visible memory type of the device.
+///
+///     ./out/Release/readback_benchmark [megabytes] [iterations]
+///
+/// For each memory type that a transfer destination buffer can live in, the device fills
+/// the buffer (like the copy of a rendered depth image would), and the host then reads the
+/// whole buffer from the mapped memory into host memory. Only the host read is timed,
+/// including the invalidation of non-coherent memory. The memory type that the render
+/// context picks for its readback buffers is marked.
+
+#include "render.h"
+#include "timing.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+static void
+memoryPropertyString(VkMemoryPropertyFlags flags, char* string, size_t size)
+{
+    snprintf(string, size, "%s%s%s%s",
+             flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT ? "DEVICE_LOCAL " : "",
+             flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT ? "HOST_VISIBLE " : "",
+             flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT ? "HOST_COHERENT " : "",
+             flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT ? "HOST_CACHED " : "");
+}
+
+
+/// Let the device write `buffer` and wait for it to finish. The barrier makes the writes
+/// available to the host.
+static int
+deviceFill(RenderContext* context, VkCommandBuffer commandBuffer, VkFence fence, VkBuffer buffer)
+{
+    VkCommandBufferBeginInfo commandBufferBeginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+    vkCmdFillBuffer(commandBuffer, buffer, 0, VK_WHOLE_SIZE, 0x3F000000);
+    VkBufferMemoryBarrier bufferMemoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT,
+                         0,
+                         0, NULL,
+                         1, &bufferMemoryBarrier,
+                         0, NULL);
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+    {
+        printf("Failed to end recording of command buffer\n");
+        return EXIT_FAILURE;
+    }
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffer
+    };
+    if (vkResetFences(context->device, 1, &fence) != VK_SUCCESS ||
+        vkQueueSubmit(context->queue, 1, &submitInfo, fence) != VK_SUCCESS ||
+        vkWaitForFences(context->device, 1, &fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS)
+    {
+        printf("Failed to fill buffer on device\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/// Measure host reads from memory type `memoryTypeIndex`. Returns the throughput in GB/s,
+/// or a negative number if the memory could not be allocated.
+static double
+benchmarkMemoryType(RenderContext* context,
+                    VkCommandBuffer commandBuffer,
+                    VkFence fence,
+                    VkBuffer buffer,
+                    VkDeviceSize size,
+                    uint32_t memoryTypeIndex,
+                    uint32_t iterations)
+{
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(context->device, buffer, &memoryRequirements);
+    VkMemoryAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = memoryRequirements.size,
+        .memoryTypeIndex = memoryTypeIndex
+    };
+    VkDeviceMemory memory;
+    if (vkAllocateMemory(context->device, &allocateInfo, NULL, &memory) != VK_SUCCESS)
+    {
+        return -1.0;
+    }
+    void* mapping = NULL;
+    if (vkBindBufferMemory(context->device, buffer, memory, 0) != VK_SUCCESS ||
+        vkMapMemory(context->device, memory, 0, VK_WHOLE_SIZE, 0, &mapping) != VK_SUCCESS)
+    {
+        vkFreeMemory(context->device, memory, NULL);
+        return -1.0;
+    }
+    int coherent = (context->deviceMemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags
+                    & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    VkMappedMemoryRange mappedMemoryRange = {
+        .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+        .memory = memory,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+
+    uint8_t* hostData = (uint8_t*) malloc(size);
+    memset(hostData, 0, size);
+    double milliseconds = 0.0;
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        if (deviceFill(context, commandBuffer, fence, buffer) != EXIT_SUCCESS)
+        {
+            milliseconds = -1.0;
+            break;
+        }
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (!coherent)
+        {
+            vkInvalidateMappedMemoryRanges(context->device, 1, &mappedMemoryRange);
+        }
+        memcpy(hostData, mapping, size);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        milliseconds += elapsedMilliseconds(&start, &end);
+    }
+    free(hostData);
+    vkUnmapMemory(context->device, memory);
+    vkFreeMemory(context->device, memory, NULL);
+    return milliseconds < 0.0 ? -1.0 : 1e-6 * size * iterations / milliseconds;
+}
+
+
+int main(int argc, char** argv)
+{
+    VkDeviceSize size = (VkDeviceSize) (argc > 1 ? strtoul(argv[1], NULL, 10) : 64) << 20;
+    uint32_t iterations = argc > 2 ? (uint32_t) strtoul(argv[2], NULL, 10) : 10;
+    if (size == 0 || iterations == 0)
+    {
+        printf("Usage: %s [megabytes] [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    RenderContext context;
+    RenderConfig config = { .framesInFlight = 1 };
+    if (renderContextInit(&context, &config) != EXIT_SUCCESS)
+    {
+        renderContextShutdown(&context);
+        return EXIT_FAILURE;
+    }
+
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = context.commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO
+    };
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    if (vkAllocateCommandBuffers(context.device, &commandBufferAllocateInfo, &commandBuffer)
+        != VK_SUCCESS ||
+        vkCreateFence(context.device, &fenceCreateInfo, NULL, &fence) != VK_SUCCESS)
+    {
+        printf("Failed to create command buffer and fence\n");
+        vkDestroyFence(context.device, fence, NULL);
+        renderContextShutdown(&context);
+        return EXIT_FAILURE;
+    }
+
+    /// Memory type bits are the same for all buffers created with the same usage, so a
+    /// throwaway buffer tells us which memory types a readback buffer can use.
+    VkBufferCreateInfo bufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+    };
+    VkBuffer buffer;
+    if (vkCreateBuffer(context.device, &bufferCreateInfo, NULL, &buffer) != VK_SUCCESS)
+    {
+        printf("Failed to create buffer\n");
+        vkDestroyFence(context.device, fence, NULL);
+        renderContextShutdown(&context);
+        return EXIT_FAILURE;
+    }
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(context.device, buffer, &memoryRequirements);
+    vkDestroyBuffer(context.device, buffer, NULL);
+
+    VkMemoryPropertyFlags readbackPreferences[] = {
+        VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+    };
+    uint32_t readbackMemoryTypeIndex = findMemoryType(&context.deviceMemoryProperties,
+                                                      memoryRequirements.memoryTypeBits,
+                                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                                      readbackPreferences,
+                                                      2);
+
+    printf("Reading back %lu MB, %u iterations\n", (unsigned long) (size >> 20), iterations);
+    for (uint32_t i = 0; i < context.deviceMemoryProperties.memoryTypeCount; ++i)
+    {
+        VkMemoryType memoryType = context.deviceMemoryProperties.memoryTypes[i];
+        if (!(memoryRequirements.memoryTypeBits & (1u << i)) ||
+            !(memoryType.propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+        {
+            continue;
+        }
+        /// A buffer can only be bound to memory once, so every memory type gets a new one.
+        if (vkCreateBuffer(context.device, &bufferCreateInfo, NULL, &buffer) != VK_SUCCESS)
+        {
+            printf("Failed to create buffer\n");
+            break;
+        }
+        double gigabytesPerSecond = benchmarkMemoryType(&context, commandBuffer, fence,
+                                                        buffer, size, i, iterations);
+        vkDestroyBuffer(context.device, buffer, NULL);
+
+        char properties[128];
+        memoryPropertyString(memoryType.propertyFlags, properties, sizeof(properties));
+        if (gigabytesPerSecond < 0.0)
+        {
+            printf("Memory type %u (heap %u, %s): failed to allocate\n",
+                   i, memoryType.heapIndex, properties);
+        }
+        else
+        {
+            printf("Memory type %u (heap %u, %s): %.2f GB/s%s\n",
+                   i, memoryType.heapIndex, properties, gigabytesPerSecond,
+                   i == readbackMemoryTypeIndex ? " <- used for readback" : "");
+        }
+    }
+
+    vkDeviceWaitIdle(context.device);
+    vkDestroyFence(context.device, fence, NULL);
+    renderContextShutdown(&context);
+    return EXIT_SUCCESS;
+}
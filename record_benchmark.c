@@ -0,0 +1,96 @@
+/// Benchmark of command buffer recording with a growing number of recording threads.
+///
+///     ./out/Release/record_benchmark [draws] [renders]
+///
+/// Every render records `draws` draws of the triangle (default 100000), which stands in for
+/// a scene with many objects. The draws are first recorded inline into the primary command
+/// buffer, then into secondary command buffers by 1, 2, 4, ... threads, up to the number of
+/// cores (see command_recorder.h). Only the recording is timed, not the rendering.
+
+#include "render_benchmark.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+
+/// The average recording time per render goes to `milliseconds`.
+static int
+benchmarkRecording(uint32_t recordingThreads,
+                   uint32_t drawCount,
+                   uint32_t renderCount,
+                   double* milliseconds)
+{
+    RenderConfig config = {
+        .framesInFlight = 1,
+        .recordingThreads = recordingThreads
+    };
+    RenderRequest request = {
+        .width = 64,
+        .height = 64,
+        .drawCount = drawCount
+    };
+    RenderBenchmark benchmark;
+    RenderBenchmarkTimings timings;
+    int status = renderBenchmarkInit(&benchmark, &config, &request);
+    if (status == EXIT_SUCCESS)
+    {
+        benchmark.context.recordMilliseconds = 0.0;
+        status = renderBenchmarkRun(&benchmark, &request, renderCount, NULL, &timings);
+        *milliseconds = benchmark.context.recordMilliseconds / renderCount;
+    }
+    renderBenchmarkShutdown(&benchmark);
+    return status;
+}
+
+
+int main(int argc, char** argv)
+{
+    uint32_t drawCount = argc > 1 ? (uint32_t) strtoul(argv[1], NULL, 10) : 100000;
+    uint32_t renderCount = argc > 2 ? (uint32_t) strtoul(argv[2], NULL, 10) : 20;
+    if (drawCount == 0 || renderCount == 0)
+    {
+        printf("Usage: %s [draws] [renders]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    long coreCount = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t maxThreads = coreCount > 0 ? (uint32_t) coreCount : 1;
+    maxThreads = maxThreads < MAX_RECORDING_THREADS ? maxThreads : MAX_RECORDING_THREADS;
+
+    /// Thread counts to measure, 0 meaning inline recording.
+    uint32_t threadCounts[2 + MAX_RECORDING_THREADS];
+    double milliseconds[2 + MAX_RECORDING_THREADS];
+    uint32_t measurementCount = 0;
+    threadCounts[measurementCount++] = 0;
+    for (uint32_t threads = 1; threads < maxThreads; threads *= 2)
+    {
+        threadCounts[measurementCount++] = threads;
+    }
+    threadCounts[measurementCount++] = maxThreads;
+
+    for (uint32_t i = 0; i < measurementCount; ++i)
+    {
+        if (benchmarkRecording(threadCounts[i], drawCount, renderCount, &milliseconds[i])
+            != EXIT_SUCCESS)
+        {
+            printf("Failed to benchmark %u recording threads\n", threadCounts[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("Recording %u draws, %u renders, %ld cores\n", drawCount, renderCount, coreCount);
+    for (uint32_t i = 0; i < measurementCount; ++i)
+    {
+        if (threadCounts[i] == 0)
+        {
+            printf("inline:     %8.3f ms per render\n", milliseconds[i]);
+            continue;
+        }
+        printf("%2u threads: %8.3f ms per render, %.2fx the speed of 1 thread\n",
+               threadCounts[i],
+               milliseconds[i],
+               milliseconds[1] / milliseconds[i]);
+    }
+    return EXIT_SUCCESS;
+}
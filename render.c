@@ -0,0 +1,3613 @@
+/// This file will walk through how to setup a minimal graphics pipeline and render the depth
+/// of a triangle to image on disk. The goal is to as quickly as possible see some results.
+/// Despite the warnings provided at the start of the classic tutorials about being patient,
+/// it can feel overwhelming for a beginner how much code is needed for a simple setup.
+///
+/// We will not setup presentation to screen, which is one of the most demanding things to
+/// understand for a beginner. We will not need any extensions either, only the core API.
+///
+/// As we code, various core Vulkan concepts will be introduced and their rationale explained.
+///
+/// We will use pure C as our language of choice because Vulkan is a C API.
+/// In my opinion, mixing in a different language (usually C++) makes it harder to learn.
+/// It is easier to learn it with a C mindset.
+///
+/// The program is split into three functions, which should be read in order:
+///
+///     1. `renderContextInit` does all the setup (instance, device, resources, pipeline)
+///     2. `renderContextRender` records, submits and reads back a single depth image
+///     3. `renderContextShutdown` tears everything down
+///
+/// The functions are long on purpose. Many tutorials out there are smart and factor out
+/// code into small utility functions. While this is good practice in production code, it
+/// hampers learning for beginners. The split we do make is the one that matters in
+/// practice: setup is expensive and is done once, while rendering is cheap and is done
+/// over and over again. The main program (main.c) is a small driver on top of this.
+
+#include "render.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "depth_decode.h"
+#include "device_select.h"
+#include "pipeline_cache.h"
+
+
+/// We want to enable/disable certain features depending on the typical CMake
+/// build types (Debug/Release).
+/// For example, validation layers should only be enabled in Debug.
+#ifndef BUILD_TYPE
+#define BUILD_TYPE "Debug"
+#endif
+
+
+/// Define some user configurable compile time constants.
+/// MAX_PHYSICAL_DEVICE_COUNT and MAX_PHYSICAL_DEVICE_QUEUE_FAMILIES, which allow us to use
+/// less dynamic allocation, are defined in device_select.h.
+
+#define VERTEX_SHADER_SOURCE_PATH "out/" BUILD_TYPE "/shader.vert.spv"
+#define CULL_SHADER_SOURCE_PATH "out/" BUILD_TYPE "/cull.comp.spv"
+#define CONVERT_SHADER_SOURCE_PATH "out/" BUILD_TYPE "/convert.comp.spv"
+#define STATS_SHADER_SOURCE_PATH "out/" BUILD_TYPE "/stats.comp.spv"
+#ifndef PIPELINE_CACHE_DIRECTORY
+#define PIPELINE_CACHE_DIRECTORY "out/" BUILD_TYPE "/pipeline-cache"
+#endif
+
+
+/// Define some helper macros.
+#define STR(name) #name
+#define CASE_STR(name) case name : return STR(name)
+
+
+/// Many functions in Vulkan return status codes.
+/// We start with writing a function that converts codes into strings.
+/// See: https://registry.khronos.org/vulkan/specs/1.3/html/chap3.html#VkResult
+/// Certain result codes are introduced at specific versions of Vulkan, which we can make
+/// portable by checking against VK_VERSION_X_X definitions.
+const char*
+resultString(VkResult code)
+{
+    switch (code)
+    {
+        CASE_STR(VK_SUCCESS);
+        CASE_STR(VK_NOT_READY);
+        CASE_STR(VK_TIMEOUT);
+        CASE_STR(VK_EVENT_SET);
+        CASE_STR(VK_EVENT_RESET);
+        CASE_STR(VK_INCOMPLETE);
+        CASE_STR(VK_ERROR_OUT_OF_HOST_MEMORY);
+        CASE_STR(VK_ERROR_OUT_OF_DEVICE_MEMORY);
+        CASE_STR(VK_ERROR_INITIALIZATION_FAILED);
+        CASE_STR(VK_ERROR_DEVICE_LOST);
+        CASE_STR(VK_ERROR_MEMORY_MAP_FAILED);
+        CASE_STR(VK_ERROR_LAYER_NOT_PRESENT);
+        CASE_STR(VK_ERROR_EXTENSION_NOT_PRESENT);
+        CASE_STR(VK_ERROR_FEATURE_NOT_PRESENT);
+        CASE_STR(VK_ERROR_INCOMPATIBLE_DRIVER);
+        CASE_STR(VK_ERROR_TOO_MANY_OBJECTS);
+        CASE_STR(VK_ERROR_FORMAT_NOT_SUPPORTED);
+        CASE_STR(VK_ERROR_FRAGMENTED_POOL);
+        CASE_STR(VK_ERROR_UNKNOWN);
+#ifdef VK_VERSION_1_1
+        CASE_STR(VK_ERROR_OUT_OF_POOL_MEMORY);
+        CASE_STR(VK_ERROR_INVALID_EXTERNAL_HANDLE);
+#endif
+#ifdef VK_VERSION_1_2
+        CASE_STR(VK_ERROR_FRAGMENTATION);
+        CASE_STR(VK_ERROR_INVALID_OPAQUE_CAPTURE_ADDRESS);
+#endif
+#ifndef VK_VERSION_1_3
+        CASE_STR(VK_PIPELINE_COMPILE_REQUIRED);
+#endif
+        default: return "UNKNOWN";
+    }
+}
+
+
+const char*
+formatString(VkFormat format) {
+    switch (format) {
+        CASE_STR(VK_FORMAT_D16_UNORM);
+        CASE_STR(VK_FORMAT_D16_UNORM_S8_UINT);
+        CASE_STR(VK_FORMAT_D24_UNORM_S8_UINT);
+        CASE_STR(VK_FORMAT_D32_SFLOAT);
+        CASE_STR(VK_FORMAT_D32_SFLOAT_S8_UINT);
+        CASE_STR(VK_FORMAT_R16_SFLOAT);
+        CASE_STR(VK_FORMAT_R32_SFLOAT);
+        default: return "UNKNOWN";
+    }
+}
+
+
+uint32_t
+formatSize(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:          return 2;
+        case VK_FORMAT_D16_UNORM_S8_UINT:  return 3;
+        case VK_FORMAT_D24_UNORM_S8_UINT:  return 4;
+        case VK_FORMAT_D32_SFLOAT:         return 4;
+        case VK_FORMAT_D32_SFLOAT_S8_UINT: return 5;
+        default: return 0;
+    }
+}
+
+
+uint32_t
+findMemoryType(const VkPhysicalDeviceMemoryProperties* memoryProperties,
+               uint32_t memoryTypeBits,
+               VkMemoryPropertyFlags required,
+               const VkMemoryPropertyFlags* preferred,
+               uint32_t preferredCount)
+{
+    uint32_t bestMemoryTypeIndex = memoryProperties->memoryTypeCount;
+    uint32_t bestScore = 0;
+    for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; ++i)
+    {
+        VkMemoryPropertyFlags flags = memoryProperties->memoryTypes[i].propertyFlags;
+        if (!(memoryTypeBits & (1u << i)) || (flags & required) != required)
+        {
+            continue;
+        }
+        /// Earlier preferences outweigh all later ones together, like the digits of a
+        /// binary number. Memory types are ordered by the driver with the most performant
+        /// first, so on a tie we keep the first one.
+        uint32_t score = 1;
+        for (uint32_t j = 0; j < preferredCount; ++j)
+        {
+            score = 2 * score + ((flags & preferred[j]) == preferred[j]);
+        }
+        if (score > bestScore)
+        {
+            bestScore = score;
+            bestMemoryTypeIndex = i;
+        }
+    }
+    return bestMemoryTypeIndex;
+}
+
+
+/// The triangle, drawn when a request has no mesh of its own. It used to be hardcoded in
+/// the vertex shader, now it goes through vertex and index buffers like any other mesh.
+static const float trianglePositions[] = {
+     0.0f, -0.5f, 0.1337f,
+    +0.5f, +0.5f, 0.1337f,
+    -0.5f, +0.5f, 0.1337f
+};
+static const uint32_t triangleIndices[] = { 0, 1, 2 };
+static const Mesh triangleMesh = {
+    .id = TRIANGLE_MESH_ID,
+    .positions = trianglePositions,
+    .vertexCount = 3,
+    .indices = triangleIndices,
+    .indexCount = 3
+};
+
+
+/// Create a small buffer that the host writes before every submission, in host visible,
+/// coherent memory, preferably device local as well. The memory stays mapped.
+static int
+createFrameBuffer(RenderContext* context,
+                  VkDeviceSize size,
+                  VkBufferUsageFlags usage,
+                  VkBuffer* buffer,
+                  MemoryAllocation* memory)
+{
+    VkBufferCreateInfo bufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = size,
+        .usage = usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+    };
+    if (vkCreateBuffer(context->device, &bufferCreateInfo, NULL, buffer) != VK_SUCCESS)
+    {
+        printf("Failed to create frame buffer\n");
+        return EXIT_FAILURE;
+    }
+    VkMemoryPropertyFlags preferences[] = {
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    };
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(context->device, *buffer, &memoryRequirements);
+    uint32_t memoryTypeIndex = findMemoryType(&context->deviceMemoryProperties,
+                                              memoryRequirements.memoryTypeBits,
+                                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                              preferences,
+                                              1);
+    if (memoryTypeIndex == context->deviceMemoryProperties.memoryTypeCount ||
+        memoryAllocatorAllocate(&context->memoryAllocator,
+                                &memoryRequirements,
+                                memoryTypeIndex,
+                                MEMORY_RESOURCE_LINEAR,
+                                memory) != EXIT_SUCCESS ||
+        vkBindBufferMemory(context->device, *buffer, memory->memory, memory->offset)
+        != VK_SUCCESS)
+    {
+        printf("Failed to allocate frame buffer memory\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/// Create a shader module from the SPIR-V file at `path`.
+/// One thing I noted when reading the specs is that the shader code needs to be a multiple
+/// of 4 bytes (it is defined as an array of 32 bit integers). Most tutorials do not take this
+/// up, but unless you make sure to allocate a multiple of 4 bytes I think that a Vulkan
+/// implementation might segfault.
+static int
+createShaderModule(VkDevice device, const char* path, VkShaderModule* shaderModule)
+{
+    printf("Creating shader module from %s\n", path);
+    FILE* shaderFile = fopen(path, "r");
+    if (shaderFile == NULL)
+    {
+        printf("Missing shader code at: %s\n", path);
+        return EXIT_FAILURE;
+    }
+    fseek(shaderFile, 0, SEEK_END);
+    size_t shaderCodeSize = ftell(shaderFile);
+    rewind(shaderFile);
+    uint32_t* shaderCode = (uint32_t*) calloc((shaderCodeSize + 3) / 4 + 1, sizeof(uint32_t));
+    size_t bytesRead = shaderCode != NULL ? fread(shaderCode, 1, shaderCodeSize, shaderFile) : 0;
+    fclose(shaderFile);
+    if (bytesRead != shaderCodeSize)
+    {
+        printf("Failed to read shader code\n");
+        free(shaderCode);
+        return EXIT_FAILURE;
+    }
+    VkShaderModuleCreateInfo shaderModuleCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = shaderCodeSize,
+        .pCode = shaderCode
+    };
+    VkResult code = vkCreateShaderModule(device, &shaderModuleCreateInfo, NULL, shaderModule);
+    free(shaderCode);
+    if (code != VK_SUCCESS)
+    {
+        printf("Failed to create shader module from %s\n", path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/// Make the instance buffer of `frame` hold at least `instanceCount` instances, and the
+/// visible instance buffer as many indices. When they are too small, they are replaced by
+/// buffers of at least twice the capacity, and the descriptor set is pointed at them.
+/// Updating a descriptor set invalidates the command buffers that bound it, so the frame is
+/// recorded again. The frame must not be in flight.
+static int
+reserveInstanceBuffer(RenderContext* context, RenderFrame* frame, uint32_t instanceCount)
+{
+    if (instanceCount <= frame->instanceCapacity)
+    {
+        return EXIT_SUCCESS;
+    }
+    uint64_t maxCapacity =
+        context->physicalDeviceProperties.limits.maxStorageBufferRange / sizeof(FrameInstance);
+    uint64_t capacity = frame->instanceCapacity > 0
+                      ? 2 * (uint64_t) frame->instanceCapacity
+                      : INITIAL_INSTANCE_CAPACITY;
+    while (capacity < instanceCount)
+    {
+        capacity *= 2;
+    }
+    capacity = capacity < maxCapacity ? capacity : maxCapacity;
+    if (instanceCount > capacity)
+    {
+        printf("Unsupported number of instances %u (maximum %lu)\n",
+               instanceCount, (unsigned long) maxCapacity);
+        return EXIT_FAILURE;
+    }
+
+    vkDestroyBuffer(context->device, frame->instanceBuffer, NULL);
+    memoryAllocatorFree(&context->memoryAllocator, &frame->instanceMemory);
+    vkDestroyBuffer(context->device, frame->visibleBuffer, NULL);
+    memoryAllocatorFree(&context->memoryAllocator, &frame->visibleMemory);
+    frame->instanceBuffer = VK_NULL_HANDLE;
+    memset(&frame->instanceMemory, 0, sizeof(frame->instanceMemory));
+    frame->visibleBuffer = VK_NULL_HANDLE;
+    memset(&frame->visibleMemory, 0, sizeof(frame->visibleMemory));
+    frame->instanceCapacity = 0;
+    frame->recorded = 0;
+    if (createFrameBuffer(context,
+                          capacity * sizeof(FrameInstance),
+                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                          &frame->instanceBuffer,
+                          &frame->instanceMemory) != EXIT_SUCCESS ||
+        createFrameBuffer(context,
+                          capacity * sizeof(uint32_t),
+                          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                          &frame->visibleBuffer,
+                          &frame->visibleMemory) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    frame->instanceCapacity = (uint32_t) capacity;
+
+    VkDescriptorBufferInfo descriptorBufferInfos[] = {
+        {
+            .buffer = frame->instanceBuffer,
+            .offset = 0,
+            .range = VK_WHOLE_SIZE
+        },
+        {
+            .buffer = frame->visibleBuffer,
+            .offset = 0,
+            .range = VK_WHOLE_SIZE
+        }
+    };
+    VkWriteDescriptorSet writeDescriptorSet = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = frame->descriptorSet,
+        .dstBinding = 2,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &descriptorBufferInfos[0]
+    };
+    vkUpdateDescriptorSets(context->device, 1, &writeDescriptorSet, 0, NULL);
+    writeDescriptorSet.dstBinding = 3;
+    writeDescriptorSet.pBufferInfo = &descriptorBufferInfos[1];
+    vkUpdateDescriptorSets(context->device, 1, &writeDescriptorSet, 0, NULL);
+    return EXIT_SUCCESS;
+}
+
+
+int
+renderContextInit(RenderContext* context, const RenderConfig* config)
+{
+    /// Sometimes we need a variable in order to do several checks on it.
+    /// For convenience we create one that we use throughout the whole function.
+    VkResult code;
+
+    /// All handles start out as VK_NULL_HANDLE, so that `renderContextShutdown` knows what
+    /// has been created if we bail out half way through.
+    memset(context, 0, sizeof(*context));
+    if (config->framesInFlight == 0 || config->framesInFlight > MAX_FRAMES_IN_FLIGHT)
+    {
+        printf("Unsupported number of frames in flight: %u (maximum %d)\n",
+               config->framesInFlight, MAX_FRAMES_IN_FLIGHT);
+        return EXIT_FAILURE;
+    }
+
+
+    ////////////////////////////////////
+    ////////// PART 1 | Setup //////////
+    ////////////////////////////////////
+
+
+    /// First step is to create an instance object.
+    /// Here we can specify global stuff such as info about our application,
+    /// which validation layers and extensions that we want to load, etc.
+    /// The instance object is an opaque handle, which will be used to get physical devices.
+    ///
+    /// We create the `VkInstance` by passing a `VkInstanceCreateInfo` to `vkCreateInstance`.
+    /// Note that there is a corresponding `vkDestroyInstance` at the end of the program.
+    /// This pattern is fundamental in Vulkan, the lifetime of all opaque
+    /// objects follows this
+    ///
+    ///     1. Construct a `Vk...CreateInfo` object, where `...` is a
+    ///        placeholder for the type we are going to create
+    ///     2. Call `vkCreate...` to create the object.
+    ///     3. Call `vkDestroy...` when the object is not needed anymore.
+    ///
+    /// where the destruction usually happen in reverse order of creation.
+    ///
+    /// For this program we only specify the application info, which is minimal.
+    /// The application info is used for things like telling Vulkan what API version we expect
+    /// and telling GPU vendors about our application.
+    /// The latter usage can be used for application specific optimizations by a vendor,
+    /// say for a game engine or a game title. We ask for Vulkan 1.1, which is needed to
+    /// query the UUID of physical devices (see device_select.h).
+    ///
+    /// Note that we have to explicitly set the type of the application info structure.
+    /// That seems like a common point of error, and setting this wrong indeed leads to
+    /// undefined behaviour. The reason why the type exist is so that the drivers can
+    /// dynamically figure out types from objects passed in (reserved for advanced usage).
+    /// However, don't be afraid: validation layers in debug mode will detect this, so in
+    /// practice this is not really an issue (as long as you excercise all code paths ofc).
+    /// We use a compile time flag to select wheter we should enable validation layers or not.
+    /// There exist many validation layers, we only use the code Krhonos validation layer,
+    /// which does conformance checking against the API.
+#ifndef NDEBUG
+    const uint32_t validationLayerCount = 1;
+    const char * validationLayers[] = {
+        "VK_LAYER_KHRONOS_validation"
+    };
+#else
+    const uint32_t validationLayerCount = 0;
+    const char** validationLayers = NULL;
+#endif
+    printf("Creating instance with %d validation layers\n", validationLayerCount);
+    VkApplicationInfo appInfo = {
+        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .apiVersion = VK_API_VERSION_1_1
+    };
+    VkInstanceCreateInfo instanceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+        .pApplicationInfo = &appInfo,
+        .enabledLayerCount = validationLayerCount,
+        .ppEnabledLayerNames = validationLayers
+    };
+    if (vkCreateInstance(&instanceCreateInfo, NULL, &context->instance) != VK_SUCCESS)
+    {
+        printf("Failed to create instance\n");
+        return EXIT_FAILURE;
+    }
+
+
+    /// After setting up the instance we are ready to define the device we will operate on.
+    /// In Vulkan you can handle several physical devices, and we want to pick one of them.
+    /// I am writing this on a laptop with 2 physical devices:
+    ///
+    ///   - The CPU with a software implementation of Vulkan called Lavapipe
+    ///   - The integrated graphics card
+    ///
+    /// which I can see by running `vulkaninfo | grep -A 7 VkPhysicalDeviceProperties`
+    ///
+    ///     VkPhysicalDeviceProperties:
+    ///     ---------------------------
+    ///     	apiVersion     = 4202678 (1.2.182)
+    ///     	driverVersion  = 88088582 (0x5402006)
+    ///     	vendorID       = 0x8086
+    ///     	deviceID       = 0x3ea0
+    ///     	deviceType     = PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU
+    ///     	deviceName     = Intel(R) UHD Graphics 620 (WHL GT2)
+    ///     --
+    ///     VkPhysicalDeviceProperties:
+    ///     ---------------------------
+    ///     	apiVersion     = 4198582 (1.1.182)
+    ///     	driverVersion  = 1 (0x0001)
+    ///     	vendorID       = 0x10005
+    ///     	deviceID       = 0x0000
+    ///     	deviceType     = PHYSICAL_DEVICE_TYPE_CPU
+    ///     	deviceName     = llvmpipe (LLVM 12.0.0, 256 bits)
+    ///
+    /// We prefer the graphics card as the physical device, but we do not want to rule out
+    /// the CPU: on a headless machine without a GPU, Lavapipe is all there is.
+    /// Communication with the physical device is done through commands sent over queues.
+    /// A physical device can support a whole family of queues, each family with certain
+    /// properties, such as support for graphical, compute and transfer commands.
+    /// For each supported queue family, there can also be several queues.
+    /// We will select the first family that supports graphics, compute (for culling) and
+    /// transfer commands, and we will only require one queue in that family.
+    ///
+    /// To select the appropriate physical device we will do the following
+    ///
+    ///     1. Enumerate all physical devices
+    ///     2. Query each physical device for properties and queue families
+    ///     3. Score the devices that can render, by device type and memory
+    ///     4. Select the best one, unless the user asked for a specific device
+    ///
+    /// The details live in device_select.c.
+    PhysicalDeviceCandidate candidates[MAX_PHYSICAL_DEVICE_COUNT];
+    uint32_t candidateCount = MAX_PHYSICAL_DEVICE_COUNT;
+    if (enumeratePhysicalDeviceCandidates(context->instance, candidates, &candidateCount)
+        != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    /// We have enumerated all physical devices, now it is time to pick the most suitable one.
+    /// We want to know the best physical device among all physical devices.
+    /// We also want to know the queue family index for that physical device.
+    printf("Selecting a suitable physical device\n");
+    uint32_t selected;
+    if (selectPhysicalDeviceCandidate(candidates,
+                                      candidateCount,
+                                      config->physicalDevice,
+                                      &selected) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    VkPhysicalDevice physicalDevice = candidates[selected].physicalDevice;
+    VkPhysicalDeviceProperties physicalDeviceProperties = candidates[selected].properties;
+    uint32_t queueFamilyIndex = candidates[selected].queueFamilyIndex;
+    printf("Selected physical device: %s\n", physicalDeviceProperties.deviceName);
+    context->physicalDevice = physicalDevice;
+    context->physicalDeviceProperties = physicalDeviceProperties;
+    context->queueFamilyIndex = queueFamilyIndex;
+    context->transferQueueFamilyIndex = candidates[selected].transferQueueFamilyIndex;
+    uint32_t timestampValidBits = candidates[selected].timestampValidBits;
+    context->transferTimestamps = candidates[selected].transferTimestampValidBits > 0;
+    if (config->transferQueue && context->transferQueueFamilyIndex == queueFamilyIndex)
+    {
+        printf("No dedicated transfer queue family, reading back on the graphics queue\n");
+    }
+    else if (config->transferQueue && config->depthConversion != DEPTH_CONVERSION_NONE)
+    {
+        printf("Depth conversion runs on the graphics queue, not using the transfer queue\n");
+    }
+    else if (config->transferQueue && config->statisticsOnly)
+    {
+        printf("Nothing to read back with statistics only, not using the transfer queue\n");
+    }
+
+
+    /// When we have found a suitable physical device we are ready to create a (logical)
+    /// device from it. The logical device is an abstraction of a physical device with
+    /// specified queues. It owns all the queues it creates, and we can get a queue from it
+    /// after creating the device.
+    /// In advanced setups, logical devices can encompass several physical devices
+    /// (assuming they belong to the same device group that can share memory and queues etc).
+    /// We need to specify a queue priority, which is arbitrarily set to 1 since all our queues
+    /// are equally important.
+    /// Optionally we also get a queue from a transfer-only queue family. Such families are
+    /// often backed by a dedicated copy engine, which can copy the depth of one frame while
+    /// the graphics queue renders the next.
+    /// With depth conversion, or only statistics, there is no copy to move to another queue.
+    uint32_t useTransferQueue = config->transferQueue &&
+                                config->depthConversion == DEPTH_CONVERSION_NONE &&
+                                !config->statisticsOnly &&
+                                context->transferQueueFamilyIndex != context->queueFamilyIndex;
+
+    /// The vertex shader reads gl_ViewIndex, so the device has to be created with the
+    /// multiview feature enabled, even when we do not render multiview. Multiview is part of
+    /// Vulkan 1.1 and every 1.1 device supports it, but the features and limits of 1.1 are
+    /// queried by chaining structures to VkPhysicalDeviceFeatures2 and
+    /// VkPhysicalDeviceProperties2. Device selection only offers devices that support 1.1
+    /// (see device_select.h), so both can be called on the device.
+    VkPhysicalDeviceMultiviewFeatures multiviewFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES
+    };
+    VkPhysicalDeviceFeatures2 physicalDeviceFeatures2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &multiviewFeatures
+    };
+    vkGetPhysicalDeviceFeatures2(context->physicalDevice, &physicalDeviceFeatures2);
+    VkPhysicalDeviceMultiviewProperties multiviewProperties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_PROPERTIES
+    };
+    VkPhysicalDeviceProperties2 physicalDeviceProperties2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &multiviewProperties
+    };
+    vkGetPhysicalDeviceProperties2(context->physicalDevice, &physicalDeviceProperties2);
+    if (!multiviewFeatures.multiview)
+    {
+        printf("The physical device does not support multiview\n");
+        return EXIT_FAILURE;
+    }
+    /// The views of a multiview render pass are selected by the bits of a 32 bit mask.
+    if (config->multiviewCount > multiviewProperties.maxMultiviewViewCount ||
+        config->multiviewCount > MAX_RENDER_LAYERS ||
+        config->multiviewCount > 32)
+    {
+        printf("Unsupported number of views %u (maximum %u)\n",
+               config->multiviewCount, multiviewProperties.maxMultiviewViewCount);
+        return EXIT_FAILURE;
+    }
+    context->multiviewCount = config->multiviewCount;
+    context->culling = config->culling;
+    if (config->farPlane > 0.0f &&
+        !(config->nearPlane > 0.0f && config->nearPlane < config->farPlane))
+    {
+        printf("Unsupported near and far planes %g and %g\n",
+               config->nearPlane, config->farPlane);
+        return EXIT_FAILURE;
+    }
+    if (config->histogramBinCount > MAX_HISTOGRAM_BINS)
+    {
+        printf("Unsupported number of histogram bins %u (maximum %d)\n",
+               config->histogramBinCount, MAX_HISTOGRAM_BINS);
+        return EXIT_FAILURE;
+    }
+    if (config->statisticsOnly && config->depthConversion != DEPTH_CONVERSION_NONE)
+    {
+        printf("There is no depth to convert with statistics only\n");
+        return EXIT_FAILURE;
+    }
+    context->depthConversion = config->depthConversion;
+    context->nearPlane = config->nearPlane;
+    context->farPlane = config->farPlane;
+    context->depthStatistics = config->depthStatistics || config->statisticsOnly;
+    context->histogramBinCount = config->histogramBinCount > 0
+                               ? config->histogramBinCount
+                               : DEFAULT_HISTOGRAM_BINS;
+    context->statisticsOnly = config->statisticsOnly;
+    multiviewFeatures.multiviewGeometryShader = VK_FALSE;
+    multiviewFeatures.multiviewTessellationShader = VK_FALSE;
+    multiviewFeatures.pNext = NULL;
+
+    /// Profiling writes timestamps on the graphics queue, which not every queue family can.
+    /// Pipeline statistics queries are an optional feature, which has to be enabled when the
+    /// device is created. With recording threads, the statistics query is active while their
+    /// secondary command buffers execute, which needs the inheritedQueries feature as well.
+    /// All other features stay disabled, as before.
+    context->profiling = config->profile && timestampValidBits > 0;
+    if (config->profile && !context->profiling)
+    {
+        printf("The graphics queue family can not write timestamps, not profiling\n");
+    }
+    VkPhysicalDeviceFeatures enabledFeatures = {
+        .pipelineStatisticsQuery = context->profiling &&
+                                   physicalDeviceFeatures2.features.pipelineStatisticsQuery
+    };
+    if (context->profiling && !enabledFeatures.pipelineStatisticsQuery)
+    {
+        printf("The physical device does not support pipeline statistics queries\n");
+    }
+    if (enabledFeatures.pipelineStatisticsQuery && config->recordingThreads > 0)
+    {
+        enabledFeatures.inheritedQueries = physicalDeviceFeatures2.features.inheritedQueries;
+        if (!enabledFeatures.inheritedQueries)
+        {
+            printf("The physical device does not support inherited queries, not counting "
+                   "pipeline statistics with recording threads\n");
+        }
+    }
+    uint32_t pipelineStatistics = enabledFeatures.pipelineStatisticsQuery &&
+                                  (config->recordingThreads == 0 ||
+                                   enabledFeatures.inheritedQueries);
+
+    printf("Creating device with %u queues\n", useTransferQueue ? 2 : 1);
+    float queuePriority = 1;
+    VkDeviceQueueCreateInfo queueCreateInfos[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = context->queueFamilyIndex,
+            .queueCount = 1,
+            .pQueuePriorities = &queuePriority
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = context->transferQueueFamilyIndex,
+            .queueCount = 1,
+            .pQueuePriorities = &queuePriority
+        }
+    };
+    VkDeviceCreateInfo deviceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .pNext = &multiviewFeatures,
+        .queueCreateInfoCount = useTransferQueue ? 2 : 1,
+        .pQueueCreateInfos = queueCreateInfos,
+        .pEnabledFeatures = &enabledFeatures
+    };
+    code = vkCreateDevice(context->physicalDevice, &deviceCreateInfo, NULL, &context->device);
+    if (code != VK_SUCCESS)
+    {
+        printf("Failed to create logical device\n");
+        return EXIT_FAILURE;
+    }
+    vkGetDeviceQueue(context->device, context->queueFamilyIndex, 0, &context->queue);
+    if (useTransferQueue)
+    {
+        printf("Reading back on transfer queue family %u\n", context->transferQueueFamilyIndex);
+        vkGetDeviceQueue(context->device,
+                         context->transferQueueFamilyIndex,
+                         0,
+                         &context->transferQueue);
+    }
+
+
+    /// The memory properties of the physical device tell us which memory types and heaps are
+    /// available. We query them once here, they are needed every time we allocate memory.
+    vkGetPhysicalDeviceMemoryProperties(context->physicalDevice,
+                                        &context->deviceMemoryProperties);
+    memoryAllocatorInit(&context->memoryAllocator,
+                        context->device,
+                        &context->physicalDeviceProperties,
+                        &context->deviceMemoryProperties);
+
+    /// All depth images share the same format, since the render pass and thereby the
+    /// pipeline depends on it. We select 24 bit depth and a 8 bit stencil component format.
+    /// The resources themselves depend on the resolution, which is only known when we
+    /// render, so they are created on demand by `acquireRenderTarget` (see PART 2 below).
+    context->depthFormat = VK_FORMAT_D24_UNORM_S8_UINT;
+
+    /// Depth conversion and statistics sample the depth image in a compute shader. Every
+    /// implementation can sample some depth format, but not necessarily the one we render
+    /// to, so we ask.
+    if (context->depthConversion != DEPTH_CONVERSION_NONE || context->depthStatistics)
+    {
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(context->physicalDevice,
+                                            context->depthFormat,
+                                            &formatProperties);
+        if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+        {
+            printf("The physical device can not sample %s, which depth conversion and "
+                   "statistics need\n",
+                   formatString(context->depthFormat));
+            return EXIT_FAILURE;
+        }
+    }
+
+
+    ////////////////////////////////////////////
+    ////////// PART 3 | Graphics Pipeline //////
+    ////////////////////////////////////////////
+
+
+    /// In order to render something, we need to define a graphics pipeline.
+    /// A graphics pipeline needs a render pass, a framebuffer, loading of shader code for the
+    /// programmable stages, and configuration of the fixed (assembly, rasterization) stages.
+    ///
+    /// Let us start with the render pass.
+    /// The render pass needs to know about the attachment it will render to, i.e. the render
+    /// targets. When describing the attachment we configure Vulkan how the render pass load
+    /// and store operations will behave. We also specify the initial and final layouts of the
+    /// render target. A render pass automatically perform image layout transitions (nice!).
+    ///
+    /// Note some code duplication here regarding format and samples. Can't that be deduced
+    /// from the image it will render into? The render pass is loosely coupled with the actual
+    /// image it will render into, the framebuffer will connect the dots later on.
+    /// The specs states that these needs to match, so specifying anything different from
+    /// those in the image is an error. Again, Vulkan puts the burden on us to make sure that
+    /// this is the case. Luckily, validation layers also detects this type of errors for us.
+    printf("Creating render pass\n");
+    VkAttachmentDescription attachmentDescription = {
+        .flags = 0,
+        .format = context->depthFormat,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+    };
+
+    /// A render pass is divided into subpasses. We only need one subpass for now.
+    /// We need to tell the subpass what input and output attachment it has, which are
+    /// referenced to the attachments described by the parent render pass.
+    /// We only have one output attachment (index 0).
+    /// The pipeline bind point must be set to graphics.
+    VkAttachmentReference attachmentReference = {
+        .attachment = 0,
+        .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+    };
+    VkSubpassDescription subpassDescription = {
+        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+        .pDepthStencilAttachment = &attachmentReference
+    };
+    /// With multiview, the subpass gets a view mask with one bit per view. Every draw is then
+    /// broadcast to all views, each rendering into the array layer of the same index with
+    /// gl_ViewIndex telling the shader which view it runs for. The driver fetches the
+    /// vertices once and may rasterize the views together. The correlation mask tells it
+    /// that the views are close to each other, like the poses of a sweep.
+    uint32_t viewMask = context->multiviewCount == 32
+                      ? UINT32_MAX
+                      : (1u << context->multiviewCount) - 1;
+    VkRenderPassMultiviewCreateInfo renderPassMultiviewCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO,
+        .subpassCount = 1,
+        .pViewMasks = &viewMask,
+        .correlationMaskCount = 1,
+        .pCorrelationMasks = &viewMask
+    };
+    VkRenderPassCreateInfo renderPassCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .pNext = context->multiviewCount > 0 ? &renderPassMultiviewCreateInfo : NULL,
+        .attachmentCount = 1,
+        .pAttachments = &attachmentDescription,
+        .subpassCount = 1,
+        .pSubpasses = &subpassDescription
+    };
+    code = vkCreateRenderPass(context->device, &renderPassCreateInfo, NULL, &context->renderPass);
+    if (code != VK_SUCCESS)
+    {
+        printf("Failed to create render pass\n");
+        return EXIT_FAILURE;
+    }
+
+
+    /// The graphics pipeline must have at least a vertex shader in order to draw something.
+    /// In Vulkan we load pre-compiled SPIR-V files. This allows different shading languages
+    /// to be used together with Vulkan.
+    if (createShaderModule(context->device,
+                           VERTEX_SHADER_SOURCE_PATH,
+                           &context->vertexShaderModule) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+
+    /// Now we are ready to setup the graphics pipeline.
+    /// We do this by describing the pipeline programmable (shader) stages, the pipeline fixed
+    /// (assembly, rasterization, etc.) stages, the viewport, and the render pass to use.
+    printf("Creating graphics pipeline\n");
+    /// Whether the vertex shader goes through the visible instances is a specialization
+    /// constant, fixed when the pipeline is compiled, so the shader does not pay for culling
+    /// when it is off.
+    VkBool32 culling = context->culling ? VK_TRUE : VK_FALSE;
+    VkSpecializationMapEntry specializationMapEntry = {
+        .constantID = 0,
+        .offset = 0,
+        .size = sizeof(culling)
+    };
+    VkSpecializationInfo specializationInfo = {
+        .mapEntryCount = 1,
+        .pMapEntries = &specializationMapEntry,
+        .dataSize = sizeof(culling),
+        .pData = &culling
+    };
+    VkPipelineShaderStageCreateInfo pipelineShaderStageCreateInfos[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_VERTEX_BIT,
+            .module = context->vertexShaderModule,
+            .pName = "main",
+            .pSpecializationInfo = &specializationInfo
+        }
+    };
+    /// The vertex input state describes how vertices are fetched from the vertex buffers.
+    /// We have a single binding of tightly packed positions, advancing per vertex, which
+    /// feeds the vec3 at location 0 of the vertex shader.
+    VkVertexInputBindingDescription vertexInputBindingDescription = {
+        .binding = 0,
+        .stride = 3 * sizeof(float),
+        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+    };
+    VkVertexInputAttributeDescription vertexInputAttributeDescription = {
+        .location = 0,
+        .binding = 0,
+        .format = VK_FORMAT_R32G32B32_SFLOAT,
+        .offset = 0
+    };
+    VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = 1,
+        .pVertexBindingDescriptions = &vertexInputBindingDescription,
+        .vertexAttributeDescriptionCount = 1,
+        .pVertexAttributeDescriptions = &vertexInputAttributeDescription
+    };
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
+    };
+    /// The viewport and scissor depend on the resolution we render at, which changes from
+    /// render to render. Baking them into the pipeline would force us to build one pipeline
+    /// per resolution. Instead we declare them as dynamic state, which means that the values
+    /// are set with vkCmdSetViewport and vkCmdSetScissor when recording the command buffer.
+    /// We still need to tell the pipeline how many viewports and scissors there are.
+    VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .scissorCount = 1
+    };
+    VkDynamicState dynamicStates[] = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = sizeof(dynamicStates) / sizeof(dynamicStates[0]),
+        .pDynamicStates = dynamicStates
+    };
+    VkPipelineRasterizationStateCreateInfo pipelineRasterizationStateCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .lineWidth = 1.0f
+    };
+    VkPipelineDepthStencilStateCreateInfo pipelineDepthStencilStateCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = VK_TRUE,
+        .depthWriteEnable = VK_TRUE,
+        .depthCompareOp = VK_COMPARE_OP_LESS
+    };
+
+    /// The vertex shader reads its per-frame parameters (see FrameParameters) from a uniform
+    /// buffer. The pipeline layout describes the resources a pipeline accesses: here a single
+    /// descriptor set with a uniform buffer at binding 0, visible to the vertex stage.
+    /// We could pass the parameters as push constants instead, which are cheaper to update.
+    /// But push constants are recorded into the command buffer, and we want to submit the
+    /// same command buffer again with different parameters.
+    /// The camera poses of a sweep (see FramePoses) are too many for a uniform buffer on
+    /// some devices (maxUniformBufferRange can be as low as 16 KiB), so they go into a storage
+    /// buffer at binding 1. The only thing that is recorded is the index of the layer being
+    /// rendered, a single push constant.
+    /// The model matrices of the instances go into another storage buffer at binding 2, which
+    /// the vertex shader indexes by gl_InstanceIndex. A single draw then renders every copy of
+    /// a mesh in the scene, however many there are.
+    /// The culling compute shader shares the descriptor set. It reads the same matrices and
+    /// writes the indices of the visible instances (binding 3) and the indirect draw command
+    /// that draws them (binding 4).
+    /// The depth statistics shader binds the set as well, for the statistics buffer it
+    /// reduces into (binding 5).
+    VkShaderStageFlags sharedStages = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+    VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[] = {
+        {
+            .binding = 0,
+            .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = sharedStages
+        },
+        {
+            .binding = 1,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = sharedStages
+        },
+        {
+            .binding = 2,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = sharedStages
+        },
+        {
+            .binding = 3,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = sharedStages
+        },
+        {
+            .binding = 4,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+        },
+        {
+            .binding = 5,
+            .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+        }
+    };
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = 6,
+        .pBindings = descriptorSetLayoutBindings
+    };
+    code = vkCreateDescriptorSetLayout(context->device,
+                                       &descriptorSetLayoutCreateInfo,
+                                       NULL,
+                                       &context->descriptorSetLayout);
+    if (code != VK_SUCCESS)
+    {
+        printf("Failed to create descriptor set layout\n");
+        return EXIT_FAILURE;
+    }
+    VkPushConstantRange pushConstantRange = {
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+        .offset = 0,
+        .size = sizeof(uint32_t)
+    };
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &context->descriptorSetLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &pushConstantRange
+    };
+    code = vkCreatePipelineLayout(context->device,
+                                  &pipelineLayoutCreateInfo,
+                                  NULL,
+                                  &context->pipelineLayout);
+    if (code != VK_SUCCESS)
+    {
+        printf("Failed to create pipeline layout\n");
+        return EXIT_FAILURE;
+    }
+
+    VkPipelineMultisampleStateCreateInfo pipelineMultisampleCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT
+    };
+
+    VkGraphicsPipelineCreateInfo graphicsPipelineCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        .stageCount = 1,
+        .pStages = pipelineShaderStageCreateInfos,
+        .pVertexInputState = &vertexInputStateCreateInfo,
+        .pInputAssemblyState = &inputAssemblyStateCreateInfo,
+        .pViewportState = &viewportStateCreateInfo,
+        .pRasterizationState = &pipelineRasterizationStateCreateInfo,
+        .pMultisampleState = &pipelineMultisampleCreateInfo,
+        .pDepthStencilState = &pipelineDepthStencilStateCreateInfo,
+        .pDynamicState = &dynamicStateCreateInfo,
+        .layout = context->pipelineLayout,
+        .renderPass = context->renderPass
+    };
+
+    /// Creating the pipeline is where the driver compiles our SPIR-V into machine code, which
+    /// is by far the most expensive call in this program. A pipeline cache lets the driver
+    /// reuse the result of earlier compilations. We seed the cache from disk before creating
+    /// the pipeline and write it back afterwards, so only the very first run pays the full
+    /// price. See pipeline_cache.h for how the file is validated against the device.
+    /// Run `./scripts/benchmark-pipeline-cache` to compare a cold and a warm start.
+    if (pipelineCacheLoad(context->device,
+                          &context->physicalDeviceProperties,
+                          PIPELINE_CACHE_DIRECTORY,
+                          &context->pipelineCache) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    struct timespec pipelineStart, pipelineEnd;
+    clock_gettime(CLOCK_MONOTONIC, &pipelineStart);
+    code = vkCreateGraphicsPipelines(context->device,
+                                     context->pipelineCache,
+                                     1, &graphicsPipelineCreateInfo,
+                                     NULL,
+                                     &context->graphicsPipeline);
+    if (code != VK_SUCCESS)
+    {
+        printf("Failed to create graphics pipeline\n");
+        return EXIT_FAILURE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &pipelineEnd);
+    printf("Created graphics pipeline in %.3f ms\n",
+           1e3 * (pipelineEnd.tv_sec - pipelineStart.tv_sec) +
+           1e-6 * (pipelineEnd.tv_nsec - pipelineStart.tv_nsec));
+
+    /// With culling, a compute pipeline culls the instances before the render pass. It binds
+    /// the same descriptor set as the graphics pipeline, with a push constant range of its
+    /// own for the bounding sphere of the mesh and the number of instances and poses.
+    if (context->culling)
+    {
+        if (createShaderModule(context->device,
+                               CULL_SHADER_SOURCE_PATH,
+                               &context->cullShaderModule) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+        VkPushConstantRange cullPushConstantRange = {
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = sizeof(CullParameters)
+        };
+        VkPipelineLayoutCreateInfo cullPipelineLayoutCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = 1,
+            .pSetLayouts = &context->descriptorSetLayout,
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &cullPushConstantRange
+        };
+        code = vkCreatePipelineLayout(context->device,
+                                      &cullPipelineLayoutCreateInfo,
+                                      NULL,
+                                      &context->cullPipelineLayout);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to create culling pipeline layout\n");
+            return EXIT_FAILURE;
+        }
+        VkComputePipelineCreateInfo computePipelineCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = context->cullShaderModule,
+                .pName = "main"
+            },
+            .layout = context->cullPipelineLayout
+        };
+        code = vkCreateComputePipelines(context->device,
+                                        context->pipelineCache,
+                                        1, &computePipelineCreateInfo,
+                                        NULL,
+                                        &context->cullPipeline);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to create culling pipeline\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    /// With depth conversion, another compute pipeline converts the depth after the render
+    /// pass. It reads the depth image through a combined image sampler and writes the
+    /// readback buffer as a storage buffer, both of which belong to the render target rather
+    /// than the frame, so they get a descriptor set layout of their own. The shader fetches
+    /// texels without filtering, the sampler is only there because sampled images need one.
+    /// It never changes, so it is baked into the layout as an immutable sampler.
+    /// The depth statistics shader samples the depth image through the same layout.
+    if (context->depthConversion != DEPTH_CONVERSION_NONE || context->depthStatistics)
+    {
+        VkSamplerCreateInfo samplerCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+            .magFilter = VK_FILTER_NEAREST,
+            .minFilter = VK_FILTER_NEAREST,
+            .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+            .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+            .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE
+        };
+        code = vkCreateSampler(context->device,
+                               &samplerCreateInfo,
+                               NULL,
+                               &context->depthSampler);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to create depth sampler\n");
+            return EXIT_FAILURE;
+        }
+        VkDescriptorSetLayoutBinding depthBindings[] = {
+            {
+                .binding = 0,
+                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                .pImmutableSamplers = &context->depthSampler
+            },
+            {
+                .binding = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            }
+        };
+        VkDescriptorSetLayoutCreateInfo depthLayoutCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .bindingCount = 2,
+            .pBindings = depthBindings
+        };
+        code = vkCreateDescriptorSetLayout(context->device,
+                                           &depthLayoutCreateInfo,
+                                           NULL,
+                                           &context->depthDescriptorSetLayout);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to create depth descriptor set layout\n");
+            return EXIT_FAILURE;
+        }
+        /// Render targets come and go with the resolutions requested, so their descriptor
+        /// sets are freed individually, which the pool has to allow.
+        VkDescriptorPoolSize depthPoolSizes[] = {
+            {
+                .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                .descriptorCount = MAX_RENDER_TARGETS
+            },
+            {
+                .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = MAX_RENDER_TARGETS
+            }
+        };
+        VkDescriptorPoolCreateInfo depthPoolCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+            .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+            .maxSets = MAX_RENDER_TARGETS,
+            .poolSizeCount = 2,
+            .pPoolSizes = depthPoolSizes
+        };
+        code = vkCreateDescriptorPool(context->device,
+                                      &depthPoolCreateInfo,
+                                      NULL,
+                                      &context->depthDescriptorPool);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to create depth descriptor pool\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if (context->depthConversion != DEPTH_CONVERSION_NONE)
+    {
+        if (createShaderModule(context->device,
+                               CONVERT_SHADER_SOURCE_PATH,
+                               &context->conversionShaderModule) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+        VkPushConstantRange conversionPushConstantRange = {
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = sizeof(ConversionParameters)
+        };
+        VkPipelineLayoutCreateInfo conversionPipelineLayoutCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = 1,
+            .pSetLayouts = &context->depthDescriptorSetLayout,
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &conversionPushConstantRange
+        };
+        code = vkCreatePipelineLayout(context->device,
+                                      &conversionPipelineLayoutCreateInfo,
+                                      NULL,
+                                      &context->conversionPipelineLayout);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to create depth conversion pipeline layout\n");
+            return EXIT_FAILURE;
+        }
+        VkComputePipelineCreateInfo conversionPipelineCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = context->conversionShaderModule,
+                .pName = "main"
+            },
+            .layout = context->conversionPipelineLayout
+        };
+        code = vkCreateComputePipelines(context->device,
+                                        context->pipelineCache,
+                                        1, &conversionPipelineCreateInfo,
+                                        NULL,
+                                        &context->conversionPipeline);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to create depth conversion pipeline\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    /// With depth statistics, a compute pipeline reduces the depth to a few numbers after the
+    /// render pass. It binds the descriptor set of the frame, where the statistics buffer is
+    /// (binding 5), as set 0, and that of the render target, with the depth image, as set 1.
+    if (context->depthStatistics)
+    {
+        if (createShaderModule(context->device,
+                               STATS_SHADER_SOURCE_PATH,
+                               &context->statisticsShaderModule) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+        VkDescriptorSetLayout statisticsSetLayouts[] = {
+            context->descriptorSetLayout,
+            context->depthDescriptorSetLayout
+        };
+        VkPushConstantRange statisticsPushConstantRange = {
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = sizeof(StatisticsParameters)
+        };
+        VkPipelineLayoutCreateInfo statisticsPipelineLayoutCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = 2,
+            .pSetLayouts = statisticsSetLayouts,
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &statisticsPushConstantRange
+        };
+        code = vkCreatePipelineLayout(context->device,
+                                      &statisticsPipelineLayoutCreateInfo,
+                                      NULL,
+                                      &context->statisticsPipelineLayout);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to create depth statistics pipeline layout\n");
+            return EXIT_FAILURE;
+        }
+        VkComputePipelineCreateInfo statisticsPipelineCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = context->statisticsShaderModule,
+                .pName = "main"
+            },
+            .layout = context->statisticsPipelineLayout
+        };
+        code = vkCreateComputePipelines(context->device,
+                                        context->pipelineCache,
+                                        1, &statisticsPipelineCreateInfo,
+                                        NULL,
+                                        &context->statisticsPipeline);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to create depth statistics pipeline\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    /// Saving is best effort, failing to write the cache only makes the next start slower.
+    pipelineCacheSave(context->device,
+                      &context->physicalDeviceProperties,
+                      PIPELINE_CACHE_DIRECTORY,
+                      context->pipelineCache);
+
+
+    ////////////////////////////////////////////
+    ////////// STEP 4 | Command buffers ////////
+    ////////////////////////////////////////////
+
+    /// Vulkan communicate with the device using commands send over the queue.
+    /// It is inefficient to send one command at a time, so we will record the commands we
+    /// want to perform in a command buffer and send it over once.
+    /// Before we can create a command buffer, we need to create a command pool. The commands
+    /// recorded in a command buffer must be compatible with the family of the queue they are
+    /// sent over. The command pool is like a factory for command buffers, they are connected
+    /// to a specific queue family on our device. Command pools let us record command buffers
+    /// in parallel in separate threads, with one pool per thread. Using a command pool also
+    /// makes allocating new command buffers more efficient that it would be allocating them
+    /// in isolation.
+    /// We create the command pool with the VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+    /// which will make sure that command buffers alloacted from the pool are put into a good
+    /// initial state if they are re-used.
+    printf("Creating command pool\n");
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = context->queueFamilyIndex
+    };
+    code = vkCreateCommandPool(context->device,
+                               &commandPoolCreateInfo,
+                               NULL,
+                               &context->commandPool);
+    if (code != VK_SUCCESS)
+    {
+        printf("Failed to create command pool\n");
+        return EXIT_FAILURE;
+    }
+
+    /// With a command pool we can create a command buffer from it.
+    /// To create the command buffer we specify a command pool at a certain level.
+    /// There are two command buffer levels in Vulkan: primary and secondary.
+    /// Primary level command buffers can be submitted to queues, while secondary are called
+    /// from primary commands (advanced usage).
+    /// When the command buffer is allocated, it is put into "initial state". Operations on
+    /// command buffers act like a state machine and transitions the command buffer state.
+    ///
+    /// We allocate one command buffer per frame in flight. A command buffer can not be
+    /// re-recorded while it is pending execution, so in order to record frame K+1 while the
+    /// device still works on frame K, each frame needs a command buffer of its own.
+    printf("Allocating %u command buffers\n", config->framesInFlight);
+    context->frameCount = config->framesInFlight;
+    VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = context->commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = context->frameCount
+    };
+    code = vkAllocateCommandBuffers(context->device, &commandBufferAllocateInfo, commandBuffers);
+    if (code != VK_SUCCESS)
+    {
+        printf("Failed to allocate command buffers\n");
+        return EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < context->frameCount; ++i)
+    {
+        context->frames[i].commandBuffer = commandBuffers[i];
+    }
+
+    /// Command buffers for the transfer queue come from a pool of their own, since a pool
+    /// belongs to a single queue family. Each frame also gets a semaphore, which the render
+    /// signals and the copy waits for. Semaphores order work between queues on the device,
+    /// without a round trip to the host.
+    if (context->transferQueue != VK_NULL_HANDLE)
+    {
+        commandPoolCreateInfo.queueFamilyIndex = context->transferQueueFamilyIndex;
+        code = vkCreateCommandPool(context->device,
+                                   &commandPoolCreateInfo,
+                                   NULL,
+                                   &context->transferCommandPool);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to create transfer command pool\n");
+            return EXIT_FAILURE;
+        }
+        commandBufferAllocateInfo.commandPool = context->transferCommandPool;
+        code = vkAllocateCommandBuffers(context->device,
+                                        &commandBufferAllocateInfo,
+                                        commandBuffers);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to allocate transfer command buffers\n");
+            return EXIT_FAILURE;
+        }
+        VkSemaphoreCreateInfo semaphoreCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
+        };
+        for (uint32_t i = 0; i < context->frameCount; ++i)
+        {
+            context->frames[i].transferCommandBuffer = commandBuffers[i];
+            code = vkCreateSemaphore(context->device,
+                                     &semaphoreCreateInfo,
+                                     NULL,
+                                     &context->frames[i].renderFinished);
+            if (code != VK_SUCCESS)
+            {
+                printf("Failed to create semaphore\n");
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    /// We will also create a fence object per frame so that we know when the commands
+    /// submitted for that frame have finished executing. The fence is created once and reset
+    /// before every submission. When creating the device we made sure to get a queue from a
+    /// family supporting both graphics and transfer operations.
+    /// With a dedicated transfer queue the fence is signaled by the copy, which comes last.
+    VkFenceCreateInfo fenceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO
+    };
+    for (uint32_t i = 0; i < context->frameCount; ++i)
+    {
+        code = vkCreateFence(context->device, &fenceCreateInfo, NULL, &context->frames[i].fence);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to create fence\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    /// Every frame has a uniform buffer with its parameters, storage buffers with its camera
+    /// poses, its instances, the visible instances, the indirect draw command and, with depth
+    /// statistics, the statistics, and a descriptor set pointing at all of them.
+    VkDescriptorPoolSize descriptorPoolSizes[] = {
+        {
+            .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            .descriptorCount = context->frameCount
+        },
+        {
+            .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+            .descriptorCount = 5 * context->frameCount
+        }
+    };
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = context->frameCount,
+        .poolSizeCount = 2,
+        .pPoolSizes = descriptorPoolSizes
+    };
+    code = vkCreateDescriptorPool(context->device,
+                                  &descriptorPoolCreateInfo,
+                                  NULL,
+                                  &context->descriptorPool);
+    if (code != VK_SUCCESS)
+    {
+        printf("Failed to create descriptor pool\n");
+        return EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < context->frameCount; ++i)
+    {
+        RenderFrame* frame = &context->frames[i];
+        if (createFrameBuffer(context,
+                              sizeof(FrameParameters),
+                              VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                              &frame->parameterBuffer,
+                              &frame->parameterMemory) != EXIT_SUCCESS ||
+            createFrameBuffer(context,
+                              sizeof(FramePoses),
+                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                              &frame->poseBuffer,
+                              &frame->poseMemory) != EXIT_SUCCESS ||
+            createFrameBuffer(context,
+                              sizeof(VkDrawIndexedIndirectCommand),
+                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                              VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                              &frame->drawCommandBuffer,
+                              &frame->drawCommandMemory) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+
+        VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = context->descriptorPool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &context->descriptorSetLayout
+        };
+        code = vkAllocateDescriptorSets(context->device,
+                                        &descriptorSetAllocateInfo,
+                                        &frame->descriptorSet);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to allocate descriptor set\n");
+            return EXIT_FAILURE;
+        }
+        VkDescriptorBufferInfo descriptorBufferInfos[] = {
+            {
+                .buffer = frame->parameterBuffer,
+                .offset = 0,
+                .range = sizeof(FrameParameters)
+            },
+            {
+                .buffer = frame->poseBuffer,
+                .offset = 0,
+                .range = sizeof(FramePoses)
+            },
+            {
+                .buffer = frame->drawCommandBuffer,
+                .offset = 0,
+                .range = sizeof(VkDrawIndexedIndirectCommand)
+            }
+        };
+        VkWriteDescriptorSet writeDescriptorSets[] = {
+            {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = frame->descriptorSet,
+                .dstBinding = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                .pBufferInfo = &descriptorBufferInfos[0]
+            },
+            {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = frame->descriptorSet,
+                .dstBinding = 1,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &descriptorBufferInfos[1]
+            },
+            {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = frame->descriptorSet,
+                .dstBinding = 4,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &descriptorBufferInfos[2]
+            }
+        };
+        vkUpdateDescriptorSets(context->device, 3, writeDescriptorSets, 0, NULL);
+        if (context->depthStatistics)
+        {
+            VkDeviceSize statisticsSize = sizeof(FrameStatistics) +
+                                          context->histogramBinCount * sizeof(uint32_t);
+            if (createFrameBuffer(context,
+                                  statisticsSize,
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                  &frame->statisticsBuffer,
+                                  &frame->statisticsMemory) != EXIT_SUCCESS)
+            {
+                return EXIT_FAILURE;
+            }
+            VkDescriptorBufferInfo statisticsBufferInfo = {
+                .buffer = frame->statisticsBuffer,
+                .offset = 0,
+                .range = statisticsSize
+            };
+            VkWriteDescriptorSet writeDescriptorSet = {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = frame->descriptorSet,
+                .dstBinding = 5,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &statisticsBufferInfo
+            };
+            vkUpdateDescriptorSets(context->device, 1, &writeDescriptorSet, 0, NULL);
+        }
+        if (reserveInstanceBuffer(context, frame, INITIAL_INSTANCE_CAPACITY) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    context->reuseCommandBuffers = config->reuseCommandBuffers;
+
+    /// Geometry lives in device local vertex and index buffers, uploaded through a staging
+    /// buffer (see mesh_cache.h). The triangle is uploaded right away, so that it is resident
+    /// by the first render.
+    ResidentMesh* residentTriangle;
+    if (meshCacheInit(&context->meshCache,
+                      context->device,
+                      context->queue,
+                      context->queueFamilyIndex,
+                      &context->memoryAllocator) != EXIT_SUCCESS ||
+        meshCacheUpload(&context->meshCache, &triangleMesh, 1, &residentTriangle)
+        != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    /// Optionally the draws are recorded by a set of threads, each with a command pool of its
+    /// own (see command_recorder.h).
+    if (config->recordingThreads > 0)
+    {
+        printf("Starting %u recording threads\n", config->recordingThreads);
+        if (commandRecorderInit(&context->recorder,
+                                context->device,
+                                context->queueFamilyIndex,
+                                config->recordingThreads,
+                                context->frameCount) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    /// When profiling, every frame gets timestamp queries for its passes and a pipeline
+    /// statistics query (see gpu_profiler.h). The statistics query is active while the draws
+    /// recorded by the threads execute, so their secondary command buffers have to declare
+    /// that they inherit it. Without the pool of statistics queries, none is ever begun.
+    if (context->profiling)
+    {
+        if (gpuProfilerInit(&context->profiler,
+                            context->device,
+                            context->frameCount,
+                            context->physicalDeviceProperties.limits.timestampPeriod,
+                            timestampValidBits,
+                            pipelineStatistics) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+        if (pipelineStatistics)
+        {
+            context->recorder.pipelineStatistics = GPU_PIPELINE_STATISTICS;
+        }
+    }
+
+    /// Rather than polling the fences, completion is tracked by a waiter thread that sleeps
+    /// in the driver until the device signals a fence (see completion.h).
+    context->completed = config->completed;
+    context->userData = config->userData;
+    if (completionQueueInit(&context->completionQueue, context->device) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+////////////////////////////////////
+////////// PART 2 | Resources //////
+////////////////////////////////////
+
+
+/// Arrange the tiles of a depth atlas in a grid that is as square as possible.
+static void
+atlasGrid(uint32_t tileCount, uint32_t* columns, uint32_t* rows)
+{
+    uint32_t n = 1;
+    while (n * n < tileCount)
+    {
+        ++n;
+    }
+    *columns = n;
+    *rows = (tileCount + n - 1) / n;
+}
+
+
+/// Create the readback buffer of `target`, for `pixelCount` pixels of all layers.
+static int
+createReadbackBuffer(RenderContext* context, RenderTarget* target, VkDeviceSize pixelCount)
+{
+    VkResult code;
+    uint32_t memoryTypeIndex;
+
+    /// We need a buffer which we can read back the rendered data to the host with.
+    /// The procedure for allocating a suitable memory for the buffer is similar to images.
+    /// We require that the buffer memory have the HOST_VISIBLE bit set, and prefer memory
+    /// that also has the HOST_CACHED bit and then the HOST_COHERENT bit set.
+    /// HOST_VISIBLE means that the memory can be mapped to host memory.
+    /// HOST_CACHED means that host accesses to the memory go through the CPU caches.
+    /// Host visible memory that is not cached is typically write-combined, which is fine for
+    /// the host writing data for the device, but reading from it is very slow. For a
+    /// readback buffer that the host reads every pixel of, cached memory is what we want.
+    /// HOST_COHERENT means that device writes to the memory will be visible to the host
+    /// without extra flushing commands. Without it, we have to invalidate the host caches
+    /// of the mapped range with vkInvalidateMappedMemoryRanges before reading.
+    /// Note the slight inconsistency in the naming conventions here. Memory visibility is a
+    /// concept in Vulkan related to synchronization of commands, which is what the
+    /// HOST_COHERENT bit addresses.
+    /// Since we know that the memory layout will be linear for a buffer we can also calculate
+    /// how much memory we need to allocate from the image format and size.
+    /// We will also specify that the buffer will be used as a destination of a transfer
+    /// operation.
+    /// With depth conversion, the buffer is written by the conversion shader as a storage
+    /// buffer instead, and holds a float or half a word per pixel. Half floats come in pairs,
+    /// so the size is rounded up to a whole word. The shader addresses the whole buffer, so
+    /// it must fit in the range of a storage buffer descriptor.
+    printf("Creating image pixel read back buffer\n");
+    VkDeviceSize pixelReadbackBufferSize =
+        context->depthConversion == DEPTH_CONVERSION_FLOAT32 ? 4 * pixelCount
+        : context->depthConversion == DEPTH_CONVERSION_FLOAT16 ? 4 * ((pixelCount + 1) / 2)
+        : formatSize(target->format) * pixelCount;
+    target->pixelReadbackBufferSize = pixelReadbackBufferSize;
+    if (pixelReadbackBufferSize == 0)
+    {
+        printf("Failed to estimate byte size of image format: %s\n",
+               formatString(target->format));
+        return EXIT_FAILURE;
+    }
+    if (context->depthConversion != DEPTH_CONVERSION_NONE &&
+        pixelReadbackBufferSize > context->physicalDeviceProperties.limits.maxStorageBufferRange)
+    {
+        printf("Converted depth of %lu bytes exceeds the maximum storage buffer range %u\n",
+               (unsigned long) pixelReadbackBufferSize,
+               context->physicalDeviceProperties.limits.maxStorageBufferRange);
+        return EXIT_FAILURE;
+    }
+    VkBufferCreateInfo pixelReadbackBufferCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = pixelReadbackBufferSize,
+        .usage = context->depthConversion != DEPTH_CONVERSION_NONE
+               ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+               : VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = &context->queueFamilyIndex
+    };
+    code = vkCreateBuffer(context->device,
+                          &pixelReadbackBufferCreateInfo,
+                          NULL,
+                          &target->pixelReadbackBuffer);
+    if (code != VK_SUCCESS)
+    {
+        printf("Failed to create pixel readback buffer\n");
+        return EXIT_FAILURE;
+    }
+
+    VkMemoryRequirements pixelReadbackBufferMemoryRequirements;
+    vkGetBufferMemoryRequirements(context->device, target->pixelReadbackBuffer,
+                                  &pixelReadbackBufferMemoryRequirements);
+    VkMemoryPropertyFlags pixelReadbackBufferMemoryPreferences[] = {
+        VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+        VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+    };
+    memoryTypeIndex = findMemoryType(&context->deviceMemoryProperties,
+                                     pixelReadbackBufferMemoryRequirements.memoryTypeBits,
+                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                     pixelReadbackBufferMemoryPreferences,
+                                     2);
+    if (memoryTypeIndex == context->deviceMemoryProperties.memoryTypeCount)
+    {
+        printf("Failed to find device memory matching pixel readback memory requirements\n");
+        return EXIT_FAILURE;
+    }
+    target->pixelReadbackBufferCoherent =
+        (context->deviceMemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags
+         & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+
+    /// Buffers are linear resources, so they come from other memory blocks than the images.
+    printf("Allocating pixel readback buffer memory\n");
+    if (memoryAllocatorAllocate(&context->memoryAllocator,
+                                &pixelReadbackBufferMemoryRequirements,
+                                memoryTypeIndex,
+                                MEMORY_RESOURCE_LINEAR,
+                                &target->pixelReadbackBufferMemory) != EXIT_SUCCESS)
+    {
+        printf("Failed to allocated pixel readback buffer memory\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("Binding image buffer to image buffer memory\n");
+    code = vkBindBufferMemory(context->device,
+                              target->pixelReadbackBuffer,
+                              target->pixelReadbackBufferMemory.memory,
+                              target->pixelReadbackBufferMemory.offset);
+    if (code != VK_SUCCESS)
+    {
+        printf("Failed to bind image buffer to image buffer memory\n");
+        return EXIT_FAILURE;
+    }
+
+    /// The memory allocator maps host visible memory blocks once and keeps them mapped for
+    /// their whole lifetime, so the buffer memory is already mapped. Mapping is not free, and
+    /// Vulkan allows memory to stay mapped while the device writes to it, as long as the host
+    /// does not read it at the same time.
+    target->pixelReadbackBufferMapping = target->pixelReadbackBufferMemory.mapping;
+    return EXIT_SUCCESS;
+}
+
+
+/// Create the resources of a render target of the given resolution, i.e. everything that
+/// depends on the size of the image we render to. These are kept in a cache by
+/// `acquireRenderTarget`, so this only runs the first time a resolution is requested.
+static int
+createRenderTarget(RenderContext* context,
+                   uint32_t width,
+                   uint32_t height,
+                   uint32_t layerCount,
+                   uint32_t tileCount,
+                   RenderTarget* target)
+{
+    VkResult code;
+    printf("Creating render target %ux%u with %u layers and %u tiles\n",
+           width, height, layerCount, tileCount);
+    target->width = width;
+    target->height = height;
+    target->layerCount = layerCount;
+    target->tileCount = tileCount;
+    atlasGrid(tileCount, &target->tileColumns, &target->tileRows);
+    target->format = context->depthFormat;
+    target->readbackFormat = context->depthConversion == DEPTH_CONVERSION_FLOAT32
+                           ? VK_FORMAT_R32_SFLOAT
+                           : context->depthConversion == DEPTH_CONVERSION_FLOAT16
+                           ? VK_FORMAT_R16_SFLOAT
+                           : context->depthFormat;
+
+    /// Next step is to allocate resources for the image we will render to, as well as a pixel
+    /// readback buffer. Vulkan distinguish images, buffers, memory and views.
+    /// In Vulkan, memory can be allocated on different physical devices, on different heaps
+    /// of different memory types. The memory type becomes important when you want to transfer
+    /// data between device and host, for example. You will never (to my knowledge) operate
+    /// directly on memory, but through buffers and images or other memory like objects.
+    /// Buffers are simple memory objects. They add the functionality of belonging to a queue,
+    /// having a usage flag etc. Several buffers can share memory, they can even overlap,
+    /// which also should highlight why it is good to differ between raw memory and the buffer
+    /// that lies on top of it.
+    /// Images are more advanced than buffers. While buffers represent linear memory, images
+    /// support several features optimized for graphics such as formats, mipmaps, layers, and
+    /// multisampling. Images can also be (and usually are) tiled, which makes them more
+    /// efficient than buffers for image like access patterns.
+    /// Images also have something called a layout which specifies what kind of operation they
+    /// are optimized for. You want to specify a certain layout when rendering, and then
+    /// transition it to another layout before transferring.
+    /// Finally there are views, which specify a subset of the underlying resource to access.
+    /// This is what eventually will go into the framebuffer.
+    ///
+    /// Ok, what resources do we need?
+    /// We need an image + image memory + image view for the render target.
+    /// We will also need a buffer that we can transfer the image to after rendering to it.
+    /// Having the rendered content in a buffer allows us to memory map it back on the host.
+
+    /// Let us create the image for storing the rendered depth.
+    /// We use the depth format selected in `renderContextInit`, and specify that the
+    /// image will be used as a depth/stencil attachment and as a source for a transfer
+    /// operation.
+    /// We specify that the image will not be shared between different queue families by
+    /// setting share mode to VK_SHARING_MODE_EXCLUSIVE.
+    /// We specify the initial layout as undefined. We can also specify it as pre-initialized,
+    /// but then we need to initialize it manually. Other settings are boilerplate for now.
+    /// The image needs separately allocated memory.
+    /// A camera sweep renders every pose into a layer of its own, so the image has as many
+    /// array layers as there are poses. Layers of an image are like a stack of 2D images that
+    /// share format, size and memory allocation.
+    /// A depth atlas is a single layer, large enough for a grid of tiles.
+    /// With depth conversion the image is sampled by the conversion shader instead of being
+    /// copied. The statistics shader samples it as well, and with statistics only, nothing
+    /// copies it.
+    uint32_t sampled = context->depthConversion != DEPTH_CONVERSION_NONE ||
+                       context->depthStatistics;
+    uint32_t copied = context->depthConversion == DEPTH_CONVERSION_NONE &&
+                      !context->statisticsOnly;
+    VkExtent3D imageExtent = {
+        .width = width * target->tileColumns,
+        .height = height * target->tileRows,
+        .depth = 1
+    };
+    VkImageCreateInfo imageCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = context->depthFormat,
+        .extent = imageExtent,
+        .mipLevels = 1,
+        .arrayLayers = layerCount,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                 (sampled ? VK_IMAGE_USAGE_SAMPLED_BIT : 0) |
+                 (copied ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0),
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 1,
+        .pQueueFamilyIndices = &context->queueFamilyIndex,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    code = vkCreateImage(context->device, &imageCreateInfo, NULL, &target->image);
+    if (code != VK_SUCCESS)
+    {
+        printf("Failed to create image: %s\n", resultString(code));
+        return EXIT_FAILURE;
+    }
+
+    /// With an image object we can query for which memory type we want to use for it.
+    /// Every image can be queried for its memory requirements, which we then can compare with
+    /// the memory properties provided by the physical device.
+    /// We created the image using the device, so it knows what memory types are available.
+    /// The memory types that the image can use is provided by a bitmask.
+    /// If the bit at position `i` is set, then memory type `i` is compatible with the image
+    /// memory requirements. This leads to some bit-shifting logic in `findMemoryType`.
+    /// We require that the image memory have the DEVICE_LOCAL bit set, which means that
+    /// accesses to the image will be made on the device (which is optimal for rendering).
+    VkMemoryRequirements imageMemoryRequirements;
+    vkGetImageMemoryRequirements(context->device, target->image, &imageMemoryRequirements);
+    uint32_t memoryTypeIndex = findMemoryType(&context->deviceMemoryProperties,
+                                              imageMemoryRequirements.memoryTypeBits,
+                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                              NULL, 0);
+    if (memoryTypeIndex == context->deviceMemoryProperties.memoryTypeCount)
+    {
+        printf("Failed to find suitable device memory matching image memory requirements\n");
+        return EXIT_FAILURE;
+    }
+
+    /// Rather than allocating memory for every image with vkAllocateMemory, we take a range
+    /// of a larger block from the memory allocator of the context (see memory_allocator.h)
+    /// and bind the image at the offset of that range. Optimally tiled images are
+    /// non-linear resources.
+    printf("Allocating image memory\n");
+    if (memoryAllocatorAllocate(&context->memoryAllocator,
+                                &imageMemoryRequirements,
+                                memoryTypeIndex,
+                                MEMORY_RESOURCE_NON_LINEAR,
+                                &target->imageMemory) != EXIT_SUCCESS)
+    {
+        printf("Failed to allocate image memory\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("Binding image memory\n");
+    code = vkBindImageMemory(context->device,
+                             target->image,
+                             target->imageMemory.memory,
+                             target->imageMemory.offset);
+    if (code != VK_SUCCESS)
+    {
+        printf("Failed to bind image to image memory\n");
+        return EXIT_FAILURE;
+    }
+
+    /// We create an image view by specifying which mip level and array layer of the image
+    /// that we want to access. We also specify which "aspects" of an image we want to access.
+    /// In our case, we want to view both the depth and the stencil part of the image, so we
+    /// "or" those to apsects together.
+    /// Note that we need to specify that we want a 2D image view again.
+    /// The component mapping can be used to "swizzle" around the components of each pixel.
+    /// Usually this is assigned a 4-tuple of "swizzle identity".
+    /// Setting the format to something different than the format of the image can be used to
+    /// reinterpret the image components.
+    /// Every array layer gets a 2D view of its own, which selects the layer through
+    /// baseArrayLayer. A multiview render pass instead renders into a single 2D array view
+    /// of all layers, view i going to layer i.
+    uint32_t multiview = context->multiviewCount > 0;
+    target->framebufferCount = multiview ? 1 : layerCount;
+    printf("Creating %u image views\n", target->framebufferCount);
+    for (uint32_t layer = 0; layer < target->framebufferCount; ++layer)
+    {
+        VkImageSubresourceRange imageSubresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = layer,
+            .layerCount = multiview ? layerCount : 1
+        };
+        VkImageViewCreateInfo imageViewCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = target->image,
+            .viewType = multiview ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D,
+            .format = imageCreateInfo.format,
+            .components = { VK_COMPONENT_SWIZZLE_IDENTITY,
+                            VK_COMPONENT_SWIZZLE_IDENTITY,
+                            VK_COMPONENT_SWIZZLE_IDENTITY,
+                            VK_COMPONENT_SWIZZLE_IDENTITY },
+            .subresourceRange = imageSubresourceRange
+        };
+        code = vkCreateImageView(context->device,
+                                 &imageViewCreateInfo,
+                                 NULL,
+                                 &target->imageViews[layer]);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to create image view\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+
+    /// Now we have defined the image, memory and view for the render target.
+    /// We also need a buffer to read the depth back to the host with, unless we only want
+    /// its statistics.
+    if (!context->statisticsOnly &&
+        createReadbackBuffer(context,
+                             target,
+                             (VkDeviceSize) imageExtent.width * imageExtent.height * layerCount)
+        != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    /// The conversion and statistics shaders sample the depth aspect of all layers through a
+    /// 2D array view. Only one aspect of a depth/stencil image can be sampled at a time. The
+    /// descriptor set is written once here, the image and buffer stay the same for the life
+    /// of the target. Without a readback buffer, the buffer binding is left empty, which is
+    /// fine as long as no shader that uses it is dispatched.
+    if (sampled)
+    {
+        VkImageViewCreateInfo sampledImageViewCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = target->image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY,
+            .format = imageCreateInfo.format,
+            .components = { VK_COMPONENT_SWIZZLE_IDENTITY,
+                            VK_COMPONENT_SWIZZLE_IDENTITY,
+                            VK_COMPONENT_SWIZZLE_IDENTITY,
+                            VK_COMPONENT_SWIZZLE_IDENTITY },
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+                .baseMipLevel = 0,
+                .levelCount = 1,
+                .baseArrayLayer = 0,
+                .layerCount = layerCount
+            }
+        };
+        code = vkCreateImageView(context->device,
+                                 &sampledImageViewCreateInfo,
+                                 NULL,
+                                 &target->sampledImageView);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to create sampled image view\n");
+            return EXIT_FAILURE;
+        }
+        VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+            .descriptorPool = context->depthDescriptorPool,
+            .descriptorSetCount = 1,
+            .pSetLayouts = &context->depthDescriptorSetLayout
+        };
+        code = vkAllocateDescriptorSets(context->device,
+                                        &descriptorSetAllocateInfo,
+                                        &target->depthDescriptorSet);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to allocate depth descriptor set\n");
+            return EXIT_FAILURE;
+        }
+        VkDescriptorImageInfo descriptorImageInfo = {
+            .imageView = target->sampledImageView,
+            .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+        };
+        VkDescriptorBufferInfo descriptorBufferInfo = {
+            .buffer = target->pixelReadbackBuffer,
+            .offset = 0,
+            .range = VK_WHOLE_SIZE
+        };
+        VkWriteDescriptorSet writeDescriptorSets[] = {
+            {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = target->depthDescriptorSet,
+                .dstBinding = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                .pImageInfo = &descriptorImageInfo
+            },
+            {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = target->depthDescriptorSet,
+                .dstBinding = 1,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &descriptorBufferInfo
+            }
+        };
+        /// Only the conversion writes the readback buffer, the statistics shader just samples.
+        vkUpdateDescriptorSets(context->device,
+                               context->depthConversion != DEPTH_CONVERSION_NONE ? 2 : 1,
+                               writeDescriptorSets,
+                               0, NULL);
+    }
+
+
+    /// Let us create the framebuffer.
+    /// The framebuffer connects image views as attachments for the render pass.
+    /// The framebuffer shape (width, height) need to match up with those of the image view.
+    /// The layer parameter should be 1 except in advanced use cases.
+    /// The framebuffer is created against the render pass of the context, but it can be used
+    /// with any render pass that is compatible with it.
+    /// A framebuffer with `layers` > 1 over all array layers is one such advanced use case,
+    /// but then the shader has to pick the layer of each primitive through gl_Layer, which
+    /// the vertex stage can only write with VK_EXT_shader_viewport_index_layer (core in 1.2).
+    /// Instead, each layer gets a framebuffer of its own, and a sweep runs one render pass
+    /// per layer, all in the same command buffer.
+    /// A multiview framebuffer also has `layers` 1, the views come from the view mask of the
+    /// render pass and the layers of the attached 2D array view.
+    for (uint32_t layer = 0; layer < target->framebufferCount; ++layer)
+    {
+        VkFramebufferCreateInfo framebufferCreateInfo = {
+            .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+            .renderPass = context->renderPass,
+            .attachmentCount = 1,
+            .pAttachments = &target->imageViews[layer],
+            .width = imageExtent.width,
+            .height = imageExtent.height,
+            .layers = 1
+        };
+        code = vkCreateFramebuffer(context->device,
+                                   &framebufferCreateInfo,
+                                   NULL,
+                                   &target->framebuffers[layer]);
+        if (code != VK_SUCCESS)
+        {
+            printf("Failed to create framebuffer\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+static void
+destroyRenderTarget(RenderContext* context, RenderTarget* target)
+{
+    printf("Destroying render target %ux%u with %u layers\n",
+           target->width, target->height, target->layerCount);
+    /// Command buffers recorded against the target refer to its framebuffer, image and buffer,
+    /// they have to be recorded again.
+    for (uint32_t i = 0; i < context->frameCount; ++i)
+    {
+        if (context->frames[i].recordedTarget == target)
+        {
+            context->frames[i].recorded = 0;
+            context->frames[i].recordedTarget = NULL;
+        }
+    }
+    for (uint32_t layer = 0; layer < MAX_RENDER_LAYERS; ++layer)
+    {
+        vkDestroyFramebuffer(context->device, target->framebuffers[layer], NULL);
+    }
+    if (target->depthDescriptorSet != VK_NULL_HANDLE)
+    {
+        vkFreeDescriptorSets(context->device,
+                             context->depthDescriptorPool,
+                             1, &target->depthDescriptorSet);
+    }
+    vkDestroyImageView(context->device, target->sampledImageView, NULL);
+    vkDestroyBuffer(context->device, target->pixelReadbackBuffer, NULL);
+    memoryAllocatorFree(&context->memoryAllocator, &target->pixelReadbackBufferMemory);
+    for (uint32_t layer = 0; layer < MAX_RENDER_LAYERS; ++layer)
+    {
+        vkDestroyImageView(context->device, target->imageViews[layer], NULL);
+    }
+    vkDestroyImage(context->device, target->image, NULL);
+    memoryAllocatorFree(&context->memoryAllocator, &target->imageMemory);
+    memset(target, 0, sizeof(*target));
+}
+
+
+/// Look up a render target for the requested resolution in the cache, creating it on a
+/// miss. When the cache is full the least recently used render target is replaced.
+/// Render targets of frames that have been submitted but not yet collected are marked as in
+/// use. They are neither handed out again nor evicted, since the device may still write to
+/// them. There are at least as many cache entries as frames in flight, so there is always
+/// some render target that is not in use.
+static RenderTarget*
+acquireRenderTarget(RenderContext* context,
+                    uint32_t width,
+                    uint32_t height,
+                    uint32_t layerCount,
+                    uint32_t tileCount,
+                    RenderTarget* preferred)
+{
+    /// The target the frame recorded its command buffers against is preferred, since they
+    /// can then be submitted again without recording.
+    if (preferred != NULL &&
+        !preferred->inUse &&
+        preferred->width == width &&
+        preferred->height == height &&
+        preferred->layerCount == layerCount &&
+        preferred->tileCount == tileCount &&
+        preferred->format == context->depthFormat)
+    {
+        preferred->lastUsed = context->renderCount;
+        preferred->inUse = 1;
+        return preferred;
+    }
+    RenderTarget* leastRecentlyUsed = NULL;
+    for (uint32_t i = 0; i < context->renderTargetCount; ++i)
+    {
+        RenderTarget* target = &context->renderTargets[i];
+        if (target->inUse)
+        {
+            continue;
+        }
+        if (target->width == width &&
+            target->height == height &&
+            target->layerCount == layerCount &&
+            target->tileCount == tileCount &&
+            target->format == context->depthFormat)
+        {
+            target->lastUsed = context->renderCount;
+            target->inUse = 1;
+            return target;
+        }
+        if (leastRecentlyUsed == NULL || target->lastUsed < leastRecentlyUsed->lastUsed)
+        {
+            leastRecentlyUsed = target;
+        }
+    }
+
+    RenderTarget* target;
+    if (context->renderTargetCount < MAX_RENDER_TARGETS)
+    {
+        target = &context->renderTargets[context->renderTargetCount++];
+    }
+    else
+    {
+        target = leastRecentlyUsed;
+        destroyRenderTarget(context, target);
+    }
+    if (createRenderTarget(context, width, height, layerCount, tileCount, target)
+        != EXIT_SUCCESS)
+    {
+        /// Keep whatever was created so far in the cache with an impossible size, it will be
+        /// evicted (and destroyed) before anything else, or at shutdown.
+        target->width = 0;
+        target->height = 0;
+        target->lastUsed = 0;
+        return NULL;
+    }
+    target->lastUsed = context->renderCount;
+    target->inUse = 1;
+    return target;
+}
+
+
+/// Everything needed to record the draws of a render, shared by all recording threads.
+typedef struct DrawRecording {
+    VkPipeline pipeline;
+    VkPipelineLayout pipelineLayout;
+    VkDescriptorSet descriptorSet;
+    VkBuffer vertexBuffer;
+    VkBuffer indexBuffer;
+    uint32_t indexCount;
+    VkViewport viewport;
+    VkRect2D scissor;
+    uint32_t drawCount;
+    uint32_t instanceCount;
+    /// With culling, the draws take their instance count from this indirect draw command.
+    VkBuffer drawCommandBuffer;
+    /// Array layer of the render target, which selects the camera pose in the shader.
+    uint32_t layer;
+    /// Tiles of a depth atlas, each selecting the pose after the previous one.
+    uint32_t tileCount;
+    uint32_t tileColumns;
+} DrawRecording;
+
+
+/// Record the share of the draws of thread `threadIndex`. Secondary command buffers do not
+/// inherit any state from the primary, so each of them binds the pipeline and descriptor set
+/// and sets the dynamic state and push constants itself.
+/// In a depth atlas, the draws are repeated for every tile, with the viewport and scissor
+/// moved to the tile. Changing dynamic state between draws is cheap, far cheaper than a
+/// render pass, let alone a submission, per tile.
+static void
+recordDraws(void* userData,
+            uint32_t threadIndex,
+            uint32_t threadCount,
+            VkCommandBuffer commandBuffer)
+{
+    const DrawRecording* drawRecording = (const DrawRecording*) userData;
+    uint32_t first = (uint32_t) ((uint64_t) drawRecording->drawCount * threadIndex / threadCount);
+    uint32_t last =
+        (uint32_t) ((uint64_t) drawRecording->drawCount * (threadIndex + 1) / threadCount);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, drawRecording->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer,
+                            VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            drawRecording->pipelineLayout,
+                            0, 1, &drawRecording->descriptorSet,
+                            0, NULL);
+    VkDeviceSize vertexBufferOffset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &drawRecording->vertexBuffer, &vertexBufferOffset);
+    vkCmdBindIndexBuffer(commandBuffer, drawRecording->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    for (uint32_t tile = 0; tile < drawRecording->tileCount; ++tile)
+    {
+        uint32_t layer = drawRecording->layer + tile;
+        uint32_t column = tile % drawRecording->tileColumns;
+        uint32_t row = tile / drawRecording->tileColumns;
+        VkViewport viewport = drawRecording->viewport;
+        viewport.x = column * viewport.width;
+        viewport.y = row * viewport.height;
+        VkRect2D scissor = drawRecording->scissor;
+        scissor.offset.x = (int32_t) (column * scissor.extent.width);
+        scissor.offset.y = (int32_t) (row * scissor.extent.height);
+        vkCmdPushConstants(commandBuffer,
+                           drawRecording->pipelineLayout,
+                           VK_SHADER_STAGE_VERTEX_BIT,
+                           0, sizeof(uint32_t),
+                           &layer);
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        for (uint32_t i = first; i < last; ++i)
+        {
+            if (drawRecording->drawCommandBuffer != VK_NULL_HANDLE)
+            {
+                vkCmdDrawIndexedIndirect(commandBuffer,
+                                         drawRecording->drawCommandBuffer,
+                                         0, 1, sizeof(VkDrawIndexedIndirectCommand));
+            }
+            else
+            {
+                vkCmdDrawIndexed(commandBuffer,
+                                 drawRecording->indexCount,
+                                 drawRecording->instanceCount,
+                                 0, 0, 0);
+            }
+        }
+    }
+}
+
+
+/// Record the timestamp at the start of `section` of `frame` into `commandBuffer`, when
+/// profiling (see gpu_profiler.h), and remember that the frame has the section, and whether
+/// it is written on the transfer queue.
+static void
+beginSection(RenderContext* context,
+             RenderFrame* frame,
+             VkCommandBuffer commandBuffer,
+             GpuSection section)
+{
+    if (context->profiling)
+    {
+        gpuProfilerBegin(&context->profiler,
+                         commandBuffer,
+                         (uint32_t) (frame - context->frames),
+                         section);
+        frame->profiledSections |= 1u << section;
+        if (commandBuffer == frame->transferCommandBuffer)
+        {
+            frame->profiledTransferSections |= 1u << section;
+        }
+    }
+}
+
+
+/// Record the timestamp at the end of `section`, see `beginSection`.
+static void
+endSection(RenderContext* context,
+           RenderFrame* frame,
+           VkCommandBuffer commandBuffer,
+           GpuSection section)
+{
+    if (context->profiling)
+    {
+        gpuProfilerEnd(&context->profiler,
+                       commandBuffer,
+                       (uint32_t) (frame - context->frames),
+                       section);
+    }
+}
+
+
+/// Record the copy of the depth of `target` to its readback buffer, after the render pass
+/// recorded into `commandBuffer`. With a dedicated transfer queue the copy goes into the
+/// transfer command buffer of the frame, which is begun here. The command buffer the copy
+/// went into, which the caller ends, is returned in `readbackCommandBuffer`.
+/// When the depth was `sampled` by a compute shader first, see `recordSampleBarrier`, the
+/// image is in the read-only layout already and the copy only has to wait for those reads.
+/// When profiling, the barrier out of the attachment layout is timed as the barrier section,
+/// and everything after it on the readback command buffer as the copy section. A transfer
+/// queue that can not write timestamps leaves the copy untimed.
+static int
+recordReadbackCopy(RenderContext* context,
+                   RenderFrame* frame,
+                   RenderTarget* target,
+                   uint32_t sampled,
+                   VkCommandBuffer commandBuffer,
+                   const VkCommandBufferBeginInfo* commandBufferBeginInfo,
+                   VkCommandBuffer* readbackCommandBuffer)
+{
+    VkExtent3D imageExtent = {
+        .width = target->width * target->tileColumns,
+        .height = target->height * target->tileRows,
+        .depth = 1
+    };
+    VkImageSubresourceRange imageSubresourceRange = {
+        .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
+        .baseMipLevel = 0,
+        .levelCount = 1,
+        .baseArrayLayer = 0,
+        .layerCount = target->layerCount
+    };
+
+    /// Efter the render pass we want to change the image layout from the optimal layout for
+    /// depth/stencil attachment to something better as a source for a transfer operation.
+    /// We do that using an image memory barrier to synchronize access before and after the
+    /// layout transition. The memory barrier will modify the layout of the image in-place.
+    /// Note that this can also be expressed using render subpass dependencies, which is
+    /// probably more efficient if we are using more than one subpass.
+    /// We specify the "access scope" before the layout transition as those operations that
+    /// writes to the depth/stencil attachment. We specify the access scope after the
+    /// transition as those operations that do a transfer read. An access scope means what
+    /// kind of memory operations will be made before and after a synchronization command.
+    /// To really understand access scopes I recommend reading the chapter regarding
+    /// synchronization in the spec.
+    ///
+    /// With a dedicated transfer queue, the image also changes hands between queue families.
+    /// The image is created with VK_SHARING_MODE_EXCLUSIVE, so the transfer queue may only
+    /// read it after a queue family ownership transfer: a "release" barrier on the graphics
+    /// queue and a matching "acquire" barrier on the transfer queue, with identical layouts
+    /// and queue family indices. The release only makes the depth writes available, the
+    /// access scope after it is empty and is supplied by the acquire instead.
+    /// The ownership does not have to be handed back: the render pass starts from
+    /// VK_IMAGE_LAYOUT_UNDEFINED, and the spec allows a queue family to take over an
+    /// exclusive resource without a transfer when it does not care about the contents.
+    ///
+    /// After sampling, the depth writes were made visible by the earlier barrier already.
+    /// Reads do not have to be made available, so the copy (a write-after-read hazard only for
+    /// the layout transition) needs an execution dependency on the compute stage and nothing
+    /// more.
+    uint32_t useTransferQueue = context->transferQueue != VK_NULL_HANDLE;
+    VkImageMemoryBarrier imageMemoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = sampled ? 0 : VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = useTransferQueue ? 0 : VK_ACCESS_TRANSFER_READ_BIT,
+        .oldLayout = sampled
+                   ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                   : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        .srcQueueFamilyIndex = context->queueFamilyIndex,
+        .dstQueueFamilyIndex = useTransferQueue
+                             ? context->transferQueueFamilyIndex
+                             : context->queueFamilyIndex,
+        .image = target->image,
+        .subresourceRange = imageSubresourceRange
+    };
+    /// We also need to specify a "synchronization scope", which means which type of
+    /// operations need to happen before and happen after the barrier.
+    /// We specify the VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT as the prior scope (i.e. the
+    /// stage that access the depth/stencil buffer) and the VK_PIPELINE_STAGE_TRANSFER_BIT as
+    /// the posterior scope (i.e. the transfer command we want to do after the barrier).
+    /// Can can also use VkDependencyInfo + vkCmdPipelineBarrier2, which separates
+    /// configuration and function call a bit, as well as allowing more fine grained control.
+    /// We specify that the execution and memory dependencies are "framebuffer local" by
+    /// setting the VK_DEPENDENCY_BY_REGION_BIT, allowing some optimizations to be made.
+    uint32_t timedCopy = !useTransferQueue || context->transferTimestamps;
+    if (!sampled)
+    {
+        beginSection(context, frame, commandBuffer, GPU_SECTION_BARRIER);
+    }
+    else if (!useTransferQueue)
+    {
+        beginSection(context, frame, commandBuffer, GPU_SECTION_COPY);
+    }
+    vkCmdPipelineBarrier(commandBuffer,
+                         sampled
+                         ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+                         : VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                         useTransferQueue
+                         ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
+                         : VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_DEPENDENCY_BY_REGION_BIT,
+                         0, NULL,
+                         0, NULL,
+                         1, &imageMemoryBarrier);
+    if (!sampled)
+    {
+        endSection(context, frame, commandBuffer, GPU_SECTION_BARRIER);
+        if (!useTransferQueue)
+        {
+            beginSection(context, frame, commandBuffer, GPU_SECTION_COPY);
+        }
+    }
+
+    /// On a dedicated transfer queue the copy goes into the transfer command buffer of the
+    /// frame, starting with the acquire half of the ownership transfer. The copy waits for
+    /// the render through the semaphore, so the acquire barrier needs no source stage.
+    *readbackCommandBuffer = commandBuffer;
+    if (useTransferQueue)
+    {
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        {
+            printf("Failed to end recording of command buffer\n");
+            return EXIT_FAILURE;
+        }
+        *readbackCommandBuffer = frame->transferCommandBuffer;
+        vkBeginCommandBuffer(*readbackCommandBuffer, commandBufferBeginInfo);
+        if (timedCopy)
+        {
+            beginSection(context, frame, *readbackCommandBuffer, GPU_SECTION_COPY);
+        }
+        imageMemoryBarrier.srcAccessMask = 0;
+        imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(*readbackCommandBuffer,
+                             VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             0,
+                             0, NULL,
+                             0, NULL,
+                             1, &imageMemoryBarrier);
+    }
+
+    /// Now the image layout is optimized for transfer and we copy it to the pixel readback
+    /// buffer. We can only copy one aspect of an image at time. Reading the specs on
+    /// VkBufferImageCopy (https://devdocs.io/vulkan/index#VkBufferImageCopy) tells us that
+    /// the depth/stencil format we have choosen can be treated as packed into 32-bit texels.
+    /// Hence, what we actually copy is both the depth and stencil aspects. Note that if we
+    /// defined the format as VK_FORMAT_D32_SFLOAT_S8_UINT, then the stencil part would be
+    /// dropped. The expected behaviour needs to be understood on a format by format basis.
+    /// Keep in mind that these rules apply for an image to buffer copy. Memory mapping an
+    /// image directly is not possible with our texel format, which is opaque by the spec.
+    /// Implementors are free to store the depth and stencil components in separate planes,
+    /// for example, and there are no guarantees on the byte packing.
+    /// Hence, copying the image to a buffer is a safe choice.
+    /// Copying the depth aspect of an image to a buffer is allowed on queues without graphics
+    /// support (only the opposite direction is not), and a copy of the whole image satisfies
+    /// any minImageTransferGranularity of the transfer queue.
+    /// A single region covers all layers of a sweep. The buffer is tightly packed, so the
+    /// layers end up one after the other, each width * height texels.
+    VkBufferImageCopy imageRegion = {
+        .imageSubresource = {
+            .aspectMask     = VK_IMAGE_ASPECT_DEPTH_BIT,
+            .mipLevel       = imageSubresourceRange.baseMipLevel,
+            .baseArrayLayer = imageSubresourceRange.baseArrayLayer,
+            .layerCount     = imageSubresourceRange.layerCount
+        },
+        .imageExtent = imageExtent
+    };
+    vkCmdCopyImageToBuffer(*readbackCommandBuffer,
+                           target->image,
+                           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           target->pixelReadbackBuffer,
+                           1, &imageRegion);
+
+    /// The host is going to read the buffer once the fence signals. Signaling a fence does
+    /// not by itself make the transfer writes available to the host, so we add a barrier from
+    /// the transfer stage to the (pseudo) host stage.
+    VkBufferMemoryBarrier bufferMemoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = target->pixelReadbackBuffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    vkCmdPipelineBarrier(*readbackCommandBuffer,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT,
+                         0,
+                         0, NULL,
+                         1, &bufferMemoryBarrier,
+                         0, NULL);
+    if (timedCopy)
+    {
+        endSection(context, frame, *readbackCommandBuffer, GPU_SECTION_COPY);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+/// Record the barrier that lets compute shaders sample the depth of `target`, after the
+/// render pass recorded into `commandBuffer`.
+/// The depth image goes from the attachment layout to a read-only layout in which it can be
+/// sampled. The barrier waits for the depth writes of the late fragment tests, and makes
+/// them visible to the shader reads of the compute stage. Unlike the copy, this dependency
+/// is not framebuffer local, an invocation reads pixels that other fragments wrote.
+static void
+recordSampleBarrier(RenderTarget* target, VkCommandBuffer commandBuffer)
+{
+    VkImageMemoryBarrier imageMemoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        .newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = target->image,
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = target->layerCount
+        }
+    };
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0,
+                         0, NULL,
+                         0, NULL,
+                         1, &imageMemoryBarrier);
+}
+
+
+/// Record the conversion of the depth of `target` into its readback buffer, after
+/// `recordSampleBarrier`.
+/// The dispatch has an invocation per pixel, or per pair of pixels with half floats, in
+/// workgroups of CONVERT_WORKGROUP_SIZE. Large images need more workgroups than fit in one
+/// dimension (maxComputeWorkGroupCount is at least 65535), so they are wrapped into rows.
+/// Finally the shader writes are made available to the host, like the transfer writes of
+/// the copy.
+static void
+recordConversion(RenderContext* context, RenderTarget* target, VkCommandBuffer commandBuffer)
+{
+    uint32_t halfFloat = context->depthConversion == DEPTH_CONVERSION_FLOAT16;
+    ConversionParameters conversionParameters = {
+        .width = target->width,
+        .height = target->height,
+        .tileColumns = target->tileColumns,
+        .tileCount = target->tileCount,
+        .pixelCount = target->width * target->height * target->layerCount * target->tileCount,
+        .halfFloat = halfFloat,
+        .nearPlane = context->nearPlane,
+        .farPlane = context->farPlane
+    };
+    uint32_t invocationCount = halfFloat
+                             ? (conversionParameters.pixelCount + 1) / 2
+                             : conversionParameters.pixelCount;
+    uint32_t groupCount = (invocationCount + CONVERT_WORKGROUP_SIZE - 1) / CONVERT_WORKGROUP_SIZE;
+    uint32_t maxGroupCountX = context->physicalDeviceProperties.limits.maxComputeWorkGroupCount[0];
+    uint32_t groupCountX = groupCount < maxGroupCountX ? groupCount : maxGroupCountX;
+    uint32_t groupCountY = (groupCount + groupCountX - 1) / groupCountX;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->conversionPipeline);
+    vkCmdBindDescriptorSets(commandBuffer,
+                            VK_PIPELINE_BIND_POINT_COMPUTE,
+                            context->conversionPipelineLayout,
+                            0, 1, &target->depthDescriptorSet,
+                            0, NULL);
+    vkCmdPushConstants(commandBuffer,
+                       context->conversionPipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT,
+                       0, sizeof(conversionParameters),
+                       &conversionParameters);
+    vkCmdDispatch(commandBuffer, groupCountX, groupCountY, 1);
+
+    VkBufferMemoryBarrier bufferMemoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = target->pixelReadbackBuffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT,
+                         0,
+                         0, NULL,
+                         1, &bufferMemoryBarrier,
+                         0, NULL);
+}
+
+
+/// Record the reduction of the depth of `target` into the statistics buffer of `frame`,
+/// after `recordSampleBarrier`.
+/// Every invocation of a workgroup of STATISTICS_WORKGROUP_SIZE walks the pixels with a
+/// stride of the whole dispatch, so a fixed number of workgroups covers any image, and
+/// there are never more partial sums than the buffer has room for. The host resets the
+/// buffer before the submission, see `renderContextSubmit`, and reads it like the readback
+/// buffer.
+static void
+recordStatistics(RenderContext* context,
+                 RenderFrame* frame,
+                 RenderTarget* target,
+                 VkCommandBuffer commandBuffer)
+{
+    StatisticsParameters statisticsParameters = {
+        .width = target->width,
+        .height = target->height,
+        .tileColumns = target->tileColumns,
+        .tileCount = target->tileCount,
+        .pixelCount = target->width * target->height * target->layerCount * target->tileCount,
+        .binCount = context->histogramBinCount,
+        .nearPlane = context->nearPlane,
+        .farPlane = context->farPlane
+    };
+    uint32_t groupCount = (statisticsParameters.pixelCount + STATISTICS_WORKGROUP_SIZE - 1) /
+                          STATISTICS_WORKGROUP_SIZE;
+    if (groupCount > STATISTICS_WORKGROUP_COUNT)
+    {
+        groupCount = STATISTICS_WORKGROUP_COUNT;
+    }
+    VkDescriptorSet descriptorSets[] = { frame->descriptorSet, target->depthDescriptorSet };
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->statisticsPipeline);
+    vkCmdBindDescriptorSets(commandBuffer,
+                            VK_PIPELINE_BIND_POINT_COMPUTE,
+                            context->statisticsPipelineLayout,
+                            0, 2, descriptorSets,
+                            0, NULL);
+    vkCmdPushConstants(commandBuffer,
+                       context->statisticsPipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT,
+                       0, sizeof(statisticsParameters),
+                       &statisticsParameters);
+    vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+
+    VkBufferMemoryBarrier bufferMemoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = frame->statisticsBuffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT,
+                         0,
+                         0, NULL,
+                         1, &bufferMemoryBarrier,
+                         0, NULL);
+}
+
+
+/// Record the command buffers of `frame`: the render of `drawCount` draws of `instanceCount`
+/// instances of `mesh` into every layer of `target`, and the copy of the depth to the
+/// readback buffer, on the graphics or the transfer queue, or its conversion, and the
+/// reduction of the depth to statistics.
+static int
+recordFrame(RenderContext* context,
+            RenderFrame* frame,
+            RenderTarget* target,
+            const ResidentMesh* mesh,
+            uint32_t drawCount,
+            uint32_t instanceCount)
+{
+    VkExtent3D imageExtent = {
+        .width = target->width * target->tileColumns,
+        .height = target->height * target->tileRows,
+        .depth = 1
+    };
+
+    /// Let us record some commands for execution into the allocated command buffer.
+    /// This is the first time we are actually going "to do something", everything else up to
+    /// this point is setup code. This will put the command buffer into "recording state".
+    /// There exist several families of commands that can be recorded in a command buffer:
+    /// action, state, synchronization and launch commands. For action commands we will begin
+    /// a render pass, bind the graphics pipeline and draw our triangle. For synchronization
+    /// we will make an image layout transition so that we can transfer it to our pixel
+    /// readback buffer.
+    /// The VK_SUBPASS_CONTENTS_INLINE specify how we provide contents to the subpass, which
+    /// can either be done through recording to a primary command buffer "inline" (as belong)
+    /// or inderectly through secondary command buffers (advanced).
+    /// Beginning a command buffer that has been recorded before implicitly resets it, which
+    /// is allowed since the pool was created with VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT.
+    /// Command buffers that are recorded for a single submission are marked with
+    /// VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, which lets the driver optimize for that.
+    /// Command buffers that are going to be submitted again must not have it.
+    struct timespec recordStart, recordEnd;
+    clock_gettime(CLOCK_MONOTONIC, &recordStart);
+    VkCommandBufferBeginInfo commandBufferBeginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = context->reuseCommandBuffers ? 0 : VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+    };
+    VkCommandBuffer commandBuffer = frame->commandBuffer;
+    vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+
+    /// When profiling, the queries of the frame are reset before anything writes them, and
+    /// the pipeline statistics query counts everything up to the copy.
+    uint32_t frameIndex = (uint32_t) (frame - context->frames);
+    frame->profiledSections = 0;
+    frame->profiledTransferSections = 0;
+    frame->profiledStatistics = 0;
+    if (context->profiling)
+    {
+        gpuProfilerReset(&context->profiler, commandBuffer, frameIndex);
+        gpuProfilerBeginStatistics(&context->profiler, commandBuffer, frameIndex);
+        frame->profiledStatistics = context->profiler.statisticsPool != VK_NULL_HANDLE;
+    }
+    VkClearValue clearValue = { .depthStencil = {1.0f, 0} };
+    VkRenderPassBeginInfo renderPassBeginInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .renderPass = context->renderPass,
+        .framebuffer = target->framebuffers[0],
+        .renderArea = { { 0, 0 }, { imageExtent.width, imageExtent.height } },
+        .clearValueCount = 1,
+        .pClearValues = &clearValue
+    };
+
+    /// The viewport and scissor are dynamic state of the pipeline, so we set them to cover
+    /// the whole render target, or a tile of it. Dynamic state must be set after binding the
+    /// pipeline.
+    DrawRecording drawRecording = {
+        .pipeline = context->graphicsPipeline,
+        .pipelineLayout = context->pipelineLayout,
+        .descriptorSet = frame->descriptorSet,
+        .vertexBuffer = mesh->vertexBuffer,
+        .indexBuffer = mesh->indexBuffer,
+        .indexCount = mesh->indexCount,
+        .viewport = {
+            .width = (float) target->width,
+            .height = (float) target->height,
+            .minDepth = 0.0f,
+            .maxDepth = 1.0f
+        },
+        .scissor = {
+            .extent = { target->width, target->height }
+        },
+        .drawCount = drawCount,
+        .instanceCount = instanceCount,
+        .drawCommandBuffer = context->culling ? frame->drawCommandBuffer : VK_NULL_HANDLE,
+        .tileCount = target->tileCount,
+        .tileColumns = target->tileColumns
+    };
+
+    /// With culling, the compute pass runs first, outside of the render pass. There is an
+    /// invocation per instance, in workgroups of CULL_WORKGROUP_SIZE. The draws wait for it
+    /// through a barrier: the indirect draw command is read at the draw indirect stage, the
+    /// visible instances by the vertex shader. The host reads the count after the fence, so
+    /// the writes are made available to the host as well.
+    if (context->culling)
+    {
+        beginSection(context, frame, commandBuffer, GPU_SECTION_CULL);
+        CullParameters cullParameters = {
+            .bounds = { mesh->bounds[0], mesh->bounds[1], mesh->bounds[2], mesh->bounds[3] },
+            .instanceCount = instanceCount,
+            .poseCount = target->layerCount * target->tileCount
+        };
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, context->cullPipeline);
+        vkCmdBindDescriptorSets(commandBuffer,
+                                VK_PIPELINE_BIND_POINT_COMPUTE,
+                                context->cullPipelineLayout,
+                                0, 1, &frame->descriptorSet,
+                                0, NULL);
+        vkCmdPushConstants(commandBuffer,
+                           context->cullPipelineLayout,
+                           VK_SHADER_STAGE_COMPUTE_BIT,
+                           0, sizeof(cullParameters),
+                           &cullParameters);
+        vkCmdDispatch(commandBuffer,
+                      (instanceCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+        VkMemoryBarrier memoryBarrier = {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+                             VK_ACCESS_SHADER_READ_BIT |
+                             VK_ACCESS_HOST_READ_BIT
+        };
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                             VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+                             VK_PIPELINE_STAGE_HOST_BIT,
+                             0,
+                             1, &memoryBarrier,
+                             0, NULL,
+                             0, NULL);
+        endSection(context, frame, commandBuffer, GPU_SECTION_CULL);
+    }
+
+    /// With recording threads, the draws are recorded into secondary command buffers in
+    /// parallel, and the render pass contents are provided by executing them. A subpass
+    /// takes either inline commands or secondary command buffers, not a mix of both.
+    /// Each thread has a single secondary command buffer per frame, which is recorded
+    /// against one framebuffer, so sweeps over several framebuffers are recorded inline.
+    beginSection(context, frame, commandBuffer, GPU_SECTION_RENDER_PASS);
+    if (context->recorder.threadCount > 0 && target->framebufferCount == 1)
+    {
+        VkCommandBuffer secondaryCommandBuffers[MAX_RECORDING_THREADS];
+        if (commandRecorderRecord(&context->recorder,
+                                  frameIndex,
+                                  context->renderPass,
+                                  target->framebuffers[0],
+                                  recordDraws,
+                                  &drawRecording,
+                                  secondaryCommandBuffers) != EXIT_SUCCESS)
+        {
+            if (context->profiling)
+            {
+                gpuProfilerEndStatistics(&context->profiler, commandBuffer, frameIndex);
+            }
+            vkEndCommandBuffer(commandBuffer);
+            return EXIT_FAILURE;
+        }
+        vkCmdBeginRenderPass(commandBuffer,
+                             &renderPassBeginInfo,
+                             VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        vkCmdExecuteCommands(commandBuffer,
+                             context->recorder.threadCount,
+                             secondaryCommandBuffers);
+    }
+    else
+    {
+        /// A camera sweep renders each pose into its own layer, with one render pass per
+        /// layer. They all go into this one command buffer, so a sweep costs a single
+        /// submission and a single fence wait however many poses it has. Only the push
+        /// constant with the layer index differs between the passes.
+        /// With multiview there is a single render pass, and the shader adds gl_ViewIndex to
+        /// the pushed layer 0.
+        for (uint32_t layer = 0; layer < target->framebufferCount; ++layer)
+        {
+            if (layer > 0)
+            {
+                vkCmdEndRenderPass(commandBuffer);
+            }
+            renderPassBeginInfo.framebuffer = target->framebuffers[layer];
+            drawRecording.layer = layer;
+            vkCmdBeginRenderPass(commandBuffer,
+                                 &renderPassBeginInfo,
+                                 VK_SUBPASS_CONTENTS_INLINE);
+            recordDraws(&drawRecording, 0, 1, commandBuffer);
+        }
+    }
+    vkCmdEndRenderPass(commandBuffer);
+    endSection(context, frame, commandBuffer, GPU_SECTION_RENDER_PASS);
+
+    /// Without depth conversion, the depth image is copied to the readback buffer as it is,
+    /// see `recordReadbackCopy`. With it, the conversion shader reads the image and writes
+    /// the readback buffer, see `recordConversion`. The statistics shader reads the image
+    /// before either, see `recordStatistics`, and in the statistics only mode there is
+    /// nothing else to record.
+    uint32_t sampled = context->depthConversion != DEPTH_CONVERSION_NONE ||
+                       context->depthStatistics;
+    /// The copy may end the command buffer, see `recordReadbackCopy`, so the pipeline
+    /// statistics query ends before it.
+    if (sampled)
+    {
+        beginSection(context, frame, commandBuffer, GPU_SECTION_BARRIER);
+        recordSampleBarrier(target, commandBuffer);
+        endSection(context, frame, commandBuffer, GPU_SECTION_BARRIER);
+    }
+    if (context->depthStatistics)
+    {
+        beginSection(context, frame, commandBuffer, GPU_SECTION_STATISTICS);
+        recordStatistics(context, frame, target, commandBuffer);
+        endSection(context, frame, commandBuffer, GPU_SECTION_STATISTICS);
+    }
+    if (context->depthConversion != DEPTH_CONVERSION_NONE)
+    {
+        beginSection(context, frame, commandBuffer, GPU_SECTION_CONVERSION);
+        recordConversion(context, target, commandBuffer);
+        endSection(context, frame, commandBuffer, GPU_SECTION_CONVERSION);
+    }
+    if (context->profiling)
+    {
+        gpuProfilerEndStatistics(&context->profiler, commandBuffer, frameIndex);
+    }
+    VkCommandBuffer readbackCommandBuffer = commandBuffer;
+    if (context->depthConversion == DEPTH_CONVERSION_NONE &&
+        !context->statisticsOnly &&
+        recordReadbackCopy(context,
+                           frame,
+                           target,
+                           sampled,
+                           commandBuffer,
+                           &commandBufferBeginInfo,
+                           &readbackCommandBuffer) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    /// Finish the recording of the command buffer. This will put the command buffer into
+    /// "executable state", that is, we can submit it for execution.
+    if (vkEndCommandBuffer(readbackCommandBuffer) != VK_SUCCESS)
+    {
+        printf("Failed to end recording of command buffer\n");
+        return EXIT_FAILURE;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &recordEnd);
+    context->recordMilliseconds += 1e3 * (recordEnd.tv_sec - recordStart.tv_sec) +
+                                   1e-6 * (recordEnd.tv_nsec - recordStart.tv_nsec);
+    context->recordedCount++;
+
+    frame->recorded = 1;
+    frame->recordedTarget = target;
+    frame->recordedPipeline = context->graphicsPipeline;
+    frame->recordedDrawCount = drawCount;
+    frame->recordedInstanceCount = instanceCount;
+    frame->recordedMeshSerial = mesh->serial;
+    return EXIT_SUCCESS;
+}
+
+
+/// Give back the render target of a submission of `frame` that failed. When the fence was
+/// submitted before the failure, the device is still working on the target, so its work is
+/// waited for first. Otherwise the fence may be left reset, which is harmless: the frame is
+/// not pending, so nothing waits on the fence, and the next submission resets it again.
+static void
+abandonSubmission(RenderContext* context,
+                  RenderFrame* frame,
+                  RenderTarget* target,
+                  uint32_t fenceSubmitted)
+{
+    if (fenceSubmitted)
+    {
+        vkWaitForFences(context->device, 1, &frame->fence, VK_TRUE, UINT64_MAX);
+    }
+    target->inUse = 0;
+}
+
+
+int
+renderContextSubmit(RenderContext* context, const RenderRequest* request, uint32_t* frameIndex)
+{
+    RenderFrame* frame = &context->frames[context->nextFrame];
+    if (frame->pending)
+    {
+        printf("Frame %u is still in flight, it must be collected before it is reused\n",
+               context->nextFrame);
+        return EXIT_FAILURE;
+    }
+    const VkPhysicalDeviceLimits* limits = &context->physicalDeviceProperties.limits;
+    if (request->width == 0 || request->width > limits->maxFramebufferWidth ||
+        request->height == 0 || request->height > limits->maxFramebufferHeight)
+    {
+        printf("Unsupported resolution %ux%u (maximum %ux%u)\n",
+               request->width, request->height,
+               limits->maxFramebufferWidth, limits->maxFramebufferHeight);
+        return EXIT_FAILURE;
+    }
+    /// The poses go either into the array layers or into the tiles of an atlas.
+    uint32_t poseCount = request->layerCount > 0 ? request->layerCount : 1;
+    uint32_t layerCount = request->atlas ? 1 : poseCount;
+    uint32_t tileCount = request->atlas ? poseCount : 1;
+    if (layerCount > limits->maxImageArrayLayers || poseCount > MAX_RENDER_LAYERS)
+    {
+        printf("Unsupported number of layers %u (maximum %u)\n",
+               poseCount,
+               limits->maxImageArrayLayers < MAX_RENDER_LAYERS
+               ? limits->maxImageArrayLayers
+               : MAX_RENDER_LAYERS);
+        return EXIT_FAILURE;
+    }
+    uint32_t tileColumns, tileRows;
+    atlasGrid(tileCount, &tileColumns, &tileRows);
+    if ((uint64_t) request->width * tileColumns > limits->maxFramebufferWidth ||
+        (uint64_t) request->height * tileRows > limits->maxFramebufferHeight ||
+        (uint64_t) request->width * tileColumns > limits->maxImageDimension2D ||
+        (uint64_t) request->height * tileRows > limits->maxImageDimension2D)
+    {
+        printf("Unsupported atlas of %ux%u tiles of %ux%u\n",
+               tileColumns, tileRows, request->width, request->height);
+        return EXIT_FAILURE;
+    }
+    if (context->multiviewCount > 0 && layerCount != context->multiviewCount)
+    {
+        printf("The multiview render pass renders %u layers, not %u\n",
+               context->multiviewCount, layerCount);
+        return EXIT_FAILURE;
+    }
+    /// The statistics shader counts pixels in 32 bit integers.
+    if (context->depthStatistics &&
+        (uint64_t) request->width * request->height * poseCount > UINT32_MAX)
+    {
+        printf("Too many pixels for depth statistics: %ux%u, %u poses\n",
+               request->width, request->height, poseCount);
+        return EXIT_FAILURE;
+    }
+    context->renderCount++;
+    RenderTarget* target = acquireRenderTarget(context,
+                                               request->width,
+                                               request->height,
+                                               layerCount,
+                                               tileCount,
+                                               frame->recordedTarget);
+    if (target == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    uint32_t drawCount = request->drawCount > 0 ? request->drawCount : 1;
+    uint32_t instanceCount = request->instanceCount > 0 ? request->instanceCount : 1;
+    if (reserveInstanceBuffer(context, frame, instanceCount) != EXIT_SUCCESS)
+    {
+        target->inUse = 0;
+        return EXIT_FAILURE;
+    }
+
+    /// Meshes that are already resident are found by their id, without any upload.
+    ResidentMesh* mesh;
+    if (meshCacheUpload(&context->meshCache,
+                        request->mesh != NULL ? request->mesh : &triangleMesh,
+                        1,
+                        &mesh) != EXIT_SUCCESS)
+    {
+        target->inUse = 0;
+        return EXIT_FAILURE;
+    }
+
+    /// Per-frame parameters go through the uniform buffer of the frame rather than into the
+    /// command buffer, so that a recorded command buffer stays valid when they change. The
+    /// previous submission of the frame has been collected, so the device is not reading it.
+    FrameParameters* parameters = (FrameParameters*) frame->parameterMemory.mapping;
+    if (request->transform != NULL)
+    {
+        memcpy(parameters->transform, request->transform, sizeof(parameters->transform));
+    }
+    else
+    {
+        memset(parameters->transform, 0, sizeof(parameters->transform));
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            parameters->transform[5 * i] = 1.0f;
+        }
+    }
+    FramePoses* poses = (FramePoses*) frame->poseMemory.mapping;
+    if (request->poses != NULL)
+    {
+        memcpy(poses->poses, request->poses, poseCount * sizeof(poses->poses[0]));
+    }
+    else
+    {
+        memset(poses->poses, 0, poseCount * sizeof(poses->poses[0]));
+        for (uint32_t layer = 0; layer < poseCount; ++layer)
+        {
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                poses->poses[layer][5 * i] = 1.0f;
+            }
+        }
+    }
+
+    /// The culling shader counts the visible instances into the indirect draw command, from 0.
+    frame->instanceCount = instanceCount;
+    VkDrawIndexedIndirectCommand* drawCommand =
+        (VkDrawIndexedIndirectCommand*) frame->drawCommandMemory.mapping;
+    *drawCommand = (VkDrawIndexedIndirectCommand) {
+        .indexCount = mesh->indexCount,
+        .instanceCount = 0
+    };
+    FrameInstance* instances = (FrameInstance*) frame->instanceMemory.mapping;
+    if (request->instances != NULL)
+    {
+        memcpy(instances, request->instances, instanceCount * sizeof(FrameInstance));
+    }
+    else
+    {
+        memset(instances, 0, instanceCount * sizeof(FrameInstance));
+        for (uint32_t instance = 0; instance < instanceCount; ++instance)
+        {
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                instances[instance].model[5 * i] = 1.0f;
+            }
+        }
+    }
+
+    /// The statistics shader reduces into the statistics buffer with atomics, starting from
+    /// no pixels, and from a minimum of +infinity, which every depth is below.
+    if (context->depthStatistics)
+    {
+        FrameStatistics* statistics = (FrameStatistics*) frame->statisticsMemory.mapping;
+        memset(statistics, 0, sizeof(FrameStatistics) +
+                              context->histogramBinCount * sizeof(uint32_t));
+        statistics->minDepth = 0x7F800000;
+    }
+
+    /// A command buffer only has to be recorded again when something it refers to changed:
+    /// the render target (framebuffer, image and readback buffer), the pipeline, the mesh,
+    /// the number of draws or instances, or the instance buffer. Otherwise the frame submits
+    /// the command buffers it already has, as they are.
+    if (!context->reuseCommandBuffers ||
+        !frame->recorded ||
+        frame->recordedTarget != target ||
+        frame->recordedPipeline != context->graphicsPipeline ||
+        frame->recordedMeshSerial != mesh->serial ||
+        frame->recordedDrawCount != drawCount ||
+        frame->recordedInstanceCount != instanceCount)
+    {
+        frame->recorded = 0;
+        if (recordFrame(context, frame, target, mesh, drawCount, instanceCount) != EXIT_SUCCESS)
+        {
+            target->inUse = 0;
+            return EXIT_FAILURE;
+        }
+    }
+    uint32_t useTransferQueue = context->transferQueue != VK_NULL_HANDLE;
+    VkCommandBuffer commandBuffer = frame->commandBuffer;
+    VkCommandBuffer readbackCommandBuffer = useTransferQueue
+                                          ? frame->transferCommandBuffer
+                                          : commandBuffer;
+
+    /// Now it is time to submit the recorded command buffer to the queue and execute the
+    /// graphics pipeline. Submitting the command buffer will put it into "pending state".
+    /// Depending on how the command buffer was created, it will be put back into either
+    /// "executable" or "invalid" state upon completion. Note that you can't check the state
+    /// of the command buffer, in particular there is no "executing" state.
+    /// The fence is reset first, since it is still signaled from the previous render.
+    if (vkResetFences(context->device, 1, &frame->fence) != VK_SUCCESS)
+    {
+        printf("Failed to reset fence\n");
+        abandonSubmission(context, frame, target, 0);
+        return EXIT_FAILURE;
+    }
+    /// With a dedicated transfer queue there are two submissions: the render signals the
+    /// semaphore of the frame, and the copy waits for it before its transfer stage. Only the
+    /// copy signals the fence, it is the last thing that happens to the frame.
+    VkSubmitInfo submitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commandBuffer,
+        .signalSemaphoreCount = useTransferQueue ? 1 : 0,
+        .pSignalSemaphores = &frame->renderFinished
+    };
+    if (vkQueueSubmit(context->queue,
+                      1, &submitInfo,
+                      useTransferQueue ? VK_NULL_HANDLE : frame->fence) != VK_SUCCESS)
+    {
+        printf("Failed to submit command buffer to queue\n");
+        abandonSubmission(context, frame, target, 0);
+        return EXIT_FAILURE;
+    }
+    if (useTransferQueue)
+    {
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        VkSubmitInfo transferSubmitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &frame->renderFinished,
+            .pWaitDstStageMask = &waitStage,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &readbackCommandBuffer
+        };
+        if (vkQueueSubmit(context->transferQueue, 1, &transferSubmitInfo, frame->fence)
+            != VK_SUCCESS)
+        {
+            printf("Failed to submit command buffer to transfer queue\n");
+            /// The render is on its way already and will signal the semaphore, which has
+            /// to be waited on before it can be signaled again. An empty submission on the
+            /// graphics queue waits on it in place of the copy, and signals the fence.
+            VkPipelineStageFlags allCommands = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+            VkSubmitInfo waitSubmitInfo = {
+                .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                .waitSemaphoreCount = 1,
+                .pWaitSemaphores = &frame->renderFinished,
+                .pWaitDstStageMask = &allCommands
+            };
+            if (vkQueueSubmit(context->queue, 1, &waitSubmitInfo, frame->fence) != VK_SUCCESS)
+            {
+                vkQueueWaitIdle(context->queue);
+                abandonSubmission(context, frame, target, 0);
+                return EXIT_FAILURE;
+            }
+            abandonSubmission(context, frame, target, 1);
+            return EXIT_FAILURE;
+        }
+    }
+    if (completionQueueAdd(&context->completionQueue,
+                           frame->fence,
+                           context->completed,
+                           context->userData,
+                           &frame->ticket) != EXIT_SUCCESS)
+    {
+        abandonSubmission(context, frame, target, 1);
+        return EXIT_FAILURE;
+    }
+
+    /// We do not wait for the device here. The frame keeps its render target until it is
+    /// collected, and the next submission goes to the next frame in the ring.
+    frame->target = target;
+    frame->mesh = mesh;
+    mesh->inUse++;
+    frame->pending = 1;
+    *frameIndex = context->nextFrame;
+    context->nextFrame = (context->nextFrame + 1) % context->frameCount;
+    return EXIT_SUCCESS;
+}
+
+
+/// Decode the readback buffer of `target` into `depthData`, see `renderContextCollect`.
+static int
+decodeReadback(const RenderTarget* target, float* depthData)
+{
+    if (target->readbackFormat != target->format)
+    {
+        if (depthDecode(target->readbackFormat,
+                        target->pixelReadbackBufferMapping,
+                        depthData,
+                        (size_t) target->width * target->height *
+                        target->layerCount * target->tileCount) != EXIT_SUCCESS)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    else if (target->tileCount > 1)
+    {
+        uint32_t texelSize = depthTexelSize(target->format);
+        size_t atlasWidth = (size_t) target->width * target->tileColumns;
+        const uint8_t* texels = (const uint8_t*) target->pixelReadbackBufferMapping;
+        for (uint32_t tile = 0; tile < target->tileCount; ++tile)
+        {
+            size_t x = (size_t) (tile % target->tileColumns) * target->width;
+            size_t y = (size_t) (tile / target->tileColumns) * target->height;
+            float* tileDepth = depthData + (size_t) tile * target->width * target->height;
+            for (uint32_t row = 0; row < target->height; ++row)
+            {
+                if (depthDecode(target->format,
+                                texels + ((y + row) * atlasWidth + x) * texelSize,
+                                tileDepth + (size_t) row * target->width,
+                                target->width) != EXIT_SUCCESS)
+                {
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+    }
+    else if (depthDecode(target->format,
+                         target->pixelReadbackBufferMapping,
+                         depthData,
+                         (size_t) target->width * target->height * target->layerCount)
+             != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+/// Sum up the statistics the shader reduced into the statistics buffer of `frame`.
+/// Vulkan 1.1 has no atomic float addition, so every workgroup writes the sum of its pixels
+/// into a slot of its own, and they are added up here, in double precision.
+static void
+readStatistics(RenderContext* context,
+               const RenderFrame* frame,
+               const RenderTarget* target,
+               RenderStatistics* statistics)
+{
+    const FrameStatistics* frameStatistics =
+        (const FrameStatistics*) frame->statisticsMemory.mapping;
+    uint64_t pixelCount = (uint64_t) target->width * target->height *
+                          target->layerCount * target->tileCount;
+    uint64_t groupCount = (pixelCount + STATISTICS_WORKGROUP_SIZE - 1) /
+                          STATISTICS_WORKGROUP_SIZE;
+    if (groupCount > STATISTICS_WORKGROUP_COUNT)
+    {
+        groupCount = STATISTICS_WORKGROUP_COUNT;
+    }
+    double sum = 0.0;
+    for (uint64_t i = 0; i < groupCount; ++i)
+    {
+        sum += frameStatistics->partialSums[i];
+    }
+    uint32_t coveredCount = frameStatistics->coveredCount;
+    statistics->pixelCount = pixelCount;
+    statistics->coveredCount = coveredCount;
+    statistics->minDepth = 0.0f;
+    statistics->maxDepth = 0.0f;
+    statistics->meanDepth = coveredCount > 0 ? sum / coveredCount : 0.0;
+    if (coveredCount > 0)
+    {
+        memcpy(&statistics->minDepth, &frameStatistics->minDepth, sizeof(float));
+        memcpy(&statistics->maxDepth, &frameStatistics->maxDepth, sizeof(float));
+    }
+    uint32_t linearized = context->farPlane > 0.0f;
+    statistics->binCount = context->histogramBinCount;
+    statistics->histogramMin = linearized ? context->nearPlane : 0.0f;
+    statistics->histogramMax = linearized ? context->farPlane : 1.0f;
+    memcpy(statistics->histogram,
+           (const uint8_t*) frameStatistics + sizeof(FrameStatistics),
+           context->histogramBinCount * sizeof(uint32_t));
+}
+
+
+int
+renderContextCollect(RenderContext* context, uint32_t frameIndex, float* depthData)
+{
+    return renderContextCollectStatistics(context, frameIndex, depthData, NULL);
+}
+
+
+int
+renderContextCollectStatistics(RenderContext* context,
+                               uint32_t frameIndex,
+                               float* depthData,
+                               RenderStatistics* statistics)
+{
+    if (statistics != NULL && !context->depthStatistics)
+    {
+        printf("Depth statistics are not enabled\n");
+        return EXIT_FAILURE;
+    }
+    if (frameIndex >= context->frameCount || !context->frames[frameIndex].pending)
+    {
+        printf("Frame %u has not been submitted\n", frameIndex);
+        return EXIT_FAILURE;
+    }
+    RenderFrame* frame = &context->frames[frameIndex];
+    RenderTarget* target = frame->target;
+
+    /// Block until the waiter thread has seen the fence of this frame signal. This sleeps on
+    /// a condition variable, there is no timeout to wake up for.
+    if (completionQueueWait(&context->completionQueue, frame->ticket) != EXIT_SUCCESS)
+    {
+        printf("Failed to wait for frame %u\n", frameIndex);
+        return EXIT_FAILURE;
+    }
+
+    /// The queries of the frame have been written by now, reading them does not wait.
+    if (context->profiling &&
+        gpuProfilerRead(&context->profiler,
+                        frameIndex,
+                        frame->profiledSections,
+                        frame->profiledTransferSections,
+                        frame->profiledStatistics,
+                        &context->frameTimings) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    ///////////////////////////////////////////
+    ////////// STEP 5 | Pixel readback ////////
+    ///////////////////////////////////////////
+
+    /// The command has finished executing and we are ready to read back the pixels.
+    /// The device memory is mapped to host, which is possible since the buffer memory was
+    /// created with the VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT. If the memory also has the
+    /// VK_MEMORY_PROPERTY_HOST_COHERENT_BIT set the data is already visible, otherwise we
+    /// need to invalidate the host caches for the mapped range first.
+    /// We decode straight from the mapping, there is no intermediate copy to host memory.
+    /// In the statistics only mode there is no readback buffer, only the statistics.
+    if (!context->statisticsOnly &&
+        !target->pixelReadbackBufferCoherent &&
+        memoryAllocatorInvalidate(&context->memoryAllocator, &target->pixelReadbackBufferMemory)
+        != EXIT_SUCCESS)
+    {
+        printf("Failed to invalidate pixel readback buffer memory\n");
+        return EXIT_FAILURE;
+    }
+
+    /// The pixels are now readable from the pixel read back buffer.
+    /// Reading the spec we can read that copying the depth aspect of an image with
+    /// VK_FORMAT_D24_UNORM_S8_UINT will give us texels on the format
+    /// VK_FORMAT_X8_D24_UNFORM_PACK32. Further reading up on that format in the spec
+    /// (https://registry.khronos.org/vulkan/specs/1.3/html/chap34.html#formats-definition)
+    /// tells us that
+    ///
+    ///     1. Formats are layed out in memory in component order
+    ///     2. Multi-byte components are layed out in memory according to host endianess
+    ///
+    /// This means that the most significant byte is unspecified and the 3 least significant
+    /// bytes of the 32-bit integer contains the depth component. Let us extract the depth
+    /// component from that. D24_UNORM means 24-bit depth in unsigned normalized fixed-point
+    /// format. We extract the 3 least significant bits by bit-wise anding with 0xFFFFFF.
+    /// To convert from unorm to float we refer to the spec:
+    /// https://registry.khronos.org/vulkan/specs/1.3/html/chap3.html#fundamentals-fixedconv
+    /// For visualization purposes we set the depth data to 0 if has not been written to
+    /// (as indicated by maximum depth value).
+    /// Doing this one pixel at a time is slow for large images, so the decoding is done by
+    /// `depthDecode`, which processes many pixels per instruction using SIMD (see
+    /// depth_decode.c) and handles the other depth formats as well.
+    /// A depth atlas is decoded tile by tile, one tile row at a time, scattering the tiles
+    /// into consecutive width * height blocks of depthData, in the same order as layers.
+    /// With depth conversion, the shader already wrote the final values in the order of
+    /// depthData, tiles included, as floats or half floats. The floats are copied as they
+    /// are, the half floats widened, both through `depthDecode` of the readback format.
+    if (!context->statisticsOnly && decodeReadback(target, depthData) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    if (statistics != NULL)
+    {
+        readStatistics(context, frame, target, statistics);
+    }
+
+    if (context->culling)
+    {
+        const VkDrawIndexedIndirectCommand* drawCommand =
+            (const VkDrawIndexedIndirectCommand*) frame->drawCommandMemory.mapping;
+        context->visibleInstanceCount += drawCommand->instanceCount;
+        context->culledInstanceCount += frame->instanceCount - drawCommand->instanceCount;
+    }
+
+    /// The render target is free to be reused, or evicted, by later submissions.
+    target->inUse = 0;
+    frame->target = NULL;
+    frame->mesh->inUse--;
+    frame->mesh = NULL;
+    frame->pending = 0;
+    return EXIT_SUCCESS;
+}
+
+
+int
+renderContextRender(RenderContext* context, const RenderRequest* request, float* depthData)
+{
+    uint32_t frameIndex;
+    if (renderContextSubmit(context, request, &frameIndex) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    return renderContextCollect(context, frameIndex, depthData);
+}
+
+
+void
+renderContextShutdown(RenderContext* context)
+{
+    /// Finally, tear down the system.
+    /// Before destruction of each object we need to make sure it is not in use anymore, which
+    /// is easiest by waiting for the device to become idle. All resources that are children of
+    /// another resource needs to be released before their parent. The easiest way to do this
+    /// is by destroying objects in reverse order of creation. Resources allocated from pools
+    /// do not have to be manually freed, but we will do it anyways to show how it can be done
+    /// manually.
+    /// Destroying VK_NULL_HANDLE is a no-op in Vulkan, which is what makes it safe to call this
+    /// function after a failed `renderContextInit`. Only the device itself needs to exist for
+    /// us to call device level functions.
+    if (context->device != VK_NULL_HANDLE)
+    {
+        printf("Waiting until device is idle\n");
+        vkDeviceWaitIdle(context->device);
+
+        printf("Stopping completion waiter thread\n");
+        completionQueueShutdown(&context->completionQueue);
+
+        commandRecorderShutdown(&context->recorder);
+
+        printf("Destroying fences\n");
+        for (uint32_t i = 0; i < context->frameCount; ++i)
+        {
+            vkDestroyFence(context->device, context->frames[i].fence, NULL);
+            vkDestroySemaphore(context->device, context->frames[i].renderFinished, NULL);
+        }
+
+        for (uint32_t i = 0; i < context->renderTargetCount; ++i)
+        {
+            destroyRenderTarget(context, &context->renderTargets[i]);
+        }
+
+        printf("Destroying parameter buffers\n");
+        for (uint32_t i = 0; i < context->frameCount; ++i)
+        {
+            vkDestroyBuffer(context->device, context->frames[i].parameterBuffer, NULL);
+            memoryAllocatorFree(&context->memoryAllocator, &context->frames[i].parameterMemory);
+            vkDestroyBuffer(context->device, context->frames[i].poseBuffer, NULL);
+            memoryAllocatorFree(&context->memoryAllocator, &context->frames[i].poseMemory);
+            vkDestroyBuffer(context->device, context->frames[i].instanceBuffer, NULL);
+            memoryAllocatorFree(&context->memoryAllocator, &context->frames[i].instanceMemory);
+            vkDestroyBuffer(context->device, context->frames[i].visibleBuffer, NULL);
+            memoryAllocatorFree(&context->memoryAllocator, &context->frames[i].visibleMemory);
+            vkDestroyBuffer(context->device, context->frames[i].drawCommandBuffer, NULL);
+            memoryAllocatorFree(&context->memoryAllocator,
+                                &context->frames[i].drawCommandMemory);
+            vkDestroyBuffer(context->device, context->frames[i].statisticsBuffer, NULL);
+            memoryAllocatorFree(&context->memoryAllocator,
+                                &context->frames[i].statisticsMemory);
+        }
+
+        if (context->profiling)
+        {
+            gpuProfilerPrintTotals(&context->profiler);
+            printf("Destroying query pools\n");
+            gpuProfilerShutdown(&context->profiler);
+        }
+
+        if (context->culling)
+        {
+            printf("Culled %lu of %lu instances\n",
+                   (unsigned long) context->culledInstanceCount,
+                   (unsigned long) (context->visibleInstanceCount +
+                                    context->culledInstanceCount));
+        }
+
+        printf("Destroying %u resident meshes, %lu uploaded in %lu submissions\n",
+               context->meshCache.meshCount,
+               (unsigned long) context->meshCache.uploadedMeshCount,
+               (unsigned long) context->meshCache.submissionCount);
+        meshCacheShutdown(&context->meshCache);
+
+        memoryAllocatorPrintStats(&context->memoryAllocator);
+        printf("Releasing device memory\n");
+        memoryAllocatorShutdown(&context->memoryAllocator);
+
+        printf("Destroying shader modules\n");
+        vkDestroyShaderModule(context->device, context->vertexShaderModule, NULL);
+        vkDestroyShaderModule(context->device, context->cullShaderModule, NULL);
+        vkDestroyShaderModule(context->device, context->conversionShaderModule, NULL);
+        vkDestroyShaderModule(context->device, context->statisticsShaderModule, NULL);
+
+        if (context->frames[0].commandBuffer != VK_NULL_HANDLE)
+        {
+            printf("Releasing command buffers\n");
+            for (uint32_t i = 0; i < context->frameCount; ++i)
+            {
+                vkFreeCommandBuffers(context->device,
+                                     context->commandPool,
+                                     1, &context->frames[i].commandBuffer);
+            }
+        }
+
+        if (context->frames[0].transferCommandBuffer != VK_NULL_HANDLE)
+        {
+            for (uint32_t i = 0; i < context->frameCount; ++i)
+            {
+                vkFreeCommandBuffers(context->device,
+                                     context->transferCommandPool,
+                                     1, &context->frames[i].transferCommandBuffer);
+            }
+        }
+
+        printf("Destroying command pools\n");
+        vkDestroyCommandPool(context->device, context->commandPool, NULL);
+        vkDestroyCommandPool(context->device, context->transferCommandPool, NULL);
+
+        printf("Destroying pipelines\n");
+        vkDestroyPipeline(context->device, context->graphicsPipeline, NULL);
+        vkDestroyPipeline(context->device, context->cullPipeline, NULL);
+        vkDestroyPipeline(context->device, context->conversionPipeline, NULL);
+        vkDestroyPipeline(context->device, context->statisticsPipeline, NULL);
+
+        printf("Destroying pipeline cache\n");
+        vkDestroyPipelineCache(context->device, context->pipelineCache, NULL);
+
+        printf("Destroying pipeline layouts\n");
+        vkDestroyPipelineLayout(context->device, context->pipelineLayout, NULL);
+        vkDestroyPipelineLayout(context->device, context->cullPipelineLayout, NULL);
+        vkDestroyPipelineLayout(context->device, context->conversionPipelineLayout, NULL);
+        vkDestroyPipelineLayout(context->device, context->statisticsPipelineLayout, NULL);
+
+        printf("Destroying descriptor pools and set layouts\n");
+        vkDestroyDescriptorPool(context->device, context->descriptorPool, NULL);
+        vkDestroyDescriptorSetLayout(context->device, context->descriptorSetLayout, NULL);
+        vkDestroyDescriptorPool(context->device, context->depthDescriptorPool, NULL);
+        vkDestroyDescriptorSetLayout(context->device,
+                                     context->depthDescriptorSetLayout,
+                                     NULL);
+        vkDestroySampler(context->device, context->depthSampler, NULL);
+
+        printf("Destroying render pass\n");
+        vkDestroyRenderPass(context->device, context->renderPass, NULL);
+
+        printf("Destroying device\n");
+        vkDestroyDevice(context->device, NULL);
+    }
+
+    printf("Destroying instance\n");
+    vkDestroyInstance(context->instance, NULL);
+
+    memset(context, 0, sizeof(*context));
+}
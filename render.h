@@ -0,0 +1,500 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+/// A long-lived render context.
+///
+/// Setting up Vulkan is expensive: creating an instance and a device, compiling the
+/// pipeline etc. takes orders of magnitude longer than rendering a small depth image.
+/// The render context pays that cost once in `renderContextInit`, after which
+/// `renderContextRender` can be called any number of times against the same instance,
+/// device, render pass and pipeline. `renderContextShutdown` tears everything down again.
+///
+/// The resolution is chosen per render. Everything that depends on it (depth image, image
+/// view, framebuffer and readback buffer) is bundled into a `RenderTarget`, and the context
+/// keeps a small cache of render targets keyed by (width, height, format), so that mixed
+/// resolutions do not create and destroy resources on every render.
+///
+/// Rendering is split into `renderContextSubmit` and `renderContextCollect`, so that several
+/// frames can be in flight at once: while the host reads back and decodes frame K, frames
+/// K+1..K+N are already rendering on the device. Each frame in flight owns a command buffer,
+/// a fence and a render target. `renderContextRender` is a synchronous shorthand.
+/// Completion is tracked by a waiter thread (see completion.h), which can also notify the
+/// caller through a callback as soon as a frame is done.
+///
+/// All functions report errors by printing a message and returning EXIT_FAILURE, similar to
+/// how the original single function program exited.
+
+#include "command_recorder.h"
+#include "completion.h"
+#include "gpu_profiler.h"
+#include "memory_allocator.h"
+#include "mesh_cache.h"
+
+#include <vulkan/vulkan.h>
+
+#include <stdint.h>
+
+
+/// Default resolution, used when nothing else is requested.
+#define IMAGE_WIDTH 20
+#define IMAGE_HEIGHT 20
+
+/// Maximum number of cached render targets. When the cache is full, the least recently
+/// used render target is destroyed to make room for a new one.
+#ifndef MAX_RENDER_TARGETS
+#define MAX_RENDER_TARGETS 8
+#endif
+
+/// Maximum number of frames that can be submitted before the first one is collected.
+/// Every frame in flight holds on to its render target, so the render target cache must be
+/// at least as large.
+#ifndef MAX_FRAMES_IN_FLIGHT
+#define MAX_FRAMES_IN_FLIGHT 4
+#endif
+
+/// Maximum number of array layers of a render target, i.e. camera poses of a sweep.
+/// Every device supports at least 256 (maxImageArrayLayers).
+#ifndef MAX_RENDER_LAYERS
+#define MAX_RENDER_LAYERS 256
+#endif
+
+/// Number of instances the instance buffer of a frame holds at first. It grows as needed.
+#ifndef INITIAL_INSTANCE_CAPACITY
+#define INITIAL_INSTANCE_CAPACITY 64
+#endif
+
+/// Invocations per workgroup of the culling shader, local_size_x in cull.comp.
+#define CULL_WORKGROUP_SIZE 64
+
+/// Invocations per workgroup of the depth conversion shader, local_size_x in convert.comp.
+#define CONVERT_WORKGROUP_SIZE 64
+
+/// Invocations per workgroup of the depth statistics shader, local_size_x in stats.comp, and
+/// the largest number of workgroups it is dispatched with. Every workgroup reduces its share
+/// of the pixels into a single partial sum.
+#define STATISTICS_WORKGROUP_SIZE 256
+#define STATISTICS_WORKGROUP_COUNT 256
+
+/// Histogram bins of the depth statistics: the default, and the most the shared memory of
+/// stats.comp holds.
+#define DEFAULT_HISTOGRAM_BINS 64
+#define MAX_HISTOGRAM_BINS 1024
+
+/// Id of the mesh drawn by requests without one, the triangle.
+#define TRIANGLE_MESH_ID UINT64_MAX
+
+_Static_assert(MAX_RESIDENT_MESHES > MAX_FRAMES_IN_FLIGHT,
+               "MAX_RESIDENT_MESHES must be larger than MAX_FRAMES_IN_FLIGHT");
+_Static_assert(MAX_RENDER_TARGETS >= MAX_FRAMES_IN_FLIGHT,
+               "MAX_RENDER_TARGETS must be at least MAX_FRAMES_IN_FLIGHT");
+
+
+/// What the readback buffer holds, see RenderConfig.depthConversion.
+typedef enum DepthConversion {
+    /// The depth aspect of the image as it is copied, decoded on the host.
+    DEPTH_CONVERSION_NONE,
+    /// Final depth values written by a compute pass, as 32 or 16 bit floats.
+    DEPTH_CONVERSION_FLOAT32,
+    DEPTH_CONVERSION_FLOAT16
+} DepthConversion;
+
+
+typedef struct RenderConfig {
+    /// Number of frames in flight, between 1 and MAX_FRAMES_IN_FLIGHT.
+    uint32_t framesInFlight;
+    /// Optional callback, invoked on the waiter thread when a frame has finished rendering.
+    /// The ticket is the number of the submission, counting from 1. The callback must not
+    /// call back into the render context, use `renderContextCollect` to get at the depth.
+    CompletionCallback completed;
+    void* userData;
+    /// Physical device to render on: an index, UUID or name substring (see device_select.h).
+    /// NULL selects the device from the RENDER_DEVICE environment variable, or the best one.
+    const char* physicalDevice;
+    /// Copy the depth image to the readback buffer on a dedicated transfer queue, when the
+    /// device has a transfer-only queue family. The copy of one frame then overlaps the
+    /// rendering of the next.
+    uint32_t transferQueue;
+    /// Number of threads recording the draws into secondary command buffers, at most
+    /// MAX_RECORDING_THREADS. 0 records them inline into the primary command buffer.
+    uint32_t recordingThreads;
+    /// Keep the recorded command buffers of each frame and submit them again, as long as the
+    /// render target, pipeline and number of draws stay the same.
+    uint32_t reuseCommandBuffers;
+    /// Render the layers of a camera sweep as the views of a single multiview render pass
+    /// (VK_KHR_multiview, core in Vulkan 1.1), rather than one render pass per layer. The
+    /// render pass is built for this many views, so every request must then have exactly
+    /// this layerCount. 0 disables multiview.
+    uint32_t multiviewCount;
+    /// Cull the instances of every render against the view frustum of its poses in a compute
+    /// pass on the device, and draw only the visible ones with an indirect draw. The host
+    /// neither tests nor counts the instances, see cull.comp.
+    uint32_t culling;
+    /// Convert the depth on the device rather than on the host. A compute pass samples the
+    /// depth image and writes the final values into the readback buffer, in the order of
+    /// depthData, atlas tiles included. The host then only copies them (float32), or widens
+    /// them (float16, half the bytes to read back). The conversion runs on the graphics
+    /// queue, so it does not combine with transferQueue.
+    DepthConversion depthConversion;
+    /// With depth conversion and farPlane > 0, depth is linearized to the distance from the
+    /// camera of a perspective projection with these near and far planes, in their unit.
+    float nearPlane;
+    float farPlane;
+    /// Reduce the depth of every render on the device to a few statistics, see
+    /// RenderStatistics and `renderContextCollectStatistics`. With nearPlane and farPlane the
+    /// statistics are of the linearized depth, like depthData.
+    uint32_t depthStatistics;
+    /// Number of histogram bins, at most MAX_HISTOGRAM_BINS. 0 counts as
+    /// DEFAULT_HISTOGRAM_BINS.
+    uint32_t histogramBinCount;
+    /// Only compute the statistics, and skip the readback of the depth altogether. There is
+    /// no readback buffer, and collecting leaves depthData alone.
+    uint32_t statisticsOnly;
+    /// Time the passes of every frame on the device with timestamp queries, and count what
+    /// the pipeline did with a pipeline statistics query when the device supports it, see
+    /// gpu_profiler.h. Collecting a frame leaves its timings in RenderContext.frameTimings.
+    uint32_t profile;
+} RenderConfig;
+
+
+typedef struct RenderRequest {
+    uint32_t width;
+    uint32_t height;
+    /// Mesh to draw, NULL for the triangle. It is uploaded to device local memory the first
+    /// time it is drawn and stays resident after that, see mesh_cache.h.
+    const Mesh* mesh;
+    /// Number of draws of the mesh, 0 counts as 1. Many draws stand in for a scene with
+    /// many objects, where recording the commands is a noticeable cost.
+    uint32_t drawCount;
+    /// Number of instances of the mesh drawn by every draw, 0 counts as 1. The instances
+    /// only differ by their model matrix, so a scene of many copies of a mesh is one draw.
+    uint32_t instanceCount;
+    /// instanceCount column-major 4x4 model matrices, applied before the transform. NULL for
+    /// the identity.
+    const float* instances;
+    /// Column-major 4x4 matrix applied to the triangle in the vertex shader, NULL for the
+    /// identity.
+    const float* transform;
+    /// Number of camera poses to render, 0 counts as 1. A sweep of several poses renders each
+    /// of them into its own array layer of the render target, and reads all of them back at
+    /// once. The depth of layer i follows that of layer i - 1.
+    uint32_t layerCount;
+    /// layerCount column-major 4x4 view-projection matrices, applied after the transform.
+    /// NULL for the identity.
+    const float* poses;
+    /// Render the poses as tiles of a single 2D image, a depth atlas, rather than into array
+    /// layers. Each tile is a width x height render with a viewport of its own. This suits
+    /// many small renders, they all come back with one copy, and the host scatters the tiles
+    /// into depthData in the same order as layers.
+    uint32_t atlas;
+} RenderRequest;
+
+
+/// Parameters of a frame, laid out like the uniform block in shader.vert (std140).
+typedef struct FrameParameters {
+    float transform[16];
+} FrameParameters;
+
+
+/// Per-layer matrices, laid out like the storage buffer in shader.vert (std430).
+typedef struct FramePoses {
+    float poses[MAX_RENDER_LAYERS][16];
+} FramePoses;
+
+
+/// Per-instance model matrix, an element of the instance buffer in shader.vert (std430).
+typedef struct FrameInstance {
+    float model[16];
+} FrameInstance;
+
+
+/// Push constants of the culling shader, laid out like the push constant block in cull.comp.
+typedef struct CullParameters {
+    float bounds[4];
+    uint32_t instanceCount;
+    uint32_t poseCount;
+} CullParameters;
+
+
+/// Push constants of the depth conversion shader, laid out like the push constant block in
+/// convert.comp.
+typedef struct ConversionParameters {
+    uint32_t width;
+    uint32_t height;
+    uint32_t tileColumns;
+    uint32_t tileCount;
+    uint32_t pixelCount;
+    uint32_t halfFloat;
+    float nearPlane;
+    float farPlane;
+} ConversionParameters;
+
+
+/// Push constants of the depth statistics shader, laid out like the push constant block in
+/// stats.comp.
+typedef struct StatisticsParameters {
+    uint32_t width;
+    uint32_t height;
+    uint32_t tileColumns;
+    uint32_t tileCount;
+    uint32_t pixelCount;
+    uint32_t binCount;
+    float nearPlane;
+    float farPlane;
+} StatisticsParameters;
+
+
+/// Header of the statistics buffer the shader reduces into, laid out like the storage buffer
+/// in stats.comp (std430). The histogram bins follow it. The minimum and maximum are the bits
+/// of non-negative floats, which order like unsigned integers.
+typedef struct FrameStatistics {
+    uint32_t coveredCount;
+    uint32_t minDepth;
+    uint32_t maxDepth;
+    uint32_t padding;
+    float partialSums[STATISTICS_WORKGROUP_COUNT];
+} FrameStatistics;
+
+
+/// Depth statistics of a render, over all of its layers and tiles.
+typedef struct RenderStatistics {
+    /// Pixels rendered, and those of them that were written to (not at the far plane).
+    uint64_t pixelCount;
+    uint64_t coveredCount;
+    /// Of the covered pixels, 0 when there are none.
+    float minDepth;
+    float maxDepth;
+    double meanDepth;
+    /// Covered pixels per bin of binCount equal bins from histogramMin to histogramMax:
+    /// [0, 1], or [nearPlane, farPlane] when the depth is linearized.
+    uint32_t binCount;
+    float histogramMin;
+    float histogramMax;
+    uint32_t histogram[MAX_HISTOGRAM_BINS];
+} RenderStatistics;
+
+
+typedef struct RenderTarget {
+    uint32_t width;
+    uint32_t height;
+    uint32_t layerCount;
+    /// A depth atlas has tileCount tiles of width x height, in rows of tileColumns tiles.
+    /// Other render targets have a single tile.
+    uint32_t tileCount;
+    uint32_t tileColumns;
+    uint32_t tileRows;
+    VkFormat format;
+    /// Format of the texels in the readback buffer: the depth format, or with depth
+    /// conversion VK_FORMAT_R32_SFLOAT or VK_FORMAT_R16_SFLOAT.
+    VkFormat readbackFormat;
+    uint64_t lastUsed;
+    uint32_t inUse;
+
+    VkImage image;
+    MemoryAllocation imageMemory;
+    /// One view and framebuffer per array layer, or with multiview a single one of each
+    /// covering all layers.
+    VkImageView imageViews[MAX_RENDER_LAYERS];
+    VkFramebuffer framebuffers[MAX_RENDER_LAYERS];
+    uint32_t framebufferCount;
+    /// Only with depth conversion or statistics: a view of the depth aspect of all layers,
+    /// and the descriptor set pointing at it and the readback buffer, if there is one.
+    VkImageView sampledImageView;
+    VkDescriptorSet depthDescriptorSet;
+    VkBuffer pixelReadbackBuffer;
+    VkDeviceSize pixelReadbackBufferSize;
+    MemoryAllocation pixelReadbackBufferMemory;
+    void* pixelReadbackBufferMapping;
+    uint32_t pixelReadbackBufferCoherent;
+} RenderTarget;
+
+
+typedef struct RenderFrame {
+    VkCommandBuffer commandBuffer;
+    /// Only used with a dedicated transfer queue: the copy is recorded into a command buffer
+    /// of its own, which waits for the semaphore signaled by the render.
+    VkCommandBuffer transferCommandBuffer;
+    VkSemaphore renderFinished;
+    VkFence fence;
+    VkBuffer parameterBuffer;
+    MemoryAllocation parameterMemory;
+    VkBuffer poseBuffer;
+    MemoryAllocation poseMemory;
+    /// Holds instanceCapacity FrameInstance, replaced by a larger one when a render has more
+    /// instances.
+    VkBuffer instanceBuffer;
+    MemoryAllocation instanceMemory;
+    uint32_t instanceCapacity;
+    /// With culling, the indices of the visible instances, as many as the instance buffer
+    /// holds, and the indirect draw command with their count.
+    VkBuffer visibleBuffer;
+    MemoryAllocation visibleMemory;
+    VkBuffer drawCommandBuffer;
+    MemoryAllocation drawCommandMemory;
+    uint32_t instanceCount;
+    /// With depth statistics, what the statistics shader reduces the depth into.
+    VkBuffer statisticsBuffer;
+    MemoryAllocation statisticsMemory;
+    VkDescriptorSet descriptorSet;
+    /// What the command buffers were last recorded against. They are submitted again as long
+    /// as this matches the next render.
+    uint32_t recorded;
+    RenderTarget* recordedTarget;
+    VkPipeline recordedPipeline;
+    uint32_t recordedDrawCount;
+    uint32_t recordedInstanceCount;
+    uint64_t recordedMeshSerial;
+    /// The sections the command buffers write timestamps for, those of them written on the
+    /// transfer queue, and whether they count pipeline statistics, see GpuProfiler.
+    uint32_t profiledSections;
+    uint32_t profiledTransferSections;
+    uint32_t profiledStatistics;
+    RenderTarget* target;
+    ResidentMesh* mesh;
+    uint32_t pending;
+    uint64_t ticket;
+} RenderFrame;
+
+
+typedef struct RenderContext {
+    VkInstance instance;
+    VkPhysicalDevice physicalDevice;
+    VkPhysicalDeviceProperties physicalDeviceProperties;
+    VkPhysicalDeviceMemoryProperties deviceMemoryProperties;
+    MemoryAllocator memoryAllocator;
+    uint32_t queueFamilyIndex;
+    VkDevice device;
+    VkQueue queue;
+    uint32_t transferQueueFamilyIndex;
+    /// VK_NULL_HANDLE unless a dedicated transfer queue is used for readback.
+    VkQueue transferQueue;
+
+    VkFormat depthFormat;
+    /// Number of views of the multiview render pass, 0 without multiview.
+    uint32_t multiviewCount;
+    RenderTarget renderTargets[MAX_RENDER_TARGETS];
+    uint32_t renderTargetCount;
+    uint64_t renderCount;
+
+    VkRenderPass renderPass;
+    VkShaderModule vertexShaderModule;
+    VkShaderModule cullShaderModule;
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorPool descriptorPool;
+    VkPipelineLayout pipelineLayout;
+    VkPipelineCache pipelineCache;
+    VkPipeline graphicsPipeline;
+    /// Only created with culling.
+    VkPipelineLayout cullPipelineLayout;
+    VkPipeline cullPipeline;
+    uint32_t culling;
+    /// Instances drawn and culled, summed over all collected renders.
+    uint64_t visibleInstanceCount;
+    uint64_t culledInstanceCount;
+    /// Only created with depth conversion or statistics, which sample the depth image. Every
+    /// render target has a descriptor set of its own, from a pool of MAX_RENDER_TARGETS sets.
+    DepthConversion depthConversion;
+    float nearPlane;
+    float farPlane;
+    VkSampler depthSampler;
+    VkDescriptorSetLayout depthDescriptorSetLayout;
+    VkDescriptorPool depthDescriptorPool;
+    VkShaderModule conversionShaderModule;
+    VkPipelineLayout conversionPipelineLayout;
+    VkPipeline conversionPipeline;
+    /// Only created with depth statistics.
+    uint32_t depthStatistics;
+    uint32_t histogramBinCount;
+    uint32_t statisticsOnly;
+    VkShaderModule statisticsShaderModule;
+    VkPipelineLayout statisticsPipelineLayout;
+    VkPipeline statisticsPipeline;
+    MeshCache meshCache;
+
+    VkCommandPool commandPool;
+    VkCommandPool transferCommandPool;
+    RenderFrame frames[MAX_FRAMES_IN_FLIGHT];
+    uint32_t frameCount;
+    uint32_t nextFrame;
+
+    CommandRecorder recorder;
+    uint32_t reuseCommandBuffers;
+    /// Time spent recording command buffers, summed over all submissions, and the number of
+    /// submissions that had to record.
+    double recordMilliseconds;
+    uint64_t recordedCount;
+
+    /// Only used when profiling. Without timestamps on the transfer queue, a copy there is not
+    /// timed.
+    uint32_t profiling;
+    uint32_t transferTimestamps;
+    GpuProfiler profiler;
+    /// Device side timings of the last collected frame.
+    GpuFrameTimings frameTimings;
+
+    CompletionQueue completionQueue;
+    CompletionCallback completed;
+    void* userData;
+} RenderContext;
+
+
+/// Convert Vulkan codes and formats to strings, for error messages.
+const char*
+resultString(VkResult code);
+
+const char*
+formatString(VkFormat format);
+
+/// Byte size of a texel of the given depth format, or 0 for unknown formats.
+uint32_t
+formatSize(VkFormat format);
+
+
+/// Pick the memory type allowed by `memoryTypeBits` that has all of the `required` property
+/// flags and best matches `preferred`, a list of property flags in decreasing order of
+/// importance. Returns the memory type index, or memoryTypeCount if no memory type has the
+/// required flags.
+uint32_t
+findMemoryType(const VkPhysicalDeviceMemoryProperties* memoryProperties,
+               uint32_t memoryTypeBits,
+               VkMemoryPropertyFlags required,
+               const VkMemoryPropertyFlags* preferred,
+               uint32_t preferredCount);
+
+
+/// Create the instance, device and graphics pipeline. Render targets are created on demand
+/// by the first render at each resolution.
+/// On failure the context is left in a state that `renderContextShutdown` can clean up.
+int
+renderContextInit(RenderContext* context, const RenderConfig* config);
+
+/// Record and submit a render of the triangle at the requested resolution, without waiting
+/// for it to finish. Frames are handed out round robin, `*frameIndex` receives the frame
+/// used. The previous submission of that frame must have been collected.
+int
+renderContextSubmit(RenderContext* context, const RenderRequest* request, uint32_t* frameIndex);
+
+/// Wait for the frame to finish rendering and read back its depth into `depthData`, which
+/// must hold width * height * layerCount floats of the submitted request. Pixels that were
+/// not written to are set to 0.
+int
+renderContextCollect(RenderContext* context, uint32_t frameIndex, float* depthData);
+
+/// Collect the frame like `renderContextCollect`, and also read back its depth statistics
+/// into `statistics`, which needs RenderConfig.depthStatistics. With statisticsOnly,
+/// `depthData` is not written to and may be NULL.
+int
+renderContextCollectStatistics(RenderContext* context,
+                               uint32_t frameIndex,
+                               float* depthData,
+                               RenderStatistics* statistics);
+
+/// Submit and collect a single frame.
+int
+renderContextRender(RenderContext* context, const RenderRequest* request, float* depthData);
+
+/// Destroy everything created by `renderContextInit`. Safe to call on a partially
+/// initialized context.
+void
+renderContextShutdown(RenderContext* context);
+
+#endif // RENDER_H
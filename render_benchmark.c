@@ -0,0 +1,80 @@
+#include "render_benchmark.h"
+
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+int
+renderBenchmarkInit(RenderBenchmark* benchmark,
+                    const RenderConfig* config,
+                    const RenderRequest* request)
+{
+    memset(benchmark, 0, sizeof(*benchmark));
+    if (renderContextInit(&benchmark->context, config) != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+    uint32_t poseCount = request->layerCount > 0 ? request->layerCount : 1;
+    benchmark->depthData = (float*) malloc((size_t) request->width * request->height *
+                                           poseCount * sizeof(float));
+    if (benchmark->depthData == NULL)
+    {
+        printf("Failed to allocate depth data\n");
+        return EXIT_FAILURE;
+    }
+    return renderContextRender(&benchmark->context, request, benchmark->depthData);
+}
+
+
+int
+renderBenchmarkRun(RenderBenchmark* benchmark,
+                   const RenderRequest* request,
+                   uint32_t renderCount,
+                   RenderStatistics* statistics,
+                   RenderBenchmarkTimings* timings)
+{
+    RenderContext* context = &benchmark->context;
+    RenderStatistics* collectedStatistics = context->depthStatistics ? statistics : NULL;
+    uint32_t framesInFlight = context->frameCount;
+    uint32_t frameIndices[MAX_FRAMES_IN_FLIGHT];
+    double collectMilliseconds = 0.0;
+    int status = EXIT_SUCCESS;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < renderCount + framesInFlight && status == EXIT_SUCCESS; ++i)
+    {
+        if (i >= framesInFlight)
+        {
+            uint32_t collectIndex = i - framesInFlight;
+            struct timespec collectStart, collectEnd;
+            clock_gettime(CLOCK_MONOTONIC, &collectStart);
+            status = renderContextCollectStatistics(context,
+                                                    frameIndices[collectIndex % framesInFlight],
+                                                    benchmark->depthData,
+                                                    collectedStatistics);
+            clock_gettime(CLOCK_MONOTONIC, &collectEnd);
+            collectMilliseconds += elapsedMilliseconds(&collectStart, &collectEnd);
+        }
+        if (i < renderCount && status == EXIT_SUCCESS)
+        {
+            status = renderContextSubmit(context, request, &frameIndices[i % framesInFlight]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    timings->milliseconds = elapsedMilliseconds(&start, &end) / renderCount;
+    timings->collectMilliseconds = collectMilliseconds / renderCount;
+    return status;
+}
+
+
+void
+renderBenchmarkShutdown(RenderBenchmark* benchmark)
+{
+    free(benchmark->depthData);
+    benchmark->depthData = NULL;
+    renderContextShutdown(&benchmark->context);
+}
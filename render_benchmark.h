@@ -0,0 +1,59 @@
+#ifndef RENDER_BENCHMARK_H
+#define RENDER_BENCHMARK_H
+
+/// The measurement that the render benchmarks share: a render context with its own config,
+/// and a request rendered over and over, `framesInFlight` frames at a time, with the time
+/// from the first submission to the last collect averaged over the renders.
+///
+/// A benchmark creates one of these per configuration it compares, reads whatever it reports
+/// besides the timings from the render context, and shuts it down again:
+///
+///     RenderBenchmark benchmark;
+///     if (renderBenchmarkInit(&benchmark, &config, &request) == EXIT_SUCCESS)
+///     {
+///         status = renderBenchmarkRun(&benchmark, &request, renderCount, NULL, &timings);
+///     }
+///     renderBenchmarkShutdown(&benchmark);
+
+#include "render.h"
+
+#include <stdint.h>
+
+
+typedef struct RenderBenchmark {
+    RenderContext context;
+    /// Receives the depth of every render, width * height floats per pose.
+    float* depthData;
+} RenderBenchmark;
+
+
+typedef struct RenderBenchmarkTimings {
+    /// Average time per render.
+    double milliseconds;
+    /// Average time per render spent in `renderContextCollect`, part of `milliseconds`.
+    double collectMilliseconds;
+} RenderBenchmarkTimings;
+
+
+/// Initialize a render context with `config` and render `request` once. The first render
+/// creates the render target, so it is not part of the measurement.
+/// On failure the benchmark is left in a state that `renderBenchmarkShutdown` can clean up.
+int
+renderBenchmarkInit(RenderBenchmark* benchmark,
+                    const RenderConfig* config,
+                    const RenderRequest* request);
+
+/// Render `request`, which has at most as many pixels as the one the benchmark was
+/// initialized with, `renderCount` times. The depth statistics of the last render go to
+/// `statistics` when the context computes them and it is not NULL.
+int
+renderBenchmarkRun(RenderBenchmark* benchmark,
+                   const RenderRequest* request,
+                   uint32_t renderCount,
+                   RenderStatistics* statistics,
+                   RenderBenchmarkTimings* timings);
+
+void
+renderBenchmarkShutdown(RenderBenchmark* benchmark);
+
+#endif // RENDER_BENCHMARK_H
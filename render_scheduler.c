@@ -0,0 +1,459 @@
+#include "render_scheduler.h"
+
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/// Each render context creates its own instance, so we cannot hand it a physical device
+/// handle. Instead we describe the device by its UUID, which is the same in every instance.
+/// The UUID is written with dashes, 8-4-4-4-12 digits, so that one of only decimal digits
+/// is not taken for an index. Devices that do not report a UUID, or that share it with
+/// another candidate, as the same GPU exposed by two drivers does, are described by their
+/// enumeration index instead.
+static void
+physicalDeviceSpecification(const PhysicalDeviceCandidate* candidates,
+                            uint32_t candidateCount,
+                            uint32_t candidateIndex,
+                            char* specification)
+{
+    const PhysicalDeviceCandidate* candidate = &candidates[candidateIndex];
+    uint8_t zeroUUID[VK_UUID_SIZE] = {0};
+    uint32_t unique = memcmp(candidate->deviceUUID, zeroUUID, VK_UUID_SIZE) != 0;
+    for (uint32_t i = 0; i < candidateCount && unique; ++i)
+    {
+        unique = i == candidateIndex ||
+                 memcmp(candidates[i].deviceUUID, candidate->deviceUUID, VK_UUID_SIZE) != 0;
+    }
+    if (!unique)
+    {
+        snprintf(specification, PHYSICAL_DEVICE_SPECIFICATION_SIZE, "%u", candidate->index);
+        return;
+    }
+    char* end = specification;
+    for (uint32_t i = 0; i < VK_UUID_SIZE; ++i)
+    {
+        if (i == 4 || i == 6 || i == 8 || i == 10)
+        {
+            *end++ = '-';
+        }
+        end += snprintf(end, 3, "%02x", candidate->deviceUUID[i]);
+    }
+}
+
+
+int
+renderSchedulerInit(RenderScheduler* scheduler, const RenderConfig* config)
+{
+    memset(scheduler, 0, sizeof(*scheduler));
+
+    /// A throwaway instance, without validation layers, is enough to find the devices.
+    VkApplicationInfo appInfo = {
+        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .apiVersion = VK_API_VERSION_1_1
+    };
+    VkInstanceCreateInfo instanceCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+        .pApplicationInfo = &appInfo
+    };
+    VkInstance instance;
+    if (vkCreateInstance(&instanceCreateInfo, NULL, &instance) != VK_SUCCESS)
+    {
+        printf("Failed to create instance\n");
+        return EXIT_FAILURE;
+    }
+    PhysicalDeviceCandidate candidates[MAX_PHYSICAL_DEVICE_COUNT];
+    uint32_t candidateCount = MAX_PHYSICAL_DEVICE_COUNT;
+    int status = enumeratePhysicalDeviceCandidates(instance, candidates, &candidateCount);
+    vkDestroyInstance(instance, NULL);
+    if (status != EXIT_SUCCESS)
+    {
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t i = 0; i < candidateCount; ++i)
+    {
+        RenderWorker* worker = &scheduler->workers[scheduler->workerCount];
+        worker->scheduler = scheduler;
+        worker->index = scheduler->workerCount;
+        physicalDeviceSpecification(candidates, candidateCount, i, worker->physicalDevice);
+
+        printf("Initializing render context %u on %s\n",
+               worker->index, candidates[i].properties.deviceName);
+        RenderConfig workerConfig = *config;
+        workerConfig.physicalDevice = worker->physicalDevice;
+        if (renderContextInit(&worker->context, &workerConfig) != EXIT_SUCCESS)
+        {
+            printf("Skipping %s, failed to initialize render context\n",
+                   candidates[i].properties.deviceName);
+            renderContextShutdown(&worker->context);
+            continue;
+        }
+        pthread_mutex_init(&worker->queue.mutex, NULL);
+        scheduler->workerCount++;
+    }
+    if (scheduler->workerCount == 0)
+    {
+        printf("Failed to initialize a render context on any physical device\n");
+        return EXIT_FAILURE;
+    }
+    printf("Rendering on %u physical devices\n", scheduler->workerCount);
+    return EXIT_SUCCESS;
+}
+
+
+/// Count a job as held by a worker. Called with the queue it is taken from still locked, so
+/// that a worker looking for jobs always finds it either in a queue or held.
+static void
+holdJob(RenderScheduler* scheduler)
+{
+    pthread_mutex_lock(&scheduler->mutex);
+    scheduler->heldCount++;
+    pthread_mutex_unlock(&scheduler->mutex);
+}
+
+
+/// A held job was collected or given back, wake the workers waiting for it.
+static void
+releaseJob(RenderScheduler* scheduler)
+{
+    pthread_mutex_lock(&scheduler->mutex);
+    scheduler->heldCount--;
+    scheduler->releaseCount++;
+    pthread_cond_broadcast(&scheduler->released);
+    pthread_mutex_unlock(&scheduler->mutex);
+}
+
+
+static uint32_t
+jobReleaseCount(RenderScheduler* scheduler)
+{
+    pthread_mutex_lock(&scheduler->mutex);
+    uint32_t releaseCount = scheduler->releaseCount;
+    pthread_mutex_unlock(&scheduler->mutex);
+    return releaseCount;
+}
+
+
+/// Called after finding every queue empty, with the release count from before looking.
+/// Returns 0 if no job is held either, so there is no more work. Otherwise waits until a
+/// held job was released, which may have put it back into a queue, and returns 1.
+static int
+waitForReleasedJob(RenderScheduler* scheduler, uint32_t releaseCount)
+{
+    pthread_mutex_lock(&scheduler->mutex);
+    while (scheduler->heldCount > 0 && scheduler->releaseCount == releaseCount)
+    {
+        pthread_cond_wait(&scheduler->released, &scheduler->mutex);
+    }
+    int released = scheduler->releaseCount != releaseCount;
+    pthread_mutex_unlock(&scheduler->mutex);
+    return released;
+}
+
+
+/// Put a job the worker could not finish back at the front of its own queue.
+static void
+returnJob(RenderWorker* worker, uint32_t job)
+{
+    RenderJobQueue* queue = &worker->queue;
+    pthread_mutex_lock(&queue->mutex);
+    queue->jobs[--queue->head] = job;
+    pthread_mutex_unlock(&queue->mutex);
+    releaseJob(worker->scheduler);
+}
+
+
+/// Take a job from the front of the worker's own queue. The front is where the owner works,
+/// the back is where thieves steal, so the two only contend for the last job.
+static int
+takeOwnJob(RenderWorker* worker, uint32_t* job)
+{
+    RenderJobQueue* queue = &worker->queue;
+    pthread_mutex_lock(&queue->mutex);
+    int taken = queue->head < queue->tail;
+    if (taken)
+    {
+        *job = queue->jobs[queue->head++];
+        holdJob(worker->scheduler);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return taken;
+}
+
+
+static int
+stealJob(RenderWorker* victim, uint32_t* job)
+{
+    RenderJobQueue* queue = &victim->queue;
+    pthread_mutex_lock(&queue->mutex);
+    int taken = queue->head < queue->tail;
+    if (taken)
+    {
+        *job = queue->jobs[--queue->tail];
+        holdJob(victim->scheduler);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return taken;
+}
+
+
+/// Take a job from the worker's own queue, or else steal one from another.
+static int
+takeJob(RenderWorker* worker, uint32_t* job)
+{
+    if (takeOwnJob(worker, job))
+    {
+        return 1;
+    }
+    RenderScheduler* scheduler = worker->scheduler;
+    for (uint32_t i = 1; i < scheduler->workerCount; ++i)
+    {
+        RenderWorker* victim = &scheduler->workers[(worker->index + i) % scheduler->workerCount];
+        if (stealJob(victim, job))
+        {
+            worker->stats.stolenCount++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static float*
+depthDestination(RenderWorker* worker, const RenderJob* job)
+{
+    if (job->depthData != NULL)
+    {
+        return job->depthData;
+    }
+    uint32_t layerCount = job->request.layerCount > 0 ? job->request.layerCount : 1;
+    uint64_t pixelCount = (uint64_t) job->request.width * job->request.height * layerCount;
+    if (pixelCount > worker->scratchPixelCount)
+    {
+        free(worker->scratch);
+        worker->scratch = pixelCount <= SIZE_MAX / sizeof(float)
+                        ? (float*) malloc((size_t) pixelCount * sizeof(float))
+                        : NULL;
+        worker->scratchPixelCount = worker->scratch != NULL ? pixelCount : 0;
+    }
+    return worker->scratch;
+}
+
+
+/// Keep up to framesInFlight jobs on the device. Frames are handed out round robin by the
+/// context, so collecting the oldest job first always frees the frame the next submit gets.
+static void*
+workerThread(void* argument)
+{
+    RenderWorker* worker = (RenderWorker*) argument;
+    RenderScheduler* scheduler = worker->scheduler;
+    RenderContext* context = &worker->context;
+    RenderJob* jobs = scheduler->jobs;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint32_t pendingJobs[MAX_FRAMES_IN_FLIGHT];
+    uint32_t pendingFrames[MAX_FRAMES_IN_FLIGHT];
+    uint32_t pendingHead = 0;
+    uint32_t pendingCount = 0;
+    int exhausted = 0;
+    worker->status = EXIT_SUCCESS;
+    while (worker->status == EXIT_SUCCESS)
+    {
+        uint32_t job;
+        if (!exhausted && pendingCount < context->frameCount)
+        {
+            uint32_t releaseCount = jobReleaseCount(scheduler);
+            if (takeJob(worker, &job))
+            {
+                uint32_t slot = (pendingHead + pendingCount) % MAX_FRAMES_IN_FLIGHT;
+                worker->status = renderContextSubmit(context,
+                                                     &jobs[job].request,
+                                                     &pendingFrames[slot]);
+                if (worker->status != EXIT_SUCCESS)
+                {
+                    returnJob(worker, job);
+                    break;
+                }
+                pendingJobs[slot] = job;
+                pendingCount++;
+                continue;
+            }
+            exhausted = 1;
+            /// Every queue is empty, but a device that fails gives back the jobs it holds.
+            /// Jobs are never added otherwise, so once none are held the batch is done.
+            if (pendingCount == 0)
+            {
+                if (!waitForReleasedJob(scheduler, releaseCount))
+                {
+                    break;
+                }
+                exhausted = 0;
+                continue;
+            }
+        }
+        if (pendingCount == 0)
+        {
+            exhausted = 0;
+            continue;
+        }
+        job = pendingJobs[pendingHead];
+        float* depthData = depthDestination(worker, &jobs[job]);
+        if (depthData == NULL)
+        {
+            printf("Failed to allocate scratch buffer for device %u\n", worker->index);
+            worker->status = EXIT_FAILURE;
+            break;
+        }
+        worker->status = renderContextCollect(context, pendingFrames[pendingHead], depthData);
+        if (worker->status != EXIT_SUCCESS)
+        {
+            break;
+        }
+        pendingHead = (pendingHead + 1) % MAX_FRAMES_IN_FLIGHT;
+        pendingCount--;
+        releaseJob(scheduler);
+        jobs[job].device = worker->index;
+        worker->stats.jobCount++;
+        worker->stats.pixelCount += (uint64_t) jobs[job].request.width *
+                                    jobs[job].request.height *
+                                    (jobs[job].request.layerCount > 0
+                                     ? jobs[job].request.layerCount
+                                     : 1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    worker->stats.milliseconds = elapsedMilliseconds(&start, &end);
+    if (worker->status != EXIT_SUCCESS)
+    {
+        /// The jobs that were not collected go back newest first, so that the oldest ends up
+        /// at the front of the queue.
+        for (uint32_t i = pendingCount; i-- > 0;)
+        {
+            returnJob(worker, pendingJobs[(pendingHead + i) % MAX_FRAMES_IN_FLIGHT]);
+        }
+        printf("Device %u failed, its remaining jobs are left to the other devices\n",
+               worker->index);
+    }
+    return NULL;
+}
+
+
+int
+renderSchedulerRun(RenderScheduler* scheduler, RenderJob* jobs, uint32_t jobCount)
+{
+    scheduler->jobs = jobs;
+    scheduler->jobCount = jobCount;
+
+    /// Split the batch into contiguous runs, so that thieves taking from the back of a queue
+    /// and its owner taking from the front rarely meet. Every run is preceded by room for
+    /// the jobs its worker may give back.
+    uint32_t* jobIndices = (uint32_t*) malloc(((size_t) jobCount +
+                                               (size_t) scheduler->workerCount *
+                                               MAX_FRAMES_IN_FLIGHT) * sizeof(uint32_t));
+    if (jobIndices == NULL)
+    {
+        printf("Failed to allocate job queues\n");
+        return EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < scheduler->workerCount; ++i)
+    {
+        RenderWorker* worker = &scheduler->workers[i];
+        uint32_t first = (uint32_t) ((uint64_t) jobCount * i / scheduler->workerCount);
+        uint32_t last = (uint32_t) ((uint64_t) jobCount * (i + 1) / scheduler->workerCount);
+        worker->queue.jobs = jobIndices + (size_t) (i + 1) * MAX_FRAMES_IN_FLIGHT;
+        worker->queue.head = first;
+        worker->queue.tail = last;
+        for (uint32_t job = first; job < last; ++job)
+        {
+            worker->queue.jobs[job] = job;
+        }
+        memset(&worker->stats, 0, sizeof(worker->stats));
+    }
+    pthread_mutex_init(&scheduler->mutex, NULL);
+    pthread_cond_init(&scheduler->released, NULL);
+    scheduler->heldCount = 0;
+    scheduler->releaseCount = 0;
+
+    uint32_t startedCount = 0;
+    for (; startedCount < scheduler->workerCount; ++startedCount)
+    {
+        RenderWorker* worker = &scheduler->workers[startedCount];
+        if (pthread_create(&worker->thread, NULL, workerThread, worker) != 0)
+        {
+            printf("Failed to start worker thread for device %u\n", startedCount);
+            break;
+        }
+    }
+    /// Workers that did start steal the jobs of those that did not.
+    for (uint32_t i = 0; i < startedCount; ++i)
+    {
+        pthread_join(scheduler->workers[i].thread, NULL);
+    }
+
+    uint32_t completedCount = 0;
+    for (uint32_t i = 0; i < startedCount; ++i)
+    {
+        completedCount += scheduler->workers[i].stats.jobCount;
+    }
+    pthread_cond_destroy(&scheduler->released);
+    pthread_mutex_destroy(&scheduler->mutex);
+    free(jobIndices);
+    for (uint32_t i = 0; i < scheduler->workerCount; ++i)
+    {
+        scheduler->workers[i].queue.jobs = NULL;
+    }
+    if (completedCount != jobCount)
+    {
+        printf("Rendered %u out of %u jobs\n", completedCount, jobCount);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+
+void
+renderSchedulerPrintStats(const RenderScheduler* scheduler)
+{
+    double milliseconds = 0.0;
+    uint32_t jobCount = 0;
+    for (uint32_t i = 0; i < scheduler->workerCount; ++i)
+    {
+        const RenderWorker* worker = &scheduler->workers[i];
+        const RenderDeviceStats* stats = &worker->stats;
+        printf("Device %u (%s): %u renders (%u stolen) in %.3f ms, %.1f frames/s, "
+               "%.1f Mpixels/s\n",
+               i,
+               worker->context.physicalDeviceProperties.deviceName,
+               stats->jobCount,
+               stats->stolenCount,
+               stats->milliseconds,
+               stats->milliseconds > 0.0 ? 1e3 * stats->jobCount / stats->milliseconds : 0.0,
+               stats->milliseconds > 0.0 ? 1e-3 * stats->pixelCount / stats->milliseconds : 0.0);
+        jobCount += stats->jobCount;
+        milliseconds = stats->milliseconds > milliseconds ? stats->milliseconds : milliseconds;
+    }
+    printf("All %u devices: %u renders in %.3f ms, %.1f frames/s\n",
+           scheduler->workerCount,
+           jobCount,
+           milliseconds,
+           milliseconds > 0.0 ? 1e3 * jobCount / milliseconds : 0.0);
+}
+
+
+void
+renderSchedulerShutdown(RenderScheduler* scheduler)
+{
+    for (uint32_t i = 0; i < scheduler->workerCount; ++i)
+    {
+        RenderWorker* worker = &scheduler->workers[i];
+        printf("Shutting down render context %u\n", i);
+        renderContextShutdown(&worker->context);
+        pthread_mutex_destroy(&worker->queue.mutex);
+        free(worker->scratch);
+    }
+    scheduler->workerCount = 0;
+}
@@ -0,0 +1,109 @@
+#ifndef RENDER_SCHEDULER_H
+#define RENDER_SCHEDULER_H
+
+/// Parallel rendering on every physical device of the machine.
+///
+/// A render context drives a single physical device. On a machine with several GPUs, or a
+/// GPU next to Lavapipe, the scheduler creates one render context, with its own logical
+/// device and pipeline, per physical device and spreads a batch of render jobs over them.
+///
+/// Each device has a worker thread and a double ended queue of jobs. The batch is split into
+/// contiguous runs, one per queue. A worker takes jobs from the front of its own queue, and
+/// when that runs dry it steals from the back of the queue of another device. Faster devices
+/// thus end up doing more of the batch, without us having to know in advance how fast each
+/// device is. A device that fails gives back the jobs it had not finished, including those
+/// already submitted to it, to the front of its queue, where the others steal them. So a
+/// worker that finds every queue empty only stops once no other worker holds a job either.
+///
+/// The render contexts are only ever used by their worker thread while a batch runs.
+
+#include "render.h"
+
+#include "device_select.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+/// A device UUID in 8-4-4-4-12 form, or an enumeration index, and the terminating zero.
+#define PHYSICAL_DEVICE_SPECIFICATION_SIZE (2 * VK_UUID_SIZE + 5)
+
+
+typedef struct RenderJob {
+    RenderRequest request;
+    /// Receives width * height * layerCount floats of depth. May be NULL, in which case the
+    /// depth is read back into a scratch buffer of the device and discarded.
+    float* depthData;
+    /// Index of the device that rendered the job, written by the scheduler.
+    uint32_t device;
+} RenderJob;
+
+
+/// Double ended queue of job indices, guarded by its mutex. There is room for
+/// MAX_FRAMES_IN_FLIGHT jobs to be given back in front of the first one.
+typedef struct RenderJobQueue {
+    pthread_mutex_t mutex;
+    uint32_t* jobs;
+    uint32_t head;
+    uint32_t tail;
+} RenderJobQueue;
+
+
+typedef struct RenderDeviceStats {
+    uint32_t jobCount;
+    /// Jobs taken from the queue of another device.
+    uint32_t stolenCount;
+    uint64_t pixelCount;
+    /// Time from the start of the batch until the worker ran out of jobs.
+    double milliseconds;
+} RenderDeviceStats;
+
+
+typedef struct RenderWorker {
+    struct RenderScheduler* scheduler;
+    uint32_t index;
+    /// Device specification the context was created with, see device_select.h.
+    char physicalDevice[PHYSICAL_DEVICE_SPECIFICATION_SIZE];
+    RenderContext context;
+    RenderJobQueue queue;
+    pthread_t thread;
+    float* scratch;
+    uint64_t scratchPixelCount;
+    int status;
+    RenderDeviceStats stats;
+} RenderWorker;
+
+
+typedef struct RenderScheduler {
+    RenderWorker workers[MAX_PHYSICAL_DEVICE_COUNT];
+    uint32_t workerCount;
+    RenderJob* jobs;
+    uint32_t jobCount;
+    /// Number of jobs taken from a queue and not yet collected, and number of times such a
+    /// job was collected or given back, guarded by the mutex. Workers without jobs wait for
+    /// `released` while others hold jobs.
+    pthread_mutex_t mutex;
+    pthread_cond_t released;
+    uint32_t heldCount;
+    uint32_t releaseCount;
+} RenderScheduler;
+
+
+/// Create a render context on every physical device that can render. `config` applies to
+/// each of them, except for the physical device. Devices whose context fails to initialize
+/// are skipped, it is only an error if no device is left.
+int
+renderSchedulerInit(RenderScheduler* scheduler, const RenderConfig* config);
+
+/// Render all jobs and return when they are done. Per-device stats are reset at the start.
+int
+renderSchedulerRun(RenderScheduler* scheduler, RenderJob* jobs, uint32_t jobCount);
+
+/// Print the throughput of every device over the last batch.
+void
+renderSchedulerPrintStats(const RenderScheduler* scheduler);
+
+/// Shut down all render contexts.
+void
+renderSchedulerShutdown(RenderScheduler* scheduler);
+
+#endif // RENDER_SCHEDULER_H
@@ -1,11 +1,39 @@
 #version 450
+#extension GL_EXT_multiview : require
 
-vec2 positions[3] = {
-    {  0.0, -0.5 },
-    { +0.5, +0.5 },
-    { -0.5, +0.5 }
+// Fetched from the vertex buffer, see the vertex input state in render.c.
+layout(location = 0) in vec3 position;
+
+layout(set = 0, binding = 0) uniform FrameParameters {
+    mat4 transform;
+} frame;
+
+// One view-projection matrix per array layer of a camera sweep.
+layout(set = 0, binding = 1) readonly buffer FramePoses {
+    mat4 poses[];
+};
+
+// One model matrix per instance, selected by gl_InstanceIndex. Every draw starts at instance 0.
+layout(set = 0, binding = 2) readonly buffer FrameInstances {
+    mat4 instances[];
 };
 
+// With culling (see cull.comp), the draw only has the visible instances, and instance i of
+// the draw is the i-th visible instance. Set when the pipeline is created.
+layout(constant_id = 0) const bool culling = false;
+
+layout(set = 0, binding = 3) readonly buffer FrameVisibleInstances {
+    uint visibleInstances[];
+};
+
+// The layer of the render pass. A multiview render pass renders all layers at once, the
+// pushed layer is then 0 and gl_ViewIndex selects the layer. Otherwise gl_ViewIndex is 0.
+layout(push_constant) uniform Layer {
+    uint layer;
+} pushed;
+
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.1337, 1.0);
+    uint instance = culling ? visibleInstances[gl_InstanceIndex] : uint(gl_InstanceIndex);
+    gl_Position = poses[pushed.layer + uint(gl_ViewIndex)] * frame.transform
+                * instances[instance] * vec4(position, 1.0);
 }
@@ -0,0 +1,92 @@
+/// Benchmark of reducing the depth to statistics on the device.
+///
+///     ./out/Release/statistics_benchmark [renders] [WIDTHxHEIGHT]
+///
+/// The triangle is rendered `renders` times (default 100) at WIDTHxHEIGHT (default
+/// 1920x1080), with two frames in flight, three ways (see RenderConfig.depthStatistics): with
+/// the depth read back and decoded as usual, read back and reduced to statistics as well, and
+/// reduced to statistics only, with no readback of the depth at all. Rendering and readback
+/// are timed together, and the time spent collecting is reported on its own.
+
+#include "render_benchmark.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/// The statistics of the last render go to `statistics` when they are computed.
+static int
+benchmarkStatistics(const RenderRequest* request,
+                    uint32_t depthStatistics,
+                    uint32_t statisticsOnly,
+                    uint32_t renderCount,
+                    RenderBenchmarkTimings* timings,
+                    RenderStatistics* statistics)
+{
+    RenderConfig config = {
+        .framesInFlight = 2,
+        .reuseCommandBuffers = 1,
+        .depthStatistics = depthStatistics,
+        .statisticsOnly = statisticsOnly
+    };
+    RenderBenchmark benchmark;
+    int status = renderBenchmarkInit(&benchmark, &config, request);
+    if (status == EXIT_SUCCESS)
+    {
+        status = renderBenchmarkRun(&benchmark, request, renderCount, statistics, timings);
+    }
+    renderBenchmarkShutdown(&benchmark);
+    return status;
+}
+
+
+int main(int argc, char** argv)
+{
+    RenderRequest request = {
+        .width = 1920,
+        .height = 1080
+    };
+    uint32_t renderCount = argc > 1 ? (uint32_t) strtoul(argv[1], NULL, 10) : 100;
+    if (renderCount == 0 ||
+        (argc > 2 && sscanf(argv[2], "%ux%u", &request.width, &request.height) != 2))
+    {
+        printf("Usage: %s [renders] [WIDTHxHEIGHT]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char* names[] = { "readback", "readback + stats", "stats only" };
+    const uint32_t modeCount = sizeof(names) / sizeof(names[0]);
+    RenderBenchmarkTimings timings[sizeof(names) / sizeof(names[0])];
+    RenderStatistics statistics;
+    for (uint32_t i = 0; i < modeCount; ++i)
+    {
+        if (benchmarkStatistics(&request,
+                                i > 0,
+                                i == 2,
+                                renderCount,
+                                &timings[i],
+                                &statistics) != EXIT_SUCCESS)
+        {
+            printf("Failed to benchmark %s\n", names[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("Renders at %ux%u, %u renders\n", request.width, request.height, renderCount);
+    for (uint32_t i = 0; i < modeCount; ++i)
+    {
+        printf("%-17s %8.3f ms per render, %8.3f ms per collect, %.2fx\n",
+               names[i],
+               timings[i].milliseconds,
+               timings[i].collectMilliseconds,
+               timings[0].milliseconds / timings[i].milliseconds);
+    }
+    printf("Covered %lu of %lu pixels, depth min %.6f, max %.6f, mean %.6f\n",
+           (unsigned long) statistics.coveredCount,
+           (unsigned long) statistics.pixelCount,
+           statistics.minDepth,
+           statistics.maxDepth,
+           statistics.meanDepth);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,8 @@
+#include "timing.h"
+
+
+double
+elapsedMilliseconds(const struct timespec* start, const struct timespec* end)
+{
+    return 1e3 * (end->tv_sec - start->tv_sec) + 1e-6 * (end->tv_nsec - start->tv_nsec);
+}
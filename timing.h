@@ -0,0 +1,14 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+/// Wall clock timing, for the reports of main and the benchmarks. Times are taken with
+/// `clock_gettime(CLOCK_MONOTONIC, ...)`, which does not jump when the system clock is set.
+
+#include <time.h>
+
+
+/// Milliseconds from `start` to `end`.
+double
+elapsedMilliseconds(const struct timespec* start, const struct timespec* end);
+
+#endif // TIMING_H